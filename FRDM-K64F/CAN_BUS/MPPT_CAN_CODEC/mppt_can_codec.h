@@ -0,0 +1,60 @@
+/*************************** mppt_can_codec.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Packed Binary Payload for the MPPT Readings
+ *
+ * Purpose: The MPPT used to send each reading as its own 8 byte ASCII frame (3 integer digits,
+ * '.', 3 decimals): five frames per update, no sign (negative currents were dropped) and nothing
+ * at or above 1000. All five readings now go in a single 8 byte frame as signed, scaled
+ * fixed-point fields, little-endian, least significant bit first:
+ *
+ *      Bits    Field        Type   Scale     Range
+ *      0-3     version      u4                MPPT_CAN_VERSION
+ *      4-16    outVoltage   s13    0.05 V    +-204.75 V
+ *      17-29   inVoltage    s13    0.05 V    +-204.75 V
+ *      30-41   inCurrent    s12    0.01 A    +-20.47 A
+ *      42-53   outCurrent   s12    0.01 A    +-20.47 A
+ *      54-63   efficiency   s10    0.25 %    -128 .. 127.75 %
+ *
+ * The layout is defined once, in the MPPT_CAN_READINGS message of mppt_can.dbc; the pack and
+ * unpack code is generated from it into mppt_can_messages.h (see mppt_can_gen.cpp). This file
+ * is the byte-level interface the firmware and the CAN_BUS examples use.
+ *
+ * Values are rounded to the nearest step and saturate at the ends of their range (NaN is sent as
+ * 0). A receiver refuses frames of another length or version, so the layout can change later by
+ * bumping the version in the schema. The version is 10 to 15: an old ASCII frame, on the same ID
+ * and also 8 bytes, starts with NUL or a digit, whose low nibble is 0 to 9, so it is refused too.
+ *
+ * This file has no mbed dependencies and compiles on any host with a C++11 compiler.
+ *
+ *****************************************************************************************/
+#ifndef _MPPT_CAN_CODEC_H_
+#define _MPPT_CAN_CODEC_H_
+
+#include "mppt_can_messages.h"
+
+#define MPPT_CAN_ID          MPPT_CAN_READINGS_ID       // CAN ID of the MPPT readings frame
+#define MPPT_CAN_LENGTH      MPPT_CAN_READINGS_LENGTH   // bytes in the readings frame
+#define MPPT_CAN_VERSION     MPPT_CAN_READINGS_VERSION  // layout version, bits 0-3 of the frame
+
+/* Packs 'r' into the MPPT_CAN_LENGTH bytes at 'data' */
+inline void mpptCanEncode(const MpptCanReadings &r, unsigned char *data)
+{
+    mpptCanStore(mpptCanReadingsPack(r), data, MPPT_CAN_LENGTH);
+}
+
+/*
+* Unpacks a frame of 'length' bytes into 'r'. Returns false, leaving 'r' alone, if the frame has
+* the wrong length or version.
+*/
+inline bool mpptCanDecode(const unsigned char *data, int length, MpptCanReadings &r)
+{
+    if(length != MPPT_CAN_LENGTH) return false;
+
+    uint64_t frame = mpptCanLoad(data, MPPT_CAN_LENGTH);
+    if(!mpptCanReadingsValid(frame)) return false;
+    r = mpptCanReadingsUnpack(frame);
+    return true;
+}
+
+#endif // _MPPT_CAN_CODEC_H_
@@ -0,0 +1,441 @@
+/*************************** mppt_can_gen.cpp ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Message Code Generator
+ *
+ * Purpose: Reads the message schema (mppt_can.dbc, the BO_/SG_/CM_ subset of the DBC format) and
+ * writes mppt_can_messages.h, so the layout of every frame is written down once and the
+ * firmware, the CAN_BUS examples and the host tools can't drift apart. For each message it emits:
+ *
+ *      <NAME>_ID, <NAME>_LENGTH       - the CAN ID and the data length
+ *      <NAME>_<SIGNAL>                - the value of each constant signal (min == max)
+ *      struct <Name>                  - one float per non-constant signal, in schema order
+ *      <name>Pack(const <Name>&)      - constexpr, the 64 bit frame word
+ *      <name>Unpack(uint64_t)         - constexpr, the readings of a frame word
+ *      <name>Valid(uint64_t)          - constexpr, true if the constant signals match
+ *      <name>Signals[]                - the schema of the message, for host tools
+ *
+ * in the constexpr helpers of mppt_can_signal.h. The schema is checked: signals must be
+ * little-endian, fit in the frame, not overlap, and [min|max] must fit in the raw bits.
+ *
+ * Instructions: To compile code:
+ *                  $g++ -std=c++11 -O2 -o mppt_can_gen mppt_can_gen.cpp
+ *               To run code: $./mppt_can_gen mppt_can.dbc mppt_can_messages.h
+ *               The exit code is 0 when the schema is valid and the header was written.
+ *
+ *****************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+struct Signal {
+    std::string name;
+    std::string unit;
+    std::string comment;
+    int start;
+    int length;
+    bool isSigned;
+    double factor;
+    double offset;
+    double minimum;
+    double maximum;
+};
+
+struct Message {
+    unsigned id;
+    std::string name;
+    std::string sender;
+    std::string comment;
+    int length;
+    std::vector<Signal> signals;
+};
+
+/*
+* Splits the schema into tokens: names and numbers, quoted strings (which may span lines) and
+* the punctuation of the DBC syntax.
+*/
+class Lexer
+{
+public:
+    Lexer(const char *path, const std::string &text) : _path(path), _text(text), _pos(0), _line(1) {}
+
+    enum Kind { END, WORD, NUMBER, STRING, PUNCT };
+
+    Kind next(std::string &token){
+        while(_pos < _text.size() && isspace((unsigned char)_text[_pos])){
+            if(_text[_pos++] == '\n') _line++;
+        }
+        token.clear();
+        if(_pos >= _text.size()) return END;
+
+        char c = _text[_pos];
+        if(c == '"'){
+            _pos++;
+            while(_pos < _text.size() && _text[_pos] != '"'){
+                if(_text[_pos] == '\n') _line++;
+                token += _text[_pos++];
+            }
+            if(_pos >= _text.size()) fail("unterminated string");
+            _pos++;
+            return STRING;
+        }
+        bool sign = (c == '-' || c == '+') && _pos + 1 < _text.size() && (isdigit((unsigned char)_text[_pos + 1]) || _text[_pos + 1] == '.');
+        if(isdigit((unsigned char)c) || c == '.' || sign){
+            token += _text[_pos++];
+            while(_pos < _text.size() && (isalnum((unsigned char)_text[_pos]) || _text[_pos] == '.' ||
+                  ((_text[_pos] == '-' || _text[_pos] == '+') && tolower(_text[_pos - 1]) == 'e'))){
+                token += _text[_pos++];
+            }
+            return NUMBER;
+        }
+        if(isalpha((unsigned char)c) || c == '_'){
+            while(_pos < _text.size() && (isalnum((unsigned char)_text[_pos]) || _text[_pos] == '_')){
+                token += _text[_pos++];
+            }
+            return WORD;
+        }
+        token += _text[_pos++];
+        return PUNCT;
+    }
+
+    /* The next token, which must be of 'kind' (and be 'expected', if given) */
+    std::string expect(Kind kind, const char *what, const char *expected = 0){
+        std::string token;
+        if(next(token) != kind || (expected && token != expected)) fail(std::string("expected ") + what);
+        return token;
+    }
+
+    double number(const char *what){
+        std::string token = expect(NUMBER, what);
+        char *end;
+        double value = strtod(token.c_str(), &end);
+        if(*end) fail(std::string("bad ") + what + " '" + token + "'");
+        return value;
+    }
+
+    /* Looks at the next token without taking it */
+    Kind peek(std::string &token){
+        size_t pos = _pos;
+        int line = _line;
+        Kind kind = next(token);
+        _pos = pos;
+        _line = line;
+        return kind;
+    }
+
+    void fail(const std::string &message){
+        fprintf(stderr, "%s:%d: %s\n", _path, _line, message.c_str());
+        exit(1);
+    }
+
+private:
+    const char *_path;
+    std::string _text;
+    size_t _pos;
+    int _line;
+};
+
+static bool isKeyword(const std::string &token)
+{
+    return token == "VERSION" || token == "BU_" || token == "BO_" || token == "SG_" || token == "CM_";
+}
+
+/* Skips a list of names (node lists), up to the next keyword */
+static void skipNames(Lexer &lexer)
+{
+    std::string token;
+    Lexer::Kind kind;
+    while((kind = lexer.peek(token)) != Lexer::END && !(kind == Lexer::WORD && isKeyword(token))){
+        lexer.next(token);
+    }
+}
+
+static Message *findMessage(std::vector<Message> &messages, unsigned id)
+{
+    for(size_t k = 0; k < messages.size(); k++){
+        if(messages[k].id == id) return &messages[k];
+    }
+    return 0;
+}
+
+static void parseSignal(Lexer &lexer, Message &message)
+{
+    Signal s;
+    s.name = lexer.expect(Lexer::WORD, "signal name");
+    lexer.expect(Lexer::PUNCT, "':'", ":");
+    s.start = (int)lexer.number("start bit");
+    lexer.expect(Lexer::PUNCT, "'|'", "|");
+    s.length = (int)lexer.number("length");
+    lexer.expect(Lexer::PUNCT, "'@'", "@");
+    std::string order = lexer.expect(Lexer::NUMBER, "byte order");
+    if(order != "1") lexer.fail("signal " + s.name + ": only little-endian (@1) signals are supported");
+    std::string sign = lexer.expect(Lexer::PUNCT, "'+' or '-'");
+    if(sign != "+" && sign != "-") lexer.fail("expected '+' or '-'");
+    s.isSigned = sign == "-";
+    lexer.expect(Lexer::PUNCT, "'('", "(");
+    s.factor = lexer.number("factor");
+    lexer.expect(Lexer::PUNCT, "','", ",");
+    s.offset = lexer.number("offset");
+    lexer.expect(Lexer::PUNCT, "')'", ")");
+    lexer.expect(Lexer::PUNCT, "'['", "[");
+    s.minimum = lexer.number("minimum");
+    lexer.expect(Lexer::PUNCT, "'|'", "|");
+    s.maximum = lexer.number("maximum");
+    lexer.expect(Lexer::PUNCT, "']'", "]");
+    s.unit = lexer.expect(Lexer::STRING, "unit");
+
+    if(s.length < 1 || s.length > 32) lexer.fail("signal " + s.name + ": length must be 1 to 32 bits");
+    if(s.start < 0 || s.start + s.length > 8 * message.length) lexer.fail("signal " + s.name + " does not fit in the frame");
+    if(s.factor == 0) lexer.fail("signal " + s.name + ": factor of 0");
+    if(s.minimum > s.maximum) lexer.fail("signal " + s.name + ": minimum above maximum");
+    double rawMin = s.isSigned ? -ldexp(1, s.length - 1) : 0;
+    double rawMax = s.isSigned ? ldexp(1, s.length - 1) - 1 : ldexp(1, s.length) - 1;
+    double lo = (s.minimum - s.offset) / s.factor, hi = (s.maximum - s.offset) / s.factor;
+    if(lo > hi){ double t = lo; lo = hi; hi = t; }
+    if(floor(lo + 0.5) < rawMin || floor(hi + 0.5) > rawMax) lexer.fail("signal " + s.name + ": [min|max] does not fit in the raw bits");
+    for(size_t k = 0; k < message.signals.size(); k++){
+        const Signal &o = message.signals[k];
+        if(o.name == s.name) lexer.fail("signal " + s.name + " defined twice");
+        if(s.start < o.start + o.length && o.start < s.start + s.length) lexer.fail("signal " + s.name + " overlaps " + o.name);
+    }
+    message.signals.push_back(s);
+    skipNames(lexer);               // receivers
+}
+
+static void parseComment(Lexer &lexer, std::vector<Message> &messages)
+{
+    std::string token;
+    Lexer::Kind kind = lexer.next(token);
+    if(kind == Lexer::WORD && (token == "BO_" || token == "SG_")){
+        bool isSignal = token == "SG_";
+        unsigned id = (unsigned)lexer.number("message ID");
+        Message *message = findMessage(messages, id);
+        if(!message) lexer.fail("comment on an unknown message");
+        std::string name = isSignal ? lexer.expect(Lexer::WORD, "signal name") : "";
+        std::string text = lexer.expect(Lexer::STRING, "comment");
+        if(!isSignal){
+            message->comment = text;
+        } else{
+            size_t k = 0;
+            while(k < message->signals.size() && message->signals[k].name != name) k++;
+            if(k == message->signals.size()) lexer.fail("comment on an unknown signal " + name);
+            message->signals[k].comment = text;
+        }
+    } else if(kind != Lexer::STRING){
+        lexer.fail("expected a comment");
+    }
+    lexer.expect(Lexer::PUNCT, "';'", ";");
+}
+
+static std::vector<Message> parse(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if(!f){
+        fprintf(stderr, "%s: cannot open\n", path);
+        exit(1);
+    }
+    std::string text;
+    char buffer[4096];
+    size_t n;
+    while((n = fread(buffer, 1, sizeof(buffer), f)) > 0) text.append(buffer, n);
+    fclose(f);
+
+    Lexer lexer(path, text);
+    std::vector<Message> messages;
+    std::string token;
+    Lexer::Kind kind;
+    while((kind = lexer.next(token)) != Lexer::END){
+        if(kind != Lexer::WORD) lexer.fail("unexpected '" + token + "'");
+        if(token == "VERSION"){
+            lexer.expect(Lexer::STRING, "version string");
+        } else if(token == "BU_"){
+            lexer.expect(Lexer::PUNCT, "':'", ":");
+            skipNames(lexer);
+        } else if(token == "BO_"){
+            Message m;
+            m.id = (unsigned)lexer.number("message ID");
+            m.name = lexer.expect(Lexer::WORD, "message name");
+            lexer.expect(Lexer::PUNCT, "':'", ":");
+            m.length = (int)lexer.number("length");
+            m.sender = lexer.expect(Lexer::WORD, "sender");
+            if(m.length < 0 || m.length > 8) lexer.fail("message " + m.name + ": length must be 0 to 8 bytes");
+            if(m.id > 0x7FF) lexer.fail("message " + m.name + ": only standard (11 bit) IDs are supported");
+            if(findMessage(messages, m.id)) lexer.fail("message ID used twice");
+            messages.push_back(m);
+        } else if(token == "SG_"){
+            if(messages.empty()) lexer.fail("signal outside of a message");
+            parseSignal(lexer, messages.back());
+        } else if(token == "CM_"){
+            parseComment(lexer, messages);
+        } else{
+            lexer.fail("unsupported keyword " + token);
+        }
+    }
+    return messages;
+}
+
+/* MPPT_CAN_READINGS -> MpptCanReadings (or mpptCanReadings) */
+static std::string camelCase(const std::string &name, bool capitalise)
+{
+    std::string out;
+    bool upper = capitalise;
+    for(size_t k = 0; k < name.size(); k++){
+        if(name[k] == '_'){
+            upper = true;
+            continue;
+        }
+        out += upper ? (char)toupper((unsigned char)name[k]) : (char)tolower((unsigned char)name[k]);
+        upper = false;
+    }
+    return out;
+}
+
+/* outVoltage -> OUT_VOLTAGE */
+static std::string upperCase(const std::string &name)
+{
+    std::string out;
+    for(size_t k = 0; k < name.size(); k++){
+        if(k > 0 && isupper((unsigned char)name[k]) && islower((unsigned char)name[k - 1])) out += '_';
+        out += (char)toupper((unsigned char)name[k]);
+    }
+    return out;
+}
+
+/* The shortest float literal that reads back as the same float */
+static std::string literal(double value)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "%.9g", value);
+    for(int decimals = 0; decimals <= 9; decimals++){
+        char fixed[64];
+        snprintf(fixed, sizeof(fixed), "%.*f", decimals, value);
+        if((float)strtod(fixed, 0) == (float)value){
+            strcpy(text, fixed);
+            break;
+        }
+    }
+    std::string out = text;
+    if(out.find_first_of(".en") == std::string::npos) out += ".0";
+    return out + "f";
+}
+
+static bool isConstant(const Signal &s)
+{
+    return s.minimum == s.maximum;
+}
+
+static long constantRaw(const Signal &s)
+{
+    return (long)floor((s.minimum - s.offset) / s.factor + 0.5);
+}
+
+static void writeMessage(FILE *out, const Message &m)
+{
+    std::string type = camelCase(m.name, true), prefix = camelCase(m.name, false);
+    int members = 0;
+
+    fprintf(out, "/*\n* %s: ID %u, %d bytes, sent by %s\n", m.name.c_str(), m.id, m.length, m.sender.c_str());
+    if(!m.comment.empty()) fprintf(out, "* %s\n", m.comment.c_str());
+    fprintf(out, "*/\n");
+    fprintf(out, "#define %-40s %u\n", (m.name + "_ID").c_str(), m.id);
+    fprintf(out, "#define %-40s %d\n", (m.name + "_LENGTH").c_str(), m.length);
+    for(size_t k = 0; k < m.signals.size(); k++){
+        const Signal &s = m.signals[k];
+        if(isConstant(s)) fprintf(out, "#define %-40s %ld\n", (m.name + "_" + upperCase(s.name)).c_str(), constantRaw(s));
+    }
+    fprintf(out, "#define %-40s %d\n\n", (m.name + "_SIGNAL_COUNT").c_str(), (int)m.signals.size());
+
+    fprintf(out, "struct %s {\n", type.c_str());
+    for(size_t k = 0; k < m.signals.size(); k++){
+        const Signal &s = m.signals[k];
+        if(isConstant(s)) continue;
+        std::string member = "float " + s.name + ";";
+        fprintf(out, "    %-24s // %s%s%s%g .. %g\n", member.c_str(), s.comment.c_str(), s.comment.empty() ? "" : ", ",
+                s.unit.empty() ? "" : (s.unit + ", ").c_str(), s.minimum, s.maximum);
+        members++;
+    }
+    if(!members) fprintf(out, "    char unused;\n");
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "constexpr uint64_t %sPack(const %s &m)\n{\n    return 0", prefix.c_str(), type.c_str());
+    for(size_t k = 0; k < m.signals.size(); k++){
+        const Signal &s = m.signals[k];
+        if(isConstant(s)){
+            fprintf(out, "\n         | mpptCanPackRaw(%s_%s, %d, %d)", m.name.c_str(), upperCase(s.name).c_str(), s.start, s.length);
+        } else{
+            double fallback = s.minimum > 0 ? s.minimum : s.maximum < 0 ? s.maximum : 0;
+            fprintf(out, "\n         | mpptCanPack(m.%s, %s, %s, %s, %s, %s, %d, %d)", s.name.c_str(), literal(1 / s.factor).c_str(),
+                    literal(s.offset).c_str(), literal(s.minimum).c_str(), literal(s.maximum).c_str(), literal(fallback).c_str(),
+                    s.start, s.length);
+        }
+    }
+    fprintf(out, ";\n}\n\n");
+
+    fprintf(out, "constexpr %s %sUnpack(uint64_t frame)\n{\n    return %s{", type.c_str(), prefix.c_str(), type.c_str());
+    const char *separator = "";
+    for(size_t k = 0; k < m.signals.size(); k++){
+        const Signal &s = m.signals[k];
+        if(isConstant(s)) continue;
+        fprintf(out, "%s\n        mpptCanUnpack%s(frame, %d, %d, %s, %s)", separator, s.isSigned ? "Signed" : "Unsigned",
+                s.start, s.length, literal(s.factor).c_str(), literal(s.offset).c_str());
+        separator = ",";
+    }
+    fprintf(out, "%s\n    };\n}\n\n", members ? "" : "0");
+
+    fprintf(out, "/* true if the constant signals of 'frame' have their values */\n");
+    fprintf(out, "constexpr bool %sValid(uint64_t frame)\n{\n    return true", prefix.c_str());
+    for(size_t k = 0; k < m.signals.size(); k++){
+        const Signal &s = m.signals[k];
+        if(isConstant(s)){
+            fprintf(out, "\n        && mpptCanRaw(frame, %d, %d) == mpptCanRaw(%s_%s, 0, %d)", s.start, s.length,
+                    m.name.c_str(), upperCase(s.name).c_str(), s.length);
+        }
+    }
+    fprintf(out, ";\n}\n\n");
+
+    fprintf(out, "static const MpptCanSignal %sSignals[%s_SIGNAL_COUNT] = {\n", prefix.c_str(), m.name.c_str());
+    for(size_t k = 0; k < m.signals.size(); k++){
+        const Signal &s = m.signals[k];
+        fprintf(out, "    { \"%s\", %d, %d, %s, %s, %s, %s, %s, \"%s\" }%s\n", s.name.c_str(), s.start, s.length,
+                s.isSigned ? "true" : "false", literal(s.factor).c_str(), literal(s.offset).c_str(), literal(s.minimum).c_str(),
+                literal(s.maximum).c_str(), s.unit.c_str(), k + 1 < m.signals.size() ? "," : "");
+    }
+    fprintf(out, "};\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc != 3){
+        fprintf(stderr, "usage: %s schema.dbc output.h\n", argv[0]);
+        return 1;
+    }
+    std::vector<Message> messages = parse(argv[1]);
+
+    FILE *out = fopen(argv[2], "w");
+    if(!out){
+        fprintf(stderr, "%s: cannot write\n", argv[2]);
+        return 1;
+    }
+    const char *base = strrchr(argv[1], '/') ? strrchr(argv[1], '/') + 1 : argv[1];
+    fprintf(out, "/*************************** mppt_can_messages.h ***************************************************\n");
+    fprintf(out, " * Maximum Power Point Tracker Project for EE 464R\n *\n");
+    fprintf(out, " * CAN_BUS: Messages of the MPPT\n *\n");
+    fprintf(out, " * GENERATED by mppt_can_gen from %s - do not edit, change the schema and run\n", base);
+    fprintf(out, " *      $./mppt_can_gen %s mppt_can_messages.h\n *\n", base);
+    fprintf(out, " *****************************************************************************************/\n");
+    fprintf(out, "#ifndef _MPPT_CAN_MESSAGES_H_\n#define _MPPT_CAN_MESSAGES_H_\n\n");
+    fprintf(out, "#include \"mppt_can_signal.h\"\n\n");
+    for(size_t k = 0; k < messages.size(); k++){
+        writeMessage(out, messages[k]);
+    }
+    fprintf(out, "#endif // _MPPT_CAN_MESSAGES_H_\n");
+    if(fclose(out) != 0){
+        fprintf(stderr, "%s: cannot write\n", argv[2]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*************************** mppt_can_messages.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Messages of the MPPT
+ *
+ * GENERATED by mppt_can_gen from mppt_can.dbc - do not edit, change the schema and run
+ *      $./mppt_can_gen mppt_can.dbc mppt_can_messages.h
+ *
+ *****************************************************************************************/
+#ifndef _MPPT_CAN_MESSAGES_H_
+#define _MPPT_CAN_MESSAGES_H_
+
+#include "mppt_can_signal.h"
+
+/*
+* MPPT_CAN_READINGS: ID 7, 8 bytes, sent by MPPT
+* All the readings of one controller step, sent by the main loop of the MPPT firmware.
+*/
+#define MPPT_CAN_READINGS_ID                     7
+#define MPPT_CAN_READINGS_LENGTH                 8
+#define MPPT_CAN_READINGS_VERSION                10
+#define MPPT_CAN_READINGS_SIGNAL_COUNT           6
+
+struct MpptCanReadings {
+    float outVoltage;        // Battery side (boost converter output) voltage, V, -204.8 .. 204.75
+    float inCurrent;         // Array current (input Hall sensor), A, -20.48 .. 20.47
+    float inVoltage;         // Array voltage, V, -204.8 .. 204.75
+    float outCurrent;        // Battery current (output Hall sensor), A, -20.48 .. 20.47
+    float efficiency;        // Output power / input power, %, -128 .. 127.75
+};
+
+constexpr uint64_t mpptCanReadingsPack(const MpptCanReadings &m)
+{
+    return 0
+         | mpptCanPackRaw(MPPT_CAN_READINGS_VERSION, 0, 4)
+         | mpptCanPack(m.outVoltage, 20.0f, 0.0f, -204.8f, 204.75f, 0.0f, 4, 13)
+         | mpptCanPack(m.inCurrent, 100.0f, 0.0f, -20.48f, 20.47f, 0.0f, 30, 12)
+         | mpptCanPack(m.inVoltage, 20.0f, 0.0f, -204.8f, 204.75f, 0.0f, 17, 13)
+         | mpptCanPack(m.outCurrent, 100.0f, 0.0f, -20.48f, 20.47f, 0.0f, 42, 12)
+         | mpptCanPack(m.efficiency, 4.0f, 0.0f, -128.0f, 127.75f, 0.0f, 54, 10);
+}
+
+constexpr MpptCanReadings mpptCanReadingsUnpack(uint64_t frame)
+{
+    return MpptCanReadings{
+        mpptCanUnpackSigned(frame, 4, 13, 0.05f, 0.0f),
+        mpptCanUnpackSigned(frame, 30, 12, 0.01f, 0.0f),
+        mpptCanUnpackSigned(frame, 17, 13, 0.05f, 0.0f),
+        mpptCanUnpackSigned(frame, 42, 12, 0.01f, 0.0f),
+        mpptCanUnpackSigned(frame, 54, 10, 0.25f, 0.0f)
+    };
+}
+
+/* true if the constant signals of 'frame' have their values */
+constexpr bool mpptCanReadingsValid(uint64_t frame)
+{
+    return true
+        && mpptCanRaw(frame, 0, 4) == mpptCanRaw(MPPT_CAN_READINGS_VERSION, 0, 4);
+}
+
+static const MpptCanSignal mpptCanReadingsSignals[MPPT_CAN_READINGS_SIGNAL_COUNT] = {
+    { "version", 0, 4, false, 1.0f, 0.0f, 10.0f, 10.0f, "" },
+    { "outVoltage", 4, 13, true, 0.05f, 0.0f, -204.8f, 204.75f, "V" },
+    { "inCurrent", 30, 12, true, 0.01f, 0.0f, -20.48f, 20.47f, "A" },
+    { "inVoltage", 17, 13, true, 0.05f, 0.0f, -204.8f, 204.75f, "V" },
+    { "outCurrent", 42, 12, true, 0.01f, 0.0f, -20.48f, 20.47f, "A" },
+    { "efficiency", 54, 10, true, 0.25f, 0.0f, -128.0f, 127.75f, "%" }
+};
+
+#endif // _MPPT_CAN_MESSAGES_H_
@@ -0,0 +1,100 @@
+/*************************** mppt_can_signal.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Building Blocks of the Generated Message Code
+ *
+ * Purpose: The constexpr helpers mppt_can_messages.h (generated by mppt_can_gen from
+ * mppt_can.dbc) is written in. A frame is handled as one 64 bit word, byte 0 in the low byte,
+ * and every signal is a shift and a mask of it: no loops and no branches (the saturation and
+ * rounding are selects, which the compilers turn into conditional instructions), so the
+ * generated code is the same straight line of shifts a hand-written packer would be.
+ *
+ * Also the descriptor of a signal, for host tools that print or check any message.
+ *
+ * This file has no mbed dependencies and compiles on any host with a C++11 compiler.
+ *
+ *****************************************************************************************/
+#ifndef _MPPT_CAN_SIGNAL_H_
+#define _MPPT_CAN_SIGNAL_H_
+
+#include <stdint.h>
+
+/* One signal of a message, as written in the schema */
+struct MpptCanSignal {
+    const char *name;
+    uint8_t     start;          // least significant bit in the 64 bit frame
+    uint8_t     length;         // bits
+    bool        isSigned;
+    float       factor;         // value = raw * factor + offset
+    float       offset;
+    float       minimum;        // values saturate at [minimum, maximum]; equal for a constant
+    float       maximum;
+    const char *unit;
+};
+
+/* 'value' limited to [lo, hi]; NaN becomes 'fallback' */
+constexpr float mpptCanClamp(float value, float lo, float hi, float fallback)
+{
+    return value != value ? fallback : value < lo ? lo : value > hi ? hi : value;
+}
+
+/* 'value' rounded to the nearest integer, halves away from zero */
+constexpr int64_t mpptCanRound(float value)
+{
+    return (int64_t)(value + (value < 0 ? -0.5f : 0.5f));
+}
+
+/*
+* The bits of one signal in the frame: 'value' saturated to [lo, hi] (NaN sent as 'fallback'),
+* scaled to raw counts ('scale' = 1 / factor) and placed at 'start'.
+*/
+constexpr uint64_t mpptCanPack(float value, float scale, float offset, float lo, float hi, float fallback,
+                               int start, int length)
+{
+    return ((uint64_t)mpptCanRound((mpptCanClamp(value, lo, hi, fallback) - offset) * scale)
+            & ((1ULL << length) - 1)) << start;
+}
+
+/* A constant signal, 'raw' at 'start' */
+constexpr uint64_t mpptCanPackRaw(uint64_t raw, int start, int length)
+{
+    return (raw & ((1ULL << length) - 1)) << start;
+}
+
+constexpr uint64_t mpptCanRaw(uint64_t frame, int start, int length)
+{
+    return (frame >> start) & ((1ULL << length) - 1);
+}
+
+/* An unsigned signal of the frame */
+constexpr float mpptCanUnpackUnsigned(uint64_t frame, int start, int length, float factor, float offset)
+{
+    return (float)mpptCanRaw(frame, start, length) * factor + offset;
+}
+
+/* A signed signal of the frame: the raw bits sign extended by flipping and removing the sign bit */
+constexpr float mpptCanUnpackSigned(uint64_t frame, int start, int length, float factor, float offset)
+{
+    return (float)((int64_t)(mpptCanRaw(frame, start, length) ^ (1ULL << (length - 1))) - (int64_t)(1ULL << (length - 1)))
+           * factor + offset;
+}
+
+/* The first 'length' bytes of 'data' as a frame word */
+inline uint64_t mpptCanLoad(const unsigned char *data, int length)
+{
+    uint64_t frame = 0;
+    for(int b = 0; b < length; b++){
+        frame |= (uint64_t)data[b] << (8 * b);
+    }
+    return frame;
+}
+
+/* A frame word into the first 'length' bytes of 'data' */
+inline void mpptCanStore(uint64_t frame, unsigned char *data, int length)
+{
+    for(int b = 0; b < length; b++){
+        data[b] = (unsigned char)(frame >> (8 * b));
+    }
+}
+
+#endif // _MPPT_CAN_SIGNAL_H_
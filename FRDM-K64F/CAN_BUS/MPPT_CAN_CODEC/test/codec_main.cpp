@@ -0,0 +1,416 @@
+/*************************** codec_main.cpp ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Packed Binary Payload Test
+ *
+ * Purpose: Tests the readings codec of ../mppt_can_codec.h and the code generated for it from
+ * ../mppt_can.dbc.
+ *
+ *      1. Round trip: random readings across the range of every field decode within half a step;
+ *         negative currents, values past the end of a field, NaN and the old ASCII limits.
+ *         Frames of another length or version are refused, and so are the old ASCII frames on
+ *         the same ID (CAN_TRANSMIT's 120.1234 and every reading from 0 to 999.99).
+ *      2. Generated code: the generated pack and unpack run at compile time (static_assert) and
+ *         give the same bits and readings as a hand-written packer for the same layout.
+ *      3. Throughput: encodes and decodes per second, generated and hand-written.
+ *      4. Bus load: the exact number of bits on the wire (bit stuffing, CRC, ACK, end of frame and
+ *         intermission) of one update sent as five ASCII frames, the old way, and as one packed
+ *         frame. The packed frame must cut the bus load by at least MIN_LOAD_RATIO.
+ *
+ * Instructions: To compile code:
+ *                  $g++ -std=c++11 -O2 -I.. -o runCodec codec_main.cpp
+ *               To run code: $./runCodec [frames for the throughput check]
+ *               The exit code is 0 when every check passes.
+ *
+ *****************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include "mppt_can_codec.h"
+
+#define ROUND_TRIP_COUNT    1000000     // random readings in the round trip check
+#define THROUGHPUT_FRAMES   10000000    // default frames in the throughput check
+#define BIT_RATE            500000      // bit/s of the MPPT's CAN bus
+#define ASCII_FRAMES        5           // frames per update the old way, one per reading
+#define MIN_LOAD_RATIO      2.5
+
+/* Uniform random number in [lo, hi) (xorshift32), so the readings are the same on every run */
+static double randomBetween(unsigned &state, double lo, double hi)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return lo + (hi - lo) * (state / 4294967296.0);
+}
+
+/* The reading of signal 'index' of mpptCanReadingsSignals[] */
+static float fieldValue(const MpptCanReadings &r, int index)
+{
+    const char *name = mpptCanReadingsSignals[index].name;
+    if(!strcmp(name, "outVoltage")) return r.outVoltage;
+    if(!strcmp(name, "inVoltage")) return r.inVoltage;
+    if(!strcmp(name, "inCurrent")) return r.inCurrent;
+    if(!strcmp(name, "outCurrent")) return r.outCurrent;
+    return r.efficiency;
+}
+
+/* The signals that carry a reading (not the version) */
+static bool isReading(int index)
+{
+    return mpptCanReadingsSignals[index].minimum != mpptCanReadingsSignals[index].maximum;
+}
+
+/*
+* The frame packed by hand, the way the codec was written before it was generated: saturate,
+* scale, round, mask and shift each field.
+*/
+static inline uint64_t handField(float value, float scale, int bits)
+{
+    float largest = (float)((1L << (bits - 1)) - 1);
+    float steps = value == value ? value * scale : 0;
+    steps = steps > largest ? largest : steps < -largest - 1 ? -largest - 1 : steps;
+    return (uint64_t)(int64_t)roundf(steps) & ((1ULL << bits) - 1);
+}
+
+static inline uint64_t handPack(const MpptCanReadings &r)
+{
+    return MPPT_CAN_VERSION
+         | handField(r.outVoltage, 20, 13) << 4
+         | handField(r.inVoltage, 20, 13) << 17
+         | handField(r.inCurrent, 100, 12) << 30
+         | handField(r.outCurrent, 100, 12) << 42
+         | handField(r.efficiency, 4, 10) << 54;
+}
+
+static inline float handSigned(uint64_t frame, int shift, int bits, float factor)
+{
+    int32_t raw = (int32_t)((frame >> shift) & ((1ULL << bits) - 1));
+    return (raw - ((raw >> (bits - 1)) << bits)) * factor;
+}
+
+static inline MpptCanReadings handUnpack(uint64_t frame)
+{
+    MpptCanReadings r;
+    r.outVoltage = handSigned(frame, 4, 13, 0.05f);
+    r.inVoltage = handSigned(frame, 17, 13, 0.05f);
+    r.inCurrent = handSigned(frame, 30, 12, 0.01f);
+    r.outCurrent = handSigned(frame, 42, 12, 0.01f);
+    r.efficiency = handSigned(frame, 54, 10, 0.25f);
+    return r;
+}
+
+// the generated code runs at compile time
+static_assert(mpptCanReadingsPack(MpptCanReadings{ 0, 0, 0, 0, 0 }) == MPPT_CAN_VERSION, "version only");
+static_assert(mpptCanReadingsPack(MpptCanReadings{ 0.05f, 0, 0, 0, 0 }) == (MPPT_CAN_VERSION | 1 << 4), "one step of outVoltage");
+static_assert(mpptCanReadingsPack(MpptCanReadings{ -0.05f, 0, 0, 0, 0 }) == (MPPT_CAN_VERSION | 0x1FFF << 4), "minus one step");
+static_assert(mpptCanReadingsUnpack(mpptCanReadingsPack(MpptCanReadings{ 0, 0, 0, 0, 1000 })).efficiency == 127.75f, "saturation");
+static_assert(mpptCanReadingsValid(MPPT_CAN_VERSION) && !mpptCanReadingsValid(MPPT_CAN_VERSION + 1), "version check");
+
+/* The old payload: convertToCharArray() of main.cpp and CAN_TRANSMIT.cpp */
+static void convertToCharArray(char *ptr, float val)
+{
+    memset(ptr, 0, MPPT_CAN_LENGTH);
+    ptr = ptr + 7;
+    int expandedVal = val * 10000;
+    int counter = 0;
+    while (expandedVal > 0) {
+        *ptr = expandedVal % 10 + '0';
+        counter++; ptr--;
+        if(counter == 4){
+            *ptr = '.';
+            ptr--;
+        }
+        expandedVal /= 10;
+    }
+}
+
+/* ... and its decoder, convertToVariable() of CAN_RECEIVE.cpp */
+static float convertToVariable(const unsigned char *ptr)
+{
+    float value = 0, weight = 100;
+    for(int k = 0; k < 7; k++){
+        if(k == 3) continue;
+        float digit = ((float)ptr[k] - 48) * weight;
+        value += digit < 0 ? 0 : digit;
+        weight /= 10;
+    }
+    return value;
+}
+
+/*
+* Bits on the wire of a standard data frame with an 11 bit ID: start of frame to the end of the
+* CRC with stuff bits (a bit of the opposite level after five equal bits), then CRC delimiter,
+* ACK slot, ACK delimiter, 7 bit end of frame and the 3 bit intermission.
+*/
+static int frameBits(int id, const unsigned char *data, int length)
+{
+    unsigned char bits[128];
+    int n = 0;
+
+    bits[n++] = 0;                                              // start of frame
+    for(int b = 10; b >= 0; b--) bits[n++] = (id >> b) & 1;
+    bits[n++] = 0;                                              // RTR
+    bits[n++] = 0;                                              // IDE
+    bits[n++] = 0;                                              // r0
+    for(int b = 3; b >= 0; b--) bits[n++] = (length >> b) & 1;
+    for(int k = 0; k < length; k++){
+        for(int b = 7; b >= 0; b--) bits[n++] = (data[k] >> b) & 1;
+    }
+    unsigned crc = 0;
+    for(int k = 0; k < n; k++){
+        unsigned next = bits[k] ^ ((crc >> 14) & 1);
+        crc = (crc << 1) & 0x7FFF;
+        if(next) crc ^= 0x4599;
+    }
+    for(int b = 14; b >= 0; b--) bits[n++] = (crc >> b) & 1;
+
+    int total = 0, run = 0;
+    unsigned char last = 2;
+    for(int k = 0; k < n; k++){
+        run = bits[k] == last ? run + 1 : 1;
+        last = bits[k];
+        total++;
+        if(run == 5){                                           // the stuff bit starts a new run
+            total++;
+            last = !last;
+            run = 1;
+        }
+    }
+    return total + 1 + 1 + 1 + 7 + 3;
+}
+
+/*
+* 1. Round trip and edge cases.
+*/
+static bool checkRoundTrip(void)
+{
+    double worst[MPPT_CAN_READINGS_SIGNAL_COUNT] = {};
+    unsigned state = 2463534242u;
+    unsigned char data[MPPT_CAN_LENGTH];
+    MpptCanReadings in, out;
+    bool pass = true;
+
+    for(int n = 0; n < ROUND_TRIP_COUNT; n++){
+        in.outVoltage = randomBetween(state, -200, 200);
+        in.inVoltage = randomBetween(state, -200, 200);
+        in.inCurrent = randomBetween(state, -20, 20);
+        in.outCurrent = randomBetween(state, -20, 20);
+        in.efficiency = randomBetween(state, -125, 125);
+        mpptCanEncode(in, data);
+        if(!mpptCanDecode(data, MPPT_CAN_LENGTH, out)){
+            pass = false;
+            break;
+        }
+        for(int k = 0; k < MPPT_CAN_READINGS_SIGNAL_COUNT; k++){
+            if(!isReading(k)) continue;
+            double error = fabs((double)fieldValue(out, k) - fieldValue(in, k));
+            if(error > worst[k]) worst[k] = error;
+        }
+    }
+
+    printf("1. Round trip (%d random readings, largest error against half a step)\n", ROUND_TRIP_COUNT);
+    printf("%-12s %-4s %10s %10s\n", "Field", "unit", "error", "step / 2");
+    for(int k = 0; k < MPPT_CAN_READINGS_SIGNAL_COUNT; k++){
+        if(!isReading(k)) continue;
+        const MpptCanSignal &signal = mpptCanReadingsSignals[k];
+        double limit = signal.factor / 2 + 1e-4;                // float rounding of the readings
+        printf("%-12s %-4s %10.5f %10.5f\n", signal.name, signal.unit, worst[k], signal.factor / 2);
+        pass = pass && worst[k] <= limit;
+    }
+
+    // a negative current and an array above the old 3 digit limit
+    in.outVoltage = 48.3f; in.inVoltage = 1024.0f; in.inCurrent = -0.42f; in.outCurrent = 3.12f; in.efficiency = 96.5f;
+    mpptCanEncode(in, data);
+    mpptCanDecode(data, MPPT_CAN_LENGTH, out);
+    char ascii[MPPT_CAN_LENGTH];
+    convertToCharArray(ascii, in.inCurrent);
+    float asciiCurrent = convertToVariable((unsigned char *)ascii);
+    bool negative = fabs(out.inCurrent + 0.42f) < 0.006f;
+    bool saturated = out.inVoltage == 204.75f;
+    printf("inCurrent -0.42 A: packed %.2f A, ASCII %.2f A\n", out.inCurrent, asciiCurrent);
+    printf("inVoltage 1024 V: packed %.2f V (saturated)\n", out.inVoltage);
+
+    in.inVoltage = -1e9f; in.inCurrent = NAN; in.efficiency = 1e9f;
+    mpptCanEncode(in, data);
+    mpptCanDecode(data, MPPT_CAN_LENGTH, out);
+    saturated = saturated && out.inVoltage == -204.8f && out.efficiency == 127.75f;
+    bool nan = out.inCurrent == 0;
+    printf("inVoltage -1e9 V: %.2f V, efficiency 1e9 %%: %.2f %%, inCurrent NaN: %.2f A\n",
+           out.inVoltage, out.efficiency, out.inCurrent);
+
+    MpptCanReadings untouched = out;
+    bool shortFrame = !mpptCanDecode(data, MPPT_CAN_LENGTH - 1, out);
+    data[0] = (data[0] & 0xF0) | (MPPT_CAN_VERSION + 1);
+    bool version = !mpptCanDecode(data, MPPT_CAN_LENGTH, out);
+    // old ASCII frames share the ID and the length: CAN_TRANSMIT's own sample, then every reading
+    // from 0 to 999.99 in steps of 0.01
+    const float oldSamples[] = { 120.1234f, 150.5f, 100.0f, 999.9999f, 3.12f };
+    int asciiDecoded = 0, asciiFrames = 0;
+    for(int k = 0; k < (int)(sizeof(oldSamples) / sizeof(oldSamples[0])) + 100000; k++){
+        float value = k < (int)(sizeof(oldSamples) / sizeof(oldSamples[0])) ? oldSamples[k] : (k - 5) * 0.01f;
+        convertToCharArray(ascii, value);
+        asciiFrames++;
+        if(mpptCanDecode((unsigned char *)ascii, MPPT_CAN_LENGTH, out)) asciiDecoded++;
+    }
+    bool asciiFrame = asciiDecoded == 0;
+    bool unchanged = memcmp(&untouched, &out, sizeof(out)) == 0;
+    printf("7 byte frame: %s, version %d: %s, old ASCII frames (120.1234 ...): %d of %d DECODED, readings %s\n",
+           shortFrame ? "refused" : "DECODED", MPPT_CAN_VERSION + 1, version ? "refused" : "DECODED",
+           asciiDecoded, asciiFrames, unchanged ? "unchanged" : "CHANGED");
+
+    pass = pass && negative && saturated && nan && shortFrame && version && asciiFrame && unchanged;
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/*
+* 2. The generated code against the hand-written packer, over random readings that include values
+* past the ends of the fields and NaN.
+*/
+static bool checkGenerated(void)
+{
+    static const int count = 1000000;
+    unsigned state = 3141592653u;
+    int packDiffer = 0, unpackDiffer = 0;
+
+    for(int n = 0; n < count; n++){
+        MpptCanReadings r;
+        r.outVoltage = randomBetween(state, -250, 250);
+        r.inVoltage = randomBetween(state, -250, 250);
+        r.inCurrent = randomBetween(state, -25, 25);
+        r.outCurrent = n % 1000 == 0 ? NAN : randomBetween(state, -25, 25);
+        r.efficiency = randomBetween(state, -150, 150);
+
+        uint64_t frame = mpptCanReadingsPack(r);
+        if(frame != handPack(r)) packDiffer++;
+        MpptCanReadings generated = mpptCanReadingsUnpack(frame), hand = handUnpack(frame);
+        if(memcmp(&generated, &hand, sizeof(hand)) != 0) unpackDiffer++;
+    }
+
+    bool pass = packDiffer == 0 && unpackDiffer == 0;
+    printf("2. Generated code against hand-written (%d random readings, compile-time checks passed)\n", count);
+    printf("frames that differ: %d, readings that differ: %d\n", packDiffer, unpackDiffer);
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/*
+* 3. Encodes and decodes per second. 'Pack' and 'Unpack' time one readings frame; 'sink' keeps
+* the compiler from dropping the work.
+*/
+static volatile float sink;
+
+template <class Pack, class Unpack>
+static void timeCodec(const char *name, long frames, Pack pack, Unpack unpack)
+{
+    MpptCanReadings r = { 48.3f, 5.2f, 31.7f, 3.1f, 95.2f };
+    uint64_t word = 0;
+    float sum = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(long n = 0; n < frames; n++){
+        r.inCurrent = (float)(n & 1023) * 0.01f;
+        word ^= pack(r);
+    }
+    double packTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for(long n = 0; n < frames; n++){
+        sum += unpack(word ^ ((uint64_t)(n & 1023) << 30)).inCurrent;
+    }
+    double unpackTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sink = sum + (float)(word & 1);
+
+    printf("%-14s %10.1f %8.2f %10.1f %8.2f\n", name, frames / packTime / 1e6, packTime / frames * 1e9,
+           frames / unpackTime / 1e6, unpackTime / frames * 1e9);
+}
+
+static uint64_t generatedPack(const MpptCanReadings &r) { return mpptCanReadingsPack(r); }
+static MpptCanReadings generatedUnpack(uint64_t frame) { return mpptCanReadingsUnpack(frame); }
+
+static void checkThroughput(long frames)
+{
+    printf("3. Throughput (%ld frames)\n", frames);
+    printf("%-14s %10s %8s %10s %8s\n", "Code", "pack M/s", "ns", "unpack M/s", "ns");
+    timeCodec("generated", frames, generatedPack, generatedUnpack);
+    timeCodec("hand-written", frames, handPack, handUnpack);
+
+    unsigned char data[MPPT_CAN_LENGTH];
+    MpptCanReadings r = { 48.3f, 5.2f, 31.7f, 3.1f, 95.2f }, out = r;
+    float sum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(long n = 0; n < frames; n++){
+        r.inCurrent = (float)(n & 1023) * 0.01f;
+        mpptCanEncode(r, data);
+        mpptCanDecode(data, MPPT_CAN_LENGTH, out);
+        sum += out.inCurrent;
+    }
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("bytes encode + decode (mpptCanEncode, mpptCanDecode): %.1f ns (checksum %.0f)\n\n", time / frames * 1e9, sum);
+}
+
+/*
+* 4. Bits on the wire per update, the old way and packed, averaged over random readings in the
+* range of the MPPT's sensors (stuff bits depend on the data).
+*/
+static bool checkBusLoad(void)
+{
+    static const int samples = 10000;
+    unsigned state = 88172645u;
+    double asciiBits = 0, packedBits = 0;
+    int asciiWorst = 0, packedWorst = 0;
+
+    for(int n = 0; n < samples; n++){
+        MpptCanReadings r;
+        r.outVoltage = randomBetween(state, 40, 60);
+        r.inCurrent = randomBetween(state, 0, 4.5);
+        r.inVoltage = randomBetween(state, 20, 45);
+        r.outCurrent = randomBetween(state, 0, 4.5);
+        r.efficiency = randomBetween(state, 80, 99);
+
+        int bits = 0;
+        for(int k = 0; k < ASCII_FRAMES; k++){
+            const float values[ASCII_FRAMES] = { r.outVoltage, r.inCurrent, r.inVoltage, r.outCurrent, r.efficiency };
+            char ascii[MPPT_CAN_LENGTH];
+            convertToCharArray(ascii, values[k]);
+            bits += frameBits(MPPT_CAN_ID, (unsigned char *)ascii, MPPT_CAN_LENGTH);
+        }
+        asciiBits += bits;
+        if(bits > asciiWorst) asciiWorst = bits;
+
+        unsigned char data[MPPT_CAN_LENGTH];
+        mpptCanEncode(r, data);
+        bits = frameBits(MPPT_CAN_ID, data, MPPT_CAN_LENGTH);
+        packedBits += bits;
+        if(bits > packedWorst) packedWorst = bits;
+    }
+    asciiBits /= samples;
+    packedBits /= samples;
+    double ratio = asciiBits / packedBits;
+
+    printf("4. Bus load per update at %d kbit/s (%d random readings)\n", BIT_RATE / 1000, samples);
+    printf("%-22s %8s %8s %8s %10s\n", "Payload", "frames", "bits", "worst", "us");
+    printf("%-22s %8d %8.1f %8d %10.1f\n", "ASCII, one per reading", ASCII_FRAMES, asciiBits, asciiWorst, asciiBits * 1e6 / BIT_RATE);
+    printf("%-22s %8d %8.1f %8d %10.1f\n", "packed", 1, packedBits, packedWorst, packedBits * 1e6 / BIT_RATE);
+    printf("bus load cut %.2fx (at least %.1fx)\n", ratio, MIN_LOAD_RATIO);
+
+    bool pass = ratio >= MIN_LOAD_RATIO;
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+int main(int argc, char *argv[])
+{
+    long frames = argc > 1 ? atol(argv[1]) : THROUGHPUT_FRAMES;
+    bool pass = true;
+
+    pass = checkRoundTrip() && pass;
+    pass = checkGenerated() && pass;
+    checkThroughput(frames);
+    pass = checkBusLoad() && pass;
+
+    printf("%s\n", pass ? "All checks passed" : "Some checks FAILED");
+    return pass ? 0 : 1;
+}
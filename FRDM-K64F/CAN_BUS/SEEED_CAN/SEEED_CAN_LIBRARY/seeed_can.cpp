@@ -21,13 +21,25 @@
 SEEED_CAN::SEEED_CAN(PinName ncs, PinName irq, PinName mosi, PinName miso, PinName clk, int spiBitrate) :
     _spi(mosi, miso, clk),
     _can(_spi, ncs, irq),
-    _irqpin(irq)
+    _irqpin(irq),
+    _irqUser(0),
+    _txIrq(0),
+    _txHighWater(0),
+    _txDropped(0),
+    _txPreempted(0),
+    _rxOn(0)
 {
+    memset((void *)_txHead, 0, sizeof(_txHead));
+    memset((void *)_txTail, 0, sizeof(_txTail));
     // Make sure CS is high
     _can.ncs = 1;
     // Set up the spi interface
     _can.spi.format(8, 3);
     _can.spi.frequency(spiBitrate);
+#if DEVICE_SPI_ASYNCH
+    _can.spi.set_dma_usage(DMA_USAGE_OPPORTUNISTIC);                    // let write() hand the TX buffer to DMA
+#endif
+    _can.deferredIrq.attach(this, &SEEED_CAN::call_irq);
 //    _can.irq.fall(this, &SEEED_CAN::call_irq);
     _irqpin.fall(this, &SEEED_CAN::call_irq);
 }
@@ -36,91 +48,366 @@ SEEED_CAN::SEEED_CAN(PinName ncs, PinName irq, PinName mosi, PinName miso, PinNa
  */
 int SEEED_CAN::open(int canBitrate, Mode mode)
 {
-    return mcpInit(&_can, (uint32_t) canBitrate, (CANMode)mode);
+    return open(mcpSolveBitTiming(MCP_CLOCK_FREQ, (uint32_t) canBitrate), mode);
+}
+ 
+/** Open initialises the Seeed Studios CAN-BUS Shield with CNF1-3 worked out beforehand.
+ */
+int SEEED_CAN::open(const CANbitTiming &timing, Mode mode)
+{
+    _irqpin.disable_irq();
+    txDiscard();
+    int status = mcpInitTiming(&_can, &timing, (CANMode)mode);
+    driverInterrupts();
+    _irqpin.enable_irq();
+    return status;
 }
  
 /** Puts or removes the Seeed Studios CAN-BUS shield into or from silent monitoring mode
  */
 void SEEED_CAN::monitor(bool silent)
 {
+    _irqpin.disable_irq();                                              // the interrupt handler uses the SPI bus too
     mcpMonitor(&_can, silent);
+    _irqpin.enable_irq();
 }
  
 /** Change the Seeed Studios CAN-BUS shield CAN operation mode
  */
 int SEEED_CAN::mode(Mode mode)
 {
-    return mcpMode(&_can, (CANMode)mode);
+    _irqpin.disable_irq();
+    if (mode == Reset) {
+        txDiscard();
+    }
+    int status = mcpMode(&_can, (CANMode)mode);
+    if (mode == Reset) {
+        driverInterrupts();
+    }
+    _irqpin.enable_irq();
+    return status;
 }
  
 /** Set the CAN bus frequency (Bit Rate)
 */
 int SEEED_CAN::frequency(int canBitRate)
 {
-//    return mcpSetBitRate(&_can, (uint32_t) canBitRate);
-    return mcpInit(&_can, (uint32_t) canBitRate, (CANMode)Normal);
+    return frequency(mcpSolveBitTiming(MCP_CLOCK_FREQ, (uint32_t) canBitRate));
+}
+ 
+/** Set the CAN bus bit timing (CNF1-3)
+*/
+int SEEED_CAN::frequency(const CANbitTiming &timing)
+{
+//    return mcpSetBitTiming(&_can, &timing);
+    _irqpin.disable_irq();
+    txDiscard();
+    int status = mcpInitTiming(&_can, &timing, (CANMode)Normal);
+    driverInterrupts();
+    _irqpin.enable_irq();
+    return status;
 }
  
 /** Read a CAN bus message from the MCP2515 (if one has been received)
  */
 int SEEED_CAN::read(SEEED_CANMessage &msg)
 {
-    return mcpCanRead(&_can, &msg);
+    _irqpin.disable_irq();                                              // the interrupt handler uses the SPI bus too
+    int status = mcpCanRead(&_can, &msg);
+    _irqpin.enable_irq();
+    return status;
+}
+ 
+/** Read every CAN bus message waiting in the MCP2515, up to n
+ */
+int SEEED_CAN::readAll(SEEED_CANMessage msg[], int n)
+{
+    static_assert(sizeof(SEEED_CANMessage) == sizeof(CAN_Message),      // msg[] is walked as a CAN_Message array
+                  "SEEED_CANMessage must add no members to CAN_Message");
+    _irqpin.disable_irq();                                              // the interrupt handler uses the SPI bus too
+    int status = mcpCanReadAll(&_can, msg, (n > 255) ? 255 : n);
+    _irqpin.enable_irq();
+    return status;
+}
+ 
+/**  Write a CAN bus message to the MCP2515, or queue it until a TX buffer is free
+ */
+int SEEED_CAN::write(SEEED_CANMessage msg, Priority priority)
+{
+    int written = 1;
+    unsigned int p = priority & TxUrgent;
+    _irqpin.disable_irq();                                              // the interrupt handler sends from the queues
+    unsigned int queued = _txHead[p] - _txTail[p];
+    if ((queued > 0) ||                                                 // behind queued messages,
+        !(txLoad(msg, p) || ((p == TxUrgent) && txPreempt(msg)))) {     // or no TX buffer free
+        if (queued < SEEED_CAN_TX_QUEUE) {
+            _txQueue[p][_txHead[p] % SEEED_CAN_TX_QUEUE] = msg;
+            _txHead[p]++;
+            if (queued + 1 > _txHighWater) {
+                _txHighWater = queued + 1;
+            }
+            txArm();
+        } else {
+            _txDropped++;
+            written = 0;
+        }
+    }
+    _irqpin.enable_irq();
+    return written;
+}
+ 
+/** Returns the number of messages waiting in the transmit queues
+ */
+int SEEED_CAN::txQueued(void)
+{
+    unsigned int queued = 0;
+    for (unsigned int p = TxLow; p <= TxUrgent; p++) {
+        queued += _txHead[p] - _txTail[p];
+    }
+    return queued;
+}
+ 
+/** Returns the largest number of messages the queue of one priority has held
+ */
+int SEEED_CAN::txHighWater(void)
+{
+    return _txHighWater;
+}
+ 
+/** Returns the number of pending messages aborted for a TxUrgent one
+ */
+unsigned long SEEED_CAN::txPreempted(void)
+{
+    return _txPreempted;
+}
+ 
+/** Returns the number of messages dropped from the transmit queue
+ */
+unsigned long SEEED_CAN::txDropped(void)
+{
+    return _txDropped;
+}
+ 
+/** Load a message into a TX buffer at the TXP of its priority (TX buffer 2 only for TxUrgent), 0 if none is free
+ */
+uint8_t SEEED_CAN::txLoad(const CAN_Message &msg, unsigned int priority)
+{
+    uint8_t num = mcpCanWritePriority(&_can, msg, priority, (priority == TxUrgent) ? 0x07 : 0x03);
+    if (num) {
+        _txLoaded[num - 1] = msg;
+    }
+    return num;
+}
+ 
+/** Make room for a TxUrgent message: abort the newest pending message of the lowest priority in a TX buffer the urgent one
+ *  may take, put it back at the head of its queue and load the urgent one instead
+ */
+uint8_t SEEED_CAN::txPreempt(const CAN_Message &msg)
+{
+    uint8_t pendingFlag[] = {MCP_STAT_TX0REQ, MCP_STAT_TX1REQ, MCP_STAT_TX2REQ};
+    uint8_t status = mcpStatus(&_can);
+    unsigned int limit = 3;                                             // an urgent message must stay behind the pending urgent ones
+    for (unsigned int num = 0; num < 3; num++) {
+        if ((status & pendingFlag[num]) && (_can.txPriority[num] == TxUrgent)) {
+            limit = num;
+            break;
+        }
+    }
+    for (unsigned int p = TxLow; p < TxUrgent; p++) {
+        if (_txHead[p] - _txTail[p] >= SEEED_CAN_TX_QUEUE) {
+            continue;                                                   // no room to put it back
+        }
+        for (unsigned int num = 0; num < limit; num++) {                // of equal TXP the lowest buffer goes last: the newest
+            if ((status & pendingFlag[num]) && (_can.txPriority[num] == p)) {
+                if (mcpCanAbort(&_can, num)) {                          // 0: sent meanwhile, the buffer is free all the same
+                    _txTail[p]--;
+                    _txQueue[p][_txTail[p] % SEEED_CAN_TX_QUEUE] = _txLoaded[num];
+                    _txPreempted++;
+                    txArm();
+                }
+                return txLoad(msg, TxUrgent);
+            }
+        }
+    }
+    return 0;
+}
+ 
+/** Enable the TX buffer interrupts for the queued messages
+ */
+void SEEED_CAN::txArm(void)
+{
+    if (!_txIrq) {                                                      // TXnIF left set by earlier messages assert INT at once
+        mcpBitModify(&_can, MCP_CANINTE, MCP_TX_INTS, MCP_TX_INTS);
+        _txIrq = 1;
+    }
 }
  
-/**  Write a CAN bus message to the MCP2515 (if there is a free message buffer)
+/** Load queued messages into the free TX buffers, highest priority first, and stop the TX buffer interrupts once the queues are empty
  */
-int SEEED_CAN::write(SEEED_CANMessage msg)
+void SEEED_CAN::txRefill(void)
 {
-    return mcpCanWrite(&_can, msg);
+    for (int p = TxUrgent; p >= TxLow; p--) {
+        while ((_txTail[p] != _txHead[p]) && txLoad(_txQueue[p][_txTail[p] % SEEED_CAN_TX_QUEUE], p)) {
+            _txTail[p]++;
+        }
+    }
+    if (!txQueued()) {
+        mcpBitModify(&_can, MCP_CANINTE, MCP_TX_INTS & ~_irqUser, 0);   // leave the ones attach() asked for
+        _txIrq = 0;
+    }
+}
+ 
+/** Forget the queued messages, the MCP2515 is about to be reset (and its interrupts disabled)
+ */
+void SEEED_CAN::txDiscard(void)
+{
+    _txDropped += txQueued();
+    for (unsigned int p = TxLow; p <= TxUrgent; p++) {
+        _txTail[p] = _txHead[p];
+    }
+    _txIrq = 0;
+}
+ 
+/** Receive in the background, into the receive ring
+ */
+void SEEED_CAN::rxRing(bool on)
+{
+    _irqpin.disable_irq();
+    _rxOn = on;
+    mcpBitModify(&_can, MCP_CANINTE, MCP_RX_INTS & ~_irqUser, on ? MCP_RX_INTS : 0);  // leave the ones attach() asked for
+    if (on) {
+        rxDrain();                                                      // INT may be low already: no edge would come
+    }
+    _irqpin.enable_irq();
+}
+ 
+/** Take the oldest message from the receive ring
+ */
+int SEEED_CAN::rxRead(CAN_Message &msg)
+{
+    return _rxRing.get(msg);
+}
+ 
+/** Returns the number of messages waiting in the receive ring
+ */
+int SEEED_CAN::rxAvailable(void)
+{
+    return _rxRing.available();
+}
+ 
+/** Returns the largest number of messages the receive ring has held
+ */
+int SEEED_CAN::rxHighWater(void)
+{
+    return _rxRing.highWater();
+}
+ 
+/** Returns the number of received messages dropped because the receive ring was full
+ */
+unsigned long SEEED_CAN::rxDropped(void)
+{
+    return _rxRing.dropped();
+}
+ 
+/** Read every waiting message straight into the free slots of the receive ring (both receive buffers, INT released),
+ *  or throw them away once it is full. Returns the number of messages taken from the MCP2515.
+ */
+unsigned int SEEED_CAN::rxDrain(void)
+{
+    unsigned int total = 0, n, want;
+    do {
+        unsigned int free;
+        CAN_Message *slot = _rxRing.space(free);
+        want = (free < 2) ? free : 2;                                   // the MCP2515 holds two
+        if (want) {
+            n = mcpCanReadAll(&_can, slot, want);
+            _rxRing.commit(n);
+        } else {
+            CAN_Message lost[2];
+            want = 2;
+            n = mcpCanReadAll(&_can, lost, want);
+            _rxRing.drop(n);
+        }
+        total += n;
+    } while (n == want);                                                // filled what it was given: there may be more
+    return total;
 }
  
 /** Configure one of the Accpetance Masks (0 or 1)
  */
 int SEEED_CAN::mask(int maskNum, int canId, CANFormat format)
 {
-    return mcpInitMask(&_can, maskNum, canId, format);
+    _irqpin.disable_irq();                                              // the interrupt handler uses the SPI bus too
+    int status = mcpInitMask(&_can, maskNum, canId, format);
+    _irqpin.enable_irq();
+    return status;
 }
  
 /** Configure one of the Acceptance Filters (0 through 5)
  */
 int SEEED_CAN::filter(int filterNum, int canId, CANFormat format)
 {
-    return mcpInitFilter(&_can, filterNum, canId, format);
+    _irqpin.disable_irq();                                              // the interrupt handler uses the SPI bus too
+    int status = mcpInitFilter(&_can, filterNum, canId, format);
+    _irqpin.enable_irq();
+    return status;
+}
+ 
+/** Configure both Acceptance Masks and all six Acceptance Filters in one go
+ */
+int SEEED_CAN::configure(const CANacceptance &acceptance)
+{
+    _irqpin.disable_irq();                                              // a frame received now must not split the burst or its readback
+    int status = mcpConfigure(&_can, &acceptance);
+    _irqpin.enable_irq();
+    return status;
 }
  
 /** Returns number of message reception (read) errors to detect read overflow errors.
  */
 unsigned char SEEED_CAN::rderror(void)
 {
-    return mcpReceptionErrorCount(&_can);
+    _irqpin.disable_irq();                                              // the interrupt handler uses the SPI bus too
+    unsigned char count = mcpReceptionErrorCount(&_can);
+    _irqpin.enable_irq();
+    return count;
 }
  
 /** Returns number of message transmission (write) errors to detect write overflow errors.
  */
 unsigned char SEEED_CAN::tderror(void)
 {
-    return mcpTransmissionErrorCount(&_can);
+    _irqpin.disable_irq();                                              // the interrupt handler uses the SPI bus too
+    unsigned char count = mcpTransmissionErrorCount(&_can);
+    _irqpin.enable_irq();
+    return count;
 }
  
 /** Check if any type of error has been detected on the CAN bus
  */
 int SEEED_CAN::errors(ErrorType type)
 {
-    return mcpErrorType(&_can, (CANFlags)type);
+    _irqpin.disable_irq();                                              // the interrupt handler uses the SPI bus too
+    int status = mcpErrorType(&_can, (CANFlags)type);
+    _irqpin.enable_irq();
+    return status;
 }
  
 /** Returns the contents of the MCP2515's Error Flag register
  */
- unsigned char SEEED_CAN::errorFlags(void)
- {
-    return mcpErrorFlags(&_can);
- }
+unsigned char SEEED_CAN::errorFlags(void)
+{
+    _irqpin.disable_irq();                                              // the interrupt handler uses the SPI bus too
+    unsigned char flags = mcpErrorFlags(&_can);
+    _irqpin.enable_irq();
+    return flags;
+}
  
 /** Attach a function to call whenever a CAN frame received interrupt is generated.
  */
 void SEEED_CAN::attach(void (*fptr)(void), IrqType event)
 {
+    _irqpin.disable_irq();
     if (fptr) {
         _callback_irq.attach(fptr);
         mcpSetInterrupts(&_can, (CANIrqs)event);
@@ -130,24 +417,67 @@ void SEEED_CAN::attach(void (*fptr)(void), IrqType event)
         mcpSetInterrupts(&_can, (CANIrqs)SEEED_CAN::None);
 //        can_irq_set(&_can, (CanIrqType)type, 0);
     }
+    driverInterrupts();
+    _irqpin.enable_irq();
+}
+ 
+/** Remember the interrupts attach() enabled (none after a reset) and add back the TX buffer ones while messages are queued
+ *  and the RX buffer ones while the receive ring is on
+ */
+void SEEED_CAN::driverInterrupts(void)
+{
+    _irqUser = mcpRead(&_can, MCP_CANINTE);
+    uint8_t ours = (_txIrq ? MCP_TX_INTS : 0) | (_rxOn ? MCP_RX_INTS : 0);
+    if (ours) {
+        mcpBitModify(&_can, MCP_CANINTE, ours, ours);
+    }
 }
  
  
 void SEEED_CAN::call_irq(void)
 {
-    _callback_irq.call();
+    if (_can.busy) {                                                    // the MCP2515 is selected for a TX buffer transfer:
+        _can.irqDeferred = 1;                                           // run the handler when it has finished
+        return;
+    }
+    unsigned int done;
+    do {
+        uint8_t flags = _irqUser;                                       // nothing queued: it is for the ring and the attached function
+        done = 0;
+        if (_txIrq) {
+            flags = mcpRead(&_can, MCP_CANINTF);
+            uint8_t sent = flags & MCP_TX_INTS;
+            if (sent) {
+                mcpBitModify(&_can, MCP_CANINTF, sent, 0);              // before refilling, so a buffer emptied meanwhile flags again
+                txRefill();
+                done = 1;
+            }
+        }
+        if (_rxOn) {
+            done += rxDrain();
+        }
+        if (flags & _irqUser) {
+            _callback_irq.call();
+        }
+    } while (done && (_txIrq || _rxOn) && !_irqpin.read());             // INT still low: no edge will bring us back
 }
  
 /** Check if the specified interrupt event has occurred
  */
 int SEEED_CAN::interrupts(IrqType type)
 {
-    return mcpInterruptType(&_can, (CANIrqs)type);
+    _irqpin.disable_irq();                                              // the interrupt handler uses the SPI bus too
+    int status = mcpInterruptType(&_can, (CANIrqs)type);
+    _irqpin.enable_irq();
+    return status;
 }
  
 /** Returns the contents of the MCP2515's Interrupt Flag register
  */
- unsigned char SEEED_CAN::interruptFlags(void)
- {
-    return mcpInterruptFlags(&_can);
- }
+unsigned char SEEED_CAN::interruptFlags(void)
+{
+    _irqpin.disable_irq();                                              // the interrupt handler uses the SPI bus too
+    unsigned char flags = mcpInterruptFlags(&_can);
+    _irqpin.enable_irq();
+    return flags;
+}
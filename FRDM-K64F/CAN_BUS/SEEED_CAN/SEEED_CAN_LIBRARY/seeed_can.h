@@ -17,9 +17,17 @@
 #define _SEEED_CAN_H_
  
 #include "seeed_can_api.h"
+#include "seeed_can_ring.h"
  
-// if print debug information
-#define DEBUG
+// number of messages write() can hold, per priority, while the MCP2515's TX buffers are busy (a power of 2)
+#ifndef SEEED_CAN_TX_QUEUE
+#define SEEED_CAN_TX_QUEUE  16
+#endif
+ 
+// number of received messages rxRing() can hold until the application takes them (a power of 2)
+#ifndef SEEED_CAN_RX_RING
+#define SEEED_CAN_RX_RING   32
+#endif
  
 /** CANMessage class
  */
@@ -110,6 +118,17 @@ public:
      */
     int open(int canBitrate=100000, Mode mode = Normal);
  
+    /** Open initialises the Seeed Studios CAN-BUS Shield with a bit timing worked out when the firmware is built.
+     *
+     *  @param timing CNF1-3 from mcpBitTiming<rate>() (seeed_can_timing.h), e.g. @p mcpBitTiming<500000>().
+     *  @param mode The initial operation mode, @b default: @p Normal.
+     *
+     *  @returns
+     *     1 if successful,
+     *  @n 0 otherwise
+     */
+    int open(const CANbitTiming &timing, Mode mode = Normal);
+ 
     /** Puts or removes the Seeed Studios CAN-BUS shield into or from silent monitoring mode.
      *
      *  @param silent boolean indicating whether to go into silent mode or not.
@@ -141,6 +160,16 @@ public:
      */
     int frequency(int canBitRate);
  
+    /** Set the CAN bus bit timing
+     *
+     *  @param timing CNF1-3 from mcpBitTiming<rate>() (seeed_can_timing.h)
+     *
+     *  @returns
+     *     1 if successful,
+     *  @n 0 otherwise
+     */
+    int frequency(const CANbitTiming &timing);
+ 
     /** Read a CAN bus message from the MCP2515 (if one has been received)
      *
      *  @param msg A CANMessage to read to.
@@ -151,15 +180,90 @@ public:
      */
     int read(SEEED_CANMessage &msg);
  
-    /** Write a CAN bus message to the MCP2515 (if there is a free message buffer)
+    /** Read every CAN bus message waiting in the MCP2515, up to n, oldest first
+     *  (one pass: empties both receive buffers and releases the interrupt line, for use in an RxAny handler)
+     *
+     *  @param msg An array of n CANMessages to read to.
+     *  @param n The size of the array.
+     *
+     *  @returns
+     *     the number of messages read (0 if none had arrived)
+     */
+    int readAll(SEEED_CANMessage msg[], int n);
+ 
+    enum Priority {
+        TxLow = 0,
+        TxNormal,
+        TxHigh,
+        TxUrgent
+    };
+ 
+    /** Write a CAN bus message to the MCP2515, or queue it until a TX buffer is free (does not wait)
+     *  @n Queued messages are loaded by the interrupt handler as the TX buffers empty (TX0IF, TX1IF, TX2IF),
+     *  higher priorities first; messages of one priority go out in the order they were written.
+     *  @n The priority is the TXP level of the TX buffer: a pending message of a higher priority is sent before every one of a lower priority.
+     *  TX buffer 2 is kept for TxUrgent. When a TxUrgent message finds no TX buffer free, the newest pending message of the lowest
+     *  priority is aborted for it (unless it is already on the bus) and goes back to the head of its queue.
      *
      *  @param msg The CANMessage to write.
+     *  @param priority @b default: @p TxNormal.
+     *  @n @p SEEED_CAN::TxLow - Status and other messages that can wait,
+     *  @n @p SEEED_CAN::TxNormal - Ordinary messages,
+     *  @n @p SEEED_CAN::TxHigh - Control messages,
+     *  @n @p SEEED_CAN::TxUrgent - Faults: TX buffer 2 is reserved for them and they may abort lower priority messages.
+     *
+     *  @returns
+     *     1 if the message was written or queued
+     *  @n 0 if the queue of its priority was full and the message was dropped
+     */
+    int write(SEEED_CANMessage msg, Priority priority = TxNormal);
+ 
+    /** Returns the number of messages waiting in the transmit queues
+     */
+    int txQueued(void);
+ 
+    /** Returns the largest number of messages the queue of one priority has held (its high-water mark)
+     */
+    int txHighWater(void);
+ 
+    /** Returns the number of pending messages aborted for a TxUrgent one (they were sent later)
+     */
+    unsigned long txPreempted(void);
+ 
+    /** Returns the number of messages dropped because the transmit queue was full, or discarded by open(), frequency() or mode(Reset)
+     */
+    unsigned long txDropped(void);
+ 
+    /** Receive in the background: the interrupt handler moves every message the MCP2515 receives into a ring, where rxRead() takes them
+     *  @n The interrupt handler is the only writer of the ring and rxRead() the only reader, so neither locks the other out: rxRead() may be
+     *  called from the main loop or from an RTOS thread while messages arrive. A function attached to RxAny is called after the new messages
+     *  are in the ring (e.g. to signal a thread). Do not use read() or readAll() while the ring is on.
+     *
+     *  @param on true to start (also takes the messages already waiting), false to stop.
+     */
+    void rxRing(bool on);
+ 
+    /** Take the oldest message from the receive ring (does not wait)
+     *
+     *  @param msg A CANMessage to read to.
      *
      *  @returns
-     *     1 if write was successful
-     *  @n 0 if write failed,
+     *     1 if a message was taken
+     *  @n 0 if the ring was empty
+     */
+    int rxRead(CAN_Message &msg);
+ 
+    /** Returns the number of messages waiting in the receive ring
      */
-    int write(SEEED_CANMessage msg);
+    int rxAvailable(void);
+ 
+    /** Returns the largest number of messages the receive ring has held (its high-water mark)
+     */
+    int rxHighWater(void);
+ 
+    /** Returns the number of received messages dropped because the receive ring was full
+     */
+    unsigned long rxDropped(void);
  
     /** Configure one of the Accpetance Masks (0 or 1)
      *
@@ -185,6 +289,20 @@ public:
      */
     int filter(int filterNum, int canId, CANFormat format = CANStandard);
  
+    /** Configure both Acceptance Masks and all six Acceptance Filters in one go
+     *
+     *  Enters configuration mode once, writes the masks and filters in bursts, reads them back and restores the
+     *  operation mode. Use it instead of a series of mask() and filter() calls, which change mode twice each.
+     *
+     *  @param acceptance Mask 0 (Filters 0 and 1), Mask 1 (Filters 2 through 5) and the six Filters, each with its
+     *  extended flag (1: @p CANExtended, 0: @p CANStandard).
+     *
+     *  @returns
+     *     1 if every Acceptance Mask and Filter was set and read back unchanged
+     *  @n 0 otherwise
+     */
+    int configure(const CANacceptance &acceptance);
+ 
     /** Returns number of message reception (read) errors to detect read overflow errors.
      *
      *  @returns
@@ -302,6 +420,7 @@ public:
      */
     template<typename T>
     void attach(T* tptr, void (T::*mptr)(void), IrqType event=RxAny) {
+        _irqpin.disable_irq();
         _callback_irq.attach(tptr, mptr);
         mcpSetInterrupts(&_can, (CANIrqs)event);
         if((mptr != NULL) && (tptr != NULL)) {
@@ -313,6 +432,8 @@ public:
             mcpSetInterrupts(&_can, (CANIrqs)SEEED_CAN::None);
 //            can_irq_set(&_can, (CanIrqType)type, 0);
         }
+        driverInterrupts();
+        _irqpin.enable_irq();
     }
  
     void call_irq(void);
@@ -358,6 +479,27 @@ protected:
     mcp_can_t       _can;
     InterruptIn     _irqpin;
     FunctionPointer _callback_irq;
+    uint8_t         _irqUser;                                           // CANINTE bits enabled by attach()
+ 
+    CAN_Message     _txQueue[TxUrgent + 1][SEEED_CAN_TX_QUEUE];         // messages waiting for a TX buffer, per priority
+    volatile unsigned int _txHead[TxUrgent + 1];                        // written by write()
+    volatile unsigned int _txTail[TxUrgent + 1];                        // sent by the interrupt handler
+    volatile uint8_t _txIrq;                                            // 1 while the TX buffer interrupts are enabled for the queues
+    unsigned int    _txHighWater;
+    unsigned long   _txDropped;
+    CAN_Message     _txLoaded[3];                                       // what each TX buffer was loaded with, to queue it again if aborted
+    unsigned long   _txPreempted;
+ 
+    SEEED_CANRing<SEEED_CAN_RX_RING> _rxRing;                           // filled by the interrupt handler, emptied by rxRead()
+    volatile uint8_t _rxOn;                                             // 1 while rxRing() is on
+ 
+    uint8_t txLoad(const CAN_Message &msg, unsigned int priority);
+    uint8_t txPreempt(const CAN_Message &msg);
+    void txArm(void);
+    void txRefill(void);
+    void txDiscard(void);
+    unsigned int rxDrain(void);
+    void driverInterrupts(void);
  
 };
  
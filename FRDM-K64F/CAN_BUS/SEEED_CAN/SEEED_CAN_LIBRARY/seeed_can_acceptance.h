@@ -0,0 +1,237 @@
+/*************************** seeed_can_acceptance.h *********************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Acceptance Filter Planner of the SEEED_CAN Library
+ *
+ * Purpose: Works out the MCP2515's two Acceptance Masks and six Acceptance Filters for a set of
+ * wanted standard CAN ids, letting through as few other ids as it can, so the K64F is not
+ * interrupted for frames it throws away. Mask 0 goes with Filters 0 and 1 (RXB0), Mask 1 with
+ * Filters 2 through 5 (RXB1): an id gets in when (id & mask) == (filter & mask) for any pair.
+ *
+ * Under a mask the wanted ids fall into groups with the same id & mask, one filter per group,
+ * and each group lets in 2 ^ (cleared bits of the mask) ids. For every Mask 1, most bits set
+ * first, the (up to) four groups holding the most wanted ids go to Filters 2-5; the ids left over
+ * go to Mask 0 and Filters 0-1, with the mask that lets in the fewest ids and gives them at most
+ * two groups. A mask that lets more ids in than the best plan so far ends the search, so it is
+ * quick when the ids fit well. The plan with the fewest ids let in is kept; the two buffers may
+ * let in some of the same ids, so accepted is counted afterwards, id by id.
+ *
+ * Instructions: mcpPlanAcceptance() fills a CANacceptancePlan, whose acceptance goes to
+ * SEEED_CAN::configure(). Up to SEEED_CAN_PLAN_IDS ids, all standard (0 to 0x7FF). The plan
+ * depends only on the ids: work it out once, at start-up or on the host. mcpFalseAcceptRate() is
+ * the share of the ids not wanted that still get in; every id counts the same, whatever its
+ * traffic on the bus.
+ *
+ *****************************************************************************************/
+#ifndef _SEEED_CAN_ACCEPTANCE_H_
+#define _SEEED_CAN_ACCEPTANCE_H_
+
+#include "seeed_can_api.h"
+
+// most distinct ids mcpPlanAcceptance() takes (their groups are kept on the stack)
+#ifndef SEEED_CAN_PLAN_IDS
+#define SEEED_CAN_PLAN_IDS  64
+#endif
+
+#define MCP_STD_ID_BITS     11
+#define MCP_STD_IDS         (1UL << MCP_STD_ID_BITS)
+
+/// Masks and filters for a set of wanted ids, and how many ids they let through
+struct MCP_CANacceptancePlan {
+    CANacceptance acceptance;
+    uint32_t wanted;            // distinct ids asked for
+    uint32_t accepted;          // standard ids the masks and filters let through, the wanted ones included
+};
+typedef struct MCP_CANacceptancePlan CANacceptancePlan;
+
+/* The next mask with as many bits set (0 after the last one below MCP_STD_IDS) */
+inline uint32_t mcpPlanNextMask(uint32_t mask)
+{
+    if (mask == 0) {
+        return 0;
+    }
+    uint32_t lowest = mask & (~mask + 1);
+    uint32_t ripple = mask + lowest;
+    uint32_t next = (((ripple ^ mask) >> 2) / lowest) | ripple;
+    return (next < MCP_STD_IDS) ? next : 0;
+}
+
+/* Groups of ids under mask: their id & mask in value[] and how many ids each holds in count[];
+ * stops counting at limit + 1 groups */
+inline uint32_t mcpPlanGroups(const uint32_t *ids, uint32_t n, uint32_t mask, uint32_t limit, uint32_t value[], uint32_t count[])
+{
+    uint32_t groups = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t g = 0;
+        while (g < groups && value[g] != (ids[i] & mask)) {
+            g++;
+        }
+        if (g == groups) {
+            if (groups == limit) {
+                return limit + 1;
+            }
+            value[groups] = ids[i] & mask;
+            count[groups++] = 0;
+        }
+        count[g]++;
+    }
+    return groups;
+}
+
+/* The mask letting in the fewest ids under which ids fall into at most 'filters' groups, if fewer
+ * than 'bound'; returns the ids it lets in (bound when none does better) and the groups in value[] */
+inline uint32_t mcpPlanMask(const uint32_t *ids, uint32_t n, uint32_t filters, uint32_t bound, uint32_t &mask, uint32_t value[])
+{
+    uint32_t tryValue[SEEED_CAN_PLAN_IDS], tryCount[SEEED_CAN_PLAN_IDS];
+    uint32_t best = bound;
+
+    for (int bits = MCP_STD_ID_BITS; bits >= 0; bits--) {
+        uint32_t per = 1UL << (MCP_STD_ID_BITS - bits);                // ids let in per group
+        if (per >= best) {
+            break;                                                      // fewer bits only let in more
+        }
+        uint32_t m = (1UL << bits) - 1;
+        do {
+            uint32_t groups = mcpPlanGroups(ids, n, m, filters, tryValue, tryCount);
+            if (groups <= filters && groups * per < best) {
+                best = groups * per;
+                mask = m;
+                memcpy(value, tryValue, groups * sizeof(uint32_t));
+                for (uint32_t g = groups; g < filters; g++) {
+                    value[g] = tryValue[0];                             // spare filters repeat a group
+                }
+            }
+            m = mcpPlanNextMask(m);
+        } while (m != 0);
+    }
+    return best;
+}
+
+/* 1 if mask and filter let the standard id in */
+inline int mcpPlanLetsIn(uint32_t mask, uint32_t filter, uint32_t id)
+{
+    return ((id ^ filter) & mask) == 0;
+}
+
+/** Masks and filters letting in the wanted standard ids and as few others as the MCP2515 allows
+ *
+ *  @param ids The wanted CAN ids, 0 to 0x7FF; repeats are allowed
+ *  @param n How many, at least 1 and at most SEEED_CAN_PLAN_IDS distinct ids
+ *  @param plan The masks and filters for SEEED_CAN::configure(), the ids wanted and let in
+ *
+ *  @returns
+ *     1 if a plan was made
+ *  @n 0 if there are no ids, too many, or an extended one
+ */
+inline uint8_t mcpPlanAcceptance(const uint32_t *ids, uint32_t n, CANacceptancePlan &plan)
+{
+    uint32_t wanted[SEEED_CAN_PLAN_IDS], rest[SEEED_CAN_PLAN_IDS];
+    uint32_t value[SEEED_CAN_PLAN_IDS], count[SEEED_CAN_PLAN_IDS];
+    uint32_t restValue[2], bestValue[6] = { 0 }, bestMask[2] = { 0, 0 };
+    uint32_t w = 0, best = MCP_STD_IDS + 1;
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (ids[i] >= MCP_STD_IDS) {
+            return 0;
+        }
+        uint32_t j = 0;
+        while (j < w && wanted[j] != ids[i]) {
+            j++;
+        }
+        if (j == w) {
+            if (w == SEEED_CAN_PLAN_IDS) {
+                return 0;
+            }
+            wanted[w++] = ids[i];
+        }
+    }
+    if (w == 0) {
+        return 0;
+    }
+
+    for (int bits = MCP_STD_ID_BITS; bits >= 0; bits--) {
+        uint32_t per = 1UL << (MCP_STD_ID_BITS - bits);
+        if (per >= best) {
+            break;
+        }
+        uint32_t m1 = (1UL << bits) - 1;
+        do {
+            // Filters 2-5: the four groups holding the most wanted ids
+            uint32_t groups = mcpPlanGroups(wanted, w, m1, SEEED_CAN_PLAN_IDS, value, count);
+            uint32_t taken = (groups < 4) ? groups : 4;
+            for (uint32_t t = 0; t < taken; t++) {
+                uint32_t most = t;
+                for (uint32_t g = t + 1; g < groups; g++) {
+                    if (count[g] > count[most]) {
+                        most = g;
+                    }
+                }
+                uint32_t v = value[t], c = count[t];
+                value[t] = value[most];
+                count[t] = count[most];
+                value[most] = v;
+                count[most] = c;
+            }
+            uint32_t cost = taken * per;
+            if (cost < best) {
+                // Mask 0 and Filters 0-1: the ids in none of those groups
+                uint32_t r = 0, m0 = MCP_STD_IDS - 1;
+                for (uint32_t i = 0; i < w; i++) {
+                    uint32_t t = 0;
+                    while (t < taken && value[t] != (wanted[i] & m1)) {
+                        t++;
+                    }
+                    if (t == taken) {
+                        rest[r++] = wanted[i];
+                    }
+                }
+                if (r == 0) {
+                    restValue[0] = restValue[1] = value[0];             // an id Filters 2-5 let in already
+                } else {
+                    cost += mcpPlanMask(rest, r, 2, best - cost, m0, restValue);
+                }
+                if (cost < best) {
+                    best = cost;
+                    bestMask[0] = m0;
+                    bestMask[1] = m1;
+                    bestValue[0] = restValue[0];
+                    bestValue[1] = restValue[1];
+                    for (uint32_t t = 0; t < 4; t++) {
+                        bestValue[2 + t] = value[(t < taken) ? t : 0];
+                    }
+                }
+            }
+            m1 = mcpPlanNextMask(m1);
+        } while (m1 != 0);
+    }
+
+    for (uint32_t i = 0; i < 2; i++) {
+        plan.acceptance.maskId[i] = bestMask[i];
+        plan.acceptance.maskExt[i] = 0;
+    }
+    for (uint32_t i = 0; i < 6; i++) {
+        plan.acceptance.filterId[i] = bestValue[i];
+        plan.acceptance.filterExt[i] = 0;
+    }
+    plan.wanted = w;
+    plan.accepted = 0;
+    for (uint32_t id = 0; id < MCP_STD_IDS; id++) {
+        for (uint32_t f = 0; f < 6; f++) {
+            if (mcpPlanLetsIn(bestMask[(f < 2) ? 0 : 1], bestValue[f], id)) {
+                plan.accepted++;
+                break;
+            }
+        }
+    }
+    return 1;
+}
+
+/** The share of the standard ids not wanted that the plan still lets in, 0 to 1
+ */
+inline float mcpFalseAcceptRate(const CANacceptancePlan &plan)
+{
+    return (plan.wanted >= MCP_STD_IDS) ? 0.0f
+         : (float)(plan.accepted - plan.wanted) / (float)(MCP_STD_IDS - plan.wanted);
+}
+
+#endif      // _SEEED_CAN_ACCEPTANCE_H_
@@ -16,21 +16,44 @@
  
 #include "seeed_can_api.h"
  
+/* CANCTRL REQOP for each CANMode (Reset: the configuration mode the reset leaves the MCP2515 in)
+ */
+static const uint8_t mcpModes[] = { MODE_NORMAL,
+                                    MODE_SLEEP,
+                                    MODE_LOOPBACK,
+                                    MODE_LISTENONLY,
+                                    MODE_CONFIG,
+                                    MODE_CONFIG
+                                  };
+ 
 /** Initialise the MCP2515 and set the bit rate
  */
 uint8_t mcpInit(mcp_can_t *obj, const uint32_t bitRate, const CANMode mode)
+{
+    const CANbitTiming timing = mcpSolveBitTiming(MCP_CLOCK_FREQ, bitRate);
+    return mcpInitTiming(obj, &timing, mode);
+}
+ 
+/** Initialise the MCP2515 with the bit timing of seeed_can_timing.h
+ *
+ * A timing the solver could not find is refused before the MCP2515 is touched. The reset leaves
+ * the MCP2515 in configuration mode, so CNF1-3 go in one burst without a mode change.
+ */
+uint8_t mcpInitTiming(mcp_can_t *obj, const CANbitTiming *timing, const CANMode mode)
 {
     union {                                                             // Access CANMsg as:
         CANMsg x;                                                       // the organised struct
-        uint8_t y[];                                                    // or contiguous memory array
+        uint8_t y[sizeof(CANMsg)];                                      // or contiguous memory array
     };
     uint8_t maskFilt[8] = { MCP_RXM0SIDH, MCP_RXM1SIDH, MCP_RXF0SIDH, MCP_RXF1SIDH, MCP_RXF2SIDH, MCP_RXF3SIDH, MCP_RXF4SIDH, MCP_RXF5SIDH };
     uint8_t canBufCtrl[5] = { MCP_TXB0CTRL, MCP_TXB1CTRL, MCP_TXB2CTRL, MCP_RXB0CTRL, MCP_RXB1CTRL };
     uint8_t canBuffer[3] = { MCP_TXB0CTRL+1, MCP_TXB1CTRL+1, MCP_TXB2CTRL+1 };
  
-#ifdef DEBUG
-    printf("Reseting MCP2515\r\n");
-#endif
+    if (!mcpBitTimingValid(*timing)) {
+        MCP_ERROR(MCP_EVENT_NO_TIMING);
+        return 0;                                                       // Cannot set the requested bit rate!
+    }
+    MCP_INFO(MCP_EVENT_RESET);
     mcpReset(obj);
     for (uint32_t i = 0; i < 8; i++) {                                  // Clear all CAN id masks and filters
         mcpWriteId(obj, maskFilt[i], NULL, NULL);
@@ -45,140 +68,71 @@ uint8_t mcpInit(mcp_can_t *obj, const uint32_t bitRate, const CANMode mode)
     // enable both receive-buffers, using filters to receive messages with std. and ext. identifiers that meet the filter criteria and enable rollover from RXB0 to RXB1 if RXB0 is full
     mcpBitModify(obj, MCP_RXB0CTRL, MCP_RXB_RX_MASK | MCP_RXB_BUKT_MASK, MCP_RXB_RX_STDEXT | MCP_RXB_BUKT_MASK );
     mcpBitModify(obj, MCP_RXB1CTRL, MCP_RXB_RX_MASK, MCP_RXB_RX_STDEXT);
-#ifdef DEBUG
-    printf("Setting bit rate\r\n");
-#endif
-    if (!mcpSetBitRate(obj, bitRate)) {                                 // set baudrate
-        return 0;
-    }
-//    return mcpSetMode(obj, MODE_NORMAL) ? 1 : 0;                        // set Normal mode and return
-    return mcpSetMode(obj, mode) ? 1 : 0;                        // set Normal mode and return
+    mcpWriteMultiple(obj, MCP_CNF3, timing->cnf, sizeof(timing->cnf));  // set baudrate: CNF3, CNF2, CNF1
+    return mcpSetMode(obj, mcpModes[mode]) ? 1 : 0;                     // set the requested mode and return
 }
  
 /**  set MCP2515 operation mode
  *
  * Configuration, Normal, Sleep, Listen-only or Loopback
+ * Nothing is sent when the MCP2515 was last seen in that mode and no other has been asked for since
+ * (obj->opMode). Sleep is never taken as known: bus activity wakes the MCP2515 into Listen-only mode.
  */
 uint8_t mcpSetMode(mcp_can_t *obj, const uint8_t newmode)
 {
+    if (obj->opMode == newmode) {
+        return 1;
+    }
     mcpBitModify(obj, MCP_CANCTRL, MODE_MASK, newmode);
     for (uint32_t i = 0; i<10; i++) {
         if ((mcpRead(obj, MCP_CANSTAT) & MODE_MASK) == newmode) {
-#ifdef DEBUG
-            printf("Successfully entered mode: %02x time: %dms\r\n", newmode, i);
-            printf("CANCTRL:%02x CANSTAT:%02x TXB0:%02x TXB1:%02x TXB2:%02x\r\n", mcpRead(obj, MCP_CANCTRL),  mcpRead(obj, MCP_CANSTAT), mcpRead(obj, MCP_TXB0CTRL), mcpRead(obj, MCP_TXB1CTRL), mcpRead(obj, MCP_TXB2CTRL));
-#endif
+            obj->opMode = (newmode == MODE_SLEEP) ? MCP_MODE_UNKNOWN : newmode;
+            MCP_INFO(MCP_EVENT_MODE, newmode, i);
             return 1;
         }
         wait_ms(1);
     }
-#ifdef DEBUG
-    printf("Failed to enter mode: %02x\r\n", newmode);
-    printf("CANCTRL:%02x CANSTAT:%02x TXB0:%02x TXB1:%02x TXB2:%02x\r\n", mcpRead(obj, MCP_CANCTRL),  mcpRead(obj, MCP_CANSTAT), mcpRead(obj, MCP_TXB0CTRL), mcpRead(obj, MCP_TXB1CTRL), mcpRead(obj, MCP_TXB2CTRL));
-#endif
+    MCP_ERROR(MCP_EVENT_MODE_FAILED, newmode, mcpRead(obj, MCP_CANCTRL), mcpRead(obj, MCP_CANSTAT),
+              mcpRead(obj, MCP_TXB0CTRL), mcpRead(obj, MCP_TXB1CTRL), mcpRead(obj, MCP_TXB2CTRL));
     return 0;
 }
  
 /** set the CAN bus bitrate
  *
- * Calculate suitable BTR register values.
- * The Bit Rate Pre-scaler (BRP) can be in the range of 1-64.
- * According to CANopen, Bit Time can be be between 25 and 8 Time Quanta (TQU).
- * Bit Time = SyncSeg(1 TQU) + PropSeg(1-8 TQU) + PhaseSeg1(1-8 TQU) + PhaseSeg2(2-8 TQU).
- * SyncSeg is always 1TQU, PhaseSeg2 must be at least 2TQU to be longer than the processing time.
- * Opinions vary on when to take a sample but a point roughly 2/3 of Bit Time seems OK.
- * Synchronisation Jump width can be 1-4 TQU, a value of 1 seems to be normal.
- *
- * All register values are -1, e.g. PropSeg can range from 1-8 TQU, so values are 0-7 (0-63 for BRP).
- *
- * This table has the sampling points as close to 2/3 (66.7%) as possible.
- * The first value is PropSeg, 2nd PhaseSeg1.
- * PhaseSeg2 will be the same as PhaseSeg1 when btlmode bit is initialised to 0.
+ * The bit timing comes from mcpSolveBitTiming() (seeed_can_timing.h) for the MCP_CLOCK_FREQ
+ * oscillator, CAN_SAMPLE_POINT and CAN_SJW. Rates it cannot reach are refused (0).
  */
-static const uint8_t timing_pts[18][2] = {
-    {0x0, 0x2},    // 8,  62.5%
-    {0x1, 0x2},    // 9,  66.7%
-    {0x2, 0x2},    // 10, 70.0%
-    {0x1, 0x3},    // 11, 63.6%
-    {0x2, 0x3},    // 12, 66.7%
-    {0x3, 0x3},    // 13, 69.2%
-    {0x2, 0x4},    // 14, 64.3%
-    {0x3, 0x4},    // 15, 66.7%
-    {0x4, 0x4},    // 16, 68.75%
-    {0x3, 0x5},    // 17, 64.7%
-    {0x4, 0x5},    // 18, 66.7%
-    {0x5, 0x5},    // 19, 63.2%
-    {0x4, 0x6},    // 20, 65.0%
-    {0x5, 0x6},    // 21, 66.7%
-    {0x6, 0x6},    // 22, 68.2%
-    {0x5, 0x7},    // 23, 65.2
-    {0x6, 0x7},    // 24, 66.7%
-    {0x7, 0x7},    // 25, 68.0%
-};
- 
 uint8_t mcpSetBitRate(mcp_can_t *obj, const uint32_t bitRate)
 {
-    union {                                                             // Access CANtiming as:
-        CANtiming x;                                                    // the organised struct
-        uint8_t y[];                                                    // or contiguous memory array
-    };
-    uint32_t bestBRP = 0;
-    uint32_t bestTQU = 0;
-    uint32_t bestCanRate = 0;
-    uint32_t minBRP = (MCP_CLOCK_FREQ / (2 * MCP_MAX_TIME_QUANTA * bitRate));
-    uint32_t maxBRP = (MCP_CLOCK_FREQ / (2 * MCP_MIN_TIME_QUANTA * bitRate));
- 
-#ifdef DEBUG
-    printf("Setting configuration mode\r\n");
-#endif
-    uint8_t initialMode = mcpRead(obj, MCP_CANCTRL) & MODE_MASK;        // Store the current operation mode
-    if(!mcpSetMode(obj, MODE_CONFIG)) {                             // Go into configuration mode
-        return 0;
-    }
+    const CANbitTiming timing = mcpSolveBitTiming(MCP_CLOCK_FREQ, bitRate);
+    return mcpSetBitTiming(obj, &timing);
+}
  
-    for (uint32_t i = 0; i < sizeof(x); i++) y[i] = NULL;               // Initialise CANtiming (btlmode, sjw and sam all = 0)
-    if ((bitRate < CAN_MIN_RATE) || (bitRate > CAN_MAX_RATE)) {
-#ifdef DEBUG
-        printf("FAILED!! The requested Bit Rate is too high or too low: %d\r\n", bitRate);
-#endif
+/** write CNF1-3 in one burst
+ *
+ * CNF1-3 can only be written in configuration mode: the current mode is restored afterwards.
+ */
+uint8_t mcpSetBitTiming(mcp_can_t *obj, const CANbitTiming *timing)
+{
+    if (!mcpBitTimingValid(*timing)) {
+        MCP_ERROR(MCP_EVENT_NO_TIMING);
         return 0;                                                       // Cannot set the requested bit rate!
     }
-    minBRP = (minBRP == 0) ? MCP_MIN_PRESCALER : minBRP;
-    maxBRP = (maxBRP > MCP_MAX_PRESCALER) ? MCP_MAX_PRESCALER : maxBRP;
-    for (uint32_t BRP = minBRP; BRP < (maxBRP + 1); BRP++) {
-        uint32_t timeQuanta = (MCP_CLOCK_FREQ / (2 * BRP * bitRate));
-        if ((timeQuanta >= MCP_MIN_TIME_QUANTA) && (timeQuanta <= MCP_MAX_TIME_QUANTA)) {
-            for (uint32_t TQU = timeQuanta; TQU <= MCP_MAX_TIME_QUANTA; TQU++) {
-                uint32_t thisCanRate = MCP_CLOCK_FREQ / (2 * BRP * TQU);
-                if ( abs((int)bitRate - (int)thisCanRate) < abs((int)bitRate - (int)bestCanRate)) {
-                    bestCanRate = thisCanRate;
-                    bestBRP= BRP;
-                    bestTQU= TQU;
-                }
-            }
-        }
+    uint8_t initialMode = mcpRead(obj, MCP_CANCTRL) & MODE_MASK;        // Store the current operation mode
+    if(!mcpSetMode(obj, MODE_CONFIG)) {                                 // Go into configuration mode
+        return 0;
     }
-    x.brp = (bestBRP - 1);
-    x.prseg = (timing_pts[bestTQU - 8][0]);
-    x.phseg1 = (timing_pts[bestTQU - 8][1]);
-    mcpWriteMultiple(obj,  MCP_CNF3, y, sizeof(x) );                    // Copy CANtiming to the MCP2515 (as an array)
-#ifdef DEBUG
-    printf("minBRP %d maxBRP %d\r\n", minBRP, maxBRP);
-    printf("Bitrate: %d\tactualBitRate: %d\t Error: %1.2f percent.\r\n", bitRate, bestCanRate, (100-(100*(float)bitRate/(float)bestCanRate)));
-    printf("TimeQuanta: %d\tbitRatePrescaler: %d\tSamplePoint: %2.2f percent\r\n", bestTQU, bestBRP, 100*(float)(3 + x.prseg + x.phseg1)/(float)bestTQU ) ;
-    printf("Syncseg: 1\tPropSeg: %d\tPhaseSeg1: %d\tPhaseSeg2: %d\r\n", (x.prseg+1), (x.phseg1+1), (x.phseg1+1));
-    printf("Setting normal mode\r\n");
-#endif
-    return (mcpSetMode(obj, initialMode)) ? 1 : 0;                      // desired bit rate set enter normal mode and return
+    mcpWriteMultiple(obj, MCP_CNF3, timing->cnf, sizeof(timing->cnf));  // CNF3, CNF2, CNF1
+    return (mcpSetMode(obj, initialMode)) ? 1 : 0;                      // restore the operation mode and return
 }
  
-/** write a CAN id to a mask, filter or transmit buffer
+/** lay a CAN id out as the SIDH, SIDL, EID8 and EID0 registers of a mask, filter or transmit buffer
  */
-void mcpWriteId(mcp_can_t *obj, const uint8_t mcp_addr, const uint8_t ext, const uint32_t id )
+static void mcpPackId(uint8_t image[], const uint8_t ext, const uint32_t id)
 {
     union {                                                             // Access CANid as:
         CANid x;                                                        // the organised struct
-        uint8_t y[];                                                    // or contiguous memory array
+        uint8_t y[sizeof(CANid)];                                       // or contiguous memory array
     };
  
     for (uint32_t i = 0; i < sizeof(x); i++) y[i] = NULL;               // Initialise CANid structure
@@ -193,116 +147,222 @@ void mcpWriteId(mcp_can_t *obj, const uint8_t mcp_addr, const uint8_t ext, const
         x.sid10_3  = (uint8_t) (id >> 3);                               // SID10..3
         x.sid2_0   = (uint8_t) (id & 0x07);                             // SID2..0
     }
-#ifdef DEBUG
-    printf("sizeof CanIdStruct: %d bytes\r\n", sizeof(x));
-    printf("sid10_3: %x\r\n", x.sid10_3);
-    printf("eid17_16: %x\r\n", x.eid17_16);
-    printf("ide: %x\r\n", x.ide);
-    printf("srtr: %x\r\n", x.srtr);
-    printf("sid2_0: %x\r\n", x.sid2_0);
-    printf("eid15_8: %x\r\n", x.eid15_8);
-    printf("eid7_0: %x\r\n", x.eid7_0);
-#endif
-    mcpWriteMultiple(obj,  mcp_addr, y, sizeof(x) );                     // Copy CANid to the MCP2515 (as an array)
+    memcpy(image, y, sizeof(y));
 }
  
-/**  write a CAN message to the MCP2515
+/** write a CAN id to a mask, filter or transmit buffer
  */
-uint8_t mcpCanWrite(mcp_can_t *obj, CAN_Message msg)
+void mcpWriteId(mcp_can_t *obj, const uint8_t mcp_addr, const uint8_t ext, const uint32_t id )
+{
+    uint8_t image[sizeof(CANid)];
+ 
+    mcpPackId(image, ext, id);
+    MCP_DEBUG(MCP_EVENT_WRITE_ID, id, ext, mcp_addr);
+    mcpWriteMultiple(obj,  mcp_addr, image, sizeof(image) );            // Copy CANid to the MCP2515 (as an array)
+}
+ 
+/**  load a CAN message into TX buffer 'num' at TXP 'txp' and request its transmission
+ *
+ * Only the id, the DLC and the data bytes in use are sent. The id and DLC last loaded into each TX
+ * buffer are remembered (obj->txHeader), and when they have not changed only the data bytes are
+ * loaded, with the 'load TX buffer starting at D0' instruction. TXP is only written when it changes.
+ */
+static void mcpCanLoad(mcp_can_t *obj, const uint32_t num, const uint8_t txp, const CAN_Message *msg)
 {
     union {                                                             // Access CANMsg as:
         CANMsg x;                                                       // the organised struct
-        uint8_t y[];                                                    // or contiguous memory array
+        uint8_t y[sizeof(CANMsg)];                                      // or contiguous memory array
     };
+    const uint32_t headerSize = sizeof(x) - sizeof(x.data);             // id and DLC bytes
     uint8_t bufferCommand[] = {MCP_WRITE_TX0, MCP_WRITE_TX1, MCP_WRITE_TX2};
+    uint8_t dataCommand[] = {MCP_WRITE_TX0_D0, MCP_WRITE_TX1_D0, MCP_WRITE_TX2_D0};
     uint8_t rtsCommand[] = {MCP_RTS_TX0, MCP_RTS_TX1, MCP_RTS_TX2};
-    uint8_t status = mcpStatus(obj);
-    uint32_t num = 0;
-// Check if there is a free message buffer
-    if (!(status & MCP_STAT_TX0REQ)) {                                  // TX Message Buffer 0 free?
-        num = 0;
-    } else if (!(status & MCP_STAT_TX1REQ)) {                           // TX Message Buffer 1 free?
-        num = 1;
-    } else if (!(status & MCP_STAT_TX2REQ)) {                           // TX Message Buffer 2 free?
-        num = 2;
-    } else {
-        return 0;                                                       // No free transmit buffers in the MCP2515 CAN controller chip
+    uint8_t ctrlAddress[] = {MCP_TXB0CTRL, MCP_TXB1CTRL, MCP_TXB2CTRL};
+    if (obj->txPriority[num] != txp) {
+        mcpBitModify(obj, ctrlAddress[num], MCP_TXB_TXP10_M, txp);      // TXP of TX buffer 'num'
+        obj->txPriority[num] = txp;
     }
 // populate CANMsg structure
-    for (uint32_t i = 0; i < sizeof(x); i++) y[i] = NULL;               // Initialise CANMsg structure
-    x.id.ide = msg.format;                                              // Extended Identifier Flag
+    for (uint32_t i = 0; i < headerSize; i++) y[i] = 0;                 // Initialise the id and DLC of CANMsg
+    x.id.ide = msg->format;                                             // Extended Identifier Flag
     if (x.id.ide == CANExtended) {
-        x.id.sid10_3  = (uint8_t) (msg.id >> 21);                       // SID10..3
-        x.id.sid2_0   = (uint8_t) (msg.id >> 18) & 0x07;                // SID2..0
-        x.id.eid17_16 = (uint8_t) (msg.id >> 16) & 0x03;                // EID17..16
-        x.id.eid15_8  = (uint8_t) (msg.id >> 8);                        // EID15..8
-        x.id.eid7_0   = (uint8_t) msg.id;                               // EID7..0
+        x.id.sid10_3  = (uint8_t) (msg->id >> 21);                      // SID10..3
+        x.id.sid2_0   = (uint8_t) (msg->id >> 18) & 0x07;               // SID2..0
+        x.id.eid17_16 = (uint8_t) (msg->id >> 16) & 0x03;               // EID17..16
+        x.id.eid15_8  = (uint8_t) (msg->id >> 8);                       // EID15..8
+        x.id.eid7_0   = (uint8_t) msg->id;                              // EID7..0
     } else {
-        x.id.sid10_3  = (uint8_t) (msg.id >> 3);                        // SID10..3
-        x.id.sid2_0   = (uint8_t) (msg.id & 0x07);                      // SID2..0
+        x.id.sid10_3  = (uint8_t) (msg->id >> 3);                       // SID10..3
+        x.id.sid2_0   = (uint8_t) (msg->id & 0x07);                     // SID2..0
     }
-    x.dlc = msg.len & 0x0f;                                             // Number of bytes in can message
-    x.ertr = msg.type;                                                  // Data or remote message
-    memcpy(x.data,msg.data,x.dlc);                                      // Get the Data bytes
+    x.dlc = msg->len & 0x0f;                                            // Number of bytes in can message
+    x.ertr = msg->type;                                                 // Data or remote message
+    uint8_t dataBytes = (msg->type == CANRemote) ? 0 : ((x.dlc > 8) ? 8 : x.dlc);   // A remote frame has no data
+    memcpy(x.data,msg->data,dataBytes);                                 // Get the Data bytes
 // write CANmsg to the specified TX buffer 'num'
-    mcpWriteBuffer(obj, bufferCommand[num], y, sizeof(x));              // Write the message ,CANMsg, to the MCP2515's Tx buffer 'num' (as an array)
-    mcpBufferRTS(obj, rtsCommand[num]);
+// the SPI transfer and the RTS that follows it finish in the background where the target can do that
+    if ((obj->txHeaderValid & (1 << num)) && !memcmp(obj->txHeader[num], y, headerSize)) {
+        mcpWriteBufferAsync(obj, dataCommand[num], x.data, dataBytes, rtsCommand[num]); // Same id and DLC as last time: the data bytes only
+    } else {
+        mcpWriteBufferAsync(obj, bufferCommand[num], y, headerSize + dataBytes, rtsCommand[num]); // Write the id, DLC and data of CANMsg to the MCP2515's Tx buffer 'num' (as an array)
+        memcpy(obj->txHeader[num], y, headerSize);
+        obj->txHeaderValid |= (1 << num);
+    }
+}
+ 
+/**  write a CAN message to the MCP2515
+ *
+ * The MCP2515 sends the pending buffer with the highest TXP first, the highest numbered one of equal
+ * TXP. To keep messages in the order they were written, each one is loaded at a TXP and buffer that
+ * comes after every message still pending (obj->txSlot counts down through the 12 combinations and
+ * starts again at the top when nothing is pending). When no free buffer comes late enough, 0 is
+ * returned as if all three were busy.
+ */
+uint8_t mcpCanWrite(mcp_can_t *obj, CAN_Message msg)
+{
+    uint8_t pendingFlag[] = {MCP_STAT_TX0REQ, MCP_STAT_TX1REQ, MCP_STAT_TX2REQ};
+    uint8_t status = mcpStatus(obj);
+    uint32_t num = 0;
+    uint8_t slot = obj->txSlot;
+// Check if there is a free message buffer that will be sent after the pending ones
+    if (!(status & (MCP_STAT_TX0REQ | MCP_STAT_TX1REQ | MCP_STAT_TX2REQ))) {
+        slot = MCP_TX_SLOTS;                                            // Nothing pending: start again from the top
+    }
+    do {
+        if (slot == 0) {
+            return 0;                                                   // No free transmit buffer comes late enough in the MCP2515 CAN controller chip
+        }
+        slot--;
+        num = slot % 3;
+    } while (status & pendingFlag[num]);
+    obj->txSlot = slot;
+    mcpCanLoad(obj, num, slot / 3, &msg);
     return 1;                                                           // Indicate that message has been transmitted
 }
  
+/**  write a CAN message to the MCP2515 at TXP level 'txp' (0 lowest - 3 highest), in one of the TX buffers in 'buffers' (bit n for TXBn)
+ *
+ * A message of a higher TXP goes before every pending message of a lower one. Among equal TXP the
+ * MCP2515 sends the highest numbered buffer first, so to stay behind the pending messages of its own
+ * level the message goes into a free buffer numbered below all of them (the highest such one, leaving
+ * the lower ones for the next). Not to be mixed with mcpCanWrite(), which uses TXP for the order.
+ *
+ *  @returns
+ *     the number of the TX buffer + 1
+ *  @n 0 if no free buffer comes late enough
+ */
+uint8_t mcpCanWritePriority(mcp_can_t *obj, CAN_Message msg, const uint8_t txp, const uint8_t buffers)
+{
+    uint8_t pendingFlag[] = {MCP_STAT_TX0REQ, MCP_STAT_TX1REQ, MCP_STAT_TX2REQ};
+    uint8_t status = mcpStatus(obj);
+    uint32_t limit = 3;                                                 // the lowest buffer pending at this TXP
+    for (uint32_t num = 0; num < 3; num++) {
+        if ((status & pendingFlag[num]) && (obj->txPriority[num] == txp)) {
+            limit = num;
+            break;
+        }
+    }
+    for (uint32_t num = limit; num-- > 0; ) {
+        if ((buffers & (1 << num)) && !(status & pendingFlag[num])) {
+            mcpCanLoad(obj, num, txp, &msg);
+            return num + 1;
+        }
+    }
+    return 0;
+}
+ 
+/**  abort the message pending in TX buffer 'num'
+ *  A message already on the bus goes on to the end: wait for that (up to MCP_ABORT_POLLS reads of TXBnCTRL).
+ *
+ *  @returns
+ *     1 if the message was aborted and has not been sent (TX buffer free)
+ *  @n 0 if it was sent, or is still on the bus after all
+ */
+uint8_t mcpCanAbort(mcp_can_t *obj, const uint8_t num)
+{
+    uint8_t ctrlAddress[] = {MCP_TXB0CTRL, MCP_TXB1CTRL, MCP_TXB2CTRL};
+    mcpBitModify(obj, ctrlAddress[num], MCP_TXB_TXREQ_M, 0);
+    for (uint32_t i = 0; i < MCP_ABORT_POLLS; i++) {
+        uint8_t ctrl = mcpRead(obj, ctrlAddress[num]);
+        if (!(ctrl & MCP_TXB_TXREQ_M)) {
+            return (ctrl & MCP_TXB_ABTF_M) ? 1 : 0;
+        }
+    }
+    return 0;
+}
+ 
+/** unpack a CANMsg read from one of the MCP2515's receive buffers
+ *  (the IDE and RTR bits are taken from the buffer itself, RX STATUS only describes one of the two buffers)
+ */
+static void mcpCanUnpack(const CANMsg *x, CAN_Message *msg)
+{
+    msg->format = x->id.ide ? CANExtended : CANStandard;                // Extended CAN id Flag
+    if (msg->format == CANExtended) {                                   // Assemble the Extended CAN id
+        msg->id = (x->id.sid10_3 << 21)  |
+                  (x->id.sid2_0 << 18)   |
+                  (x->id.eid17_16 << 16) |
+                  (x->id.eid15_8 << 8)   |
+                  (x->id.eid7_0);
+        msg->type = x->ertr ? CANRemote : CANData;                      // RTR is in RXBnDLC for extended frames
+    } else {                                                            // Assemble the Standard CAN id
+        msg->id = (x->id.sid10_3 << 3)   |
+                  (x->id.sid2_0);
+        msg->type = x->id.srtr ? CANRemote : CANData;                   // and in RXBnSIDL (SRR) for standard frames
+    }
+    msg->len    = x->dlc;                                               // Number of bytes in CAN message
+    memcpy(msg->data, x->data, (x->dlc > 8) ? 8 : x->dlc);              // Get the Data bytes (a DLC of 9-15 means 8)
+    MCP_DEBUG(MCP_EVENT_RX_FRAME, msg->id, msg->format, msg->type,
+              (x->data[0] << 24) | (x->data[1] << 16) | (x->data[2] << 8) | x->data[3],
+              (x->data[4] << 24) | (x->data[5] << 16) | (x->data[6] << 8) | x->data[7]);
+}
+ 
 /** read a CAN message from the MCP2515
  */
 uint8_t mcpCanRead(mcp_can_t *obj, CAN_Message *msg)
+{
+    return mcpCanReadAll(obj, msg, 1);
+}
+ 
+/**  read every CAN bus message waiting in the MCP2515's receive buffers, up to 'n', oldest first
+ *  RX STATUS is read once, then each full buffer with READ RX BUFFER, which frees the buffer and clears its
+ *  RXnIF when chip select goes high, so the INT pin is released by the time this returns. RX STATUS is only
+ *  read again if the INT pin is still low after that (a frame came in meanwhile, or another interrupt).
+ *  If it returns 'n' there may be more: an INT handler should call it again, or the INT pin stays low and
+ *  there is no falling edge for the next frame.
+ */
+uint8_t mcpCanReadAll(mcp_can_t *obj, CAN_Message msg[], const uint8_t n)
 {
     union {                                                             // Access CANMsg as:
         CANMsg x;                                                       // the organised struct
-        uint8_t y[];                                                    // or contiguous memory array
+        uint8_t y[sizeof(CANMsg)];                                      // or contiguous memory array
     };
-    uint8_t bufferCommand[] = {MCP_READ_RX0, MCP_READ_RX1};
     uint8_t status = mcpReceiveStatus(obj);
-    bool num = 0;
-// Check if there is a message the buffers
-    if (status & MCP_RXSTAT_RXB0) {                                     // Msg in Buffer 0?
-        num = 0;
-    } else if (status & MCP_RXSTAT_RXB1) {                              // Msg in Buffer 1?
-        num = 1;
-    } else {
-        return 0;                                                       // No messages waiting
-    }
-    mcpReadBuffer(obj, bufferCommand[0], y, sizeof(x));                 // Read the message into CANMsg (as an array)
-    mcpBitModify(obj, MCP_CANINTF, (!num ? MCP_RX0IF : MCP_RX1IF), 0);  // Free the message buffer
-#ifdef DEBUG
-    printf("sizeof CanMsgStruct: %d bytes\r\n", sizeof(x));
-    printf("sizeof CanMsgArray: %d bytes\r\n", sizeof(y));
-    printf("sid10_3: %x\r\n", x.id.sid10_3);
-    printf("eid17_16: %x\r\n", x.id.eid17_16);
-    printf("ide: %x\r\n", x.id.ide);
-    printf("srtr: %x\r\n", x.id.srtr);
-    printf("sid2_0: %x\r\n", x.id.sid2_0);
-    printf("eid15_8: %x\r\n", x.id.eid15_8);
-    printf("eid7_0: %x\r\n", x.id.eid7_0);
-    printf("dlc: %x\r\n", x.dlc);
-    printf("ertr: %x\r\n", x.ertr);
-    printf("data: ");
-    for (char i=0; i<8; i++)
-        printf("%02x,", x.data[i]);
-    printf("\r\n");
-#endif
-    msg->format = (status & MCP_RXSTAT_IDE) ? CANExtended : CANStandard;// Extended CAN id Flag
-    if (msg->format == CANExtended) {                                   // Assemble the Extended CAN id
-        msg->id = (x.id.sid10_3 << 21)  |
-                  (x.id.sid2_0 << 18)   |
-                  (x.id.eid17_16 << 16) |
-                  (x.id.eid15_8 << 8)   |
-                  (x.id.eid7_0);
-    } else {                                                            // Assemble the Standard CAN id
-        msg->id = (x.id.sid10_3 << 3)   |
-                  (x.id.sid2_0);
+    uint8_t count = 0;
+    uint8_t last = 1;                                                   // buffer read last
+    bool olderInRxb1 = false;                                           // RXB1 filled while RXB0 was being read
+ 
+    while (count < n) {
+        if ((status & MCP_RXSTAT_RXB1) && (olderInRxb1 || !(status & MCP_RXSTAT_RXB0))) {
+            mcpReadBuffer(obj, MCP_READ_RX1, y, sizeof(x));             // Read the message into CANMsg (as an array), freeing RXB1
+            status &= ~MCP_RXSTAT_RXB1;
+            last = 1;
+        } else if (status & MCP_RXSTAT_RXB0) {                          // Msg in Buffer 0? (older than RXB1's after a rollover)
+            mcpReadBuffer(obj, MCP_READ_RX0, y, sizeof(x));             // Read the message into CANMsg (as an array), freeing RXB0
+            status &= ~MCP_RXSTAT_RXB0;
+            last = 0;
+        } else if (count && !obj->irq.read()) {                         // INT still asserted: look again
+            status = mcpReceiveStatus(obj);
+            if (!(status & MCP_RXSTAT_BOTH)) {
+                break;                                                  // not for a received message
+            }
+            olderInRxb1 = (last == 0);                                  // RXB1 then rolled over while RXB0 was full
+            continue;
+        } else {
+            break;                                                      // No (more) messages waiting
+        }
+        mcpCanUnpack(&x, &msg[count++]);
     }
-    msg->len    = x.dlc;                                                // Number of bytes in CAN message
-    msg->type = (status & MCP_RXSTAT_RTR) ? CANRemote : CANData;        // Determine if a Remote or Data message type
-    memcpy(msg->data,x.data,x.dlc);                                     // Get the Data bytes
-    return 1;                                                           // Indicate that message has been retrieved
+    return count;                                                       // Number of messages retrieved
 }
  
 /** initialise an Acceptance Mask
@@ -312,14 +372,9 @@ uint8_t mcpInitMask(mcp_can_t *obj, uint8_t num, uint32_t ulData, bool ext)
     uint8_t mask[2] = { MCP_RXM0SIDH, MCP_RXM1SIDH };
  
     if (num > 1) {
-#ifdef DEBUG
-        printf("Trying to set an invalid Mask number: %d\r\n", num);
-#endif
+        MCP_ERROR(MCP_EVENT_BAD_MASK, num);
         return 0;
     }
-#ifdef DEBUG
-    printf("Begin to set Mask!!\r\n");
-#endif
     uint8_t initialMode = mcpRead(obj, MCP_CANCTRL) & MODE_MASK;        // Store the current operation mode
     if(!mcpSetMode(obj, MODE_CONFIG)) {
         return 0;
@@ -328,9 +383,7 @@ uint8_t mcpInitMask(mcp_can_t *obj, uint8_t num, uint32_t ulData, bool ext)
     if(!mcpSetMode(obj, initialMode)) {
         return 0;
     }
-#ifdef DEBUG
-    printf("Successfully set Mask number: %d\r\n", num);
-#endif
+    MCP_INFO(MCP_EVENT_MASK, num, ulData, ext);
     return 1;
 }
  
@@ -341,14 +394,9 @@ uint8_t mcpInitFilter(mcp_can_t *obj, uint8_t num, uint32_t ulData, bool ext)
     uint8_t filter[6] = { MCP_RXF0SIDH, MCP_RXF1SIDH, MCP_RXF2SIDH, MCP_RXF3SIDH, MCP_RXF4SIDH, MCP_RXF5SIDH };
  
     if (num > 5) {
-#ifdef DEBUG
-        printf("Trying to set an invalid Filter number: %d\r\n", num);
-#endif
+        MCP_ERROR(MCP_EVENT_BAD_FILTER, num);
         return 0;
     }
-#ifdef DEBUG
-    printf("Begin to set Filter!!\r\n");
-#endif
     uint8_t initialMode = mcpRead(obj, MCP_CANCTRL) & MODE_MASK;        // Store the current operation mode
     if(!mcpSetMode(obj, MODE_CONFIG)) {
         return 0;
@@ -357,12 +405,63 @@ uint8_t mcpInitFilter(mcp_can_t *obj, uint8_t num, uint32_t ulData, bool ext)
     if(!mcpSetMode(obj, initialMode)) {
         return 0;
     }
-#ifdef DEBUG
-    printf("Successfully set Filter: %d\r\n", num);
-#endif
+    MCP_INFO(MCP_EVENT_FILTER, num, ulData, ext);
     return 1;
 }
  
+/** write every Acceptance Mask and Filter in one visit to configuration mode
+ *
+ * The filters and masks are three runs of registers (RXF0-2 from 0x00, RXF3-5 from 0x10, RXM0-1
+ * from 0x20) with BFPCTRL, TXRTSCTRL, CANSTAT, CANCTRL, TEC and REC in between, so they are written
+ * in three bursts. All of them are then read back in one burst (the registers in between are only
+ * read) and compared, leaving out the bits the MCP2515 does not implement, before the mode is
+ * restored. Returns 1 when every register holds what was written and the mode was restored.
+ */
+uint8_t mcpConfigure(mcp_can_t *obj, const CANacceptance *acceptance)
+{
+    const uint8_t filter[6] = { MCP_RXF0SIDH, MCP_RXF1SIDH, MCP_RXF2SIDH, MCP_RXF3SIDH, MCP_RXF4SIDH, MCP_RXF5SIDH };
+    const uint8_t mask[2] = { MCP_RXM0SIDH, MCP_RXM1SIDH };
+    uint8_t image[MCP_RXM1SIDH + sizeof(CANid) - MCP_RXF0SIDH];         // RXF0SIDH to RXM1EID0
+    uint8_t implemented[sizeof(image)];                                 // bits to compare on readback
+    uint8_t readback[sizeof(image)];
+ 
+    memset(image, 0, sizeof(image));
+    memset(implemented, 0, sizeof(implemented));
+    for (uint32_t i = 0; i < 6; i++) {
+        mcpPackId(&image[filter[i]], acceptance->filterExt[i], acceptance->filterId[i]);
+        memset(&implemented[filter[i]], 0xFF, sizeof(CANid));
+        implemented[filter[i] + 1] = MCP_RXF_SIDL_M;
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+        mcpPackId(&image[mask[i]], acceptance->maskExt[i], acceptance->maskId[i]);
+        memset(&implemented[mask[i]], 0xFF, sizeof(CANid));
+        implemented[mask[i] + 1] = MCP_RXM_SIDL_M;
+    }
+ 
+    uint8_t initialMode = mcpRead(obj, MCP_CANCTRL) & MODE_MASK;        // Store the current operation mode
+    if(!mcpSetMode(obj, MODE_CONFIG)) {
+        return 0;
+    }
+    mcpWriteMultiple(obj, MCP_RXF0SIDH, &image[MCP_RXF0SIDH], 3 * sizeof(CANid));
+    mcpWriteMultiple(obj, MCP_RXF3SIDH, &image[MCP_RXF3SIDH], 3 * sizeof(CANid));
+    mcpWriteMultiple(obj, MCP_RXM0SIDH, &image[MCP_RXM0SIDH], 2 * sizeof(CANid));
+    mcpReadMultiple(obj, MCP_RXF0SIDH, readback, sizeof(readback));
+    uint8_t verified = 1;
+    for (uint32_t r = 0; r < sizeof(image); r++) {
+        if ((readback[r] ^ image[r]) & implemented[r]) {
+            MCP_ERROR(MCP_EVENT_CONFIGURE_MISMATCH, r, readback[r], image[r]);
+            verified = 0;
+        }
+    }
+    if(!mcpSetMode(obj, initialMode)) {
+        return 0;
+    }
+    if (verified) {
+        MCP_INFO(MCP_EVENT_CONFIGURE);
+    }
+    return verified;
+}
+ 
 /*  Report on the specified errors and warnings
  */
 uint8_t mcpErrorType(mcp_can_t *obj, const CANFlags type)
@@ -415,18 +514,10 @@ void mcpMonitor(mcp_can_t *obj, const bool silent)
  */
 uint8_t mcpMode(mcp_can_t *obj, const CANMode mode)
 {
-    uint8_t which[] = { MODE_NORMAL,
-                        MODE_SLEEP,
-                        MODE_LOOPBACK,
-                        MODE_LISTENONLY,
-                        MODE_CONFIG,
-                        MODE_CONFIG
-                      };
- 
     if (mode == _M_RESET) {
         mcpReset(obj);
     }
-    if (mcpSetMode(obj, which[mode])) {
+    if (mcpSetMode(obj, mcpModes[mode])) {
         return 1;
     }
     return 0;
@@ -471,12 +562,12 @@ uint8_t mcpInterruptType(mcp_can_t *obj, const CANIrqs irqFlag)
                         MCP_MERRF
                       };
  
-    return (mcpRead(obj, MCP_EFLG) & which[irqFlag]) ? 1 : 0;
+    return (mcpRead(obj, MCP_CANINTF) & which[irqFlag]) ? 1 : 0;
 }
  
 /*  Return contents of the interrupt flags register
  */
 uint8_t mcpInterruptFlags(mcp_can_t *obj)
 {
-    return (mcpRead(obj, MCP_EFLG));
+    return (mcpRead(obj, MCP_CANINTF));
 }
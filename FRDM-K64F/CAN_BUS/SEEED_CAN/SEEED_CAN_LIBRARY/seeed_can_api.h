@@ -17,9 +17,8 @@
 #define _SEEED_CAN_API_H_
  
 #include "seeed_can_spi.h"
- 
-// print debug information...
-//#define DEBUG
+#include "seeed_can_timing.h"
+#include "seeed_can_log.h"                                              // MCP_ERROR, MCP_INFO, MCP_DEBUG
  
 #ifdef __cplusplus
 extern "C" {
@@ -64,6 +63,15 @@ extern "C" {
     };
     typedef struct MCP_CANid CANid;
  
+/// Type definition to hold every Acceptance Mask and Filter, for mcpConfigure
+    struct MCP_CANacceptance {
+        uint32_t maskId[2];         // Acceptance Masks 0 (RXB0, Filters 0-1) and 1 (RXB1, Filters 2-5)
+        uint8_t  maskExt[2];        // 1: the mask is laid out for extended ids
+        uint32_t filterId[6];       // Acceptance Filters 0-5
+        uint8_t  filterExt[6];      // 1: the filter only matches extended frames (EXIDE)
+    };
+    typedef struct MCP_CANacceptance CANacceptance;
+ 
 /// Type definition to hold an MCP2515 CAN id structure
     struct MCP_CANMsg {
         CANid id;
@@ -146,14 +154,26 @@ extern "C" {
                     const uint32_t bitRate,
                     const CANMode mode);
     uint8_t mcpSetMode(mcp_can_t *obj, const uint8_t newmode);          // set the MCP2515's operation mode
+    uint8_t mcpInitTiming(mcp_can_t *obj,                               // Initialise the MCP2515 with a bit timing
+                          const CANbitTiming *timing,
+                          const CANMode mode);
     uint8_t mcpSetBitRate(mcp_can_t *obj, const uint32_t bitRate);      // set bitrate
+    uint8_t mcpSetBitTiming(mcp_can_t *obj, const CANbitTiming *timing);// set CNF1-3
     
     void mcpWriteId(mcp_can_t *obj,                                     // write a CAN id
                     const uint8_t mcp_addr,
                     const uint8_t ext,
                     const uint32_t id );
     uint8_t mcpCanRead(mcp_can_t *obj, CAN_Message *msg);               // read a CAN message
+    uint8_t mcpCanReadAll(mcp_can_t *obj,                               // read every waiting CAN message, up to n
+                          CAN_Message msg[],
+                          const uint8_t n);
     uint8_t mcpCanWrite(mcp_can_t *obj, CAN_Message msg);               // write a CAN message
+    uint8_t mcpCanWritePriority(mcp_can_t *obj,                         // write a CAN message at a TXP level, behind the pending ones of that level
+                                CAN_Message msg,
+                                const uint8_t txp,
+                                const uint8_t buffers);
+    uint8_t mcpCanAbort(mcp_can_t *obj, const uint8_t num);             // abort the message pending in a TX buffer
     
     uint8_t mcpInitMask(mcp_can_t *obj,                                 // initialise an Acceptance Mask
                         uint8_t num,
@@ -163,6 +183,8 @@ extern "C" {
                           uint8_t num,
                           uint32_t ulData,
                           bool ext);
+    uint8_t mcpConfigure(mcp_can_t *obj,                                // write and verify every Acceptance Mask and Filter
+                         const CANacceptance *acceptance);
  
     uint8_t mcpErrorType(mcp_can_t *obj, const CANFlags type);          // Report on the specified errors and warnings
     uint8_t mcpErrorFlags(mcp_can_t *obj);                              // Return contents of the error and warning flags register
@@ -95,6 +95,9 @@ extern "C" {
 #define MCP_WRITE_TX0       0x40
 #define MCP_WRITE_TX1       0x42
 #define MCP_WRITE_TX2       0x44
+#define MCP_WRITE_TX0_D0    0x41                                        // load TX buffer 0 starting at D0 (payload only)
+#define MCP_WRITE_TX1_D0    0x43
+#define MCP_WRITE_TX2_D0    0x45
  
 #define MCP_RTS_TX0         0x81
 #define MCP_RTS_TX1         0x82
@@ -139,6 +142,9 @@ extern "C" {
 #define MCP_TXB_RTR_M       0x40                                        /* In TXBnDLC                   */
 #define MCP_RXB_IDE_M       0x08                                        /* In RXBnSIDL                  */
 #define MCP_RXB_RTR_M       0x40                                        /* In RXBnDLC                   */
+#define MCP_RXF_SIDL_M      0xEB                                        /* Implemented bits of RXFnSIDL */
+#define MCP_RXM_SIDL_M      0xE3                                        /* Implemented bits of RXMnSIDL */
+#define MCP_CNF3_M          0xC7                                        /* Implemented bits of CNF3     */
  
     /** STATUS Command Values
      */
@@ -205,7 +211,11 @@ extern "C" {
  
     /** Bit Rate timing
      */
-#define MCP_CLOCK_FREQ          16000000                                // 16 MHz Crystal frequency
+#ifndef MCP_CLOCK_FREQ
+#define MCP_CLOCK_FREQ          16000000                                // 16 MHz Crystal frequency (8 and 20 MHz shields exist)
+#endif
+#define CAN_SAMPLE_POINT        875                                     // Sample point, tenths of a percent of the bit (CiA 301)
+#define CAN_SJW                 1                                       // Synchronisation Jump Width (Tq)
 #define CAN_SYNCSEG             1                                       // CAN-BUS Sync segment is always 1 Time Quantum
 #define CAN_MAX_RATE            MCP_CLOCK_FREQ/(2 * MCP_MIN_TIME_QUANTA)
 #define CAN_MIN_RATE            MCP_CLOCK_FREQ/(2 * MCP_MAX_PRESCALER * MCP_MAX_TIME_QUANTA)
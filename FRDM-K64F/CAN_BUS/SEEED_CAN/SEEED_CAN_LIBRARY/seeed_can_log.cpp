@@ -0,0 +1,73 @@
+/*************************** seeed_can_log.cpp *************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Logging of the SEEED_CAN Library
+ *
+ * Purpose: The log ring of seeed_can_log.h. Nothing here is built unless SEEED_CAN_LOG_LEVEL is
+ * above 0.
+ *
+ *****************************************************************************************/
+#include "seeed_can_log.h"
+
+#if SEEED_CAN_LOG_LEVEL > MCP_LOG_OFF
+
+#include "mbed.h"
+
+typedef char logWordsIsAPowerOf2[(SEEED_CAN_LOG_WORDS > 0 && (SEEED_CAN_LOG_WORDS & (SEEED_CAN_LOG_WORDS - 1)) == 0) ? 1 : -1];
+
+static uint32_t logRing[SEEED_CAN_LOG_WORDS];
+static volatile unsigned int logHead = 0;                               // written by the writers, interrupts masked
+static volatile unsigned int logTail = 0;                               // written by the reader only
+static volatile unsigned long logDropped = 0;
+static uint16_t logSequence = 0;
+
+void mcpLogWrite(uint8_t event, const uint32_t *args, uint8_t n)
+{
+    uint32_t time = us_ticker_read();
+    uint32_t primask = __get_PRIMASK();                                 // may already be in a critical section
+    __disable_irq();
+    uint32_t header = ((uint32_t)event << 24) | ((uint32_t)n << 16) | logSequence++;
+    unsigned int head = logHead;
+    if (SEEED_CAN_LOG_WORDS - (head - logTail) < 2u + n) {
+        logDropped++;                                                   // the sequence number shows the gap
+    } else {
+        logRing[head++ % SEEED_CAN_LOG_WORDS] = header;
+        logRing[head++ % SEEED_CAN_LOG_WORDS] = time;
+        for (uint8_t i = 0; i < n; i++) {
+            logRing[head++ % SEEED_CAN_LOG_WORDS] = args[i];
+        }
+        __DMB();                                                        // the record is in place before the new head is
+        logHead = head;
+    }
+    __set_PRIMASK(primask);
+}
+
+unsigned int mcpLogRead(uint8_t *buf, unsigned int size)
+{
+    unsigned int tail = logTail;
+    unsigned int head = logHead;
+    unsigned int out = 0;
+    __DMB();                                                            // read the records after the head that published them
+    while (tail != head) {
+        unsigned int words = 2 + ((logRing[tail % SEEED_CAN_LOG_WORDS] >> 16) & 0xFF);
+        if (out + 1 + 4 * words > size) break;
+        buf[out++] = MCP_LOG_SYNC;
+        for (unsigned int i = 0; i < words; i++) {
+            uint32_t word = logRing[tail++ % SEEED_CAN_LOG_WORDS];
+            buf[out++] = (uint8_t)word;
+            buf[out++] = (uint8_t)(word >> 8);
+            buf[out++] = (uint8_t)(word >> 16);
+            buf[out++] = (uint8_t)(word >> 24);
+        }
+    }
+    __DMB();                                                            // done with the records before handing them back
+    logTail = tail;
+    return out;
+}
+
+unsigned long mcpLogDropped(void)
+{
+    return logDropped;
+}
+
+#endif
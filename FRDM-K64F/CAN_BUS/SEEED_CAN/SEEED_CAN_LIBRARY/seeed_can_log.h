@@ -0,0 +1,100 @@
+/*************************** seeed_can_log.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Logging of the SEEED_CAN Library
+ *
+ * Purpose: Replaces the DEBUG printf calls of the driver. Each MCP_ERROR, MCP_INFO or MCP_DEBUG
+ * below SEEED_CAN_LOG_LEVEL expands to nothing at all: no call, no arguments evaluated, no ring.
+ * The ones that are built store a binary record (event number, sequence number, time in us and
+ * the 32 bit arguments, 2 to 8 words) in a RAM ring, which takes a few hundred ns instead of the
+ * milliseconds a printf to the UART takes. The application drains the ring from its main loop or
+ * a low priority thread with mcpLogRead() and sends the bytes wherever it likes; the host decoder
+ * (seeed_can_log_decode.h) turns them back into text.
+ *
+ * Any thread or interrupt can log: a record is written with interrupts masked for the few stores
+ * it takes. There is one reader. When the ring is full the record is counted (mcpLogDropped())
+ * and its sequence number skipped, so the decoder can say how many went missing.
+ *
+ * On the wire each record is MCP_LOG_SYNC followed by its words, least significant byte first:
+ *      header  event (bits 31..24), number of arguments (23..16), sequence number (15..0)
+ *      time    us_ticker_read() when the record was written
+ *      args    one word each
+ * MCP_LOG_SYNC is not ASCII, so records can share a serial port with printf text.
+ *
+ * Instructions: build with -DSEEED_CAN_LOG_LEVEL=1 (errors), 2 (and info) or 3 (and debug); it is
+ * 0, no logging, by default. SEEED_CAN_LOG_WORDS is the size of the ring in 32 bit words.
+ *
+ *****************************************************************************************/
+#ifndef _SEEED_CAN_LOG_H_
+#define _SEEED_CAN_LOG_H_
+
+#include <stdint.h>
+#include "seeed_can_log_events.h"
+
+#ifndef SEEED_CAN_LOG_LEVEL
+#define SEEED_CAN_LOG_LEVEL     MCP_LOG_OFF
+#endif
+
+// size of the log ring in 32 bit words (a power of 2)
+#ifndef SEEED_CAN_LOG_WORDS
+#define SEEED_CAN_LOG_WORDS     256
+#endif
+
+#define MCP_LOG_SYNC            0xA5                                    // first byte of every record on the wire
+#define MCP_LOG_RECORD_MAX      (1 + 4 * (2 + MCP_LOG_MAX_ARGS))        // bytes of the longest record on the wire
+
+#if SEEED_CAN_LOG_LEVEL > MCP_LOG_OFF
+
+/** Stores a record; n words of args. Use MCP_ERROR, MCP_INFO and MCP_DEBUG rather than this
+ */
+void mcpLogWrite(uint8_t event, const uint32_t *args, uint8_t n);
+
+/** Moves whole records out of the ring, as they go on the wire
+ *
+ *  @param buf Where the records go
+ *  @param size Bytes buf can take, at least MCP_LOG_RECORD_MAX
+ *
+ *  @returns the number of bytes put in buf, 0 when the ring is empty
+ */
+unsigned int mcpLogRead(uint8_t *buf, unsigned int size);
+
+/** Returns the number of records lost because the ring was full
+ */
+unsigned long mcpLogDropped(void);
+
+/* Checks the event against seeed_can_log_events.h when it is compiled, then stores it */
+template<int EVENT, int LEVEL, typename... Args>
+inline void mcpLog(Args... args)
+{
+    static_assert(mcpLogLevels[EVENT] == LEVEL, "log event used at another level than its own");
+    static_assert(sizeof...(Args) == mcpLogArgs[EVENT], "wrong number of arguments for the log event");
+    const uint32_t words[] = { (uint32_t)args..., 0 };
+    mcpLogWrite(EVENT, words, sizeof...(Args));
+}
+
+#else
+
+inline unsigned int mcpLogRead(uint8_t *, unsigned int) { return 0; }
+inline unsigned long mcpLogDropped(void) { return 0; }
+
+#endif
+
+#if SEEED_CAN_LOG_LEVEL >= MCP_LOG_ERROR
+#define MCP_ERROR(event, ...)   mcpLog<event, MCP_LOG_ERROR>(__VA_ARGS__)
+#else
+#define MCP_ERROR(event, ...)   ((void)0)
+#endif
+
+#if SEEED_CAN_LOG_LEVEL >= MCP_LOG_INFO
+#define MCP_INFO(event, ...)    mcpLog<event, MCP_LOG_INFO>(__VA_ARGS__)
+#else
+#define MCP_INFO(event, ...)    ((void)0)
+#endif
+
+#if SEEED_CAN_LOG_LEVEL >= MCP_LOG_DEBUG
+#define MCP_DEBUG(event, ...)   mcpLog<event, MCP_LOG_DEBUG>(__VA_ARGS__)
+#else
+#define MCP_DEBUG(event, ...)   ((void)0)
+#endif
+
+#endif      // _SEEED_CAN_LOG_H_
@@ -0,0 +1,72 @@
+/*************************** seeed_can_log_decode.h *********************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Log Decoder of the SEEED_CAN Library
+ *
+ * Purpose: Turns the binary records of seeed_can_log.h back into text, on the host. Every byte
+ * that does not start a valid record (printf text sharing the serial port) is copied as it is.
+ * A record starts with MCP_LOG_SYNC and is valid when its event is in seeed_can_log_events.h with
+ * the same number of arguments. A jump in the sequence numbers is reported as records lost.
+ *
+ *      [   1.234567] INFO  Entered mode 00 after 0 ms
+ *
+ * The time is us_ticker_read() of the board, in seconds.
+ *
+ * Instructions: host only (stdio). SEEED_LOG_DECODE/log_decode.cpp is the command line tool.
+ *
+ *****************************************************************************************/
+#ifndef _SEEED_CAN_LOG_DECODE_H_
+#define _SEEED_CAN_LOG_DECODE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "seeed_can_log.h"
+
+static const char *const mcpLogTexts[MCP_EVENT_COUNT] = { MCP_LOG_EVENTS(MCP_LOG_TEXT_OF) };
+static const char *const mcpLogLevelNames[] = { "", "ERROR", "INFO", "DEBUG" };
+
+/* The word at p, least significant byte first */
+static inline uint32_t mcpLogWord(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Decodes a captured stream into 'out'. Returns the number of records; 'lost', if given,
+*  receives the number of records the sequence numbers say are missing */
+static inline unsigned long mcpLogDecode(const uint8_t *data, size_t size, FILE *out, unsigned long *lost = NULL)
+{
+    unsigned long records = 0, missing = 0;
+    uint16_t next = 0;
+    size_t i = 0;
+    while (i < size) {
+        if (data[i] == MCP_LOG_SYNC && i + 9 <= size) {
+            uint32_t header = mcpLogWord(&data[i + 1]);
+            unsigned int event = header >> 24;
+            unsigned int n = (header >> 16) & 0xFF;
+            if (event < MCP_EVENT_COUNT && n == mcpLogArgs[event] && i + 9 + 4 * n <= size) {
+                uint32_t args[MCP_LOG_MAX_ARGS] = {};
+                for (unsigned int a = 0; a < n; a++) {
+                    args[a] = mcpLogWord(&data[i + 9 + 4 * a]);
+                }
+                uint16_t sequence = (uint16_t)header;
+                if (records && sequence != next) {
+                    missing += (uint16_t)(sequence - next);
+                    fprintf(out, "(%u records lost)\n", (unsigned int)(uint16_t)(sequence - next));
+                }
+                next = sequence + 1;
+                fprintf(out, "[%11.6f] %-5s ", mcpLogWord(&data[i + 5]) / 1e6, mcpLogLevelNames[mcpLogLevels[event]]);
+                fprintf(out, mcpLogTexts[event], args[0], args[1], args[2], args[3], args[4], args[5]);
+                fputc('\n', out);
+                records++;
+                i += 9 + 4 * n;
+                continue;
+            }
+        }
+        fputc(data[i++], out);
+    }
+    if (lost) *lost = missing;
+    return records;
+}
+
+#endif      // _SEEED_CAN_LOG_DECODE_H_
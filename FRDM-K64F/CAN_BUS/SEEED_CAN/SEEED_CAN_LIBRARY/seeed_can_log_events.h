@@ -0,0 +1,55 @@
+/*************************** seeed_can_log_events.h *********************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Log Events of the SEEED_CAN Library
+ *
+ * Purpose: The one list of what the driver can log: the event's name, its level, how many 32 bit
+ * arguments its record carries and the text they go into. The firmware (seeed_can_log.h) only
+ * stores the event number and the arguments; the host decoder (seeed_can_log_decode.h) puts the
+ * text back. Both include this list, so they cannot disagree.
+ *
+ * Instructions: New events go at the end (the records already captured keep their numbers). The
+ * text is a printf format with one %u, %d or %x conversion per argument and at most 6 arguments.
+ * This file has no mbed dependencies and compiles on any host with a C++ compiler.
+ *
+ *****************************************************************************************/
+#ifndef _SEEED_CAN_LOG_EVENTS_H_
+#define _SEEED_CAN_LOG_EVENTS_H_
+
+#define MCP_LOG_OFF         0
+#define MCP_LOG_ERROR       1
+#define MCP_LOG_INFO        2
+#define MCP_LOG_DEBUG       3
+
+#define MCP_LOG_MAX_ARGS    6
+
+//      name                        level           args  text
+#define MCP_LOG_EVENTS(EVENT) \
+    EVENT(MCP_EVENT_RESET,          MCP_LOG_INFO,   0, "Resetting MCP2515") \
+    EVENT(MCP_EVENT_NO_TIMING,      MCP_LOG_ERROR,  0, "No bit timing for the requested bit rate, MCP2515 left alone") \
+    EVENT(MCP_EVENT_MODE,           MCP_LOG_INFO,   2, "Entered mode %02x after %u ms") \
+    EVENT(MCP_EVENT_MODE_FAILED,    MCP_LOG_ERROR,  6, "Failed to enter mode %02x: CANCTRL %02x CANSTAT %02x TXB0CTRL %02x TXB1CTRL %02x TXB2CTRL %02x") \
+    EVENT(MCP_EVENT_WRITE_ID,       MCP_LOG_DEBUG,  3, "Id %x (extended %u) written at register %02x") \
+    EVENT(MCP_EVENT_RX_FRAME,       MCP_LOG_DEBUG,  5, "Received id %x, format %u, remote %u, data %08x %08x") \
+    EVENT(MCP_EVENT_BAD_MASK,       MCP_LOG_ERROR,  1, "Trying to set an invalid Mask number: %u") \
+    EVENT(MCP_EVENT_MASK,           MCP_LOG_INFO,   3, "Mask %u set to %x (extended %u)") \
+    EVENT(MCP_EVENT_BAD_FILTER,     MCP_LOG_ERROR,  1, "Trying to set an invalid Filter number: %u") \
+    EVENT(MCP_EVENT_FILTER,         MCP_LOG_INFO,   3, "Filter %u set to %x (extended %u)") \
+    EVENT(MCP_EVENT_CONFIGURE,      MCP_LOG_INFO,   0, "Acceptance masks and filters written and read back") \
+    EVENT(MCP_EVENT_CONFIGURE_MISMATCH, MCP_LOG_ERROR, 3, "Acceptance register %02x read back as %02x, %02x written")
+
+#define MCP_LOG_ENUM(name, level, args, text)   name,
+#define MCP_LOG_LEVEL_OF(name, level, args, text) level,
+#define MCP_LOG_ARGS_OF(name, level, args, text) args,
+#define MCP_LOG_TEXT_OF(name, level, args, text) text,
+#define MCP_LOG_NAME_OF(name, level, args, text) #name,
+
+enum MCP_LogEvent {
+    MCP_LOG_EVENTS(MCP_LOG_ENUM)
+    MCP_EVENT_COUNT
+};
+
+constexpr unsigned char mcpLogLevels[MCP_EVENT_COUNT] = { MCP_LOG_EVENTS(MCP_LOG_LEVEL_OF) };
+constexpr unsigned char mcpLogArgs[MCP_EVENT_COUNT] = { MCP_LOG_EVENTS(MCP_LOG_ARGS_OF) };
+
+#endif      // _SEEED_CAN_LOG_EVENTS_H_
@@ -0,0 +1,80 @@
+/*************************** seeed_can_ring.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Receive Ring of the SEEED_CAN Library
+ *
+ * Purpose: A single-producer, single-consumer ring of CAN messages that needs no lock. SEEED_CAN's
+ * interrupt handler is the producer: it reads the MCP2515's receive buffers straight into the
+ * free slots (space(), then commit()). The application is the consumer (get()), from the main loop
+ * of a bare-metal program or from an RTOS thread; nothing here uses rtos.h.
+ *
+ * Neither side ever waits for the other or masks an interrupt. The producer is the only one that
+ * writes _head, the consumer the only one that writes _tail, and both indices run freely (the slot
+ * is the index modulo SIZE), so head - tail is the number of messages held even when they wrap.
+ * A memory barrier (__DMB) puts every message in place before the index that publishes it, and
+ * the consumer is done with a slot before it hands it back.
+ *
+ * Instructions: SIZE must be a power of 2. When the ring is full the producer still has to empty
+ * the MCP2515 (or INT stays low); it counts what it throws away with drop().
+ *
+ *****************************************************************************************/
+#ifndef _SEEED_CAN_RING_H_
+#define _SEEED_CAN_RING_H_
+
+#include "seeed_can_api.h"
+
+template<unsigned int SIZE>
+class SEEED_CANRing
+{
+    typedef char sizeIsAPowerOf2[(SIZE > 0 && (SIZE & (SIZE - 1)) == 0) ? 1 : -1];
+
+public:
+    SEEED_CANRing() : _head(0), _tail(0), _highWater(0), _dropped(0) {}
+
+    /* Producer: the free slots in a row from the next one (they stop at the end of the array), n of them */
+    CAN_Message *space(unsigned int &n) {
+        unsigned int head = _head;
+        unsigned int free = SIZE - (head - _tail);
+        unsigned int toEnd = SIZE - head % SIZE;
+        n = (free < toEnd) ? free : toEnd;
+        return &_slot[head % SIZE];
+    }
+
+    /* Producer: hands the first n slots of space() to the consumer */
+    void commit(unsigned int n) {
+        __DMB();                                                        // the messages are in place before the new head is
+        unsigned int head = _head + n;
+        _head = head;
+        unsigned int held = head - _tail;
+        if (held > _highWater) _highWater = held;
+    }
+
+    /* Producer: n messages lost because the ring was full */
+    void drop(unsigned int n) {
+        _dropped += n;
+    }
+
+    /* Consumer: takes the oldest message, 0 if there is none */
+    int get(CAN_Message &msg) {
+        unsigned int tail = _tail;
+        if (tail == _head) return 0;
+        __DMB();                                                        // read the slot after the head that published it
+        msg = _slot[tail % SIZE];
+        __DMB();                                                        // done with the slot before handing it back
+        _tail = tail + 1;
+        return 1;
+    }
+
+    unsigned int available(void) const { return _head - _tail; }
+    unsigned int highWater(void) const { return _highWater; }
+    unsigned long dropped(void) const { return _dropped; }
+
+private:
+    CAN_Message _slot[SIZE];
+    volatile unsigned int _head;                                        // written by the producer only
+    volatile unsigned int _tail;                                        // written by the consumer only
+    volatile unsigned int _highWater;                                   // most messages held at once
+    volatile unsigned long _dropped;
+};
+
+#endif      // _SEEED_CAN_RING_H_
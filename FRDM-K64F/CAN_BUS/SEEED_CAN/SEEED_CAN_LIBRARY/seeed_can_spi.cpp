@@ -16,27 +16,154 @@
  
 #include "seeed_can_spi.h"
  
-/** reset the MCP2515
+/** clock an SPI instruction to the MCP2515 with chip select low: the 'h' bytes of 'header' then 'n' bytes
+ *  from 'tx' (or 0x00 if NULL), with the 'n' bytes that come back stored in 'rx' (if not NULL)
+ *  The whole transaction goes to the SPI peripheral as one block so it can keep its FIFO full (a 13 byte
+ *  CAN buffer with its instruction and address fits), a second block carries anything that does not fit
  */
-void mcpReset(mcp_can_t *obj)
+static void mcpTransfer(mcp_can_t *obj, const uint8_t header[], const uint32_t h, const uint8_t tx[], uint8_t rx[], const uint32_t n)
 {
+    uint8_t out[MCP_SPI_BLOCK];
+    uint8_t in[MCP_SPI_BLOCK];
+    const uint32_t first = (h + n > MCP_SPI_BLOCK) ? MCP_SPI_BLOCK - h : n;  // bytes of 'tx'/'rx' in the first block
+ 
+    memcpy(out, header, h);
+    if (tx) {
+        memcpy(&out[h], tx, first);
+    } else {
+        memset(&out[h], 0x00, first);
+    }
+    mcpWait(obj);
     obj->ncs = 0;
-    obj->spi.write(MCP_RESET);
+    obj->spi.write((const char *)out, h + first, (char *)in, rx ? h + first : 0);
+    if (n > first) {
+        obj->spi.write(tx ? (const char *)&tx[first] : NULL, tx ? n - first : 0,
+                       rx ? (char *)&rx[first] : NULL, rx ? n - first : 0);
+    }
     obj->ncs = 1;
+    if (rx) {
+        memcpy(rx, &in[h], first);
+    }
+}
+ 
+/** the bits of a register kept in the shadow: the implemented bits of the configuration registers, which only
+ *  change when they are written (the Acceptance Filters and Masks, CNF1-3, CANINTE and CANCTRL, which is at every
+ *  address ending in F). 0 for the status registers and buffers, which are always read from the MCP2515; RXBnCTRL
+ *  and TXBnCTRL are among them, their FILHIT, RXRTR, TXREQ, ABTF, MLOA and TXERR bits change with the traffic.
+ */
+uint8_t mcpShadowBits(const uint8_t address)
+{
+    const uint8_t a = address & (MCP_SHADOW_SIZE - 1);
+ 
+    if ((a & 0x0F) == MCP_CANCTRL) {
+        return 0xFF;
+    }
+    if ((a <= MCP_RXF2EID0) || ((a >= MCP_RXF3SIDH) && (a <= MCP_RXF5EID0))) {
+        return ((a & 0x03) == 1) ? MCP_RXF_SIDL_M : 0xFF;               // RXFnSIDH, RXFnSIDL, RXFnEID8, RXFnEID0
+    }
+    if ((a >= MCP_RXM0SIDH) && (a <= MCP_RXM1EID0)) {
+        return ((a & 0x03) == 1) ? MCP_RXM_SIDL_M : 0xFF;
+    }
+    if (a == MCP_CNF3) {
+        return MCP_CNF3_M;
+    }
+    return ((a == MCP_CNF2) || (a == MCP_CNF1) || (a == MCP_CANINTE)) ? 0xFF : 0;
+}
+ 
+/** the shadow entry of a register (its CANCTRL for every address ending in F)
+ */
+static uint8_t mcpShadowEntry(const uint8_t address)
+{
+    const uint8_t a = address & (MCP_SHADOW_SIZE - 1);
+ 
+    return ((a & 0x0F) == MCP_CANCTRL) ? MCP_CANCTRL : a;
+}
+ 
+static bool mcpShadowHas(mcp_can_t *obj, const uint8_t entry)
+{
+    return (obj->shadowValid[entry / 32] >> (entry % 32)) & 1;
+}
+ 
+/** keep 'n' registers from 'address' in the shadow, as read from the MCP2515 or as 'written' to it
+ *
+ *  The Acceptance Filters and Masks and CNF1-3 can only be written in configuration mode: they are only kept if
+ *  configuration mode was the last one asked for in CANCTRL (mcpSetMode fails otherwise, and the callers stop).
+ *  Asking for another mode than the one mcpSetMode last saw makes that one unknown until it is seen again; CANCTRL
+ *  is not kept once Sleep is asked for, as the MCP2515 changes it when it wakes up.
+ */
+static void mcpShadowStore(mcp_can_t *obj, const uint8_t address, const uint8_t values[], const uint32_t n, const bool written)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        const uint8_t a = (address + i) & (MCP_SHADOW_SIZE - 1);
+        const uint8_t bits = mcpShadowBits(a);
+        const uint8_t entry = mcpShadowEntry(a);
+        if (!bits) {
+            continue;
+        }
+        if (written && (entry == MCP_CANCTRL) && ((values[i] & MODE_MASK) != obj->opMode)) {
+            obj->opMode = MCP_MODE_UNKNOWN;
+        }
+        if (written && (entry == MCP_CANCTRL) && ((values[i] & MODE_MASK) == MODE_SLEEP)) {
+            obj->shadowValid[entry / 32] &= ~(1UL << (entry % 32));     // REQOP becomes Listen-only when bus activity wakes it
+            continue;
+        }
+        if (written && (entry != MCP_CANCTRL) && (entry != MCP_CANINTE) &&
+            !(mcpShadowHas(obj, MCP_CANCTRL) && ((obj->shadow[MCP_CANCTRL] & MODE_MASK) == MODE_CONFIG))) {
+            obj->shadowValid[entry / 32] &= ~(1UL << (entry % 32));     // ignored outside configuration mode
+            continue;
+        }
+        obj->shadow[entry] = values[i] & bits;
+        obj->shadowValid[entry / 32] |= 1UL << (entry % 32);
+    }
+}
+ 
+/** forget every register in the shadow and the operation mode: the next reads go to the MCP2515
+ */
+void mcpShadowInvalidate(mcp_can_t *obj)
+{
+    memset(obj->shadowValid, 0, sizeof(obj->shadowValid));
+    obj->opMode = MCP_MODE_UNKNOWN;
+}
+ 
+/** wait until the transfer started by mcpWriteBufferAsync, if any, has finished
+ */
+void mcpWait(mcp_can_t *obj)
+{
+    while (obj->busy) {
+        wait_us(1);
+    }
+}
+ 
+/** reset the MCP2515
+ */
+void mcpReset(mcp_can_t *obj)
+{
+    const uint8_t header[] = {MCP_RESET};
+ 
+    obj->txHeaderValid = 0;                                             // the TX buffers are cleared
+    memset(obj->txPriority, 0, sizeof(obj->txPriority));
+    obj->txSlot = MCP_TX_SLOTS;
+    mcpShadowInvalidate(obj);
+    mcpTransfer(obj, header, sizeof(header), NULL, NULL, 0);
     wait_ms(10);
+    const uint8_t canctrl = MODE_CONFIG | CLKOUT_ENABLE | CLKOUT_PS8;   // the reset values of the data sheet (the filters and
+    const uint8_t cnf[] = {0, 0, 0, 0};                                 // masks have none): CANCTRL, CNF3, CNF2, CNF1, CANINTE
+    mcpShadowStore(obj, MCP_CANCTRL, &canctrl, 1, false);
+    mcpShadowStore(obj, MCP_CNF3, cnf, sizeof(cnf), false);
 }
  
 /** read from a single MCP2515 register
  */
 uint8_t mcpRead(mcp_can_t *obj, const uint8_t address)
 {
+    const uint8_t header[] = {MCP_READ, address};
     uint8_t result;
  
-    obj->ncs = 0;
-    obj->spi.write(MCP_READ);
-    obj->spi.write(address);
-    result = obj->spi.write(0x00);
-    obj->ncs = 1;
+    if (mcpShadowBits(address) && mcpShadowHas(obj, mcpShadowEntry(address))) {
+        return obj->shadow[mcpShadowEntry(address)];                    // a configuration register known since it was written or read
+    }
+    mcpTransfer(obj, header, sizeof(header), NULL, &result, 1);
+    mcpShadowStore(obj, address, &result, 1, false);
     return result;
 }
  
@@ -44,82 +171,120 @@ uint8_t mcpRead(mcp_can_t *obj, const uint8_t address)
  */
 void mcpReadMultiple(mcp_can_t *obj, const uint8_t address, uint8_t values[], const uint8_t n)
 {
-    obj->ncs = 0;
-    obj->spi.write(MCP_READ);
-    obj->spi.write(address);
-    for (uint32_t i=0; i<n; i++) {
-        values[i] = obj->spi.write(0x00);
-    }
-    obj->ncs = 1;
+    const uint8_t header[] = {MCP_READ, address};
+ 
+    mcpTransfer(obj, header, sizeof(header), NULL, values, n);          // always from the MCP2515 (mcpConfigure checks what it wrote)
+    mcpShadowStore(obj, address, values, n, false);
 }
  
 /** read the specified MCP2515 receive buffer into an array (needs one fewer SPI transfer than mcpReadMultiple)
  */
 void mcpReadBuffer(mcp_can_t *obj, const uint8_t command, uint8_t values[], const uint8_t n)
 {
-    obj->ncs = 0;
-    obj->spi.write(command);
-    for (uint32_t i=0; i<n; i++) {
-        values[i] = obj->spi.write(0x00);
-    }
-    obj->ncs = 1;
+    const uint8_t header[] = {command};
+ 
+    mcpTransfer(obj, header, sizeof(header), NULL, values, n);
 }
  
 /**  write to a single MCP2515 register
  */
 void mcpWrite(mcp_can_t *obj, const uint8_t address, const uint8_t value)
 {
-    obj->ncs = 0;
-    obj->spi.write(MCP_WRITE);
-    obj->spi.write(address);
-    obj->spi.write(value);
-    obj->ncs = 1;
+    const uint8_t header[] = {MCP_WRITE, address, value};
+ 
+    mcpTransfer(obj, header, sizeof(header), NULL, NULL, 0);
+    mcpShadowStore(obj, address, &value, 1, true);
 }
  
 /** write to multiple MCP2515 registers consecutively from an array
  */
 void mcpWriteMultiple(mcp_can_t *obj, const uint8_t address, const uint8_t values[], const uint8_t n)
 {
-    obj->ncs = 0;
-    obj->spi.write(MCP_WRITE);
-    obj->spi.write(address);
-    for (uint32_t i=0; i<n; i++) {
-        obj->spi.write(values[i]);
-    }
-    obj->ncs = 1;
+    const uint8_t header[] = {MCP_WRITE, address};
+ 
+    mcpTransfer(obj, header, sizeof(header), values, NULL, n);
+    mcpShadowStore(obj, address, values, n, true);
 }
  
 /** write to the specified MCP2515 transmit buffer from an array (needs one fewer SPI transfer than mcpWriteMultiple)
  */
 void mcpWriteBuffer(mcp_can_t *obj, const uint8_t command, uint8_t values[], const uint8_t n)
 {
+    const uint8_t header[] = {command};
+ 
+    mcpTransfer(obj, header, sizeof(header), values, NULL, n);
+}
+ 
+/** write to the specified MCP2515 transmit buffer from an array, then initiate its transmission with 'rts'
+ *  (0 for none), without waiting for the SPI transfer where the mbed target can do it in the background:
+ *  the caller gets on with its work while the buffer is clocked out and the next MCP2515 access waits for it
+ *  (mcpWait)
+ */
+void mcpWriteBufferAsync(mcp_can_t *obj, const uint8_t command, const uint8_t values[], const uint8_t n, const uint8_t rts)
+{
+    if ((n == 0) || (n >= MCP_SPI_BLOCK)) {                             // nothing to overlap, or too big for obj->block
+        mcpWriteBuffer(obj, command, (uint8_t *)values, n);
+        if (rts) {
+            mcpBufferRTS(obj, rts);
+        }
+        return;
+    }
+    mcpWait(obj);
+    obj->block[0] = command;
+    memcpy(&obj->block[1], values, n);
+#if DEVICE_SPI_ASYNCH
+    obj->rtsCommand = rts;
+    obj->busy = 1;
     obj->ncs = 0;
-    obj->spi.write(command);
-    for (uint32_t i=0; i<n; i++) {
-        obj->spi.write(values[i]);
+    if (!__get_IPSR() &&                                                // in a handler mcpWait could wait for an interrupt that cannot run
+        obj->spi.transfer(obj->block, n + 1, (uint8_t *)NULL, 0,
+                          event_callback_t(obj, &Seeed_MCP_CAN_Shield::transferDone), SPI_EVENT_COMPLETE) == 0) {
+        return;                                                         // transferDone() finishes it
     }
+    obj->busy = 0;                                                      // the SPI peripheral is in use: block instead
+#else
+    obj->ncs = 0;
+#endif
+    obj->spi.write((const char *)obj->block, n + 1, NULL, 0);
     obj->ncs = 1;
+    if (rts) {
+        mcpBufferRTS(obj, rts);
+    }
+}
+ 
+/** end of the transfer started by mcpWriteBufferAsync (SPI interrupt); the event is always
+ *  SPI_EVENT_COMPLETE, the only one it asks for
+ */
+void Seeed_MCP_CAN_Shield::transferDone(int)
+{
+    ncs = 1;
+    busy = 0;
+    if (rtsCommand) {
+        mcpBufferRTS(this, rtsCommand);
+    }
+    if (irqDeferred) {                                                  // an MCP2515 interrupt came in while the chip was selected
+        irqDeferred = 0;
+        deferredIrq.call();
+    }
 }
  
 /** initiate transmission of the specified MCP2515 transmit buffer
  */
 void mcpBufferRTS(mcp_can_t *obj, const uint8_t command)
 {
-    obj->ncs = 0;
-    obj->spi.write(command);
-    obj->ncs = 1;
+    const uint8_t header[] = {command};
+ 
+    mcpTransfer(obj, header, sizeof(header), NULL, NULL, 0);
 }
  
 /**  read mcp2515's status register
  */
 uint8_t mcpStatus(mcp_can_t *obj)
 {
+    const uint8_t header[] = {MCP_READ_STATUS};
     uint8_t status;
  
-    obj->ncs = 0;
-    obj->spi.write(MCP_READ_STATUS);
-    status = obj->spi.write(0x00);
-    obj->ncs = 1;
+    mcpTransfer(obj, header, sizeof(header), NULL, &status, 1);
     return status;
 }
  
@@ -127,12 +292,10 @@ uint8_t mcpStatus(mcp_can_t *obj)
  */
 uint8_t mcpReceiveStatus(mcp_can_t *obj)
 {
+    const uint8_t header[] = {MCP_RX_STATUS};
     uint8_t status;
  
-    obj->ncs = 0;
-    obj->spi.write(MCP_RX_STATUS);
-    status = obj->spi.write(0x00);
-    obj->ncs = 1;
+    mcpTransfer(obj, header, sizeof(header), NULL, &status, 1);
     return status;
 }
  
@@ -140,10 +303,19 @@ uint8_t mcpReceiveStatus(mcp_can_t *obj)
  */
 void mcpBitModify(mcp_can_t *obj, const uint8_t address, const uint8_t mask, const uint8_t data)
 {
-    obj->ncs = 0;
-    obj->spi.write(MCP_BITMOD);
-    obj->spi.write(address);
-    obj->spi.write(mask);
-    obj->spi.write(data);
-    obj->ncs = 1;
+    const uint8_t header[] = {MCP_BITMOD, address, mask, data};
+    const uint8_t entry = mcpShadowEntry(address);
+ 
+    mcpTransfer(obj, header, sizeof(header), NULL, NULL, 0);
+    if (!mcpShadowBits(address)) {
+        return;
+    }
+    if ((entry != MCP_CANCTRL) && ((entry < MCP_CNF3) || (entry > MCP_CANINTE))) {
+        mcpShadowStore(obj, address, &data, 1, true);                   // a Filter or Mask: the MCP2515 takes the mask as FFh
+    } else if (mcpShadowHas(obj, entry)) {
+        const uint8_t value = (obj->shadow[entry] & ~mask) | (data & mask);
+        mcpShadowStore(obj, address, &value, 1, true);
+    } else if ((entry == MCP_CANCTRL) && (mask & MODE_MASK)) {
+        obj->opMode = MCP_MODE_UNKNOWN;                                 // a mode change asked for
+    }
 }
\ No newline at end of file
@@ -18,6 +18,12 @@
  
 #include "seeed_can_defs.h"
  
+#define MCP_TX_SLOTS    12                                              // 4 TXP levels of 3 TX buffers, the order the MCP2515 sends them in
+#define MCP_SPI_BLOCK   16                                              // bytes of the largest SPI block (instruction, address and a 13 byte CAN buffer)
+#define MCP_ABORT_POLLS 100                                             // TXBnCTRL reads mcpCanAbort waits for a frame on the bus to end (over 1 ms)
+#define MCP_SHADOW_SIZE 0x80                                            // the register map: only the configuration registers are kept (mcpShadowBits)
+#define MCP_MODE_UNKNOWN 0xFF                                           // opMode while the operation mode may not be the one last seen
+ 
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -29,11 +35,33 @@ extern "C" {
         SPI             spi;
         DigitalOut      ncs;
         InterruptIn     irq;
+        uint8_t         txHeader[3][5];                                 // SIDH, SIDL, EID8, EID0 and DLC last loaded into each TX buffer
+        uint8_t         txHeaderValid;                                  // bit n set while txHeader[n] is what TX buffer n holds
+        uint8_t         txPriority[3];                                  // TXP of each TX buffer
+        uint8_t         txSlot;                                         // TXP * 3 + buffer of the last message loaded while others were pending
+        uint8_t         block[MCP_SPI_BLOCK];                           // instruction and data of the transfer started by mcpWriteBufferAsync
+        volatile uint8_t busy;                                          // 1 until that transfer has finished (chip select is low)
+        uint8_t         rtsCommand;                                     // RTS instruction to send when it has, 0 for none
+        volatile uint8_t irqDeferred;                                   // 1 if the INT pin fell while it was in progress
+        FunctionPointer deferredIrq;                                    // the INT handler to run when it has finished
+        uint8_t         shadow[MCP_SHADOW_SIZE];                        // configuration registers as last written or read
+        uint32_t        shadowValid[MCP_SHADOW_SIZE / 32];              // bit n set while shadow[n] is what register n holds
+        uint8_t         opMode;                                         // OPMOD last seen by mcpSetMode, or MCP_MODE_UNKNOWN
         Seeed_MCP_CAN_Shield(SPI _spi_, DigitalOut _ncs_, InterruptIn _irq_) :
             spi(_spi_),
             ncs(_ncs_),
-            irq(_irq_)
-        {}
+            irq(_irq_),
+            txHeaderValid(0),
+            txSlot(MCP_TX_SLOTS),
+            busy(0),
+            rtsCommand(0),
+            irqDeferred(0),
+            opMode(MCP_MODE_UNKNOWN)
+        {
+            memset(txPriority, 0, sizeof(txPriority));
+            memset(shadowValid, 0, sizeof(shadowValid));
+        }
+        void transferDone(int event);                                   // SPI completion of mcpWriteBufferAsync
     };
     typedef struct Seeed_MCP_CAN_Shield mcp_can_t;
  
@@ -62,6 +90,12 @@ extern "C" {
                         const uint8_t command,
                         uint8_t values[],
                         const uint8_t n);
+    void mcpWriteBufferAsync(mcp_can_t *obj,                            // write an array into the specified transmit buffer, then RTS,
+                             const uint8_t command,                     // overlapping the SPI transfer with the caller's work
+                             const uint8_t values[],
+                             const uint8_t n,
+                             const uint8_t rts);
+    void mcpWait(mcp_can_t *obj);                                       // wait for the transfer of mcpWriteBufferAsync to finish
     void mcpBufferRTS(mcp_can_t *obj, const uint8_t command);           // initiate transmission of the specified MCP2515 transmit buffer
     uint8_t mcpStatus(mcp_can_t *obj);                                  // read the MCP2515's status register
     uint8_t mcpReceiveStatus(mcp_can_t *obj);                           // read mcp2515's receive status register
@@ -69,6 +103,8 @@ extern "C" {
                       const uint8_t address,
                       const uint8_t mask,
                       const uint8_t data);
+    uint8_t mcpShadowBits(const uint8_t address);                       // the bits of a register mcpRead answers from the shadow
+    void mcpShadowInvalidate(mcp_can_t *obj);                           // forget the shadow: the next reads go to the MCP2515
  
 #ifdef __cplusplus
 };
@@ -0,0 +1,138 @@
+/*************************** seeed_can_timing.h *************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Bit Timing of the SEEED_CAN Library
+ *
+ * Purpose: Works out the MCP2515's CNF1, CNF2 and CNF3 for a bit rate, an oscillator (8, 16 or
+ * 20 MHz on the CAN-BUS Shield variants), a sample point and a synchronisation jump width. The
+ * solver is constexpr: with constant arguments the compiler does the work and the firmware only
+ * carries the three bytes, which open() writes in one burst.
+ *
+ * Bit time = SyncSeg (1 Tq) + PropSeg (1-8 Tq) + PS1 (1-8 Tq) + PS2 (2-8 Tq), 8 to 25 Tq, with
+ * Tq = 2 x BRP / Fosc and BRP 1-64. The sample point, in tenths of a percent of the bit, is the
+ * end of PS1; PS2 is what is left of the bit after it, kept longer than SJW and at least 2 Tq, and
+ * PropSeg + PS1 must be at least PS2 (MCP2515 data sheet, 5.3). Of the BRPs that give the rate with
+ * a whole number of Tq, the one whose segments come nearest the sample point asked for is taken,
+ * the smallest (the most Tq per bit) when two come as near.
+ *
+ * Instructions: mcpBitTiming<500000>() for a rate known when the firmware is built: a rate the
+ * oscillator cannot reach stops the build (static_assert). MCP_CLOCK_FREQ (seeed_can_defs.h) is
+ * the shield's oscillator, -DMCP_CLOCK_FREQ=8000000 or 20000000 for the other variants.
+ * mcpSolveBitTiming() is the same solver for a rate only known at run time; mcpBitTimingValid()
+ * is 0 when it found no timing.
+ *
+ *****************************************************************************************/
+#ifndef _SEEED_CAN_TIMING_H_
+#define _SEEED_CAN_TIMING_H_
+
+#include "seeed_can_defs.h"
+
+/// CNF3, CNF2, CNF1: the bit timing registers in address order, written as one burst from MCP_CNF3
+struct MCP_CANbitTiming {
+    uint8_t cnf[3];
+};
+typedef struct MCP_CANbitTiming CANbitTiming;
+
+/* The shortest PS2: longer than SJW, at least 2 Tq, and long enough for PropSeg + PS1 to fit in 16 Tq */
+constexpr uint32_t mcpTimingPs2Min(uint32_t tq, uint32_t sjw)
+{
+    return (tq > 17 && tq - 17 > sjw + 1 && tq - 17 > 2) ? tq - 17 : (sjw + 1 > 2) ? sjw + 1 : 2;
+}
+
+/* PS2: the Tq after the sample point, at least mcpTimingPs2Min(), at most 8 */
+constexpr uint32_t mcpTimingPs2(uint32_t tq, uint32_t sample, uint32_t sjw)
+{
+    return (tq - (tq * sample + 500) / 1000 < mcpTimingPs2Min(tq, sjw)) ? mcpTimingPs2Min(tq, sjw)
+         : (tq - (tq * sample + 500) / 1000 > 8) ? 8
+         : tq - (tq * sample + 500) / 1000;
+}
+
+/* PropSeg + PS1: the rest of the bit after SyncSeg and PS2 */
+constexpr uint32_t mcpTimingTseg1(uint32_t tq, uint32_t sample, uint32_t sjw)
+{
+    return tq - 1 - mcpTimingPs2(tq, sample, sjw);
+}
+
+/* tq quanta split into segments the MCP2515 accepts; PS1 is half of PropSeg + PS1, rounded down */
+constexpr bool mcpTimingSplits(uint32_t tq, uint32_t sample, uint32_t sjw)
+{
+    return mcpTimingTseg1(tq, sample, sjw) <= 16
+        && mcpTimingTseg1(tq, sample, sjw) >= mcpTimingPs2(tq, sample, sjw)
+        && mcpTimingTseg1(tq, sample, sjw) / 2 >= sjw;
+}
+
+/* BRP gives the rate with a whole number of Tq, 8 to 25 of them, that split */
+constexpr bool mcpTimingFits(uint32_t osc, uint32_t rate, uint32_t sample, uint32_t sjw, uint32_t brp)
+{
+    return osc / (2 * brp * rate) >= MCP_MIN_TIME_QUANTA
+        && osc / (2 * brp * rate) <= MCP_MAX_TIME_QUANTA
+        && osc / (2 * brp * (osc / (2 * brp * rate))) == rate
+        && mcpTimingSplits(osc / (2 * brp * rate), sample, sjw);
+}
+
+/* The register values of a BRP and tq that fit */
+constexpr CANbitTiming mcpTimingImage(uint32_t brp, uint32_t tq, uint32_t sample, uint32_t sjw)
+{
+    return CANbitTiming{{
+        (uint8_t)(SOF_DISABLE | WAKFIL_DISABLE | (mcpTimingPs2(tq, sample, sjw) - 1)),
+        (uint8_t)(BTLMODE | SAMPLE_1X | ((mcpTimingTseg1(tq, sample, sjw) / 2 - 1) << 3)
+                  | (mcpTimingTseg1(tq, sample, sjw) - mcpTimingTseg1(tq, sample, sjw) / 2 - 1)),
+        (uint8_t)(((sjw - 1) << 6) | (brp - 1))
+    }};
+}
+
+/* How far the sample point of tq quanta is from the one asked for, in tenths of a percent */
+constexpr uint32_t mcpTimingError(uint32_t tq, uint32_t sample, uint32_t sjw)
+{
+    return ((1000 * (tq - mcpTimingPs2(tq, sample, sjw)) + tq / 2) / tq > sample)
+         ? (1000 * (tq - mcpTimingPs2(tq, sample, sjw)) + tq / 2) / tq - sample
+         : sample - (1000 * (tq - mcpTimingPs2(tq, sample, sjw)) + tq / 2) / tq;
+}
+
+/* The BRP from brp up that fits with the nearest sample point, best the one so far (0: none) */
+constexpr CANbitTiming mcpTimingSearch(uint32_t osc, uint32_t rate, uint32_t sample, uint32_t sjw, uint32_t brp, uint32_t best)
+{
+    return (brp > MCP_MAX_PRESCALER)
+         ? ((best == 0) ? CANbitTiming{{0, 0, 0}} : mcpTimingImage(best, osc / (2 * best * rate), sample, sjw))
+         : (mcpTimingFits(osc, rate, sample, sjw, brp)
+            && (best == 0 || mcpTimingError(osc / (2 * brp * rate), sample, sjw)
+                             < mcpTimingError(osc / (2 * best * rate), sample, sjw)))
+         ? mcpTimingSearch(osc, rate, sample, sjw, brp + 1, brp)
+         : mcpTimingSearch(osc, rate, sample, sjw, brp + 1, best);
+}
+
+/** CNF3, CNF2 and CNF1 for a bit rate
+ *
+ *  @param osc The MCP2515's oscillator (Hz)
+ *  @param rate The CAN bit rate (bit/s)
+ *  @param sample The sample point in tenths of a percent of the bit (875 = 87.5 %)
+ *  @param sjw The synchronisation jump width, 1-4 Tq
+ *
+ *  @returns the register values, all zeros when the rate cannot be reached (see mcpBitTimingValid())
+ */
+constexpr CANbitTiming mcpSolveBitTiming(uint32_t osc, uint32_t rate, uint32_t sample = CAN_SAMPLE_POINT, uint32_t sjw = CAN_SJW)
+{
+    return (rate == 0 || sample > 1000 || sjw < 1 || sjw > 4) ? CANbitTiming{{0, 0, 0}}
+         : mcpTimingSearch(osc, rate, sample, sjw, MCP_MIN_PRESCALER, 0);
+}
+
+/** 1 if the solver found a timing (BTLMODE is always set in one it found), 0 otherwise
+ */
+constexpr int mcpBitTimingValid(const CANbitTiming &timing)
+{
+    return (timing.cnf[1] & BTLMODE) ? 1 : 0;
+}
+
+/** CNF3, CNF2 and CNF1 for a bit rate known when the firmware is built
+ *
+ *  Does not compile if the oscillator cannot reach the rate.
+ */
+template<uint32_t RATE, uint32_t OSC = MCP_CLOCK_FREQ, uint32_t SAMPLE = CAN_SAMPLE_POINT, uint32_t SJW = CAN_SJW>
+constexpr CANbitTiming mcpBitTiming(void)
+{
+    static_assert(mcpBitTimingValid(mcpSolveBitTiming(OSC, RATE, SAMPLE, SJW)),
+                  "CAN bit rate not reachable with this oscillator, sample point and SJW");
+    return mcpSolveBitTiming(OSC, RATE, SAMPLE, SJW);
+}
+
+#endif      // _SEEED_CAN_TIMING_H_
@@ -14,7 +14,8 @@
 svtSEEEDCAN::~svtSEEEDCAN(){
 }
 
-/** isr - handles all interrupts from MCP2515, sets/clears thread signals 
+/** isr - attached to SEEED_CAN's RxAny interrupt, which has already moved the received msgs
+ *         into its receive ring; sets thread signals
  *         note signature is (), not (void).
  */
 void svtSEEEDCAN::isr(){
@@ -25,13 +26,13 @@ void svtSEEEDCAN::isr(){
  */
 int svtSEEEDCAN::init(int canspeed, CANFormat format, uint32_t canaddr){
     _can.open(canspeed); // defaults to 1Mbs/normal 
-    _can.setinterrupts(SEEED_CAN::RxAny);  // tells MCP2515 to use interrupts
+    // one handler per pin: a second InterruptIn on Arduino_int would replace the driver's
+    _can.attach(this, &svtSEEEDCAN::isr, SEEED_CAN::RxAny);
     if(_can.errors()){
-	SEEED_CANMessage msg;
 	uint8_t err = _can.errorFlags();
 	udebug.printf("err %d\r\n", err);
-	_can.read(msg);
     }
+    _can.rxRing(true);   // MCP2515 receive interrupts fill the driver's receive ring from here on
     svtCAN::init(canspeed, format, canaddr);
     return 0;
 }
@@ -46,21 +47,40 @@ int svtSEEEDCAN::init(int canspeed, CANFormat format, uint32_t canaddr){
  *   @return 0 - success, 1 failure
  */
 int svtSEEEDCAN::Filter(int32_t mask, int32_t* idfilters, int32_t n){
-    // MCP2515 has two masks, both are set to be same here.
-    if(_can.mask(0, mask, _format)){
-	return 1;
+    if(idfilters == NULL) return 1;
+    if(n < 1 || n > 6) return 1;
+    // MCP2515 has two masks, both are set to be same here. Filters past n repeat the last one,
+    // so an unused filter cannot let id 0 through.
+    CANacceptance acceptance;
+    uint8_t ext = (_format == CANExtended) ? 1 : 0;
+    for(int i=0; i<2; i++){
+	acceptance.maskId[i] = mask;
+	acceptance.maskExt[i] = ext;
     }
-    if(_can.mask(1, mask, _format)){
-	return 1;
+    for(int i=0; i<6; i++){
+	acceptance.filterId[i] = idfilters[(i < n) ? i : n-1];
+	acceptance.filterExt[i] = ext;
     }
-    if(idfilters == NULL) return 1;
-    if( n>6) return 1;
+    // one visit to configuration mode for all of them
+    return _can.configure(acceptance) ? 0 : 1;
+}
+
+/** FilterIds - lets in the listed standard ids and as few others as the two masks and
+ *   six filters allow, each mask with its own filters (mcpPlanAcceptance).
+ *   @param ids - pointer to an array of wanted ids, 0 to 0x7FF
+ *   @param n - number of ids supplied, up to SEEED_CAN_PLAN_IDS
+ *   @return 0 - success, 1 failure (also for the extended format)
+ */
+int svtSEEEDCAN::FilterIds(int32_t* ids, int32_t n){
+    if(ids == NULL || _format == CANExtended) return 1;
+    if(n < 1 || n > SEEED_CAN_PLAN_IDS) return 1;
+    uint32_t wanted[SEEED_CAN_PLAN_IDS];
     for(int i=0; i<n; i++){
-	if(_can.filter(i, idfilters[i], _format)){
-	    return 1;
-        }
+	wanted[i] = (uint32_t)ids[i];
     }
-    return 0;
+    CANacceptancePlan plan;
+    if(!mcpPlanAcceptance(wanted, n, plan)) return 1;
+    return _can.configure(plan.acceptance) ? 0 : 1;
 }
 
 /** Set the frequency of the CAN interface
@@ -75,33 +95,25 @@ int svtSEEEDCAN::frequency(int hz){
     return _can.frequency(hz);
 }
 
-/** handleInMsg - retrieves msg  and puts in local IN queue
- *                 the read statement clears interrupt on MPC2515
+/** handleInMsg - the interrupt handler has already read both MCP2515 receive buffers into
+ *                 the driver's receive ring (and released the interrupt line); nothing is
+ *                 copied or locked here, readers take the msgs with getInMsg
  */
 int svtSEEEDCAN::handleInMsg(){
-    SEEED_CANMessage canMsg;
-    INqueue_mutex.lock();
-    {
-	if(_can.read(canMsg)){
-	    CAN_Message *message = INqueue.alloc();
-	    if(message != NULL){
-		message->len    = canMsg.len;
-		message->type   = canMsg.type;
-		message->format = canMsg.format;
-		message->id     = canMsg.id;
-		memcpy(message->data, canMsg.data, canMsg.len);
-		INqueue.put(message);
-		osSignalSet(_threadId, SIG_CAN_INQUEUE_NOTEMPTY);
-	    }
-	}
-	else{
-	    udebug.printf("X");
-	}
+    if(_can.rxAvailable()){
+	osSignalSet(_threadId, SIG_CAN_INQUEUE_NOTEMPTY);
     }
-    INqueue_mutex.unlock();
     return 0;
 }
 
+/** getInMsg - takes the oldest msg from the receive ring. The interrupt handler is its only
+ *              writer and this thread its only reader, so no mutex: one copy, straight into msg
+ *   @return 1 - msg filled, 0 - none waiting
+ */
+int svtSEEEDCAN::getInMsg(CAN_Message &msg){
+    return _can.rxRead(msg);
+}
+
 /** handleOutMsg - retrieve CAN msg from OUTqueue and send SEEED_CANMessag.
  * result codes from mail.get    
  *   osOK: no mail is available in the queue and no timeout was specified
@@ -112,7 +124,7 @@ int svtSEEEDCAN::handleInMsg(){
 int svtSEEEDCAN::handleOutMsg(){
     int err;
     if(_canmsg.len != 0){ // old unsent message, try again
-	err = _can.write(_canmsg); // err = 1-sent, 0-not sent
+	err = _can.write(_canmsg); // err = 1-sent or queued, 0-queue full
 	if(err){ // msg sent
 	    _canmsg.len = 0;
 	}
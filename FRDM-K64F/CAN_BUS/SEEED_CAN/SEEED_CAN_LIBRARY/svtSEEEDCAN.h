@@ -17,6 +17,7 @@
 #include "svtCAN.h"
 #define MBED_CAN_HELPER_H 1
 #include "seeed_can.h"
+#include "seeed_can_acceptance.h"
 
 // F64K spi uses same pins as Arduino
 #define Arduino_ncs  PTD0
@@ -39,9 +40,7 @@ class svtSEEEDCAN: public svtCAN {
      */
  svtSEEEDCAN():
         svtCAN(),
-        _can(Arduino_ncs, Arduino_int, Arduino_mosi, Arduino_miso, Arduino_sck, SPISPEED),
-	_interrupt(Arduino_int) {
-	    _interrupt.fall(this, &svtSEEEDCAN::isr);  // new CAN message on falling edge
+        _can(Arduino_ncs, Arduino_int, Arduino_mosi, Arduino_miso, Arduino_sck, SPISPEED) {
             _canmsg.len = 0;
 	};
  
@@ -49,7 +48,7 @@ class svtSEEEDCAN: public svtCAN {
      */
     ~svtSEEEDCAN();
 
-    /** isr - handles all interrupts from MPC2515
+    /** isr - called by SEEED_CAN's interrupt handler once new messages are in its receive ring
      */
     void isr();
 
@@ -70,6 +69,14 @@ class svtSEEEDCAN: public svtCAN {
  */
     int Filter(int32_t mask, int32_t* idfilters, int32_t n);
 
+/** FilterIds - lets in the listed standard ids and as few others as the two masks and
+ *   six filters allow, each mask with its own filters (mcpPlanAcceptance).
+ *   @param ids - pointer to an array of wanted ids, 0 to 0x7FF
+ *   @param n - number of ids supplied, up to SEEED_CAN_PLAN_IDS
+ *   @return 0 - success, 1 failure (also for the extended format)
+ */
+    int FilterIds(int32_t* ids, int32_t n);
+
     /** Set the frequency of the CAN interface
      *
      *  @param hz The bus frequency in hertz
@@ -80,17 +87,21 @@ class svtSEEEDCAN: public svtCAN {
      */
     int frequency(int hz);
 
-    /** handleInMsg - retrieve msg from MPC2515 and put in queue
+    /** handleInMsg - signal the thread when received msgs are waiting in the receive ring
      */
     int handleInMsg();
 
+    /** getInMsg - take the oldest received msg, without a lock
+     *   @return 1 - msg filled, 0 - none waiting
+     */
+    int getInMsg(CAN_Message &msg);
+
     /** handleOutMsg - retrieve msg from OUTqueue and send CAN message.
      */
     int handleOutMsg();
       
 private:          
-    SEEED_CAN     _can;
-    InterruptIn   _interrupt; 
+    SEEED_CAN     _can;   // also owns the MCP2515 interrupt pin
     SEEED_CANMessage   _canmsg; // single out can message  
 };
 #endif
@@ -0,0 +1,41 @@
+/*************************** log_decode.cpp ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: SEEED_CAN Log Decoder
+ *
+ * Purpose: Prints a capture of the serial port of a board built with SEEED_CAN_LOG_LEVEL above 0
+ * as text: the driver's binary log records (../SEEED_CAN_LIBRARY/seeed_can_log.h) are decoded,
+ * everything else the board printed is copied as it is.
+ *
+ * Instructions: To compile code:
+ *                  $g++ -std=c++11 -O2 -I../SEEED_CAN_LIBRARY -o log_decode log_decode.cpp
+ *               To capture (Linux, screen does not keep binary bytes):
+ *                  $stty -F /dev/ttyACM0 9600 raw && cat /dev/ttyACM0 > capture.bin
+ *               To run code: $./log_decode capture.bin    (or standard input without a file)
+ *               The exit code is 0 when the capture could be read.
+ *
+ *****************************************************************************************/
+#include <stdio.h>
+#include <vector>
+#include "seeed_can_log_decode.h"
+
+int main(int argc, char *argv[])
+{
+    FILE *in = (argc > 1) ? fopen(argv[1], "rb") : stdin;
+    if (!in) {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 1;
+    }
+    std::vector<uint8_t> capture;
+    uint8_t block[4096];
+    size_t n;
+    while ((n = fread(block, 1, sizeof(block), in)) > 0) {
+        capture.insert(capture.end(), block, block + n);
+    }
+    if (in != stdin) fclose(in);
+
+    unsigned long lost = 0;
+    unsigned long records = mcpLogDecode(capture.data(), capture.size(), stdout, &lost);
+    fprintf(stderr, "%lu records, %lu lost\n", records, lost);
+    return 0;
+}
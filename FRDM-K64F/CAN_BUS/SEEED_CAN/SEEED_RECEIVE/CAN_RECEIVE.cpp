@@ -20,64 +20,71 @@
 
 #include "mbed.h"
 #include "seeed_can.h"
+#include "seeed_can_acceptance.h"
+#include "mppt_can_codec.h" // /mppt/FRDM-K64F/CAN_BUS/MPPT_CAN_CODEC
 
-#define READING_COUNT        6
-
-// function that gets called on a receiving interrupt witht he specified ID
-void CAN_Interrupt_Received(void);
+// decodes and prints one received message
+void printReadings(const SEEED_CANMessage &msg);
 
 // prints out the status of the CAN Bus initialization
 void printStatus(int);
 
-/*
-* This function converts an 8 char array variable into a float variable
-* and returns it.
-*
-* Expected Result: [0, 2, 3, ., 2, 3, 4] -> 23.234
-*/
-float convertToVariable(unsigned char*);
-
 SEEED_CAN can(SEEED_CAN_CS,SEEED_CAN_IRQ, SEEED_CAN_MOSI, SEEED_CAN_MISO, SEEED_CAN_CLK , 500000);
-SEEED_CANMessage msg; // create empty CAN message
 Serial pc(USBTX, USBRX);                                  
 
 DigitalOut led1(LED1);
 DigitalOut led2(LED2);
 
-// Global variables that hold MPPT readings
-float outVoltage = 0;
-float inCurrent = 0;
-float inVoltage = 0;
-float outCurrent = 0;
-float efficiency = 0;
-char *readingString[] = {
-    "OutVoltage", "InCurrent",
-    "InVoltage", "OutCurrent",
-    "Efficiency"
-};
-float mpptReadings[READING_COUNT] = {outVoltage, inCurrent, inVoltage, outCurrent, efficiency};
-int readingNumber = 0; // counter for which data is being transmitted
+// Global variable that holds the latest MPPT readings: outVoltage, inCurrent, inVoltage, outCurrent, efficiency
+MpptCanReadings mpptReadings = {};
 
 
 //TODO: which data are we going to transmit in the transmitter side?
 int main() {
     printf("SEEED_RECEIVE Program Starting...\r\n");
-    int filterID = 0x07;
-    int can_open_status = can.open(500000, SEEED_CAN::Normal);  // initialize CAN-BUS Shield
+    int filterID = MPPT_CAN_ID;
+    int can_open_status = can.open(mcpBitTiming<500000>(), SEEED_CAN::Normal);  // initialize CAN-BUS Shield
     printStatus(can_open_status);
     
     //TODO: figure out which unique ID we want to use on the receiving side
-    can.mask(0, 0x1FFFFFFF); // Configure Mask 0 to check all bits of a Standard CAN message Id
-    can.mask(1, 0x1FFFFFFF, CANStandard); // Configure Mask 1 to check all bits of a Standard CAN message Id
-    can.filter(0, filterID);  // ONLY ACCEPTS ID listed in filterID variable
+    // The masks and filters that let in the wanted IDs and as few others as the MCP2515 allows; with one
+    // wanted ID, ONLY that ID is accepted. One visit to configuration mode for all of them.
+    const uint32_t wantedIDs[] = { (uint32_t)filterID };
+    CANacceptancePlan plan;
+    if(!mcpPlanAcceptance(wantedIDs, sizeof(wantedIDs) / sizeof(wantedIDs[0]), plan) || !can.configure(plan.acceptance)){
+        printf("CAN-BUS filters could not be set\r\n");
+    } else {
+        printf("CAN-BUS filters let in %lu IDs for %lu wanted (%.2f%% of the others)\r\n", (unsigned long)plan.accepted,
+               (unsigned long)plan.wanted, 100.0f * mcpFalseAcceptRate(plan));
+    }
     printf("CAN-BUS filtering messages with ID: %d\r\n", filterID);
     
-    //TODO: figure out which IRQType to use. Available IRQTypes are found in seeed_can.h on line 251!
-    can.attach(CAN_Interrupt_Received, SEEED_CAN::RxAny); // when an interrupt is triggered, it will call CAN_Interrupt_Received
+    // The interrupt handler only moves received messages into the receive ring; decoding and printing
+    // happen here, so a slow printf no longer holds off the next message (the MCP2515 only holds two)
+    can.rxRing(true);
     
+  SEEED_CANMessage msg;
+  unsigned long dropped = 0;
+  int ticks = 0;
+  uint8_t logRecords[4 * MCP_LOG_RECORD_MAX];
+  unsigned int logBytes;
   while(1) {
-    led1 = !led1; // RED heartbeat to make sure that the program is running
-    wait(1);
+    while(can.rxRead(msg)){
+      printReadings(msg);
+    }
+    // the driver's log records (built with -DSEEED_CAN_LOG_LEVEL), read back with SEEED_LOG_DECODE
+    while((logBytes = mcpLogRead(logRecords, sizeof(logRecords))) > 0){
+      fwrite(logRecords, 1, logBytes, stdout);
+    }
+    if(can.rxDropped() != dropped){
+      dropped = can.rxDropped();
+      printf("Receive ring full, %lu messages dropped so far\r\n", dropped);
+    }
+    if(++ticks == 100){
+      ticks = 0;
+      led1 = !led1; // RED heartbeat to make sure that the program is running
+    }
+    wait_ms(10);
   }
 }
 
@@ -91,43 +98,18 @@ void printStatus(int status){
 }
 
 /*
-* This function is called when the receiver receives a message from a transmitting CAN-BUS. Since the filter is set, it will
-* only accept messages with the ID as specified in the can.filter parameter. In this program, it is 7. 
-* Reads in readings in the following order:
-*   - float mpptReadings[READING_COUNT] = {outVoltage, inCurrent, inVoltage, outCurrent, efficiency};
+* This function is called from the main loop for every message the receiver took from the receive ring. Since the filter is set,
+* only messages with the ID as specified in the can.filter parameter get there. In this program, it is MPPT_CAN_ID.
+* Each message carries all five readings (see mppt_can_codec.h); a message of another length or
+* version is ignored.
 */
-void CAN_Interrupt_Received(void){
-    int counter = 0;
-    if(can.read(msg)) {  // if message is available, read into msg
-      mpptReadings[readingNumber] = convertToVariable(msg.data);
-      printf("%s: %.2f\r\n", readingString[readingNumber], mpptReadings[readingNumber]);
-      readingNumber = (readingNumber + 1) % 5;
-      led2 = !led2; // Yellow toggle receive status LED
+void printReadings(const SEEED_CANMessage &msg){
+    if(mpptCanDecode(msg.data, msg.len, mpptReadings)){
+      printf("OutVoltage: %.2f, InCurrent: %.2f, InVoltage: %.2f, OutCurrent: %.2f, Efficiency: %.2f\r\n",
+             mpptReadings.outVoltage, mpptReadings.inCurrent, mpptReadings.inVoltage,
+             mpptReadings.outCurrent, mpptReadings.efficiency);
     } else{
-        printf("No message data...\r\n");
-        return;
-    } 
+      printf("Unknown message format (%d bytes)...\r\n", msg.len);
+    }
+    led2 = !led2; // Yellow toggle receive status LED
 }
-
-/*
-* This function converts an 8 char array variable into a float variable
-* and returns it.
-*
-* Expected Result: [0, 2, 3, ., 2, 3, 4] -> 23.234
-*/
-float convertToVariable(unsigned char *ptr){
-  float hundreds = ((float)*ptr++ - 48) * 100;
-  hundreds = hundreds < 0 ? 0 : hundreds;
-  float tens = ((float)*ptr++ - 48) * 10;
-  tens = tens < 0 ? 0 : tens;
-  float ones = ((float)*ptr++ - 48) * 1;
-  ones = ones < 0 ? 0 : ones;
-  ptr++; // skip over decimal value
-  float tenths = ((float)*ptr++ - 48) / 10;
-  tenths = tenths < 0 ? 0 : tenths;
-  float hundredths = ((float)*ptr++ - 48) / 100;
-  hundredths = hundredths < 0 ? 0 : hundredths;
-  float thousandths = ((float)*ptr++ - 48) / 1000;
-  thousandths = thousandths < 0 ? 0 : thousandths;
-  return hundreds+tens+ones+tenths+hundredths+thousandths;
-}
\ No newline at end of file
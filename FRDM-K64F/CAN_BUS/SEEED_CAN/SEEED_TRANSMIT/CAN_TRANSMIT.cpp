@@ -21,14 +21,11 @@
 #include "mbed.h"
 #include "seeed_can.h"
 #include "stdlib.h"
-#define MESSAGE_LENGTH 8
+#include "mppt_can_codec.h" // /mppt/FRDM-K64F/CAN_BUS/MPPT_CAN_CODEC
 
-// prints contents that are in the 8 character array
+// prints the packed frame in hex
 void printData(char*); 
 
-// converts a char variable into an 8 character array
-void convertToCharArray(char*, float);
-
 // prints out the status of the CAN Bus initialization
 void printStatus(int);
 
@@ -44,44 +41,33 @@ DigitalOut led2(LED2);
 
 int main()
 {
-    int id = 7; // ID of the CAN_BUS Message TODO: determine which ID to send
-    char can_data[MESSAGE_LENGTH] = {}; // data being transmitted over CAN_BUS
+    char can_data[MPPT_CAN_LENGTH] = {}; // data being transmitted over CAN_BUS
 
     /* 
-    * This is all example data that I will be sending to the CAN-BUS receiver, in the following order: 
-    * outVoltage, inCurrent, inVoltage, and outCurrent
+    * This is all example data that I will be sending to the CAN-BUS receiver, all five readings
+    * packed into one frame (see mppt_can_codec.h)
     */
-    char *readingString[] = {
-        "OutVoltage", "InCurrent",
-        "InVoltage", "OutCurrent"
-    };
-    float dataRead[] = {
-        120.1234, 4.3234, 23.1232, 3.1232    
+    MpptCanReadings dataRead = {
+        120.1234, 4.3234, 23.1232, 3.1232, 95.25
     };
-    int readingNumber = 0; // counter for which data is being transmitted
     
     printf("SEEED_TRANSMIT Program Starting...\r\n"); 
     
-    int can_open_status = can.open(500000, SEEED_CAN::Normal); // initialize CAN-BUS Shield
+    int can_open_status = can.open(mcpBitTiming<500000>(), SEEED_CAN::Normal); // initialize CAN-BUS Shield
     printStatus(can_open_status); // prints status of initialization
         
     while (1) {       
-        convertToCharArray(*&can_data, dataRead[readingNumber]); // convert float to an 8 char number
+        mpptCanEncode(dataRead, (unsigned char *)can_data); // pack the readings into 8 bytes
         
         // transmit 'can_data' to the receiving CAN-BUS      
-        if (can.write(SEEED_CANMessage(id, can_data, MESSAGE_LENGTH, CANData, CANStandard))) { 
-            /*
-            * CAN-BUS TRANSMIT will send reading values in this order: 
-            * "OutVoltage:", "InCurrent:", "InVoltage", "OutCurrent:"
-            */
-            printf("Data being transmitted is: %s\r\n", readingString[readingNumber]);
-            readingNumber = (readingNumber + 1) % 4; // modulus 4 since there are 4 data elements in readingString array
+        if (can.write(SEEED_CANMessage(MPPT_CAN_ID, can_data, MPPT_CAN_LENGTH, CANData, CANStandard))) { 
+            printf("OutVoltage: %.2f, InCurrent: %.2f, InVoltage: %.2f, OutCurrent: %.2f, Efficiency: %.2f\r\n",
+                   dataRead.outVoltage, dataRead.inCurrent, dataRead.inVoltage, dataRead.outCurrent, dataRead.efficiency);
             printData(*&can_data);
             led1 = !led1; // heartbeat
         }else{
-            int reset_status = can.mode(SEEED_CAN::Reset); // reset canbus if there is a problem, returns 1 if successful, 0 otherwise
+            printf("CAN_BUS queue full, frame dropped (%lu dropped)\r\n", can.txDropped()); // write() queues while the TX buffers are busy
          }
-         convertToCharArray(*&can_data, dataRead[readingNumber]); // convert the next value being sent to a char array
          led2 = !led2;
          wait(1);                                                  
     }
@@ -98,42 +84,12 @@ void printStatus(int status){
 }
 
 /*
-* This function converts float numbers to a char array. Limit of 7 characters.
-*
-* Inputs: char* ptr - points to the beginning of buffer[8], the char array where
-*                     we will place the result
-*         float val - the value we want converted to a char array
-*
-* Output: 3 whole number values, dot, 3 decimal points
-*
-* Expected Result: 23.2345 ---->  [0, 2, 3, ., 2, 3, 4]
-* Expected Result: 120.1234 ----> [1, 2, 0, ., 1, 2, 3]
-*/
-void convertToCharArray(char* ptr, float val){
-    memset(ptr, 0, MESSAGE_LENGTH); // empty array  
-    ptr = ptr + 7; // point the pointer to the end of the array
-    int expandedVal = val * 10000; // 23.2345 -> 232345, 120.123 -> 120123
-    int counter = 0;
-    int digit; 
-    while (expandedVal > 0) {
-        digit = expandedVal % 10;
-        *ptr = digit + '0'; // convert to a char
-        counter++; ptr--;
-        if(counter == 4){
-            *ptr = '.';
-            ptr--;
-        }
-        expandedVal /= 10;
-    }
-}
-
-/*
-* This function prints out all the character elements inside an 8 character array
+* This function prints out the 8 bytes of the packed frame in hex
 */
 void printData(char* ptr){
     int counter = 0;
-    while(counter < MESSAGE_LENGTH){
-        printf("%c", *ptr++);
+    while(counter < MPPT_CAN_LENGTH){
+        printf("%02X ", (unsigned char)*ptr++);
         counter++;
     }
     printf("\r\n");
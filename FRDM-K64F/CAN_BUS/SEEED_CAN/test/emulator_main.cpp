@@ -0,0 +1,1855 @@
+/*************************** emulator_main.cpp ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: SEEED_CAN Library on the MCP2515 Emulator
+ *
+ * Purpose: Runs the unmodified SEEED_CAN library (../SEEED_CAN_LIBRARY) on a workstation against
+ * the register-level MCP2515 model (mcp2515_model.h), through the host mbed shim (mbed.h).
+ *
+ *      1. open(): operating mode, bit timing at the usual rates, reset state of the buffers; the
+ *         CNF1-3 of the bit-timing solver on 8, 16 and 20 MHz shields.
+ *      2. Loopback: standard and extended, data and remote frames come back unchanged.
+ *      3. Two nodes: the MPPT readings frame (../../MPPT_CAN_CODEC) from the transmitter to a
+ *         receiver set up like CAN_RECEIVE (masks, filter on MPPT_CAN_ID, RxAny interrupt); a
+ *         frame with another ID is filtered out.
+ *      4. Chip rules the driver depends on: CNF writes outside configuration mode, ACK errors of a
+ *         lone node (TEC, error passive), locked and aborted transmit buffers, RX rollover and
+ *         overflow, READ RX BUFFER clearing RXnIF, waking from sleep.
+ *      5. SPI transactions, bytes and time of each library call.
+ *      6. Transmit path: SPI bytes and time per frame with the TX header cache of mcpCanWrite(),
+ *         against the old path that loaded the whole 13 byte buffer every time.
+ *      7. Throughput: MPPT frames per second through mcpCanWrite() with one SPI call per byte, with
+ *         block transfers, and with the TX buffer loaded in the background, with and without other
+ *         work between the frames.
+ *      8. Receive bursts: frames back to back at 500 kbit/s into a receiver that reads them in its
+ *         RxAny interrupt, one frame per interrupt the old way, one with read(), or all of them
+ *         with readAll(); receive buffer overruns (RX0OVR/RX1OVR) and frames lost.
+ *      9. Transmit queue: bursts written back to back with write(), frames queued while the three
+ *         TX buffers are busy and sent from the TXnIF interrupts; bus load, queue high-water mark,
+ *         drops, and the order on the bus, against write() without the queue.
+ *     10. Receive ring: the lock-free ring on two threads, then frames back to back taken from it
+ *         in the main loop, against handling them in the RxAny interrupt; frames lost.
+ *     11. Transmit priority: four classes of frames written with write(msg, priority) under load,
+ *         latency from write() to the end of the frame on the bus per class, against writing them
+ *         all as TxNormal; lower priority frames aborted for TxUrgent ones.
+ *     12. Log: the driver's records at SEEED_CAN_LOG_LEVEL 3, decoded with seeed_can_log_decode.h
+ *         from a stream shared with printf text; a full ring and the records it drops.
+ *     13. Acceptance masks and filters: a full set written with configure() (one visit to
+ *         configuration mode, verified by readback) against mask() and filter() one at a time;
+ *         at start-up and on a chip in use.
+ *     14. Acceptance filter planner: masks and filters for sets of wanted ids from
+ *         mcpPlanAcceptance(), against one mask shared by both buffers; ids let in and the
+ *         false-accept rate, and one plan tried on the chip with every standard id.
+ *     15. Shadow registers: the configuration registers kept in mcp_can_t against the chip after
+ *         every kind of call; reads without SPI, status registers from the chip, invalidation.
+ *
+ * Instructions: To compile code:
+ *                  $g++ -std=c++11 -O2 -DSEEED_CAN_LOG_LEVEL=3 -I. -I../SEEED_CAN_LIBRARY -I../../MPPT_CAN_CODEC -pthread -o runEmu emulator_main.cpp mcp2515_model.cpp host_mbed.cpp ../SEEED_CAN_LIBRARY/seeed_can.cpp ../SEEED_CAN_LIBRARY/seeed_can_api.cpp ../SEEED_CAN_LIBRARY/seeed_can_spi.cpp ../SEEED_CAN_LIBRARY/seeed_can_log.cpp
+ *               To run code: $./runEmu
+ *               The exit code is 0 when every check passes.
+ *
+ *****************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include "mbed.h"
+#include "seeed_can.h"
+#include "mcp2515_model.h"
+#include "mppt_can_codec.h"
+#include "seeed_can_log_decode.h"
+#include "seeed_can_acceptance.h"
+
+#define SPI_RATE        500000      // SPI clock of the MPPT firmware and the CAN_BUS examples (Hz)
+#define CAN_RATE        500000      // bit/s of the MPPT's CAN bus
+#define TIMEOUT_NS      10000000    // 10 ms to wait for a frame
+#define BENCH_CAN_RATE  1000000     // bit/s for the throughput runs, so the bus is not the limit
+#define BENCH_FRAMES    200
+#define BENCH_WORK_US   200         // other work of the caller between two frames
+
+/* SEEED_CAN with its mcp_can_t in reach, for the low-level calls */
+class TestCan : public SEEED_CAN
+{
+public:
+    TestCan(PinName ncs, PinName irq, int spiRate = SPI_RATE) :
+        SEEED_CAN(ncs, irq, SEEED_CAN_MOSI, SEEED_CAN_MISO, SEEED_CAN_CLK, spiRate) {}
+    mcp_can_t *mcp(void) { return &_can; }
+};
+
+/* A CAN-BUS Shield: the chip, wired up before the library opens it */
+struct Node {
+    Mcp2515  chip;
+    TestCan *can;
+
+    Node(CanBus &bus, PinName ncs, PinName irq, int spiRate = SPI_RATE,
+         uint32_t oscillator = MCP2515_OSCILLATOR) : chip(oscillator)
+    {
+        hostBind(chip, ncs, irq);
+        bus.attach(chip);
+        can = new TestCan(ncs, irq, spiRate);
+    }
+    ~Node() { delete can; }
+};
+
+static bool check(bool condition, const char *what)
+{
+    if(!condition) printf("  FAILED: %s\n", what);
+    return condition;
+}
+
+/* Reads a frame, waiting up to TIMEOUT_NS for one */
+static bool readFrame(TestCan &can, SEEED_CANMessage &msg)
+{
+    uint64_t deadline = hostNow() + TIMEOUT_NS;
+    while(!can.read(msg)){
+        if(hostNow() > deadline) return false;
+        wait_us(10);
+    }
+    return true;
+}
+
+static bool sameFrame(const CAN_Message &a, const CAN_Message &b)
+{
+    return a.id == b.id && a.format == b.format && a.type == b.type && a.len == b.len &&
+           (a.type == CANRemote || !memcmp(a.data, b.data, a.len));
+}
+
+/* SPI traffic and time of the last call, measured from 'start' */
+static void printCost(const char *call, Mcp2515 &chip, uint64_t start)
+{
+    const Mcp2515::Traffic &t = chip.traffic();
+    printf("  %-34s %6lu %6lu %9.1f\n", call, t.transactions, t.bytes, (hostNow() - start) / 1000.0);
+}
+
+// The solver runs in the compiler: 16 MHz, 500 kbit/s is 16 Tq (BRP 1), sampled at 87.5%
+static_assert(mcpBitTiming<500000>().cnf[2] == 0x00 && mcpBitTiming<500000>().cnf[1] == 0xAE &&
+              mcpBitTiming<500000>().cnf[0] == 0x01, "CNF1-3 for 500 kbit/s at 16 MHz");
+// 1 Mbit/s needs 8 Tq of 250 ns: an 8 MHz oscillator cannot make them (mcpBitTiming<> would not compile)
+static_assert(!mcpBitTimingValid(mcpSolveBitTiming(8000000, 1000000)), "1 Mbit/s unreachable at 8 MHz");
+
+/* open() with the timing of every shield oscillator: bit time and sample point as worked out */
+static bool checkOscillators(const int *rates, size_t n)
+{
+    static const uint32_t oscillators[] = { 8000000, 16000000, 20000000 };
+    bool pass = true;
+
+    printf("  oscillator    bit/s  CNF1 CNF2 CNF3   Tq  sample point\n");
+    for(size_t o = 0; o < sizeof(oscillators) / sizeof(oscillators[0]); o++){
+        for(size_t i = 0; i < n; i++){
+            CANbitTiming timing = mcpSolveBitTiming(oscillators[o], rates[i]);
+            if(!mcpBitTimingValid(timing)){
+                printf("  %6lu kHz  %7d  not reachable\n", (unsigned long)oscillators[o] / 1000, rates[i]);
+                pass = check(oscillators[o] == 8000000 && rates[i] == 1000000, "only 1 Mbit/s at 8 MHz unreachable") && pass;
+                continue;
+            }
+            hostReset();
+            CanBus bus;
+            hostBus(&bus);
+            Node a(bus, SEEED_CAN_CS, SEEED_CAN_IRQ, SPI_RATE, oscillators[o]);
+            int opened = a.can->open(timing, SEEED_CAN::Normal);
+            int quanta = (int)((uint64_t)a.chip.bitTime() * oscillators[o] / 2000000000ULL / ((timing.cnf[2] & 0x3F) + 1));
+            printf("  %6lu kHz  %7d    %02X   %02X   %02X  %3d  %5.1f%%\n", (unsigned long)oscillators[o] / 1000, rates[i],
+                   timing.cnf[2], timing.cnf[1], timing.cnf[0], quanta, a.chip.samplePoint() / 10.0);
+            pass = check(opened == 1 && a.chip.mode() == 0, "open(timing) in normal mode") && pass;
+            pass = check(a.chip.bitTime() == 1000000000ULL / rates[i], "bit time") && pass;
+            pass = check(a.chip.samplePoint() >= 750 && a.chip.samplePoint() <= CAN_SAMPLE_POINT, "sample point 75% to 87.5%") && pass;
+        }
+    }
+    return pass;
+}
+
+/*
+* 1. open(): mode, bit timing and the state the driver leaves the chip in.
+*/
+static bool checkOpen(void)
+{
+    static const int rates[] = { 1000000, 500000, 250000, 125000, 100000 };
+    bool pass = true;
+
+    printf("1. open()\n");
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    Node a(bus, SEEED_CAN_CS, SEEED_CAN_IRQ);
+
+    for(size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++){
+        a.chip.clearTraffic();
+        uint64_t start = hostNow();
+        int opened = a.can->open(rates[i], SEEED_CAN::Normal);
+        printf("  %7d bit/s: bit time %5llu ns, sampled at %.1f%%, %lu SPI transactions, %lu bytes, %.1f us\n", rates[i],
+               (unsigned long long)a.chip.bitTime(), a.chip.samplePoint() / 10.0, a.chip.traffic().transactions,
+               a.chip.traffic().bytes, (hostNow() - start) / 1000.0);
+        pass = check(opened == 1, "open() returns 1") && pass;
+        pass = check(a.chip.mode() == 0, "normal mode after open()") && pass;
+        pass = check(a.chip.bitTime() == 1000000000ULL / rates[i], "bit time") && pass;
+    }
+
+    bool cleared = true;
+    for(int r = MCP_RXF0SIDH; r < MCP_CNF3; r++){
+        if((r & 0x0F) < 0x0E && r != MCP_TEC && r != MCP_REC && a.chip.peek(r)) cleared = false;
+    }
+    pass = check(cleared, "masks and filters cleared") && pass;
+    pass = check(a.chip.peek(MCP_RXB0CTRL) == 0x06, "RXB0CTRL: any frame through the filters, rollover on") && pass;
+    pass = check(a.chip.peek(MCP_RXB1CTRL) == 0x00, "RXB1CTRL: any frame through the filters") && pass;
+    pass = check(a.chip.peek(MCP_CANINTE) == 0x00, "no interrupts until attach()") && pass;
+
+    // A rate the oscillator cannot make is refused before the chip is reset
+    pass = check(a.can->open(123457, SEEED_CAN::Normal) == 0 && a.chip.mode() == 0,
+                 "unreachable rate refused, chip still in normal mode") && pass;
+    pass = check(a.chip.bitTime() == 1000000000ULL / rates[sizeof(rates) / sizeof(rates[0]) - 1], "bit time kept") && pass;
+
+    // open() goes straight to the mode asked for, with the bit rate or with CNF1-3 worked out beforehand
+    pass = check(a.can->open(CAN_RATE, SEEED_CAN::Loopback) == 1 && a.chip.mode() == 2, "open(rate, Loopback)") && pass;
+    pass = check(a.can->open(mcpBitTiming<CAN_RATE>(), SEEED_CAN::Monitor) == 1 && a.chip.mode() == 3,
+                 "open(timing, Monitor): listen-only") && pass;
+    pass = check(a.can->open(mcpBitTiming<CAN_RATE>(), SEEED_CAN::Normal) == 1 && a.chip.mode() == 0,
+                 "open(timing, Normal)") && pass;
+
+    pass = checkOscillators(rates, sizeof(rates) / sizeof(rates[0])) && pass;
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/*
+* 2. Loopback: every kind of frame comes back as it was sent.
+*/
+static bool checkLoopback(void)
+{
+    static const char data[8] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, (char)0x88 };
+    SEEED_CANMessage sent[4] = {
+        SEEED_CANMessage(0x123, data, 8, CANData, CANStandard),
+        SEEED_CANMessage(0x1ABCDEF0, data, 3, CANData, CANExtended),
+        SEEED_CANMessage(0x055, CANStandard),
+        SEEED_CANMessage(0x1234567, CANExtended)
+    };
+    bool pass = true;
+
+    printf("2. Loopback\n");
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    Node a(bus, SEEED_CAN_CS, SEEED_CAN_IRQ);
+
+    a.can->open(CAN_RATE, SEEED_CAN::Normal);
+    pass = check(a.can->mode(SEEED_CAN::Loopback) == 1 && a.chip.mode() == 2, "loopback mode") && pass;
+    // Filters apply to standard frames unless EXIDE is set: filter 1 lets the extended frames in
+    pass = check(a.can->filter(1, 0, CANExtended) == 1, "filter 1 for extended frames") && pass;
+    pass = check(a.chip.mode() == 2, "back in loopback mode after filter()") && pass;
+
+    for(int i = 0; i < 4; i++){
+        SEEED_CANMessage received;
+        bool written = a.can->write(sent[i]) == 1;
+        bool read = written && readFrame(*a.can, received);
+        bool same = read && sameFrame(sent[i], received);
+        printf("  %-9s %-6s id 0x%08X len %d: %s\n", sent[i].format == CANExtended ? "extended" : "standard",
+               sent[i].type == CANRemote ? "remote" : "data", sent[i].id, sent[i].len,
+               same ? "received" : !written ? "not written" : !read ? "not received" : "different");
+        pass = check(same, "loopback round trip") && pass;
+    }
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+// Receiver of section 3, set up like CAN_RECEIVE
+static TestCan *receiver = NULL;
+static MpptCanReadings received = {};
+static int receivedFrames = 0;
+static uint64_t receivedAt = 0;
+
+static void onReceive(void)
+{
+    SEEED_CANMessage msg;
+    if(receiver->read(msg)){
+        if(mpptCanDecode(msg.data, msg.len, received)) receivedFrames++;
+        receivedAt = hostNow();
+    }
+}
+
+/*
+* 3. Two nodes: the MPPT readings from the transmitter to a receiver filtering on MPPT_CAN_ID.
+*/
+static bool checkTwoNodes(void)
+{
+    MpptCanReadings readings = { 48.3f, 5.2f, 31.7f, 3.1f, 95.2f }, expected = {};
+    unsigned char data[MPPT_CAN_LENGTH];
+    bool pass = true;
+
+    printf("3. Two nodes, MPPT readings at %d kbit/s\n", CAN_RATE / 1000);
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    bus.record(true);
+    Node tx(bus, SEEED_CAN_CS, SEEED_CAN_IRQ);
+    Node rx(bus, SEEED_CAN_IO9, PTC3);
+
+    pass = check(tx.can->open(CAN_RATE, SEEED_CAN::Normal) == 1, "transmitter open()") && pass;
+    pass = check(rx.can->open(CAN_RATE, SEEED_CAN::Normal) == 1, "receiver open()") && pass;
+    rx.can->mask(0, 0x1FFFFFFF);
+    rx.can->mask(1, 0x1FFFFFFF, CANStandard);
+    rx.can->filter(0, MPPT_CAN_ID);
+    receiver = rx.can;
+    rx.can->attach(onReceive, SEEED_CAN::RxAny);
+
+    mpptCanEncode(readings, data);
+    mpptCanDecode(data, MPPT_CAN_LENGTH, expected);
+    uint64_t start = hostNow();
+    pass = check(tx.can->write(SEEED_CANMessage(MPPT_CAN_ID, (const char *)data, MPPT_CAN_LENGTH, CANData, CANStandard)) == 1,
+                 "write() the readings") && pass;
+    while(!receivedFrames && hostNow() < start + TIMEOUT_NS) wait_us(10);
+
+    pass = check(receivedFrames == 1, "readings frame received by the interrupt") && pass;
+    pass = check(!memcmp(&received, &expected, sizeof(received)), "readings unchanged") && pass;
+    if(!bus.log().empty()){
+        const CanBusRecord &r = bus.log()[0];
+        printf("  frame: %d bits, %.1f us on the bus; write() to the end of the receive interrupt: %.1f us\n",
+               canFrameBits(r.frame), (r.end - r.start) / 1000.0, (receivedAt - start) / 1000.0);
+        pass = check(r.acknowledged && r.end - r.start == (uint64_t)canFrameBits(r.frame) * 1000000000ULL / CAN_RATE,
+                     "frame time from the bit timing") && pass;
+    }
+    printf("  readings: %.2f V %.2f A %.2f V %.2f A %.2f %%\n", received.outVoltage, received.inCurrent,
+           received.inVoltage, received.outCurrent, received.efficiency);
+
+    // Another ID: acknowledged on the bus, but the filter keeps it out
+    start = hostNow();
+    tx.can->write(SEEED_CANMessage(0x100, (const char *)data, MPPT_CAN_LENGTH, CANData, CANStandard));
+    wait_ms(2);
+    pass = check(bus.frames() == 2, "second frame sent") && pass;
+    pass = check(receivedFrames == 1 && !(rx.chip.peek(MCP_CANINTF) & MCP_RX_INTS), "ID 0x100 filtered out") && pass;
+    receiver = NULL;
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/* Writes one standard data frame and waits until it has been on the bus */
+static void sendFrame(Node &node, CanBus &bus, int id)
+{
+    static const char data[2] = { 0x5A, (char)0xA5 };
+    size_t before = bus.log().size();
+    node.can->write(SEEED_CANMessage(id, data, 2, CANData, CANStandard));
+    while(bus.log().size() == before) wait_us(10);
+}
+
+/*
+* 4. Rules of the chip the driver depends on.
+*/
+static bool checkChipRules(void)
+{
+    bool pass = true;
+
+    printf("4. MCP2515 rules\n");
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    bus.record(true);
+    Node a(bus, SEEED_CAN_CS, SEEED_CAN_IRQ);
+    Node b(bus, SEEED_CAN_IO9, PTC3);
+    a.can->open(CAN_RATE, SEEED_CAN::Normal);
+    b.can->open(CAN_RATE, SEEED_CAN::Normal);
+    b.can->mode(SEEED_CAN::Config);                             // on the bus, but silent
+
+    // CNF registers can only be written in configuration mode
+    uint8_t cnf1 = a.chip.peek(MCP_CNF1);
+    mcpWrite(a.can->mcp(), MCP_CNF1, 0x3F);
+    pass = check(a.chip.peek(MCP_CNF1) == cnf1 && a.chip.ignoredWrites() == 1, "CNF1 write ignored in normal mode") && pass;
+
+    // Nobody acknowledges: TEC rises by 8 per attempt up to error passive, where it stays
+    a.can->write(SEEED_CANMessage(0x321, "ack?", 4, CANData, CANStandard));
+    wait_ms(10);
+    printf("  alone on the bus: %lu attempts in 10 ms, TEC %d, EFLG 0x%02X\n", bus.errors(), a.can->tderror(), a.can->errorFlags());
+    pass = check(bus.frames() == 0 && bus.errors() > 16, "no acknowledgement, frame sent again") && pass;
+    pass = check(a.can->tderror() == 128 && a.can->errors(SEEED_CAN::TxPasv) == 1, "TEC 128, error passive") && pass;
+    // write() at TxNormal: TXB1 at TXP 1 (TXB2 is kept for TxUrgent)
+    pass = check((a.chip.peek(MCP_TXB1CTRL) & (MCP_TXB_TXERR_M | MCP_TXB_TXREQ_M | MCP_TXB_TXP10_M)) == (MCP_TXB_TXERR_M | MCP_TXB_TXREQ_M | 1),
+                 "TXB1: TXP 1, TXERR, still pending") && pass;
+
+    // A pending transmit buffer is locked; clearing TXREQ aborts it once the frame on the bus has ended
+    uint8_t sidh = a.chip.peek(MCP_TXB1CTRL + 1);
+    mcpWrite(a.can->mcp(), MCP_TXB1CTRL + 1, ~sidh);
+    pass = check(a.chip.peek(MCP_TXB1CTRL + 1) == sidh, "pending TXB1 locked") && pass;
+    mcpBitModify(a.can->mcp(), MCP_TXB1CTRL, MCP_TXB_TXREQ_M, 0);
+    unsigned long attempts = bus.errors();
+    wait_us(300);
+    pass = check((a.chip.peek(MCP_TXB1CTRL) & (MCP_TXB_ABTF_M | MCP_TXB_TXREQ_M)) == MCP_TXB_ABTF_M && bus.errors() <= attempts + 1,
+                 "TXB1 aborted (ABTF), not sent again") && pass;
+
+    // Reset clears the error counters
+    a.can->mode(SEEED_CAN::Reset);
+    pass = check(a.chip.mode() == 4 && a.can->tderror() == 0, "Reset: configuration mode, TEC 0") && pass;
+    a.can->open(CAN_RATE, SEEED_CAN::Normal);
+    b.can->mode(SEEED_CAN::Normal);
+
+    // Three frames, nothing read: RXB0, rolled over into RXB1, then lost (RX1OVR)
+    bus.clearLog();
+    for(int id = 0x10; id < 0x13; id++) sendFrame(a, bus, id);
+    uint8_t intf = b.chip.peek(MCP_CANINTF);
+    pass = check((intf & MCP_RX_INTS) == MCP_RX_INTS, "RXB0 and RXB1 full") && pass;
+    pass = check(b.can->errors(SEEED_CAN::Rx1Ovr) == 1 && b.can->errors(SEEED_CAN::Rx0Ovr) == 0 && b.chip.overflows() == 1,
+                 "third frame lost, RX1OVR") && pass;
+    uint8_t rxStatus = mcpReceiveStatus(b.can->mcp());
+    pass = check((rxStatus & MCP_RXSTAT_RXB_MASK) == MCP_RXSTAT_BOTH && (rxStatus & MCP_RXSTAT_RXF_MASK) == MCP_RXSTAT_RXF0,
+                 "RX STATUS: both buffers, RXB0 through filter 0") && pass;
+
+    // READ RX BUFFER frees the buffer it read when chip select goes high
+    uint8_t rxb1[5];
+    mcpReadBuffer(b.can->mcp(), MCP_READ_RX1, rxb1, sizeof(rxb1));
+    int rxb1Id = (rxb1[0] << 3) | (rxb1[1] >> 5);
+    pass = check(rxb1Id == (int)bus.log()[1].frame.id, "RXB1 holds the second frame") && pass;
+    pass = check((b.chip.peek(MCP_CANINTF) & MCP_RX_INTS) == MCP_RX0IF, "READ RX BUFFER cleared RX1IF only") && pass;
+
+    SEEED_CANMessage msg;
+    pass = check(b.can->read(msg) == 1 && msg.id == bus.log()[0].frame.id, "read() the frame in RXB0") && pass;
+    pass = check(b.can->read(msg) == 0, "then nothing to read") && pass;
+
+    // Two frames, then two read()s: RXB0, then RXB1
+    mcpBitModify(b.can->mcp(), MCP_EFLG, MCP_EFLG_RX1OVR, 0);
+    bus.clearLog();
+    sendFrame(a, bus, 0x20);
+    sendFrame(a, bus, 0x21);
+    SEEED_CANMessage first, second;
+    b.can->read(first);
+    b.can->read(second);
+    pass = check(first.id == bus.log()[0].frame.id && second.id == bus.log()[1].frame.id, "read() RXB0, then RXB1") && pass;
+
+    // Two frames, one readAll(): RX STATUS once, READ RX BUFFER for each, INT released
+    bus.clearLog();
+    sendFrame(a, bus, 0x22);
+    sendFrame(a, bus, 0x23);
+    SEEED_CANMessage both[2];
+    b.chip.clearTraffic();
+    int n = b.can->readAll(both, 2);
+    pass = check(n == 2 && both[0].id == bus.log()[0].frame.id && both[1].id == bus.log()[1].frame.id,
+                 "readAll() both frames, oldest first") && pass;
+    pass = check(b.chip.traffic().transactions == 3 && b.chip.traffic().instructions[MCP_RX_STATUS] == 1 &&
+                 !b.chip.interrupt(), "one RX STATUS, no BIT MODIFY, INT released") && pass;
+
+    // A sleeping chip wakes up on bus activity, in listen-only mode, and misses that frame
+    b.can->mode(SEEED_CAN::Sleep);
+    pass = check(b.chip.mode() == 1, "sleep mode") && pass;
+    mcpWrite(b.can->mcp(), MCP_CANINTF, 0);
+    bus.clearLog();
+    a.can->write(SEEED_CANMessage(0x30, "wake", 4, CANData, CANStandard));
+    wait_ms(1);
+    pass = check(b.chip.mode() == 3 && (b.chip.peek(MCP_CANINTF) & MCP_WAKIF), "woken up, listen-only, WAKIF") && pass;
+    pass = check(!(b.chip.peek(MCP_CANINTF) & MCP_RX_INTS) && !bus.log().empty() && !bus.log()[0].acknowledged,
+                 "frame not acknowledged or received") && pass;
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+static void onSpiCostIrq(void) {}
+
+/*
+* 5. SPI traffic of the library calls, SPI at SPI_RATE. The time includes HOST_SPI_CALL_NS per
+* byte and HOST_GPIO_NS per chip select edge (mbed.h).
+*/
+static bool checkSpiCost(void)
+{
+    static const char data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    bool pass = true;
+
+    printf("5. SPI cost per call (SPI %d kHz, CAN %d kbit/s)\n", SPI_RATE / 1000, CAN_RATE / 1000);
+    printf("  %-34s %6s %6s %9s\n", "call", "trans", "bytes", "us");
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    Node tx(bus, SEEED_CAN_CS, SEEED_CAN_IRQ);
+    Node rx(bus, SEEED_CAN_IO9, PTC3);
+
+    uint64_t start = hostNow();
+    pass = check(tx.can->open(CAN_RATE, SEEED_CAN::Normal) == 1, "open()") && pass;
+    printCost("open(500000, Normal)", tx.chip, start);
+    rx.can->open(CAN_RATE, SEEED_CAN::Normal);
+
+    rx.chip.clearTraffic();
+    start = hostNow();
+    pass = check(rx.can->mask(0, 0x7FF) == 1, "mask()") && pass;
+    printCost("mask(0, 0x7FF)", rx.chip, start);
+    rx.chip.clearTraffic();
+    start = hostNow();
+    pass = check(rx.can->filter(0, MPPT_CAN_ID) == 1, "filter()") && pass;
+    printCost("filter(0, MPPT_CAN_ID)", rx.chip, start);
+
+    tx.chip.clearTraffic();
+    start = hostNow();
+    pass = check(tx.can->write(SEEED_CANMessage(MPPT_CAN_ID, data, 8, CANData, CANStandard)) == 1, "write()") && pass;
+    mcpWait(tx.can->mcp());                                     // the whole transfer, not just the call
+    printCost("write(), 8 data bytes", tx.chip, start);
+    wait_ms(1);
+
+    SEEED_CANMessage msg;
+    rx.chip.clearTraffic();
+    start = hostNow();
+    pass = check(rx.can->read(msg) == 1 && msg.id == MPPT_CAN_ID, "read()") && pass;
+    printCost("read(), frame waiting", rx.chip, start);
+    rx.chip.clearTraffic();
+    start = hostNow();
+    pass = check(rx.can->read(msg) == 0, "read() with nothing waiting") && pass;
+    printCost("read(), nothing waiting", rx.chip, start);
+
+    rx.chip.clearTraffic();
+    start = hostNow();
+    rx.can->errors();
+    printCost("errors()", rx.chip, start);
+    rx.chip.clearTraffic();
+    start = hostNow();
+    rx.can->errorFlags();
+    printCost("errorFlags()", rx.chip, start);
+    rx.chip.clearTraffic();
+    start = hostNow();
+    rx.can->interrupts(SEEED_CAN::RxAny);
+    printCost("interrupts(RxAny)", rx.chip, start);
+    rx.chip.clearTraffic();
+    start = hostNow();
+    rx.can->interruptFlags();
+    printCost("interruptFlags()", rx.chip, start);
+
+    rx.chip.clearTraffic();
+    start = hostNow();
+    pass = check(rx.can->mode(SEEED_CAN::Loopback) == 1, "mode(Loopback)") && pass;
+    printCost("mode(Loopback)", rx.chip, start);
+    rx.chip.clearTraffic();
+    start = hostNow();
+    pass = check(rx.can->mode(SEEED_CAN::Loopback) == 1, "mode(Loopback), already in it") && pass;
+    printCost("mode(Loopback), already in it", rx.chip, start);
+    rx.chip.clearTraffic();
+    start = hostNow();
+    pass = check(rx.can->mode(SEEED_CAN::Normal) == 1 && rx.chip.mode() == 0, "mode(Normal)") && pass;
+    printCost("mode(Normal)", rx.chip, start);
+    rx.chip.clearTraffic();
+    start = hostNow();
+    pass = check(rx.can->frequency(CAN_RATE) == 1, "frequency()") && pass;
+    printCost("frequency(500000)", rx.chip, start);
+    CANacceptance acceptance = { { 0x7FF, 0x7FF }, { 0, 0 }, { MPPT_CAN_ID, MPPT_CAN_ID, MPPT_CAN_ID, MPPT_CAN_ID, MPPT_CAN_ID, MPPT_CAN_ID },
+                                 { 0, 0, 0, 0, 0, 0 } };
+    rx.chip.clearTraffic();
+    start = hostNow();
+    pass = check(rx.can->configure(acceptance) == 1, "configure()") && pass;
+    printCost("configure(), 2 masks and 6 filters", rx.chip, start);
+    rx.chip.clearTraffic();
+    start = hostNow();
+    rx.can->attach(onSpiCostIrq, SEEED_CAN::RxAny);
+    printCost("attach(fn, RxAny)", rx.chip, start);
+    rx.can->attach((void (*)(void))NULL, SEEED_CAN::None);
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/*
+* mcpCanWrite() as it was before the TX header cache: READ STATUS, the whole 13 byte CANMsg with
+* LOAD TX BUFFER, RTS. Kept here to measure the old transmit path against the new one.
+*/
+static uint8_t writeFullBuffer(mcp_can_t *obj, const CAN_Message &msg)
+{
+    union {
+        CANMsg x;
+        uint8_t y[sizeof(CANMsg)];
+    };
+    uint8_t bufferCommand[] = {MCP_WRITE_TX0, MCP_WRITE_TX1, MCP_WRITE_TX2};
+    uint8_t rtsCommand[] = {MCP_RTS_TX0, MCP_RTS_TX1, MCP_RTS_TX2};
+    uint8_t status = mcpStatus(obj);
+    int num = !(status & MCP_STAT_TX0REQ) ? 0 : !(status & MCP_STAT_TX1REQ) ? 1 : !(status & MCP_STAT_TX2REQ) ? 2 : -1;
+
+    if(num < 0) return 0;
+    memset(y, 0, sizeof(y));
+    x.id.sid10_3 = (uint8_t)(msg.id >> 3);                      // standard frames only
+    x.id.sid2_0 = (uint8_t)(msg.id & 0x07);
+    x.dlc = msg.len & 0x0f;
+    memcpy(x.data, msg.data, x.dlc);
+    mcpWriteBuffer(obj, bufferCommand[num], y, sizeof(x));
+    mcpBufferRTS(obj, rtsCommand[num]);
+    obj->txHeaderValid &= ~(1 << num);                          // the cache no longer knows this buffer
+    return 1;
+}
+
+/*
+* 6. Transmit path: SPI bytes and time per write() of the MPPT frame, the old way (whole buffer)
+* and with the TX header cache (payload only once the id and DLC are loaded). Every frame must
+* reach the receiver unchanged, also when the id changes and after a reset.
+*/
+static bool checkTransmitPath(void)
+{
+    static const int frames = 50;
+    unsigned char data[MPPT_CAN_LENGTH];
+    MpptCanReadings readings = { 48.3f, 5.2f, 31.7f, 3.1f, 95.2f };
+    bool pass = true, intact = true;
+
+    printf("6. Transmit path, MPPT frame (SPI %d kHz)\n", SPI_RATE / 1000);
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    Node tx(bus, SEEED_CAN_CS, SEEED_CAN_IRQ);
+    Node rx(bus, SEEED_CAN_IO9, PTC3);
+    tx.can->open(CAN_RATE, SEEED_CAN::Normal);
+    rx.can->open(CAN_RATE, SEEED_CAN::Normal);
+
+    // Old path
+    unsigned long oldBytes = 0, oldTransactions = 0;
+    uint64_t oldTime = 0;
+    for(int n = 0; n < frames; n++){
+        readings.inCurrent = 0.01f * n;
+        mpptCanEncode(readings, data);
+        SEEED_CANMessage sent(MPPT_CAN_ID, (const char *)data, MPPT_CAN_LENGTH), got;
+        tx.chip.clearTraffic();
+        uint64_t start = hostNow();
+        writeFullBuffer(tx.can->mcp(), sent);
+        oldTime += hostNow() - start;
+        oldBytes += tx.chip.traffic().bytes;
+        oldTransactions += tx.chip.traffic().transactions;
+        intact = readFrame(*rx.can, got) && sameFrame(sent, got) && intact;
+    }
+
+    // Header cache: the first write loads the id and DLC, the others only the payload
+    unsigned long newBytes = 0, newTransactions = 0, firstBytes = 0;
+    uint64_t newTime = 0;
+    for(int n = 0; n < frames; n++){
+        readings.inCurrent = 0.01f * n;
+        mpptCanEncode(readings, data);
+        SEEED_CANMessage sent(MPPT_CAN_ID, (const char *)data, MPPT_CAN_LENGTH), got;
+        tx.chip.clearTraffic();
+        uint64_t start = hostNow();
+        pass = check(tx.can->write(sent) == 1, "write()") && pass;
+        mcpWait(tx.can->mcp());
+        if(n == 0){
+            firstBytes = tx.chip.traffic().bytes;
+        } else {
+            newTime += hostNow() - start;
+            newBytes += tx.chip.traffic().bytes;
+            newTransactions += tx.chip.traffic().transactions;
+        }
+        intact = readFrame(*rx.can, got) && sameFrame(sent, got) && intact;
+    }
+
+    // Another id and length in the same buffer, back again, and a reset in between
+    static const char other[3] = { 9, 8, 7 };
+    SEEED_CANMessage sequence[4] = {
+        SEEED_CANMessage(0x100, other, 3),
+        SEEED_CANMessage(MPPT_CAN_ID, (const char *)data, MPPT_CAN_LENGTH),
+        SEEED_CANMessage(0x100, CANStandard),
+        SEEED_CANMessage(MPPT_CAN_ID, (const char *)data, MPPT_CAN_LENGTH)
+    };
+    for(int n = 0; n < 4; n++){
+        SEEED_CANMessage got;
+        if(n == 3){
+            tx.can->mode(SEEED_CAN::Reset);
+            tx.can->open(CAN_RATE, SEEED_CAN::Normal);
+        }
+        tx.can->write(sequence[n]);
+        intact = readFrame(*rx.can, got) && sameFrame(sequence[n], got) && intact;
+    }
+
+    double oldPerFrame = (double)oldBytes / frames, newPerFrame = (double)newBytes / (frames - 1);
+    printf("  %-32s %8s %8s %10s\n", "", "trans", "bytes", "us");
+    printf("  %-32s %8.1f %8.1f %10.1f\n", "whole buffer (before)", (double)oldTransactions / frames, oldPerFrame, oldTime / 1000.0 / frames);
+    printf("  %-32s %8s %8lu %10s\n", "header cache, first frame", "", firstBytes, "");
+    printf("  %-32s %8.1f %8.1f %10.1f\n", "header cache, payload only", (double)newTransactions / (frames - 1), newPerFrame,
+           newTime / 1000.0 / (frames - 1));
+    printf("  SPI bytes per frame cut %.0f%%, time %.0f%%\n", 100 * (1 - newPerFrame / oldPerFrame),
+           100 * (1 - (newTime / (double)(frames - 1)) / (oldTime / (double)frames)));
+
+    pass = check(intact, "every frame received unchanged") && pass;
+    pass = check(newPerFrame == 2 + 1 + MPPT_CAN_LENGTH + 1, "READ STATUS, LOAD TX BUFFER at D0 with the payload, RTS") && pass;
+    pass = check(firstBytes == 2 + 4 + 1 + 5 + MPPT_CAN_LENGTH + 1, "first frame: TXP, then id, DLC and payload only") && pass;
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/*
+* mcpCanWrite() with the SPI layer as it was before the block transfers: one SPI::write() per
+* byte. Same buffer and TXP choice and TX header cache as the driver.
+*/
+static uint8_t writeBytewise(mcp_can_t *obj, const CAN_Message &msg)
+{
+    union {
+        CANMsg x;
+        uint8_t y[sizeof(CANMsg)];
+    };
+    const uint32_t headerSize = sizeof(x) - sizeof(x.data);
+    uint8_t bufferCommand[] = {MCP_WRITE_TX0, MCP_WRITE_TX1, MCP_WRITE_TX2};
+    uint8_t dataCommand[] = {MCP_WRITE_TX0_D0, MCP_WRITE_TX1_D0, MCP_WRITE_TX2_D0};
+    uint8_t rtsCommand[] = {MCP_RTS_TX0, MCP_RTS_TX1, MCP_RTS_TX2};
+    uint8_t ctrlAddress[] = {MCP_TXB0CTRL, MCP_TXB1CTRL, MCP_TXB2CTRL};
+    uint8_t pendingFlag[] = {MCP_STAT_TX0REQ, MCP_STAT_TX1REQ, MCP_STAT_TX2REQ};
+
+    mcpWait(obj);
+    obj->ncs = 0;
+    obj->spi.write(MCP_READ_STATUS);
+    uint8_t status = obj->spi.write(0x00);
+    obj->ncs = 1;
+    int slot = (status & (MCP_STAT_TX0REQ | MCP_STAT_TX1REQ | MCP_STAT_TX2REQ)) ? obj->txSlot : MCP_TX_SLOTS;
+    do {
+        if(slot == 0) return 0;
+        slot--;
+    } while(status & pendingFlag[slot % 3]);
+    int num = slot % 3;
+    obj->txSlot = slot;
+    if(obj->txPriority[num] != slot / 3){
+        obj->ncs = 0;
+        obj->spi.write(MCP_BITMOD);
+        obj->spi.write(ctrlAddress[num]);
+        obj->spi.write(MCP_TXB_TXP10_M);
+        obj->spi.write(slot / 3);
+        obj->ncs = 1;
+        obj->txPriority[num] = slot / 3;
+    }
+    memset(y, 0, sizeof(y));
+    x.id.sid10_3 = (uint8_t)(msg.id >> 3);                      // standard data frames only
+    x.id.sid2_0 = (uint8_t)(msg.id & 0x07);
+    x.dlc = msg.len & 0x0f;
+    memcpy(x.data, msg.data, x.dlc);
+    bool cached = (obj->txHeaderValid & (1 << num)) && !memcmp(obj->txHeader[num], y, headerSize);
+    obj->ncs = 0;
+    obj->spi.write(cached ? dataCommand[num] : bufferCommand[num]);
+    for(uint32_t i = cached ? headerSize : 0; i < headerSize + x.dlc; i++) obj->spi.write(y[i]);
+    obj->ncs = 1;
+    memcpy(obj->txHeader[num], y, headerSize);
+    obj->txHeaderValid |= (1 << num);
+    obj->ncs = 0;
+    obj->spi.write(rtsCommand[num]);
+    obj->ncs = 1;
+    return 1;
+}
+
+enum WritePath { BYTEWISE, BLOCK, BACKGROUND };
+
+/*
+* BENCH_FRAMES MPPT frames through one write path, 'workUs' of other work after each: frames per
+* second from the first write() to the end of the last work, and the time spent in write() per
+* frame ('inWrite', us). 'sent' is false if a frame did not make it onto the bus.
+*/
+static double benchWrite(int spiRate, WritePath path, int workUs, double &inWrite, bool &sent)
+{
+    unsigned char data[MPPT_CAN_LENGTH];
+    MpptCanReadings readings = { 48.3f, 5.2f, 31.7f, 3.1f, 95.2f };
+
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    Node tx(bus, SEEED_CAN_CS, SEEED_CAN_IRQ, spiRate);
+    Node rx(bus, SEEED_CAN_IO9, PTC3);
+    tx.can->open(BENCH_CAN_RATE, SEEED_CAN::Normal);
+    rx.can->open(BENCH_CAN_RATE, SEEED_CAN::Normal);
+
+    uint64_t start = hostNow(), writing = 0;
+    for(int n = 0; n < BENCH_FRAMES; n++){
+        readings.inCurrent = 0.01f * n;
+        mpptCanEncode(readings, data);
+        SEEED_CANMessage msg(MPPT_CAN_ID, (const char *)data, MPPT_CAN_LENGTH);
+        uint64_t t = hostNow();
+        while(!(path == BYTEWISE ? writeBytewise(tx.can->mcp(), msg) : mcpCanWrite(tx.can->mcp(), msg))){
+            // all three TX buffers pending: try again
+        }
+        if(path == BLOCK) mcpWait(tx.can->mcp());              // no overlap
+        writing += hostNow() - t;
+        wait_us(workUs);
+    }
+    double elapsed = (hostNow() - start) / 1e9;
+    wait_ms(2);
+    inWrite = writing / 1000.0 / BENCH_FRAMES;
+    sent = bus.frames() == BENCH_FRAMES;
+    return BENCH_FRAMES / elapsed;
+}
+
+/*
+* 7. Throughput: MPPT frames per second through mcpCanWrite() at the firmware's SPI clock and at
+* the library's default, one SPI call per byte (before), block transfers, and block transfers with
+* the TX buffer loaded in the background (as mcpCanWrite() does). The CAN bus runs at 1000 kbit/s
+* so the driver is the limit. (write() would queue the frames, see 9.)
+*/
+static bool checkThroughput(void)
+{
+    static const int rates[] = { SPI_RATE, 1000000 };
+    static const char *paths[] = { "byte per call (before)", "block", "block, background" };
+    bool pass = true;
+
+    printf("7. Throughput, MPPT frames through mcpCanWrite() (CAN %d kbit/s)\n", BENCH_CAN_RATE / 1000);
+    printf("  %-8s %-24s %10s %12s %16s\n", "SPI", "path", "frames/s", "with work", "us in write()");
+    for(int r = 0; r < 2; r++){
+        double rate[3], work[3];
+        for(int p = 0; p < 3; p++){
+            double inWrite, ignore;
+            bool sent, sentWork;
+            rate[p] = benchWrite(rates[r], (WritePath)p, 0, ignore, sent);
+            work[p] = benchWrite(rates[r], (WritePath)p, BENCH_WORK_US, inWrite, sentWork);
+            printf("  %4d kHz %-24s %10.0f %12.0f %16.1f\n", rates[r] / 1000, paths[p], rate[p], work[p], inWrite);
+            pass = check(sent && sentWork, "every frame on the bus") && pass;
+        }
+        pass = check(rate[BLOCK] > rate[BYTEWISE], "block transfers faster than a call per byte") && pass;
+        pass = check(work[BACKGROUND] > 1.2 * work[BLOCK], "background load overlaps the caller's work") && pass;
+    }
+    printf("  (with work: %d us of other work after every frame; us in write() per frame, with work)\n", BENCH_WORK_US);
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/*
+* mcpCanRead() as it was before readAll(): RX STATUS, READ RX BUFFER of RXB0 whichever buffer is
+* full (bufferCommand[0]), then BIT MODIFY to clear the RXnIF it had already cleared. Kept here to
+* measure the old receive path against the new one.
+*/
+static uint8_t readOld(mcp_can_t *obj, CAN_Message *msg)
+{
+    union {
+        CANMsg x;
+        uint8_t y[sizeof(CANMsg)];
+    };
+    uint8_t status = mcpReceiveStatus(obj);
+    int num = (status & MCP_RXSTAT_RXB0) ? 0 : (status & MCP_RXSTAT_RXB1) ? 1 : -1;
+
+    if(num < 0) return 0;
+    mcpReadBuffer(obj, MCP_READ_RX0, y, sizeof(x));
+    mcpBitModify(obj, MCP_CANINTF, !num ? MCP_RX0IF : MCP_RX1IF, 0);
+    msg->id = (x.id.sid10_3 << 3) | x.id.sid2_0;                // standard data frames only
+    msg->len = x.dlc;
+    memcpy(msg->data, x.data, 8);
+    return 1;
+}
+
+/*
+* Loads a standard data frame into a free transmit buffer of 'chip' and requests it, straight into
+* the registers: the load generator of the burst runs uses no SPI.
+*/
+static bool queueFrame(Mcp2515 &chip, int id, const unsigned char data[8])
+{
+    for(int n = 0; n < 3; n++){
+        uint8_t ctrl = MCP_TXB0CTRL + 0x10 * n;
+        if(chip.peek(ctrl) & MCP_TXB_TXREQ_M) continue;
+        chip.poke(ctrl + 1, id >> 3);
+        chip.poke(ctrl + 2, (id & 0x07) << 5);
+        chip.poke(ctrl + 3, 0);
+        chip.poke(ctrl + 4, 0);
+        chip.poke(ctrl + 5, 8);
+        for(int i = 0; i < 8; i++) chip.poke(ctrl + 6 + i, data[i]);
+        chip.poke(ctrl, MCP_TXB_TXREQ_M);
+        return true;
+    }
+    return false;
+}
+
+enum ReadPath { READ_OLD, READ_ONE, READ_ALL };
+
+// Receiver of section 8: the sequence numbers in the first two bytes of the frames it got
+static TestCan *burstReceiver = NULL;
+static ReadPath burstPath = READ_ALL;
+static std::vector<int> burstSequence;
+
+static int sequenceOf(const uint8_t data[])
+{
+    return data[0] | (data[1] << 8);
+}
+
+static void burstFrame(const CAN_Message &msg)
+{
+    burstSequence.push_back(sequenceOf((const uint8_t *)msg.data));
+}
+
+// Transmitter of section 8, another board: keeps its three TX buffers loaded, every 20 us
+struct BurstSource {
+    Mcp2515 *chip;
+    int frames, burst, gapUs, next;
+    uint64_t resume;            // end of the gap after a burst
+};
+static BurstSource source;
+
+static void feedBurst(void)
+{
+    unsigned char data[8] = { 0 };
+    uint64_t t = hostNow();
+    while(source.next < source.frames && t >= source.resume){
+        if(source.burst && source.next && source.next % source.burst == 0 && source.resume == 0){
+            bool idle = true;
+            for(int n = 0; n < 3; n++) idle = idle && !(source.chip->peek(MCP_TXB0CTRL + 0x10 * n) & MCP_TXB_TXREQ_M);
+            if(!idle) break;
+            source.resume = t + 1000ULL * source.gapUs;
+            break;
+        }
+        data[0] = source.next & 0xFF;
+        data[1] = source.next >> 8;
+        if(!queueFrame(*source.chip, MPPT_CAN_ID, data)) break;
+        source.next++;
+        if(source.burst && source.next % source.burst == 0) source.resume = 0;
+    }
+    if(source.resume && t >= source.resume) source.resume = 0;
+    if(source.next < source.frames) hostAt(t + 20000, feedBurst);
+}
+
+static void onBurst(void)
+{
+    SEEED_CANMessage msg[2];
+    int n = 0;
+    switch(burstPath){
+    case READ_OLD: n = readOld(burstReceiver->mcp(), &msg[0]); break;
+    case READ_ONE: n = burstReceiver->read(msg[0]); break;
+    case READ_ALL:
+        do {                                                    // until the INT pin is released
+            n = burstReceiver->readAll(msg, 2);
+            for(int i = 0; i < n; i++) burstFrame(msg[i]);
+        } while(n == 2);
+        return;
+    }
+    for(int i = 0; i < n; i++) burstFrame(msg[i]);
+}
+
+struct BurstResult {
+    int received;
+    bool inOrder;               // in the order they were on the bus
+    unsigned long overflows;
+    bool rx0ovr, rx1ovr;
+    double load;                // share of the time the bus carried a frame
+};
+
+/*
+* 'frames' MPPT-sized frames in bursts of 'burst' back to back (all of them back to back if
+* 'burst' is 0) with 'gapUs' of quiet in between, into a receiver with SPI at 'spiRate'
+*/
+static BurstResult runBurst(int spiRate, ReadPath path, int frames, int burst, int gapUs)
+{
+    BurstResult result;
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    bus.record(true);
+    Node tx(bus, SEEED_CAN_CS, SEEED_CAN_IRQ);
+    Node rx(bus, SEEED_CAN_IO9, PTC3, spiRate);
+    tx.can->open(CAN_RATE, SEEED_CAN::Normal);
+    rx.can->open(CAN_RATE, SEEED_CAN::Normal);
+    burstReceiver = rx.can;
+    burstPath = path;
+    burstSequence.clear();
+    rx.can->attach(onBurst, SEEED_CAN::RxAny);
+    bus.clearLog();
+
+    BurstSource s = { &tx.chip, frames, burst, gapUs, 0, 0 };
+    source = s;
+    uint64_t start = hostNow(), busyBefore = bus.busyTime();
+    feedBurst();
+    while(bus.frames() < (unsigned long)frames && hostNow() < start + 1000ULL * TIMEOUT_NS) wait_us(10);
+    result.load = (double)(bus.busyTime() - busyBefore) / (hostNow() - start);
+    wait_ms(2);
+    result.received = (int)burstSequence.size();
+    result.inOrder = true;
+    for(size_t i = 0, j = 0; i < burstSequence.size(); i++, j++){    // a subsequence of the bus order
+        while(j < bus.log().size() && sequenceOf(bus.log()[j].frame.data) != burstSequence[i]) j++;
+        if(j == bus.log().size()) result.inOrder = false;
+    }
+    result.overflows = rx.chip.overflows();
+    uint8_t eflg = rx.chip.peek(MCP_EFLG);
+    result.rx0ovr = (eflg & MCP_EFLG_RX0OVR) != 0;
+    result.rx1ovr = (eflg & MCP_EFLG_RX1OVR) != 0;
+    rx.can->attach(NULL, SEEED_CAN::RxAny);
+    burstReceiver = NULL;
+    return result;
+}
+
+/*
+* 8. Receive bursts at 500 kbit/s. RxAny interrupt as in CAN_RECEIVE; the old receive path, one
+* read() per interrupt, and readAll() per interrupt.
+*/
+static bool checkReceiveBursts(void)
+{
+    static const int frames = 400;
+    static const int rates[] = { SPI_RATE, 1000000 };
+    static const char *paths[] = { "old read, one per irq", "read(), one per irq", "readAll()" };
+    bool pass = true;
+
+    printf("8. Receive bursts, %d frames of 8 bytes at %d kbit/s\n", frames, CAN_RATE / 1000);
+    printf("  %-8s %-22s %-12s %6s %9s %7s %7s %6s\n", "SPI", "receiver", "traffic", "load", "received", "lost", "overrun", "order");
+    for(int r = 0; r < 2; r++){
+        for(int p = 0; p < 3; p++){
+            for(int b = 0; b < 2; b++){
+                int burst = b ? 0 : 8;
+                BurstResult res = runBurst(rates[r], (ReadPath)p, frames, burst, 2000);
+                char traffic[16];
+                snprintf(traffic, sizeof(traffic), burst ? "bursts of %d" : "continuous", burst);
+                printf("  %4d kHz %-22s %-12s %5.0f%% %9d %7d %7lu %6s\n", rates[r] / 1000, paths[p], traffic,
+                       100 * res.load, res.received, frames - res.received, res.overflows,
+                       res.inOrder ? "ok" : "BAD");
+                if(p == READ_ALL){
+                    // Per 8 byte frame: READ RX BUFFER, 14 bytes, and half an RX STATUS; on the bus: 115 bits
+                    bool keepsUp = 15 * 8 * 1e9 / rates[r] < 115 * 1e9 / CAN_RATE;
+                    if(keepsUp || burst){
+                        pass = check(res.received == frames && !res.overflows && !res.rx0ovr && !res.rx1ovr,
+                                     "readAll(): every frame, no RX0OVR/RX1OVR") && pass;
+                    } else {
+                        printf("  note: reading a frame takes %.0f us of SPI at %d kHz, a frame %.0f us on the bus: the SPI\n"
+                               "        clock is too slow for frames back to back for ever, bursts are fine\n",
+                               15 * 8 * 1e6 / rates[r], rates[r] / 1000, 115 * 1e6 / CAN_RATE);
+                    }
+                    pass = check(res.inOrder, "readAll(): frames in order") && pass;
+                }
+            }
+        }
+    }
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+struct QueueResult {
+    int accepted;               // write() returned 1
+    int received;
+    bool inOrder;               // received exactly what was accepted, in the order written
+    unsigned long dropped;
+    int highWater;
+    double load;                // share of the time the bus carried a frame, first write() to last frame
+    double inWrite;             // us per write()
+};
+
+/*
+* 'frames' MPPT-sized frames with sequence numbers written back to back, through write() or, for
+* the old behaviour, mcpCanWrite() alone (what write() was: 0 when the TX buffers are busy). The
+* receiver reads with readAll() in its RxAny interrupt and its SPI is fast enough to keep up.
+*/
+static QueueResult runQueue(int spiRate, int frames, bool queue)
+{
+    QueueResult result = {};
+    std::vector<int> accepted;
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    Node tx(bus, SEEED_CAN_CS, SEEED_CAN_IRQ, spiRate);
+    Node rx(bus, SEEED_CAN_IO9, PTC3, 4000000);
+    tx.can->open(CAN_RATE, SEEED_CAN::Normal);
+    rx.can->open(CAN_RATE, SEEED_CAN::Normal);
+    burstReceiver = rx.can;
+    burstPath = READ_ALL;
+    burstSequence.clear();
+    rx.can->attach(onBurst, SEEED_CAN::RxAny);
+
+    unsigned char data[8] = { 0 };
+    uint64_t start = hostNow(), busyBefore = bus.busyTime(), writing = 0;
+    for(int n = 0; n < frames; n++){
+        data[0] = n & 0xFF;
+        data[1] = n >> 8;
+        SEEED_CANMessage msg(MPPT_CAN_ID, (const char *)data, 8);
+        uint64_t t = hostNow();
+        if(queue ? tx.can->write(msg) : mcpCanWrite(tx.can->mcp(), msg)) accepted.push_back(n);
+        writing += hostNow() - t;
+    }
+    while(bus.frames() < accepted.size() && hostNow() < start + TIMEOUT_NS) wait_us(1);
+    result.load = (double)(bus.busyTime() - busyBefore) / (hostNow() - start);
+    wait_ms(2);
+    result.accepted = (int)accepted.size();
+    result.received = (int)burstSequence.size();
+    result.inOrder = burstSequence == accepted;
+    result.dropped = tx.can->txDropped();
+    result.highWater = tx.can->txHighWater();
+    result.inWrite = writing / 1000.0 / frames;
+    rx.can->attach(NULL, SEEED_CAN::RxAny);
+    burstReceiver = NULL;
+    return result;
+}
+
+/*
+* 9. Transmit queue at 500 kbit/s: a burst that fits (the two TX buffers of TxNormal and
+* SEEED_CAN_TX_QUEUE queued), one that does not, and the old write() that gave up once the TX
+* buffers were busy.
+*/
+static bool checkTransmitQueue(void)
+{
+    static const int rates[] = { SPI_RATE, 4000000 };
+    const int fits = SEEED_CAN_TX_QUEUE + 2, overflows = 3 * SEEED_CAN_TX_QUEUE;     // TxNormal: TXB0 and TXB1
+    bool pass = true;
+
+    printf("9. Transmit queue (%d messages), frames of 8 bytes at %d kbit/s\n", SEEED_CAN_TX_QUEUE, CAN_RATE / 1000);
+    printf("  %-8s %-20s %6s %9s %9s %8s %11s %6s %6s %14s\n", "SPI", "writer", "burst", "accepted", "received",
+           "dropped", "high-water", "load", "order", "us in write()");
+    for(int r = 0; r < 2; r++){
+        for(int w = 0; w < 3; w++){
+            bool queue = w > 0;
+            int frames = (w == 2) ? overflows : fits;
+            QueueResult res = runQueue(rates[r], frames, queue);
+            printf("  %4d kHz %-20s %6d %9d %9d %8lu %11d %5.0f%% %6s %14.1f\n", rates[r] / 1000,
+                   queue ? "write(), queued" : "no queue (before)", frames, res.accepted, res.received,
+                   res.dropped, res.highWater, 100 * res.load, res.inOrder ? "ok" : "BAD", res.inWrite);
+            if(!queue) continue;
+            pass = check(res.received == res.accepted && res.inOrder, "every accepted frame on the bus, in order") && pass;
+            pass = check(res.accepted + (int)res.dropped == frames, "every frame accepted or counted as dropped") && pass;
+            pass = check(res.highWater <= SEEED_CAN_TX_QUEUE, "high-water mark within the queue") && pass;
+            if(frames == fits) pass = check(res.dropped == 0, "a burst that fits: nothing dropped") && pass;
+            if(res.dropped) pass = check(res.highWater == SEEED_CAN_TX_QUEUE, "drops only with the queue full") && pass;
+            if(rates[r] > SPI_RATE){                            // write() faster than the bus
+                pass = check(res.load > 0.9, "TX buffers kept loaded: bus busy") && pass;
+                if(frames == overflows) pass = check(res.dropped > 0, "a burst that does not fit: drops counted") && pass;
+            }
+        }
+    }
+
+    printf("  (at %d kHz write() takes longer than a frame on the bus: the queue hardly fills)\n", SPI_RATE / 1000);
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/*
+* Lock-free stress of the receive ring alone: a producer thread in place of the interrupt handler
+* (one or two messages per commit, like the MCP2515's two receive buffers) and a consumer thread,
+* on as many cores as the host has. 'wait' makes the producer wait for room (nothing may be lost); without it
+* the producer drops like the interrupt handler has to. Returns the number of messages consumed,
+* -1 if one was missing, repeated, out of order or torn.
+*/
+static long stressRing(unsigned long messages, bool wait, unsigned long &dropped, unsigned int &highWater)
+{
+    SEEED_CANRing<SEEED_CAN_RX_RING> *ring = new SEEED_CANRing<SEEED_CAN_RX_RING>();
+    long consumed = 0;
+    volatile bool started = false, done = false;
+
+    std::thread consumer([&]() {
+        started = true;
+        unsigned long last = 0;
+        bool first = true;
+        CAN_Message msg;
+        for(;;){
+            if(!ring->get(msg)){
+                if(done && !ring->available()) break;
+                std::this_thread::yield();                      // one core: let the producer run
+                continue;
+            }
+            unsigned long seq = msg.id;
+            bool whole = true;
+            for(int i = 0; i < 8; i++) whole = whole && msg.data[i] == (uint8_t)(seq + i);
+            if(!whole || (!first && seq <= last) || (wait && seq != (first ? 0 : last + 1))){
+                consumed = -1;
+                break;
+            }
+            first = false;
+            last = seq;
+            consumed++;
+        }
+    });
+
+    while(!started) std::this_thread::yield();
+    for(unsigned long seq = 0; seq < messages; ){
+        unsigned int n;
+        CAN_Message *slot = ring->space(n);
+        unsigned int want = (seq & 1) ? 2 : 1;
+        if(messages - seq < want) want = 1;
+        if(n == 0){
+            if(!wait){
+                ring->drop(1);
+                seq++;
+            }
+            std::this_thread::yield();                          // one core: let the consumer run
+            continue;
+        }
+        if(n > want) n = want;
+        for(unsigned int m = 0; m < n; m++, seq++){
+            slot[m].id = seq;
+            slot[m].len = 8;
+            for(int i = 0; i < 8; i++) slot[m].data[i] = (uint8_t)(seq + i);
+        }
+        ring->commit(n);
+    }
+    done = true;
+    consumer.join();
+    dropped = ring->dropped();
+    highWater = ring->highWater();
+    delete ring;
+    return consumed;
+}
+
+// Receiver of section 10: its work per frame, and the long pause (a printf) every RING_PAUSE_EVERY frames
+#define RING_WORK_US        30
+#define RING_PAUSE_US       2000
+#define RING_PAUSE_EVERY    64
+
+static int ringNotified = 0;
+
+/* What the application does with a frame, in the interrupt or in the main loop */
+static void handleFrame(const CAN_Message &msg, bool inInterrupt)
+{
+    burstFrame(msg);
+    int us = RING_WORK_US + ((burstSequence.size() % RING_PAUSE_EVERY) ? 0 : RING_PAUSE_US);
+    if(inInterrupt){
+        wait_us(us);                                            // nothing else runs meanwhile
+    } else {
+        for(int i = 0; i < us; i++) wait_us(1);                 // the interrupt handler may take the CPU in between
+    }
+}
+
+/* The old CAN_RECEIVE: readAll() in the RxAny interrupt and the frame handled right there */
+static void onWorkIrq(void)
+{
+    SEEED_CANMessage msg[2];
+    int n;
+    do {
+        n = burstReceiver->readAll(msg, 2);
+        for(int i = 0; i < n; i++) handleFrame(msg[i], true);
+    } while(n == 2);
+}
+
+/* With the ring: what a thread would be signalled with */
+static void onRingNotify(void)
+{
+    ringNotified++;
+}
+
+struct RingResult {
+    int received;
+    bool inOrder;
+    unsigned long overflows;    // frames the MCP2515 lost (RX0OVR/RX1OVR)
+    unsigned long dropped;      // frames the ring lost
+    int highWater;
+};
+
+/*
+* 'frames' MPPT-sized frames back to back at CAN_RATE into a receiver with SPI at 'spiRate' that
+* handles them in its RxAny interrupt, or takes them from the receive ring in its main loop
+*/
+static RingResult runRing(int spiRate, bool ring, int frames)
+{
+    RingResult result = {};
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    bus.record(true);
+    Node tx(bus, SEEED_CAN_CS, SEEED_CAN_IRQ);
+    Node rx(bus, SEEED_CAN_IO9, PTC3, spiRate);
+    tx.can->open(CAN_RATE, SEEED_CAN::Normal);
+    rx.can->open(CAN_RATE, SEEED_CAN::Normal);
+    burstReceiver = rx.can;
+    burstSequence.clear();
+    ringNotified = 0;
+    if(ring){
+        rx.can->rxRing(true);
+        rx.can->attach(onRingNotify, SEEED_CAN::RxAny);
+    } else {
+        rx.can->attach(onWorkIrq, SEEED_CAN::RxAny);
+    }
+    bus.clearLog();
+
+    BurstSource s = { &tx.chip, frames, 0, 0, 0, 0 };
+    source = s;
+    uint64_t deadline = hostNow() + 1000ULL * TIMEOUT_NS;
+    feedBurst();
+    while((bus.frames() < (unsigned long)frames || (ring && rx.can->rxAvailable())) && hostNow() < deadline){
+        SEEED_CANMessage msg;
+        if(ring && rx.can->rxRead(msg)) handleFrame(msg, false);
+        else wait_us(5);
+    }
+    wait_ms(2);
+    result.received = (int)burstSequence.size();
+    result.inOrder = true;
+    for(size_t i = 0, j = 0; i < burstSequence.size(); i++, j++){    // a subsequence of the bus order
+        while(j < bus.log().size() && sequenceOf(bus.log()[j].frame.data) != burstSequence[i]) j++;
+        if(j == bus.log().size()) result.inOrder = false;
+    }
+    result.overflows = rx.chip.overflows();
+    result.dropped = rx.can->rxDropped();
+    result.highWater = rx.can->rxHighWater();
+    rx.can->attach(NULL, SEEED_CAN::RxAny);
+    rx.can->rxRing(false);
+    burstReceiver = NULL;
+    return result;
+}
+
+/*
+* 10. Receive ring: the lock-free ring on two host threads, then the driver filling it from the
+* interrupt at 100% bus load while the main loop takes the frames, against CAN_RECEIVE's old way
+* of handling every frame in the interrupt.
+*/
+static bool checkReceiveRing(void)
+{
+    static const unsigned long messages = 2000000;
+    static const int frames = 2000;
+    static const int rates[] = { 1000000, 4000000 };
+    bool pass = true;
+    unsigned long dropped;
+    unsigned int highWater;
+
+    printf("10. Receive ring (%d messages)\n", SEEED_CAN_RX_RING);
+    printf("  %-40s %9s %9s %8s %11s\n", "two threads", "messages", "consumed", "dropped", "high-water");
+    long consumed = stressRing(messages, true, dropped, highWater);
+    printf("  %-40s %9lu %9ld %8lu %11u\n", "producer waits for room", messages, consumed, dropped, highWater);
+    pass = check(consumed == (long)messages && dropped == 0, "every message once, in order, none torn") && pass;
+    pass = check(highWater <= SEEED_CAN_RX_RING, "high-water mark within the ring") && pass;
+    consumed = stressRing(messages, false, dropped, highWater);
+    printf("  %-40s %9lu %9ld %8lu %11u\n", "producer drops when full", messages, consumed, dropped, highWater);
+    pass = check(consumed >= 0 && consumed + dropped == messages, "every message consumed or counted as dropped") && pass;
+
+    printf("  %d frames of 8 bytes back to back at %d kbit/s, %d us of work per frame and %d us every %d frames\n",
+           frames, CAN_RATE / 1000, RING_WORK_US, RING_PAUSE_US, RING_PAUSE_EVERY);
+    printf("  %-8s %-30s %9s %7s %7s %8s %11s %6s\n", "SPI", "receiver", "received", "lost", "overrun", "dropped",
+           "high-water", "order");
+    for(int r = 0; r < 2; r++){
+        for(int ring = 0; ring < 2; ring++){
+            RingResult res = runRing(rates[r], ring, frames);
+            printf("  %4d kHz %-30s %9d %7d %7lu %8lu %11d %6s\n", rates[r] / 1000,
+                   ring ? "rxRing(), main loop" : "in the interrupt (before)", res.received, frames - res.received,
+                   res.overflows, res.dropped, res.highWater, res.inOrder ? "ok" : "BAD");
+            if(!ring) continue;
+            pass = check(res.received == frames && !res.overflows && !res.dropped, "rxRing(): every frame") && pass;
+            pass = check(res.inOrder, "rxRing(): frames in bus order") && pass;
+            pass = check(res.highWater <= SEEED_CAN_RX_RING, "high-water mark within the ring") && pass;
+            pass = check(ringNotified > 0, "rxRing(): the RxAny function is still called") && pass;
+        }
+    }
+    printf("  (at %d kHz reading a frame takes longer than the frame on the bus, see 8)\n", SPI_RATE / 1000);
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+// Transmitter of section 11: one id per priority, lowest id (first in arbitration) for TxUrgent
+static const int priorityIds[] = { 0x300, 0x200, 0x100, 0x080 };
+static const char *priorityNames[] = { "TxLow", "TxNormal", "TxHigh", "TxUrgent" };
+static const int priorityPeriodUs[] = { 240, 5000, 7000, 11000 };  // TxLow: more than the bus can carry with the others
+#define URGENT_BURST    2           // TxUrgent frames written together (a fault), the second one finds TXB2 busy
+
+struct PriorityResult {
+    int written[4], dropped[4], sent[4];
+    double meanUs[4], maxUs[4];     // from write() to the end of the frame on the bus
+    bool inOrder;                   // each priority in the order written, every frame once
+    unsigned long preempted;
+};
+
+/*
+* 'ms' of traffic from one board at 500 kbit/s: TxLow frames faster than the bus can take them,
+* and TxNormal, TxHigh and TxUrgent ones now and then, written at their priority or, as before,
+* all at TxNormal. SPI at 4 MHz, so write() is not the limit.
+*/
+static PriorityResult runPriority(bool priorities, int ms)
+{
+    PriorityResult result = {};
+    std::vector<uint64_t> writtenAt[4];
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    bus.record(true);
+    Node tx(bus, SEEED_CAN_CS, SEEED_CAN_IRQ, 4000000);
+    Node rx(bus, SEEED_CAN_IO9, PTC3);                          // acknowledges, reads nothing
+    tx.can->open(CAN_RATE, SEEED_CAN::Normal);
+    rx.can->open(CAN_RATE, SEEED_CAN::Normal);
+    bus.clearLog();
+
+    uint64_t start = hostNow(), end = start + 1000000ULL * ms, next[4];
+    for(int p = 0; p < 4; p++) next[p] = start + 1000ULL * priorityPeriodUs[p] / 2 * (p > 0);
+    while(hostNow() < end){
+        for(int p = 0; p < 4; p++){
+            if(hostNow() < next[p]) continue;
+            next[p] += 1000ULL * priorityPeriodUs[p];
+            for(int n = 0; n < ((p == SEEED_CAN::TxUrgent) ? URGENT_BURST : 1); n++){
+                unsigned char data[8] = { 0 };
+                int seq = (int)writtenAt[p].size();
+                data[0] = seq & 0xFF;
+                data[1] = seq >> 8;
+                SEEED_CANMessage msg(priorityIds[p], (const char *)data, 8);
+                uint64_t t = hostNow();
+                if(tx.can->write(msg, priorities ? (SEEED_CAN::Priority)p : SEEED_CAN::TxNormal)){
+                    writtenAt[p].push_back(t);
+                } else {
+                    result.dropped[p]++;
+                }
+            }
+        }
+        wait_us(10);
+    }
+    wait_ms(10);                                                // the queues empty
+
+    result.inOrder = true;
+    for(int p = 0; p < 4; p++){
+        result.written[p] = (int)writtenAt[p].size();
+        double total = 0;
+        for(size_t i = 0; i < bus.log().size(); i++){
+            const CanBusRecord &r = bus.log()[i];
+            if((int)r.frame.id != priorityIds[p] || !r.acknowledged) continue;
+            int seq = sequenceOf(r.frame.data);
+            if(seq != result.sent[p] || seq >= result.written[p]){
+                result.inOrder = false;
+                continue;
+            }
+            double us = (r.end - writtenAt[p][seq]) / 1000.0;
+            total += us;
+            if(us > result.maxUs[p]) result.maxUs[p] = us;
+            result.sent[p]++;
+        }
+        result.meanUs[p] = result.sent[p] ? total / result.sent[p] : 0;
+        if(result.sent[p] != result.written[p]) result.inOrder = false;
+    }
+    result.preempted = tx.can->txPreempted();
+    return result;
+}
+
+/*
+* 11. Transmit priority at 500 kbit/s, bus overloaded by TxLow frames: latency of each priority
+* from write() to the end of its frame, against all of them in one queue.
+*/
+static bool checkTransmitPriority(void)
+{
+    static const int ms = 400;
+    const double frameUs = 135 * 1e6 / CAN_RATE;                // 8 byte frame, stuff bits included at most
+    bool pass = true;
+    PriorityResult res[2];
+
+    printf("11. Transmit priority, %d ms of frames of 8 bytes at %d kbit/s, TxLow every %d us\n", ms, CAN_RATE / 1000,
+           priorityPeriodUs[0]);
+    printf("  %-22s %-9s %8s %8s %8s %10s %10s\n", "writer", "priority", "written", "dropped", "sent", "mean us", "max us");
+    for(int w = 0; w < 2; w++){
+        res[w] = runPriority(w == 1, ms);
+        for(int p = 3; p >= 0; p--){
+            printf("  %-22s %-9s %8d %8d %8d %10.0f %10.0f\n", w ? "write(msg, priority)" : "all TxNormal (before)",
+                   priorityNames[p], res[w].written[p], res[w].dropped[p], res[w].sent[p], res[w].meanUs[p], res[w].maxUs[p]);
+        }
+        pass = check(res[w].inOrder, "every frame written sent once, each priority in order") && pass;
+    }
+    const PriorityResult &r = res[1];
+    printf("  %lu lower priority frames aborted for a TxUrgent one, and sent later\n", r.preempted);
+    for(int p = 1; p < 4; p++){
+        pass = check(r.dropped[p] == 0, "nothing dropped above TxLow") && pass;
+        pass = check(r.maxUs[p] < res[0].maxUs[p], "lower latency than in one queue") && pass;
+        pass = check(r.meanUs[p] < r.meanUs[0], "ahead of TxLow") && pass;
+    }
+    pass = check(r.meanUs[3] < r.meanUs[2] && r.meanUs[3] < r.meanUs[1], "TxUrgent ahead of TxHigh and TxNormal") && pass;
+    pass = check(r.preempted > 0, "a TxUrgent frame that found TXB2 busy took a lower priority one's buffer") && pass;
+    // the frame on the bus, the urgent ones before it and its own, and the SPI of write()
+    pass = check(r.maxUs[3] < (URGENT_BURST + 1) * frameUs + 100, "TxUrgent: never waits behind a lower priority") && pass;
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/*
+* 12. Log: the records the driver leaves in the log ring, decoded on the host.
+*/
+#if SEEED_CAN_LOG_LEVEL < MCP_LOG_DEBUG
+#error "build the emulator with -DSEEED_CAN_LOG_LEVEL=3, section 12 checks the driver's log"
+#endif
+
+/* The log ring drained into 'wire' as CAN_RECEIVE sends it to the serial port */
+static void drainLog(std::vector<uint8_t> &wire)
+{
+    uint8_t buf[MCP_LOG_RECORD_MAX * 4];
+    unsigned int n;
+    while((n = mcpLogRead(buf, sizeof(buf))) > 0) wire.insert(wire.end(), buf, buf + n);
+}
+
+/* Decodes 'wire' into text */
+static std::string decodeLog(const std::vector<uint8_t> &wire, unsigned long &records, unsigned long &lost)
+{
+    FILE *f = tmpfile();
+    records = mcpLogDecode(wire.data(), wire.size(), f, &lost);
+    std::string text((size_t)ftell(f), '\0');
+    rewind(f);
+    size_t got = fread(&text[0], 1, text.size(), f);
+    fclose(f);
+    text.resize(got);
+    return text;
+}
+
+static bool checkLog(void)
+{
+    static const char data[8] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, (char)0x88 };
+    static const char *expected[] = {
+        "INFO  Resetting MCP2515",
+        "DEBUG Id 0 (extended 0) written at register 20",
+        "INFO  Entered mode 80 after 0 ms",
+        "INFO  Mask 0 set to 7ff (extended 0)",
+        "ERROR Trying to set an invalid Mask number: 2",
+        "INFO  Filter 0 set to 123 (extended 0)",
+        "SEEED_RECEIVE text between the records\r\n",
+        "DEBUG Received id 123, format 0, remote 0, data 11223344 55667788",
+    };
+    bool pass = true;
+
+    printf("12. Log (SEEED_CAN_LOG_LEVEL %d, ring of %d words)\n", SEEED_CAN_LOG_LEVEL, SEEED_CAN_LOG_WORDS);
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    Node a(bus, SEEED_CAN_CS, SEEED_CAN_IRQ);
+    std::vector<uint8_t> wire, earlier;
+    drainLog(earlier);                                          // what the other sections logged
+    unsigned long droppedBefore = mcpLogDropped();
+
+    // What CAN_RECEIVE does, with printf text on the same serial port
+    a.can->open(CAN_RATE, SEEED_CAN::Normal);
+    a.can->mode(SEEED_CAN::Loopback);
+    a.can->mask(0, 0x7FF);
+    a.can->mask(2, 0x7FF);
+    a.can->filter(0, 0x123);
+    drainLog(wire);
+    const char *text = "SEEED_RECEIVE text between the records\r\n";
+    wire.insert(wire.end(), text, text + strlen(text));
+    SEEED_CANMessage received;
+    a.can->write(SEEED_CANMessage(0x123, data, 8, CANData, CANStandard));
+    bool read = readFrame(*a.can, received);
+    drainLog(wire);
+
+    unsigned long records, lost;
+    std::string decoded = decodeLog(wire, records, lost);
+    size_t textBytes = decoded.size() - strlen(text);
+    printf("  %lu records, %lu bytes on the wire, %lu bytes of text decoded from them, %lu lost\n",
+           records, (unsigned long)(wire.size() - strlen(text)), (unsigned long)textBytes, lost);
+    size_t at = 0;
+    bool inOrder = read;
+    for(size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++){
+        size_t found = decoded.find(expected[i], at);
+        if(found == std::string::npos){
+            printf("  missing: %s\n", expected[i]);
+            inOrder = false;
+        } else {
+            at = found;
+        }
+    }
+    pass = check(inOrder, "the driver's records decoded in order, text passed through") && pass;
+    pass = check(lost == 0 && mcpLogDropped() == droppedBefore, "nothing lost") && pass;
+
+    // A full ring: the records that do not fit are counted, and the next record shows the gap
+    wire.clear();
+    for(int i = 0; i < 1000; i++) MCP_ERROR(MCP_EVENT_BAD_FILTER, i);
+    drainLog(wire);
+    MCP_ERROR(MCP_EVENT_BAD_FILTER, 0);
+    drainLog(wire);
+    decodeLog(wire, records, lost);
+    unsigned long dropped = mcpLogDropped() - droppedBefore;
+    printf("  1000 records into the ring without draining, then one more: %lu kept, %lu dropped, decoder reports %lu lost\n",
+           records, dropped, lost);
+    pass = check(records == SEEED_CAN_LOG_WORDS / 3 + 1 && records - 1 + dropped == 1000, "ring full: the rest counted as dropped") && pass;
+    pass = check(lost == dropped, "decoder finds the dropped records from the sequence numbers") && pass;
+
+    // Cost of a record: host time per call
+    const int calls = 1000000;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i = 0; i < calls; i++){
+        MCP_DEBUG(MCP_EVENT_RX_FRAME, i, 0, 0, 0x11223344, 0x55667788);
+        if((i & 31) == 31){
+            wire.clear();
+            drainLog(wire);
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+    printf("  %.0f ns per record of 5 arguments on this host, drained every 32\n", ns);
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/*
+* 13. Acceptance masks and filters: a set of 2 masks and 6 filters written with mask() and filter()
+* as svtSEEEDCAN::Filter() did, against one configure() call; at start-up (with open()) and when
+* the filters change while the chip is in use.
+*/
+static const unsigned int configureIds[6] = { 0x101, 0x102, 0x201, 0x202, 0x203, 0x204 };
+
+static CANacceptance configureSet(int offset)
+{
+    CANacceptance acceptance;
+    for(int i = 0; i < 2; i++){
+        acceptance.maskId[i] = 0x7FF;
+        acceptance.maskExt[i] = 0;
+    }
+    for(int i = 0; i < 6; i++){
+        acceptance.filterId[i] = configureIds[i] + offset;
+        acceptance.filterExt[i] = 0;
+    }
+    return acceptance;
+}
+
+static int configureOneByOne(TestCan &can, const CANacceptance &acceptance)
+{
+    int set = 1;
+    for(int i = 0; i < 2; i++) set &= can.mask(i, acceptance.maskId[i], acceptance.maskExt[i] ? CANExtended : CANStandard);
+    for(int i = 0; i < 6; i++) set &= can.filter(i, acceptance.filterId[i], acceptance.filterExt[i] ? CANExtended : CANStandard);
+    return set;
+}
+
+/* The masks and filters in the chip are those of 'acceptance' (bits the chip does not implement left out) */
+static bool configureInChip(Mcp2515 &chip, const CANacceptance &acceptance)
+{
+    static const uint8_t filter[6] = { MCP_RXF0SIDH, MCP_RXF1SIDH, MCP_RXF2SIDH, MCP_RXF3SIDH, MCP_RXF4SIDH, MCP_RXF5SIDH };
+    static const uint8_t mask[2] = { MCP_RXM0SIDH, MCP_RXM1SIDH };
+    bool same = true;
+    for(int i = 0; i < 6; i++){
+        uint32_t id = ((uint32_t)chip.peek(filter[i]) << 3) | (chip.peek(filter[i] + 1) >> 5);
+        same = same && id == acceptance.filterId[i] && !(chip.peek(filter[i] + 1) & MCP_TXB_EXIDE_M);
+    }
+    for(int i = 0; i < 2; i++){
+        uint32_t id = ((uint32_t)chip.peek(mask[i]) << 3) | (chip.peek(mask[i] + 1) >> 5);
+        same = same && id == acceptance.maskId[i];
+    }
+    return same;
+}
+
+static bool checkConfigure(void)
+{
+    static const char data[2] = { 0x5A, (char)0xA5 };
+    bool pass = true;
+
+    printf("13. Acceptance masks and filters, 2 masks and 6 filters (SPI %d kHz)\n", SPI_RATE / 1000);
+    printf("  %-34s %6s %6s %9s\n", "call", "trans", "bytes", "us");
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    Node a(bus, SEEED_CAN_CS, SEEED_CAN_IRQ);
+    CANacceptance first = configureSet(0), second = configureSet(0x100);
+
+    // Start-up: open() and the filters of the receiver
+    a.chip.clearTraffic();
+    uint64_t start = hostNow();
+    a.can->open(CAN_RATE, SEEED_CAN::Normal);
+    pass = check(configureOneByOne(*a.can, first) == 1, "mask() and filter() return 1") && pass;
+    printCost("open() + 2 mask() + 6 filter()", a.chip, start);
+    double startupBefore = (hostNow() - start) / 1000.0;
+    a.chip.clearTraffic();
+    start = hostNow();
+    a.can->open(CAN_RATE, SEEED_CAN::Normal);
+    pass = check(a.can->configure(first) == 1, "configure() returns 1") && pass;
+    printCost("open() + configure()", a.chip, start);
+    double startupAfter = (hostNow() - start) / 1000.0;
+    pass = check(configureInChip(a.chip, first) && a.chip.mode() == 0, "set written, normal mode restored") && pass;
+
+    // Reconfiguration of a chip in use (loopback here, so the filters can be tried)
+    a.can->mode(SEEED_CAN::Loopback);
+    a.chip.clearTraffic();
+    start = hostNow();
+    configureOneByOne(*a.can, second);
+    const Mcp2515::Traffic before = a.chip.traffic();
+    printCost("2 mask() + 6 filter()", a.chip, start);
+    double reconfigureBefore = (hostNow() - start) / 1000.0;
+    a.chip.clearTraffic();
+    start = hostNow();
+    pass = check(a.can->configure(first) == 1, "configure() in loopback mode returns 1") && pass;
+    printCost("configure()", a.chip, start);
+    double reconfigureAfter = (hostNow() - start) / 1000.0;
+    pass = check(configureInChip(a.chip, first) && a.chip.mode() == 2, "set written, loopback mode restored") && pass;
+    printf("  start-up %.1f -> %.1f us, reconfiguration %.1f -> %.1f us; 16 -> 2 mode changes, each waits for the bus to\n"
+           "  be idle on the chip (at once here), and up to 10 polls of 1 ms (wait_ms(1)) if it is not\n",
+           startupBefore, startupAfter, reconfigureBefore, reconfigureAfter);
+    pass = check(a.chip.traffic().transactions < before.transactions / 4, "configure() takes under a quarter of the transactions") && pass;
+
+    // Only the ids of the set come through
+    int accepted = 0, rejected = 0;
+    for(unsigned int id = 0x100; id < 0x210; id++){
+        SEEED_CANMessage msg;
+        a.can->write(SEEED_CANMessage(id, data, 2, CANData, CANStandard));
+        wait_us(500);                                           // a 2 byte frame takes under 200 us
+        bool wanted = false;
+        for(int i = 0; i < 6; i++) wanted = wanted || id == configureIds[i];
+        if(a.can->read(msg)) (wanted && msg.id == id) ? accepted++ : rejected++;
+        else if(wanted) rejected++;
+    }
+    printf("  %d of 6 ids of the set received, %d frames wrong (0x100 to 0x20F sent)\n", accepted, rejected);
+    pass = check(accepted == 6 && rejected == 0, "only the ids of the set received") && pass;
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/*
+* 14. Acceptance filter planner: masks and filters from mcpPlanAcceptance() for sets of wanted ids,
+* against the best single mask shared by both buffers (all svtSEEEDCAN::Filter() can do); ids let
+* in, false-accept rate and host time. One set is tried on the chip with every standard id.
+*/
+struct PlanSet {
+    const char *name;
+    std::vector<uint32_t> ids;
+};
+
+static bool checkPlanner(void)
+{
+    static const char data[2] = { 0x5A, (char)0xA5 };
+    std::vector<PlanSet> sets;
+    sets.push_back(PlanSet{ "MPPT readings (CAN_RECEIVE)", { MPPT_CAN_ID } });
+    sets.push_back(PlanSet{ "6 ids", { 0x007, 0x123, 0x2A0, 0x401, 0x5FF, 0x700 } });
+    sets.push_back(PlanSet{ "solar car, 14 ids", { 0x007, 0x008, 0x401, 0x402, 0x403, 0x40B, 0x500, 0x501,
+                                                   0x502, 0x503, 0x600, 0x601, 0x602, 0x603 } });
+    uint32_t seed = 12345;
+    for(int n = 16; n <= 32; n += 16){
+        PlanSet random = { n == 16 ? "16 random ids" : "32 random ids", {} };
+        while((int)random.ids.size() < n){
+            seed = seed * 1103515245 + 12345;
+            uint32_t id = (seed >> 16) & 0x7FF;
+            if(std::find(random.ids.begin(), random.ids.end(), id) == random.ids.end()) random.ids.push_back(id);
+        }
+        sets.push_back(random);
+    }
+    bool pass = true;
+
+    printf("14. Acceptance filter planner (standard ids, %lu of them)\n", (unsigned long)MCP_STD_IDS);
+    printf("  %-28s %6s %12s %9s %12s %9s\n", "wanted ids", "wanted", "shared mask", "planned", "false-accept", "host ms");
+    CANacceptancePlan chipPlan = {};
+    for(size_t s = 0; s < sets.size(); s++){
+        const std::vector<uint32_t> &ids = sets[s].ids;
+        uint32_t sharedMask = 0, sharedValue[6];
+        uint32_t shared = mcpPlanMask(ids.data(), ids.size(), 6, MCP_STD_IDS + 1, sharedMask, sharedValue);
+        CANacceptancePlan plan;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool planned = mcpPlanAcceptance(ids.data(), ids.size(), plan) == 1;
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("  %-28s %6lu %12lu %9lu %11.2f%% %9.2f\n", sets[s].name, (unsigned long)ids.size(), (unsigned long)shared,
+               (unsigned long)plan.accepted, 100.0 * mcpFalseAcceptRate(plan), ms);
+
+        bool all = planned;
+        for(size_t i = 0; i < ids.size() && all; i++){
+            bool in = false;
+            for(int f = 0; f < 6; f++) in = in || mcpPlanLetsIn(plan.acceptance.maskId[f < 2 ? 0 : 1], plan.acceptance.filterId[f], ids[i]);
+            all = in;
+        }
+        pass = check(all && plan.wanted == ids.size(), "every wanted id let in") && pass;
+        pass = check(plan.accepted <= shared, "no more ids let in than with a shared mask") && pass;
+        if(ids.size() <= 6) pass = check(plan.accepted == ids.size(), "6 ids or fewer: only those let in") && pass;
+        if(s == 2) chipPlan = plan;
+    }
+    uint32_t tooHigh[] = { 0x123, 0x800 };
+    CANacceptancePlan refused;
+    pass = check(mcpPlanAcceptance(tooHigh, 2, refused) == 0, "an extended id refused") && pass;
+
+    // The solar car set on the chip, in loopback: every standard id sent once
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    Node a(bus, SEEED_CAN_CS, SEEED_CAN_IRQ);
+    a.can->open(CAN_RATE, SEEED_CAN::Normal);
+    a.can->mode(SEEED_CAN::Loopback);
+    pass = check(a.can->configure(chipPlan.acceptance) == 1, "configure() the plan") && pass;
+    uint32_t received = 0, wantedReceived = 0;
+    for(uint32_t id = 0; id < MCP_STD_IDS; id++){
+        SEEED_CANMessage msg;
+        a.can->write(SEEED_CANMessage(id, data, 2, CANData, CANStandard));
+        wait_us(500);
+        if(a.can->read(msg)){
+            received++;
+            if(std::find(sets[2].ids.begin(), sets[2].ids.end(), (uint32_t)msg.id) != sets[2].ids.end()) wantedReceived++;
+        }
+    }
+    printf("  %s on the chip: %lu of %lu ids received, %lu of them wanted\n", sets[2].name, (unsigned long)received,
+           (unsigned long)MCP_STD_IDS, (unsigned long)wantedReceived);
+    pass = check(received == chipPlan.accepted && wantedReceived == sets[2].ids.size(), "the chip lets in what the planner counted") && pass;
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/*
+* 15. Shadow registers: the configuration registers the driver keeps (mcpShadowBits) must be what the
+* chip holds after every kind of call; once known they are read without SPI, while the status
+* registers always come from the chip. A reset, or mcpShadowInvalidate(), forgets them.
+*/
+static bool shadowMatches(Node &node, int &kept)
+{
+    mcp_can_t *obj = node.can->mcp();
+    bool same = true;
+    kept = 0;
+    for(int r = 0; r < MCP_SHADOW_SIZE; r++){
+        uint8_t bits = mcpShadowBits(r);
+        if(!bits || ((r & 0x0F) == 0x0F && r != MCP_CANCTRL) || !((obj->shadowValid[r / 32] >> (r % 32)) & 1)) continue;
+        kept++;
+        if((obj->shadow[r] ^ node.chip.peek(r)) & bits){
+            printf("  register 0x%02X: shadow 0x%02X, chip 0x%02X\n", r, obj->shadow[r], node.chip.peek(r));
+            same = false;
+        }
+    }
+    return same;
+}
+
+static bool checkShadow(void)
+{
+    static const char data[2] = { 0x5A, (char)0xA5 };
+    CANacceptance acceptance = { { 0x7F0, 0x1FFFFFFF }, { 0, 1 }, { 0x120, 0x130, 0x1ABCDEF0, 0x200, 0x201, 0x202 },
+                                 { 0, 0, 1, 0, 0, 0 } };
+    bool pass = true;
+    int kept = 0;
+
+    printf("15. Shadow registers\n");
+    hostReset();
+    CanBus bus;
+    hostBus(&bus);
+    Node a(bus, SEEED_CAN_CS, SEEED_CAN_IRQ);
+    Node b(bus, SEEED_CAN_IO9, PTC3);
+    Node c(bus, PTC4, PTC5);                                    // acknowledges b's frames
+    mcp_can_t *obj = a.can->mcp();
+    b.can->open(CAN_RATE, SEEED_CAN::Normal);
+    c.can->open(CAN_RATE, SEEED_CAN::Normal);
+
+    a.can->open(CAN_RATE, SEEED_CAN::Normal);
+    pass = check(shadowMatches(a, kept), "shadow matches the chip after open()") && pass;
+    printf("  after open(): %d registers kept\n", kept);
+    a.can->mask(0, 0x7F0);
+    a.can->filter(3, 0x123);
+    a.can->mask(1, 0x1FFFFFFF, CANExtended);
+    pass = check(shadowMatches(a, kept), "after mask() and filter()") && pass;
+    a.can->configure(acceptance);
+    a.can->attach(onSpiCostIrq, SEEED_CAN::Error);
+    a.can->rxRing(true);
+    pass = check(shadowMatches(a, kept), "after configure(), attach() and rxRing()") && pass;
+    a.can->monitor(true);
+    a.can->mode(SEEED_CAN::Loopback);
+    a.can->frequency(250000);
+    a.can->mode(SEEED_CAN::Normal);
+    a.can->frequency(CAN_RATE);
+    a.can->rxRing(true);
+    pass = check(shadowMatches(a, kept), "after monitor(), mode() and frequency()") && pass;
+    printf("  after mask(), filter(), configure(), attach(), rxRing(), mode() and frequency(): %d registers kept\n", kept);
+
+    // Once known, the configuration registers cost no SPI; the status registers always do
+    mcpConfigure(obj, &acceptance);
+    a.chip.clearTraffic();
+    static const uint8_t configuration[] = { MCP_CANCTRL, MCP_CANINTE, MCP_CNF1, MCP_CNF2, MCP_CNF3, MCP_RXM0SIDH, MCP_RXF5EID0 };
+    for(size_t i = 0; i < sizeof(configuration); i++) mcpRead(obj, configuration[i]);
+    unsigned long configurationReads = a.chip.traffic().transactions;
+    a.chip.clearTraffic();
+    static const uint8_t status[] = { MCP_CANSTAT, MCP_CANINTF, MCP_EFLG, MCP_TEC, MCP_REC, MCP_RXB0CTRL, MCP_TXB0CTRL };
+    for(size_t i = 0; i < sizeof(status); i++) mcpRead(obj, status[i]);
+    unsigned long statusReads = a.chip.traffic().transactions;
+    printf("  7 configuration registers read with %lu SPI transactions, 7 status registers with %lu\n",
+           configurationReads, statusReads);
+    pass = check(configurationReads == 0 && statusReads == 7, "configuration registers from the shadow, status ones from the chip") && pass;
+
+    // Changed behind the driver's back: the shadow keeps the old value until it is invalidated
+    a.chip.poke(MCP_RXF1SIDH, 0x5A);
+    bool stale = mcpRead(obj, MCP_RXF1SIDH) == (0x130 >> 3);
+    mcpShadowInvalidate(obj);
+    a.chip.clearTraffic();
+    bool fresh = mcpRead(obj, MCP_RXF1SIDH) == 0x5A && a.chip.traffic().transactions == 1;
+    pass = check(stale && fresh, "mcpShadowInvalidate(): the next read goes to the chip") && pass;
+    a.chip.clearTraffic();
+    pass = check(a.can->mode(SEEED_CAN::Normal) == 1 && a.chip.traffic().transactions == 2, "mode unknown after invalidation: asked and checked") && pass;
+
+    // A reset forgets everything but the reset values of the data sheet
+    a.can->mode(SEEED_CAN::Reset);
+    pass = check(shadowMatches(a, kept) && kept == 5, "after a reset: CANCTRL, CNF1-3 and CANINTE kept") && pass;
+
+    // Sleep is never taken as known: bus activity wakes the chip into listen-only mode
+    a.can->mode(SEEED_CAN::Normal);
+    a.can->mode(SEEED_CAN::Sleep);
+    b.can->write(SEEED_CANMessage(0x30, data, 2, CANData, CANStandard));
+    wait_ms(1);
+    bool woken = a.chip.mode() == 3;
+    pass = check(woken && a.can->mode(SEEED_CAN::Sleep) == 1 && a.chip.mode() == 1, "mode(Sleep) after waking up sleeps again") && pass;
+    pass = check(shadowMatches(a, kept), "shadow matches the chip at the end") && pass;
+
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+int main(void)
+{
+    bool pass = true;
+
+    pass = checkOpen() && pass;
+    pass = checkLoopback() && pass;
+    pass = checkTwoNodes() && pass;
+    pass = checkChipRules() && pass;
+    pass = checkSpiCost() && pass;
+    pass = checkTransmitPath() && pass;
+    pass = checkThroughput() && pass;
+    pass = checkReceiveBursts() && pass;
+    pass = checkTransmitQueue() && pass;
+    pass = checkReceiveRing() && pass;
+    pass = checkTransmitPriority() && pass;
+    pass = checkLog() && pass;
+    pass = checkConfigure() && pass;
+    pass = checkPlanner() && pass;
+    pass = checkShadow() && pass;
+
+    printf("%s\n", pass ? "All checks passed" : "Some checks FAILED");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,305 @@
+/*************************** host_mbed.cpp ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Host Version of the mbed API Used by the SEEED_CAN Library
+ *
+ * Purpose: See mbed.h.
+ *
+ *****************************************************************************************/
+#include <vector>
+#include "mbed.h"
+#include "mcp2515_model.h"
+
+struct Binding {
+    Mcp2515 *chip;
+    PinName  ncs, irq;
+    bool     selected;          // chip select low
+    bool     asserted;          // INT level at the last look
+    bool     fell, rose;        // edges waiting for their handlers
+    bool     streaming;         // fed by a transfer() in the background
+};
+
+struct Handler {
+    const InterruptIn *owner;
+    PinName pin;
+    bool    falling;
+    std::function<void()> call;
+};
+
+static std::vector<Binding> bindings;
+static std::vector<Handler> handlers;
+static CanBus  *bus = NULL;
+static uint64_t now = 0;
+static int      selected = 0;           // chips with chip select low
+static bool     inHandler = false;
+static int      inCallback = 0;         // transfer() callbacks and hostAt() calls running
+static std::vector<PinName> disabled;  // InterruptIn::disable_irq()
+
+struct Completion {
+    uint64_t at;                // ns
+    std::function<void()> call;
+};
+static std::vector<Completion> completions;    // SPI transfers in the background, hostAt() calls
+
+/* Edges of the INT pins since the last look, then the handlers if they may run */
+static void serviceInterrupts(void)
+{
+    for(size_t i = 0; i < bindings.size(); i++){
+        bool level = bindings[i].chip->interrupt();
+        if(level && !bindings[i].asserted) bindings[i].fell = true;    // active low: asserted = falling edge
+        if(!level && bindings[i].asserted) bindings[i].rose = true;
+        bindings[i].asserted = level;
+    }
+    if(inHandler || selected) return;
+
+    inHandler = true;
+    for(size_t i = 0; i < bindings.size(); i++){
+        bool masked = false;
+        for(size_t d = 0; d < disabled.size(); d++) if(disabled[d] == bindings[i].irq) masked = true;
+        while(!masked && (bindings[i].fell || bindings[i].rose)){
+            bool falling = bindings[i].fell;
+            if(falling) bindings[i].fell = false;
+            else bindings[i].rose = false;
+            for(size_t h = 0; h < handlers.size(); h++){
+                if(handlers[h].pin == bindings[i].irq && handlers[h].falling == falling && handlers[h].call){
+                    std::function<void()> call = handlers[h].call;     // may attach() while running
+                    call();
+                }
+            }
+        }
+    }
+    inHandler = false;
+}
+
+void hostBind(Mcp2515 &chip, PinName ncs, PinName irq)
+{
+    Binding b = { &chip, ncs, irq, false, chip.interrupt(), false, false, false };
+    bindings.push_back(b);
+}
+
+void hostBus(CanBus *canBus)
+{
+    bus = canBus;
+}
+
+void hostReset(void)
+{
+    bindings.clear();
+    completions.clear();
+    disabled.clear();
+    bus = NULL;
+    now = 0;
+    selected = 0;
+}
+
+uint64_t hostNow(void)
+{
+    return now;
+}
+
+uint32_t us_ticker_read(void)
+{
+    return (uint32_t)(now / 1000);
+}
+
+void hostAt(uint64_t at, std::function<void()> call)
+{
+    Completion c = { at, call };
+    completions.push_back(c);
+}
+
+/* Index of the first background SPI transfer or hostAt() call due, -1 if there is none */
+static int nextCompletion(void)
+{
+    int next = -1;
+    for(size_t i = 0; i < completions.size(); i++){
+        if(next < 0 || completions[i].at < completions[next].at) next = (int)i;
+    }
+    return next;
+}
+
+/*
+* Runs the bus to now + ns, looking at the interrupt pins at the end of every frame, and calls
+* back the background SPI transfers that complete and the hostAt() calls due on the way
+*/
+void hostAdvance(uint64_t ns)
+{
+    uint64_t until = now + ns;
+
+    for(;;){
+        uint64_t stop = until;
+        int next = nextCompletion();
+        if(next >= 0 && completions[next].at < stop) stop = completions[next].at;
+        while(bus && bus->step(stop)){
+            if(bus->now() > now) now = bus->now();
+            serviceInterrupts();
+        }
+        if(stop > now) now = stop;
+        next = nextCompletion();
+        if(next >= 0 && completions[next].at <= now){
+            std::function<void()> call = completions[next].call;
+            completions.erase(completions.begin() + next);
+            inCallback++;
+            call();                                             // the SPI interrupt
+            inCallback--;
+            continue;
+        }
+        if(now >= until) break;                                 // also if a handler took longer
+    }
+    serviceInterrupts();
+}
+
+/*
+* SPI: a byte goes to every selected chip (there should be one) and takes 8 clocks. A chip that
+* a transfer() is feeding gets nothing else: the nodes of a test are separate boards.
+*/
+uint8_t SPI::clock(uint8_t mosi)
+{
+    uint8_t miso = 0xFF;
+    for(size_t i = 0; i < bindings.size(); i++){
+        if(bindings[i].selected && !bindings[i].streaming) miso &= bindings[i].chip->transfer(mosi);
+    }
+    return miso;
+}
+
+int SPI::write(int value)
+{
+    int miso = clock((uint8_t)value);
+    hostAdvance(8000000000ULL / _hz + HOST_SPI_CALL_NS);
+    return miso;
+}
+
+int SPI::write(const char *tx, int txLength, char *rx, int rxLength)
+{
+    int n = (txLength > rxLength) ? txLength : rxLength;
+    for(int i = 0; i < n; i++){
+        uint8_t miso = clock((i < txLength) ? (uint8_t)tx[i] : 0xFF);
+        if(i < rxLength) rx[i] = (char)miso;
+    }
+    hostAdvance(8000000000ULL * n / _hz + HOST_SPI_CALL_NS);
+    return n;
+}
+
+/*
+* The chip gets the bytes at once (nothing else may use the bus until the callback), the callback
+* runs when their clocks are done; the caller only pays for the call
+*/
+int SPI::start(const uint8_t *tx, int txLength, uint8_t *rx, int rxLength, const event_callback_t &callback,
+               int event)
+{
+    if(_busy) return -1;
+    int n = (txLength > rxLength) ? txLength : rxLength;
+    for(int i = 0; i < n; i++){
+        uint8_t miso = clock((tx && i < txLength) ? tx[i] : 0xFF);
+        if(rx && i < rxLength) rx[i] = miso;
+    }
+    std::vector<Mcp2515 *> fed;
+    for(size_t i = 0; i < bindings.size(); i++){
+        if(bindings[i].selected){
+            bindings[i].streaming = true;
+            fed.push_back(bindings[i].chip);
+        }
+    }
+    _busy = true;
+    Completion c = { now + HOST_SPI_CALL_NS + 8000000000ULL * n / _hz, std::function<void()>() };
+    c.call = [this, callback, event, fed]() {
+        for(size_t i = 0; i < bindings.size(); i++){
+            for(size_t f = 0; f < fed.size(); f++) if(bindings[i].chip == fed[f]) bindings[i].streaming = false;
+        }
+        _busy = false;
+        if(event & SPI_EVENT_COMPLETE) callback.call(SPI_EVENT_COMPLETE);
+    };
+    completions.push_back(c);
+    hostAdvance(HOST_SPI_CALL_NS);
+    return 0;
+}
+
+/*
+* DigitalOut: chip select of a bound chip
+*/
+void DigitalOut::write(int value)
+{
+    _value = value ? 1 : 0;
+    for(size_t i = 0; i < bindings.size(); i++){
+        if(bindings[i].ncs != _pin || bindings[i].selected == !_value) continue;
+        bindings[i].selected = !_value;
+        if(_value){
+            bindings[i].chip->deselect();
+            selected--;
+        } else {
+            bindings[i].chip->select();
+            selected++;
+        }
+    }
+    hostAdvance(HOST_GPIO_NS);
+}
+
+/*
+* InterruptIn
+*/
+InterruptIn::~InterruptIn()
+{
+    for(size_t h = handlers.size(); h-- > 0; ){
+        if(handlers[h].owner == this) handlers.erase(handlers.begin() + h);
+    }
+}
+
+void InterruptIn::attach(bool falling, std::function<void()> handler)
+{
+    for(size_t h = 0; h < handlers.size(); h++){
+        if(handlers[h].owner == this && handlers[h].falling == falling){
+            handlers[h].call = handler;
+            return;
+        }
+    }
+    Handler h = { this, _pin, falling, handler };
+    handlers.push_back(h);
+}
+
+/* Pin level: 0 while a bound chip asserts INT */
+int InterruptIn::read(void)
+{
+    for(size_t i = 0; i < bindings.size(); i++){
+        if(bindings[i].irq == _pin && bindings[i].chip->interrupt()) return 0;
+    }
+    return 1;
+}
+
+void InterruptIn::disable_irq(void)
+{
+    disabled.push_back(_pin);
+}
+
+void InterruptIn::enable_irq(void)
+{
+    for(size_t d = 0; d < disabled.size(); d++){
+        if(disabled[d] == _pin){
+            disabled.erase(disabled.begin() + d);
+            break;
+        }
+    }
+    serviceInterrupts();
+}
+
+uint32_t __get_IPSR(void)
+{
+    return (inHandler || inCallback) ? 1 : 0;
+}
+
+/*
+* Waits
+*/
+void wait(float s)
+{
+    hostAdvance((uint64_t)(s * 1e9));
+}
+
+void wait_ms(int ms)
+{
+    hostAdvance((uint64_t)ms * 1000000);
+}
+
+void wait_us(int us)
+{
+    hostAdvance((uint64_t)us * 1000);
+}
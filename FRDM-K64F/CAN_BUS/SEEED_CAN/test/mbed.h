@@ -0,0 +1,173 @@
+/*************************** mbed.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Host Version of the mbed API Used by the SEEED_CAN Library
+ *
+ * Purpose: The SEEED_CAN library (../SEEED_CAN_LIBRARY) includes "mbed.h". Compiled with this
+ * directory first on the include path, it gets this file instead and runs on a workstation,
+ * unmodified, against the MCP2515 model of mcp2515_model.h:
+ *
+ *      SPI          write() clocks one byte, or a block of bytes, to the chip whose chip
+ *                   select is low; transfer() does it in the background (DEVICE_SPI_ASYNCH)
+ *                   and calls back when the last byte is out.
+ *      DigitalOut   a pin bound to a chip (hostBind) is its chip select.
+ *      InterruptIn  fall()/rise() handlers run on the edges of the chip's INT pin.
+ *      wait()       lets simulated time pass.
+ *
+ * Time is simulated, in nanoseconds (hostNow). Every SPI byte takes 8 clocks, every SPI call
+ * HOST_SPI_CALL_NS on top (once per block, the bytes of a block follow each other without a gap)
+ * and every chip select edge HOST_GPIO_NS, so the time the driver spends on SPI can be measured.
+ * A transfer() costs the caller only HOST_SPI_CALL_NS; its callback runs when the clocks are done. The CAN bus (hostBus) runs along with it. An interrupt handler runs as soon
+ * as the edge happens, like on the K64F, but not while a chip is selected or another handler runs;
+ * the edge is kept until then, or until InterruptIn::enable_irq().
+ *
+ * Only the parts of the mbed API the library uses are here.
+ *
+ *****************************************************************************************/
+#ifndef _HOST_MBED_H_
+#define _HOST_MBED_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <functional>
+
+#define HOST_SPI_CALL_NS     1000       // estimated cost of one SPI::write() call on the K64F, besides the clocks
+#define HOST_GPIO_NS         100        // estimated cost of a DigitalOut write
+
+#define DEVICE_SPI_ASYNCH    1
+#define SPI_EVENT_COMPLETE   (1 << 3)
+
+enum DMAUsage {
+    DMA_USAGE_NEVER, DMA_USAGE_OPPORTUNISTIC, DMA_USAGE_ALWAYS, DMA_USAGE_TEMPORARY_ALLOCATED, DMA_USAGE_ALLOCATED
+};
+
+enum PinName {
+    PTA0 = 0, PTA1, PTA2, PTA3, PTA4, PTA5, PTA6, PTA7, PTA8, PTA9, PTA10, PTA11, PTA12, PTA13, PTA14, PTA15,
+    PTA16, PTA17, PTA18, PTA19, PTA20, PTA21, PTA22, PTA23, PTA24, PTA25, PTA26, PTA27, PTA28, PTA29, PTA30, PTA31,
+    PTB0 = 32, PTB1, PTB2, PTB3, PTB4, PTB5, PTB6, PTB7, PTB8, PTB9, PTB10, PTB11, PTB12, PTB13, PTB14, PTB15,
+    PTB16, PTB17, PTB18, PTB19, PTB20, PTB21, PTB22, PTB23, PTB24, PTB25, PTB26, PTB27, PTB28, PTB29, PTB30, PTB31,
+    PTC0 = 64, PTC1, PTC2, PTC3, PTC4, PTC5, PTC6, PTC7, PTC8, PTC9, PTC10, PTC11, PTC12, PTC13, PTC14, PTC15,
+    PTC16, PTC17, PTC18, PTC19, PTC20, PTC21, PTC22, PTC23, PTC24, PTC25, PTC26, PTC27, PTC28, PTC29, PTC30, PTC31,
+    PTD0 = 96, PTD1, PTD2, PTD3, PTD4, PTD5, PTD6, PTD7, PTD8, PTD9, PTD10, PTD11, PTD12, PTD13, PTD14, PTD15,
+    PTD16, PTD17, PTD18, PTD19, PTD20, PTD21, PTD22, PTD23, PTD24, PTD25, PTD26, PTD27, PTD28, PTD29, PTD30, PTD31,
+    PTE0 = 128, PTE1, PTE2, PTE3, PTE4, PTE5, PTE6, PTE7, PTE8, PTE9, PTE10, PTE11, PTE12, PTE13, PTE14, PTE15,
+    PTE16, PTE17, PTE18, PTE19, PTE20, PTE21, PTE22, PTE23, PTE24, PTE25, PTE26, PTE27, PTE28, PTE29, PTE30, PTE31,    NC = -1
+};
+
+class Mcp2515;
+class CanBus;
+
+/* Host side: wiring and time */
+void hostBind(Mcp2515 &chip, PinName ncs, PinName irq);    // chip select and INT pins of a chip
+void hostBus(CanBus *bus);                                  // the bus that runs with simulated time
+void hostReset(void);                                       // unbinds everything, time back to 0
+uint64_t hostNow(void);                                     // simulated time (ns)
+void hostAdvance(uint64_t ns);                              // lets 'ns' pass (bus, interrupts)
+void hostAt(uint64_t at, std::function<void()> call);       // runs 'call' at time 'at', like another board would
+
+class FunctionPointer
+{
+public:
+    void attach(void (*fptr)(void)) { _f = fptr ? std::function<void()>(fptr) : std::function<void()>(); }
+    template<typename T>
+    void attach(T *tptr, void (T::*mptr)(void)) { _f = [tptr, mptr]() { (tptr->*mptr)(); }; }
+    void call(void) { if(_f) _f(); }
+    void operator()(void) { call(); }
+
+private:
+    std::function<void()> _f;
+};
+
+class event_callback_t
+{
+public:
+    event_callback_t() {}
+    event_callback_t(void (*fptr)(int)) : _f(fptr) {}
+    template<typename T>
+    event_callback_t(T *tptr, void (T::*mptr)(int)) : _f([tptr, mptr](int event) { (tptr->*mptr)(event); }) {}
+    void call(int event) const { if(_f) _f(event); }
+
+private:
+    std::function<void(int)> _f;
+};
+
+class SPI
+{
+public:
+    SPI(PinName mosi, PinName miso, PinName sclk) : _hz(1000000), _busy(false) { (void)mosi; (void)miso; (void)sclk; }
+    void format(int bits, int mode = 0) { (void)bits; (void)mode; }
+    void frequency(int hz = 1000000) { _hz = hz; }
+    int write(int value);
+    int write(const char *tx, int txLength, char *rx, int rxLength);    // max of the lengths, 0xFF past 'tx'
+    template<typename Type>
+    int transfer(const Type *tx, int txLength, Type *rx, int rxLength, const event_callback_t &callback,
+                 int event = SPI_EVENT_COMPLETE)
+    {
+        return start((const uint8_t *)tx, txLength * sizeof(Type), (uint8_t *)rx, rxLength * sizeof(Type),
+                        callback, event);
+    }
+    int set_dma_usage(DMAUsage usage) { (void)usage; return 0; }
+
+private:
+    int start(const uint8_t *tx, int txLength, uint8_t *rx, int rxLength, const event_callback_t &callback,
+                 int event);
+    uint8_t clock(uint8_t mosi);
+
+    int  _hz;
+    bool _busy;                 // a transfer() is in progress
+};
+
+class DigitalOut
+{
+public:
+    DigitalOut(PinName pin) : _pin(pin), _value(0) {}
+    DigitalOut(PinName pin, int value) : _pin(pin), _value(0) { write(value); }
+    void write(int value);
+    int read(void) { return _value; }
+    DigitalOut &operator=(int value) { write(value); return *this; }
+    operator int() { return _value; }
+
+private:
+    PinName _pin;
+    int     _value;
+};
+
+class InterruptIn
+{
+public:
+    InterruptIn(PinName pin) : _pin(pin) {}
+    InterruptIn(const InterruptIn &other) : _pin(other._pin) {}    // the handlers stay with 'other'
+    ~InterruptIn();
+
+    void fall(void (*fptr)(void)) { attach(true, fptr ? std::function<void()>(fptr) : std::function<void()>()); }
+    template<typename T>
+    void fall(T *tptr, void (T::*mptr)(void)) { attach(true, [tptr, mptr]() { (tptr->*mptr)(); }); }
+    void rise(void (*fptr)(void)) { attach(false, fptr ? std::function<void()>(fptr) : std::function<void()>()); }
+    template<typename T>
+    void rise(T *tptr, void (T::*mptr)(void)) { attach(false, [tptr, mptr]() { (tptr->*mptr)(); }); }
+
+    int read(void);
+    void enable_irq(void);      // edges that came while disabled call their handlers now
+    void disable_irq(void);
+
+private:
+    void attach(bool falling, std::function<void()> handler);
+
+    PinName _pin;
+};
+
+uint32_t __get_IPSR(void);     // not 0 in an interrupt handler, a transfer() callback or a hostAt() call
+inline void __DMB(void) { __sync_synchronize(); }      // a full barrier, also between host threads
+// Interrupt handlers run one at a time on the simulation's thread: masking them has nothing to do
+inline uint32_t __get_PRIMASK(void) { return 0; }
+inline void __set_PRIMASK(uint32_t) {}
+inline void __disable_irq(void) {}
+uint32_t us_ticker_read(void);  // simulated time (us)
+
+void wait(float s);
+void wait_ms(int ms);
+void wait_us(int us);
+
+#endif // _HOST_MBED_H_
@@ -0,0 +1,776 @@
+/*************************** mcp2515_model.cpp ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Register-Level Model of the MCP2515 CAN Controller
+ *
+ * Purpose: See mcp2515_model.h. Register names, addresses, bits and access rules are those of the
+ * MCP2515 data sheet (DS21801); they are defined here rather than taken from seeed_can_defs.h so a
+ * mistake in the driver's definitions shows up as a failing test instead of being copied.
+ *
+ *****************************************************************************************/
+#include <string.h>
+#include "mcp2515_model.h"
+
+// Registers
+#define REG_RXF0SIDH        0x00
+#define REG_RXF3SIDH        0x10
+#define REG_CANSTAT         0x0E
+#define REG_CANCTRL         0x0F
+#define REG_TEC             0x1C
+#define REG_REC             0x1D
+#define REG_RXM0SIDH        0x20
+#define REG_CNF3            0x28
+#define REG_CNF2            0x29
+#define REG_CNF1            0x2A
+#define REG_CANINTE         0x2B
+#define REG_CANINTF         0x2C
+#define REG_EFLG            0x2D
+#define REG_TXB0CTRL        0x30        // TXBnCTRL at 0x30, 0x40, 0x50
+#define REG_RXB0CTRL        0x60        // RXBnCTRL at 0x60, 0x70
+#define REG_BFPCTRL         0x0C
+#define REG_TXRTSCTRL       0x0D
+
+// Buffer layout, from xxBnCTRL
+#define BUF_SIDH            1
+#define BUF_SIDL            2
+#define BUF_EID8            3
+#define BUF_EID0            4
+#define BUF_DLC             5
+#define BUF_D0              6
+
+// Bits
+#define CANCTRL_REQOP_SHIFT 5
+#define CANCTRL_ABAT        0x10
+#define CANCTRL_OSM         0x08
+#define TXB_ABTF            0x40
+#define TXB_MLOA            0x20
+#define TXB_TXERR           0x10
+#define TXB_TXREQ           0x08
+#define TXB_TXP             0x03
+#define RXB_RXM_SHIFT       5
+#define RXB_RXRTR           0x08
+#define RXB0_BUKT           0x04
+#define RXB0_BUKT1          0x02
+#define SIDL_SRR            0x10
+#define SIDL_IDE            0x08
+#define DLC_RTR             0x40
+#define INT_RX0IF           0x01
+#define INT_RX1IF           0x02
+#define INT_TX0IF           0x04        // TXnIF = INT_TX0IF << n
+#define INT_ERRIF           0x20
+#define INT_WAKIF           0x40
+#define INT_MERRF           0x80
+#define EFLG_EWARN          0x01
+#define EFLG_RXWAR          0x02
+#define EFLG_TXWAR          0x04
+#define EFLG_RXEP           0x08
+#define EFLG_TXEP           0x10
+#define EFLG_TXBO           0x20
+#define EFLG_RX0OVR         0x40
+#define EFLG_RX1OVR         0x80
+
+// Instructions
+#define INS_WRITE           0x02
+#define INS_READ            0x03
+#define INS_BITMOD          0x05
+#define INS_LOAD_TX         0x40        // 0x40-0x45
+#define INS_RTS             0x80        // 0x80-0x87
+#define INS_READ_RX         0x90        // 0x90, 0x92, 0x94, 0x96
+#define INS_READ_STATUS     0xA0
+#define INS_RX_STATUS       0xB0
+#define INS_RESET           0xC0
+
+// Operating modes (REQOP/OPMOD)
+#define MODE_NORMAL         0
+#define MODE_SLEEP          1
+#define MODE_LOOPBACK       2
+#define MODE_LISTEN         3
+#define MODE_CONFIG         4
+
+#define RXSTAT_ROLLOVER     6           // RX STATUS filter code 6 + n: RXFn rolled over into RXB1
+
+/* CRC-15 of the bits of a frame, start of frame to the end of the data field */
+static unsigned canCrc(const unsigned char *bits, int n)
+{
+    unsigned crc = 0;
+    for(int k = 0; k < n; k++){
+        unsigned next = bits[k] ^ ((crc >> 14) & 1);
+        crc = (crc << 1) & 0x7FFF;
+        if(next) crc ^= 0x4599;
+    }
+    return crc;
+}
+
+/*
+* Bits of 'frame' on the wire: start of frame to the end of the CRC with stuff bits (a bit of the
+* opposite level after five equal bits), then CRC delimiter, ACK slot, ACK delimiter, 7 bit end of
+* frame and the 3 bit intermission.
+*/
+int canFrameBits(const CanFrame &frame)
+{
+    unsigned char bits[160];
+    int n = 0;
+    int bytes = frame.remote ? 0 : (frame.length > 8 ? 8 : frame.length);
+
+    bits[n++] = 0;                                              // start of frame
+    if(frame.extended){
+        for(int b = 28; b >= 18; b--) bits[n++] = (frame.id >> b) & 1;
+        bits[n++] = 1;                                          // SRR
+        bits[n++] = 1;                                          // IDE
+        for(int b = 17; b >= 0; b--) bits[n++] = (frame.id >> b) & 1;
+        bits[n++] = frame.remote;                               // RTR
+        bits[n++] = 0;                                          // r1
+        bits[n++] = 0;                                          // r0
+    } else {
+        for(int b = 10; b >= 0; b--) bits[n++] = (frame.id >> b) & 1;
+        bits[n++] = frame.remote;                               // RTR
+        bits[n++] = 0;                                          // IDE
+        bits[n++] = 0;                                          // r0
+    }
+    for(int b = 3; b >= 0; b--) bits[n++] = (frame.length >> b) & 1;
+    for(int k = 0; k < bytes; k++){
+        for(int b = 7; b >= 0; b--) bits[n++] = (frame.data[k] >> b) & 1;
+    }
+    unsigned crc = canCrc(bits, n);
+    for(int b = 14; b >= 0; b--) bits[n++] = (crc >> b) & 1;
+
+    int total = 0, run = 0;
+    unsigned char last = 2;
+    for(int k = 0; k < n; k++){
+        run = bits[k] == last ? run + 1 : 1;
+        last = bits[k];
+        total++;
+        if(run == 5){                                           // the stuff bit starts a new run
+            total++;
+            last = !last;
+            run = 1;
+        }
+    }
+    return total + 1 + 1 + 1 + 7 + 3;
+}
+
+/* Arbitration order of a frame: the lower value wins (dominant 0 bits first) */
+static uint64_t arbitrationKey(const CanFrame &frame)
+{
+    if(frame.extended){
+        return ((uint64_t)(frame.id >> 18) << 21) | (1ULL << 20) | (1ULL << 19) |
+               ((uint64_t)(frame.id & 0x3FFFF) << 1) | frame.remote;
+    }
+    return ((uint64_t)(frame.id & 0x7FF) << 21) | ((uint64_t)frame.remote << 20);
+}
+
+Mcp2515::Mcp2515(uint32_t oscillator) :
+    _oscillator(oscillator),
+    _selected(false),
+    _state(IDLE),
+    _instruction(0),
+    _address(0),
+    _mask(0),
+    _rxRead(0),
+    _onBus(-1),
+    _abortOnBus(false),
+    _overflows(0),
+    _ignoredWrites(0)
+{
+    clearTraffic();
+    reset();
+}
+
+/* Power-on / RESET instruction: every register to its reset value, configuration mode */
+void Mcp2515::reset(void)
+{
+    memset(_reg, 0, sizeof(_reg));
+    _reg[REG_CANCTRL] = 0x87;                                   // REQOP = config, CLKEN, CLKPRE = /8
+    _reg[REG_CANSTAT] = MODE_CONFIG << CANCTRL_REQOP_SHIFT;
+    _filterHit[0] = _filterHit[1] = 0;
+    _rxRead = 0;
+    _onBus = -1;
+    _abortOnBus = false;
+}
+
+void Mcp2515::clearTraffic(void)
+{
+    memset(&_traffic, 0, sizeof(_traffic));
+}
+
+int Mcp2515::mode(void) const
+{
+    return _reg[REG_CANSTAT] >> CANCTRL_REQOP_SHIFT;
+}
+
+/* Bit time = (1 + PRSEG + PS1 + PS2) Tq, Tq = 2 (BRP + 1) / Fosc; PS2 = max(PS1, 2) unless BTLMODE */
+uint64_t Mcp2515::bitTime(void) const
+{
+    uint8_t cnf1 = _reg[REG_CNF1], cnf2 = _reg[REG_CNF2], cnf3 = _reg[REG_CNF3];
+    int brp = (cnf1 & 0x3F) + 1;
+    int prseg = (cnf2 & 0x07) + 1;
+    int ps1 = ((cnf2 >> 3) & 0x07) + 1;
+    int ps2 = (cnf2 & 0x80) ? (cnf3 & 0x07) + 1 : (ps1 > 2 ? ps1 : 2);
+    int quanta = 1 + prseg + ps1 + ps2;
+    return (uint64_t)2 * brp * quanta * 1000000000ULL / _oscillator;
+}
+
+/* The bit is sampled at the end of PS1 */
+int Mcp2515::samplePoint(void) const
+{
+    uint8_t cnf2 = _reg[REG_CNF2], cnf3 = _reg[REG_CNF3];
+    int prseg = (cnf2 & 0x07) + 1;
+    int ps1 = ((cnf2 >> 3) & 0x07) + 1;
+    int ps2 = (cnf2 & 0x80) ? (cnf3 & 0x07) + 1 : (ps1 > 2 ? ps1 : 2);
+    int quanta = 1 + prseg + ps1 + ps2;
+    return (1000 * (1 + prseg + ps1) + quanta / 2) / quanta;
+}
+
+bool Mcp2515::interrupt(void) const
+{
+    return (_reg[REG_CANINTE] & _reg[REG_CANINTF]) != 0;
+}
+
+uint8_t Mcp2515::peek(uint8_t address) const
+{
+    return readRegister(address & 0x7F);
+}
+
+void Mcp2515::poke(uint8_t address, uint8_t value)
+{
+    _reg[address & 0x7F] = value;
+}
+
+/*
+* SPI
+*/
+void Mcp2515::select(void)
+{
+    _selected = true;
+    _state = IDLE;
+    _traffic.transactions++;
+}
+
+uint8_t Mcp2515::transfer(uint8_t mosi)
+{
+    uint8_t miso = 0xFF;
+
+    if(!_selected) return miso;
+    _traffic.bytes++;
+
+    switch(_state){
+    case IDLE:
+        _instruction = mosi;
+        _traffic.instructions[mosi]++;
+        if(mosi == INS_RESET){
+            reset();
+            _state = DONE;
+        } else if(mosi == INS_READ || mosi == INS_WRITE || mosi == INS_BITMOD){
+            _state = ADDRESS;
+        } else if((mosi & 0xF9) == INS_READ_RX){                // 1001 0nm0
+            int buffer = (mosi >> 2) & 1;
+            _address = REG_RXB0CTRL + 0x10 * buffer + ((mosi & 0x02) ? BUF_D0 : BUF_SIDH);
+            _rxRead |= buffer ? INT_RX1IF : INT_RX0IF;
+            _state = READ;
+        } else if((mosi & 0xF8) == INS_LOAD_TX && (mosi & 0x07) <= 5){  // 0100 0abc
+            int buffer = (mosi >> 1) & 3;
+            _address = REG_TXB0CTRL + 0x10 * buffer + ((mosi & 0x01) ? BUF_D0 : BUF_SIDH);
+            _state = WRITE;
+        } else if((mosi & 0xF8) == INS_RTS){                    // 1000 0nnn
+            for(int n = 0; n < 3; n++){
+                if(mosi & (1 << n)) requestTransmit(n);
+            }
+            _state = DONE;
+        } else if(mosi == INS_READ_STATUS || mosi == INS_RX_STATUS){
+            _state = STATUS;
+        } else {
+            _state = DONE;                                      // not an instruction, ignored
+        }
+        break;
+    case ADDRESS:
+        _address = mosi & 0x7F;
+        _state = _instruction == INS_READ ? READ : _instruction == INS_WRITE ? WRITE : MASK;
+        break;
+    case READ:
+        miso = readRegister(_address);
+        _address = (_address + 1) & 0x7F;
+        break;
+    case WRITE:
+        writeRegister(_address, mosi, 0xFF);
+        _address = (_address + 1) & 0x7F;
+        break;
+    case MASK:
+        _mask = mosi;
+        _state = DATA;
+        break;
+    case DATA:
+        {
+            // BIT MODIFY only works on these registers, on the others the mask is 0xFF
+            uint8_t a = _address, low = a & 0x0F;
+            bool modifiable = a == REG_BFPCTRL || a == REG_TXRTSCTRL || low == 0x0F ||
+                              (a >= REG_CNF3 && a <= REG_EFLG) ||
+                              ((a & 0x8F) == 0 && a >= REG_TXB0CTRL && a <= REG_RXB0CTRL + 0x10);
+            writeRegister(a, mosi, modifiable ? _mask : 0xFF);
+            _state = DONE;
+        }
+        break;
+    case STATUS:
+        miso = _instruction == INS_READ_STATUS ? readStatus() : rxStatus();     // repeats while selected
+        break;
+    case DONE:
+        break;
+    }
+    return miso;
+}
+
+void Mcp2515::deselect(void)
+{
+    if(!_selected) return;
+    _selected = false;
+    _reg[REG_CANINTF] &= ~_rxRead;                              // READ RX BUFFER frees its buffer
+    _rxRead = 0;
+    _state = IDLE;
+}
+
+/*
+* Registers
+*/
+uint8_t Mcp2515::readRegister(uint8_t address) const
+{
+    if((address & 0x0F) == 0x0E){                               // CANSTAT in every row, with ICOD
+        uint8_t pending = _reg[REG_CANINTE] & _reg[REG_CANINTF];
+        uint8_t code = 0;
+        if(pending & INT_ERRIF) code = 1;                       // highest priority first
+        else if(pending & INT_WAKIF) code = 2;
+        else if(pending & (INT_TX0IF << 0)) code = 3;
+        else if(pending & (INT_TX0IF << 1)) code = 4;
+        else if(pending & (INT_TX0IF << 2)) code = 5;
+        else if(pending & INT_RX0IF) code = 6;
+        else if(pending & INT_RX1IF) code = 7;
+        return (_reg[REG_CANSTAT] & 0xE0) | (code << 1);
+    }
+    if((address & 0x0F) == 0x0F) return _reg[REG_CANCTRL];      // CANCTRL in every row
+    return _reg[address];
+}
+
+/*
+* Writes 'value' to the bits of 'address' set in 'mask' (WRITE, LOAD TX BUFFER, BIT MODIFY),
+* following the access rules of the data sheet: filters, masks and CNF only in configuration
+* mode, read-only bits and registers left alone, transmit buffers locked while TXREQ is set.
+*/
+void Mcp2515::writeRegister(uint8_t address, uint8_t value, uint8_t mask)
+{
+    uint8_t low = address & 0x0F;
+    uint8_t writable;
+
+    if(low == 0x0E) return;                                     // CANSTAT
+    if(low == 0x0F) address = REG_CANCTRL;
+
+    if(address < REG_TEC || (address >= REG_RXM0SIDH && address <= REG_CNF1)){
+        if(address != REG_CANCTRL && address != REG_BFPCTRL && address != REG_TXRTSCTRL){
+            if(mode() != MODE_CONFIG){                          // filters, masks and CNF
+                _ignoredWrites++;
+                return;
+            }
+        }
+    }
+
+    if(address == REG_CANCTRL){
+        uint8_t old = _reg[REG_CANCTRL];
+        _reg[REG_CANCTRL] = (old & ~mask) | (value & mask);
+        if(_reg[REG_CANCTRL] & CANCTRL_ABAT & ~old){            // abort all pending transmissions
+            for(int n = 0; n < 3; n++) abortTransmit(n);
+        }
+        int request = _reg[REG_CANCTRL] >> CANCTRL_REQOP_SHIFT;
+        if(request != mode()) setMode(request);
+        return;
+    }
+    if(address == REG_TEC || address == REG_REC) return;
+
+    if(address >= REG_TXB0CTRL && address < REG_RXB0CTRL){
+        int buffer = (address - REG_TXB0CTRL) >> 4;
+        uint8_t ctrl = REG_TXB0CTRL + 0x10 * buffer, offset = address - ctrl;
+        if(offset == 0){                                        // TXBnCTRL: TXREQ and TXP only
+            writable = TXB_TXREQ | TXB_TXP;
+            uint8_t next = (_reg[ctrl] & ~(mask & writable)) | (value & mask & writable);
+            bool wasRequested = _reg[ctrl] & TXB_TXREQ;
+            _reg[ctrl] = (_reg[ctrl] & ~TXB_TXP) | (next & TXB_TXP);
+            if(!wasRequested && (next & TXB_TXREQ)) requestTransmit(buffer);
+            if(wasRequested && !(next & TXB_TXREQ)) abortTransmit(buffer);
+            return;
+        }
+        if(_reg[ctrl] & TXB_TXREQ){                             // locked while waiting to be sent
+            _ignoredWrites++;
+            return;
+        }
+        writable = offset == BUF_SIDL ? 0xEB : offset == BUF_DLC ? 0x4F : 0xFF;
+    } else if(address >= REG_RXB0CTRL){
+        int buffer = (address - REG_RXB0CTRL) >> 4;
+        if(address != REG_RXB0CTRL + 0x10 * buffer) return;     // receive buffers are read-only
+        writable = buffer ? 0x60 : 0x64;                        // RXM (and BUKT)
+        _reg[address] = (_reg[address] & ~(mask & writable)) | (value & mask & writable);
+        if(!buffer){
+            _reg[address] = (_reg[address] & ~RXB0_BUKT1) | ((_reg[address] & RXB0_BUKT) ? RXB0_BUKT1 : 0);
+        }
+        return;
+    } else if(address == REG_EFLG){
+        writable = EFLG_RX0OVR | EFLG_RX1OVR;
+    } else if(address == REG_CNF3){
+        writable = 0xC7;
+    } else if(address >= REG_RXM0SIDH && address < REG_CNF3){
+        writable = (address & 3) == 1 ? 0xE3 : 0xFF;           // RXMnSIDL
+    } else if(address < REG_TEC && address != REG_BFPCTRL && address != REG_TXRTSCTRL){
+        writable = (address & 3) == 1 ? 0xEB : 0xFF;           // RXFnSIDL
+    } else {
+        writable = 0xFF;                                        // CANINTE, CANINTF, BFPCTRL, TXRTSCTRL
+    }
+    _reg[address] = (_reg[address] & ~(mask & writable)) | (value & mask & writable);
+}
+
+void Mcp2515::setMode(int request)
+{
+    if(request > MODE_CONFIG) request = MODE_CONFIG;            // reserved values
+    _reg[REG_CANSTAT] = (_reg[REG_CANSTAT] & 0x1F) | (request << CANCTRL_REQOP_SHIFT);
+}
+
+void Mcp2515::requestTransmit(int buffer)
+{
+    uint8_t &ctrl = _reg[REG_TXB0CTRL + 0x10 * buffer];
+    ctrl = (ctrl & ~(TXB_ABTF | TXB_MLOA | TXB_TXERR)) | TXB_TXREQ;
+}
+
+/* A frame already on the bus goes on to the end; the abort only stops it from being sent again */
+void Mcp2515::abortTransmit(int buffer)
+{
+    uint8_t &ctrl = _reg[REG_TXB0CTRL + 0x10 * buffer];
+    if(buffer == _onBus && (ctrl & TXB_TXREQ)){
+        _abortOnBus = true;
+        return;
+    }
+    if(ctrl & TXB_TXREQ) ctrl = (ctrl & ~TXB_TXREQ) | TXB_ABTF;
+}
+
+void Mcp2515::updateErrorFlags(void)
+{
+    unsigned tec = _reg[REG_TEC], rec = _reg[REG_REC];
+    uint8_t old = _reg[REG_EFLG];
+    uint8_t flags = old & (EFLG_RX0OVR | EFLG_RX1OVR);
+
+    if(tec >= 96) flags |= EFLG_TXWAR;
+    if(rec >= 96) flags |= EFLG_RXWAR;
+    if(tec >= 96 || rec >= 96) flags |= EFLG_EWARN;
+    if(tec >= 128) flags |= EFLG_TXEP;
+    if(rec >= 128) flags |= EFLG_RXEP;
+    _reg[REG_EFLG] = flags;
+    if(flags & ~old) _reg[REG_CANINTF] |= INT_ERRIF;
+}
+
+uint8_t Mcp2515::readStatus(void) const
+{
+    uint8_t intf = _reg[REG_CANINTF];
+    uint8_t status = intf & (INT_RX0IF | INT_RX1IF);
+    for(int n = 0; n < 3; n++){
+        if(_reg[REG_TXB0CTRL + 0x10 * n] & TXB_TXREQ) status |= 0x04 << (2 * n);
+        if(intf & (INT_TX0IF << n)) status |= 0x08 << (2 * n);
+    }
+    return status;
+}
+
+/* RX STATUS: buffers holding a frame (bits 7:6), then type (4:3) and filter (2:0) of RXB0, else RXB1 */
+uint8_t Mcp2515::rxStatus(void) const
+{
+    uint8_t intf = _reg[REG_CANINTF];
+    uint8_t status = (intf & INT_RX0IF ? 0x40 : 0) | (intf & INT_RX1IF ? 0x80 : 0);
+    int buffer = (intf & INT_RX0IF) ? 0 : (intf & INT_RX1IF) ? 1 : -1;
+
+    if(buffer >= 0){
+        const uint8_t *b = &_reg[REG_RXB0CTRL + 0x10 * buffer];
+        if(b[BUF_SIDL] & SIDL_IDE) status |= 0x10;
+        if(b[0] & RXB_RXRTR) status |= 0x08;
+        status |= _filterHit[buffer];
+    }
+    return status;
+}
+
+/*
+* Bus side
+*/
+bool Mcp2515::pendingTransmit(int &buffer, CanFrame &frame) const
+{
+    int m = mode();
+    if(m != MODE_NORMAL && m != MODE_LOOPBACK) return false;
+
+    // Highest TXP first, the higher buffer number on a tie
+    int best = -1;
+    for(int n = 2; n >= 0; n--){
+        uint8_t ctrl = _reg[REG_TXB0CTRL + 0x10 * n];
+        if((ctrl & TXB_TXREQ) && (best < 0 || (ctrl & TXB_TXP) > (_reg[REG_TXB0CTRL + 0x10 * best] & TXB_TXP))){
+            best = n;
+        }
+    }
+    if(best < 0) return false;
+
+    const uint8_t *b = &_reg[REG_TXB0CTRL + 0x10 * best];
+    uint32_t sid = ((uint32_t)b[BUF_SIDH] << 3) | (b[BUF_SIDL] >> 5);
+    frame.extended = (b[BUF_SIDL] & SIDL_IDE) != 0;
+    frame.id = frame.extended ? (sid << 18) | ((uint32_t)(b[BUF_SIDL] & 3) << 16) | (b[BUF_EID8] << 8) | b[BUF_EID0] : sid;
+    frame.remote = (b[BUF_DLC] & DLC_RTR) != 0;
+    frame.length = b[BUF_DLC] & 0x0F;
+    memcpy(frame.data, &b[BUF_D0], 8);
+    buffer = best;
+    return true;
+}
+
+/* Start of the frame of transmit buffer 'buffer' on the bus */
+void Mcp2515::transmitting(int buffer)
+{
+    _onBus = buffer;
+    _abortOnBus = false;
+}
+
+/*
+* End of the frame of transmit buffer 'buffer'. Without an acknowledgement TEC rises by 8, except
+* for an error passive node (CAN rule: an ACK error while error passive does not count), and the
+* frame stays pending unless in one-shot mode. Returns false if the chip was reset or left normal
+* or loopback mode during the frame, which cut it short.
+*/
+bool Mcp2515::transmitted(int buffer, bool acknowledged)
+{
+    uint8_t &ctrl = _reg[REG_TXB0CTRL + 0x10 * buffer];
+    bool aborted = _abortOnBus;
+
+    _onBus = -1;
+    _abortOnBus = false;
+    if(mode() != MODE_NORMAL && mode() != MODE_LOOPBACK) return false;
+
+    if(acknowledged){
+        ctrl &= ~(TXB_TXREQ | TXB_TXERR | TXB_MLOA);
+        _reg[REG_CANINTF] |= INT_TX0IF << buffer;
+        if(_reg[REG_TEC]) _reg[REG_TEC]--;
+    } else {
+        ctrl |= TXB_TXERR;
+        _reg[REG_CANINTF] |= INT_MERRF;
+        if(_reg[REG_TEC] < 128) _reg[REG_TEC] += 8;
+        if(_reg[REG_CANCTRL] & CANCTRL_OSM) ctrl &= ~TXB_TXREQ;
+        if(aborted) ctrl = (ctrl & ~TXB_TXREQ) | TXB_ABTF;
+    }
+    updateErrorFlags();
+    return true;
+}
+
+/* Only a node in normal mode drives the ACK slot */
+bool Mcp2515::acknowledges(void) const
+{
+    return mode() == MODE_NORMAL;
+}
+
+bool Mcp2515::loopback(void) const
+{
+    return mode() == MODE_LOOPBACK;
+}
+
+/*
+* Start of a frame on the bus: a sleeping chip wakes up in listen-only mode (WAKIF). Returns true
+* if it did; the frame that woke it is lost.
+*/
+bool Mcp2515::busActivity(void)
+{
+    if(mode() != MODE_SLEEP) return false;
+    _reg[REG_CANINTF] |= INT_WAKIF;
+    _reg[REG_CANCTRL] = (_reg[REG_CANCTRL] & 0x1F) | (MODE_LISTEN << CANCTRL_REQOP_SHIFT);
+    setMode(MODE_LISTEN);
+    return true;
+}
+
+/* A complete frame: acceptance filtering into RXB0 / RXB1 */
+void Mcp2515::receive(const CanFrame &frame)
+{
+    int m = mode();
+    if(m == MODE_CONFIG || m == MODE_SLEEP) return;
+
+    int hit;
+    if(accepts(0, frame, hit)){
+        if(!(_reg[REG_CANINTF] & INT_RX0IF)){
+            store(0, frame, hit);
+        } else if(_reg[REG_RXB0CTRL] & RXB0_BUKT){              // roll over into RXB1
+            if(!(_reg[REG_CANINTF] & INT_RX1IF)) store(1, frame, RXSTAT_ROLLOVER + hit);
+            else overflow(1);
+        } else {
+            overflow(0);
+        }
+    } else if(accepts(1, frame, hit)){
+        if(!(_reg[REG_CANINTF] & INT_RX1IF)) store(1, frame, hit);
+        else overflow(1);
+    }
+}
+
+/* Whether receive buffer 'buffer' takes 'frame' (RXM mode, then filters 0-1 / 2-5), and the filter that hit */
+bool Mcp2515::accepts(int buffer, const CanFrame &frame, int &filterHit) const
+{
+    int rxm = (_reg[REG_RXB0CTRL + 0x10 * buffer] >> RXB_RXM_SHIFT) & 3;
+
+    filterHit = buffer ? 2 : 0;
+    if(rxm == 3) return true;                                   // masks and filters off
+    if(rxm == 1 && frame.extended) return false;                // standard only
+    if(rxm == 2 && !frame.extended) return false;               // extended only
+    int first = buffer ? 2 : 0, last = buffer ? 5 : 1;
+    for(int f = first; f <= last; f++){
+        if(filterMatch(frame, f, buffer)){
+            filterHit = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+* Filter 'filter' under mask 'mask'. The filter's EXIDE must match the frame; for a standard frame
+* the EID15..0 bits of the filter and mask apply to the first two data bytes.
+*/
+bool Mcp2515::filterMatch(const CanFrame &frame, int filter, int mask) const
+{
+    const uint8_t *f = &_reg[filter < 3 ? REG_RXF0SIDH + 4 * filter : REG_RXF3SIDH + 4 * (filter - 3)];
+    const uint8_t *m = &_reg[REG_RXM0SIDH + 4 * mask];
+
+    if(((f[1] & SIDL_IDE) != 0) != frame.extended) return false;
+
+    uint32_t fsid = ((uint32_t)f[0] << 3) | (f[1] >> 5), msid = ((uint32_t)m[0] << 3) | (m[1] >> 5);
+    uint32_t feid = ((uint32_t)(f[1] & 3) << 16) | (f[2] << 8) | f[3];
+    uint32_t meid = ((uint32_t)(m[1] & 3) << 16) | (m[2] << 8) | m[3];
+
+    if(frame.extended){
+        uint32_t sid = frame.id >> 18, eid = frame.id & 0x3FFFF;
+        return ((sid ^ fsid) & msid) == 0 && ((eid ^ feid) & meid) == 0;
+    }
+    if(((frame.id ^ fsid) & msid & 0x7FF) != 0) return false;
+    int bytes = frame.remote ? 0 : frame.length;
+    if(bytes > 0 && ((frame.data[0] ^ (feid >> 8)) & (meid >> 8) & 0xFF)) return false;
+    if(bytes > 1 && ((frame.data[1] ^ feid) & meid & 0xFF)) return false;
+    return true;
+}
+
+void Mcp2515::store(int buffer, const CanFrame &frame, int filterHit)
+{
+    uint8_t *b = &_reg[REG_RXB0CTRL + 0x10 * buffer];
+
+    if(frame.extended){
+        uint32_t sid = frame.id >> 18;
+        b[BUF_SIDH] = sid >> 3;
+        b[BUF_SIDL] = ((sid & 7) << 5) | SIDL_IDE | ((frame.id >> 16) & 3);
+        b[BUF_EID8] = frame.id >> 8;
+        b[BUF_EID0] = frame.id;
+        b[BUF_DLC] = (frame.remote ? DLC_RTR : 0) | (frame.length & 0x0F);
+    } else {
+        b[BUF_SIDH] = frame.id >> 3;
+        b[BUF_SIDL] = ((frame.id & 7) << 5) | (frame.remote ? SIDL_SRR : 0);
+        b[BUF_EID8] = 0;
+        b[BUF_EID0] = 0;
+        b[BUF_DLC] = frame.length & 0x0F;
+    }
+    int bytes = frame.remote ? 0 : (frame.length > 8 ? 8 : frame.length);
+    memcpy(&b[BUF_D0], frame.data, bytes);
+
+    // RXBnCTRL: RXRTR and FILHIT (FILHIT0 in RXB0, FILHIT2:0 in RXB1)
+    b[0] = (b[0] & (buffer ? 0x60 : 0x66)) | (frame.remote ? RXB_RXRTR : 0);
+    if(buffer) b[0] |= filterHit >= RXSTAT_ROLLOVER ? filterHit - RXSTAT_ROLLOVER : filterHit;
+    else b[0] |= filterHit & 1;
+
+    _filterHit[buffer] = filterHit;
+    _reg[REG_CANINTF] |= buffer ? INT_RX1IF : INT_RX0IF;
+}
+
+/* A frame for a full receive buffer is lost: RXnOVR (and ERRIF) */
+void Mcp2515::overflow(int buffer)
+{
+    _reg[REG_EFLG] |= buffer ? EFLG_RX1OVR : EFLG_RX0OVR;
+    _reg[REG_CANINTF] |= INT_ERRIF;
+    _overflows++;
+}
+
+/*
+* CanBus
+*/
+void CanBus::attach(Mcp2515 &chip)
+{
+    _chips.push_back(&chip);
+}
+
+bool CanBus::step(uint64_t until)
+{
+    for(;;){
+        if(_busy){
+            if(_busyUntil > until){
+                if(until > _now) _now = until;
+                return false;
+            }
+            _now = _busyUntil;
+            finish();
+            return true;
+        }
+
+        // Bus idle: the pending frame of each chip takes part in arbitration
+        int winner = -1, buffer = 0;
+        CanFrame best;
+        for(size_t i = 0; i < _chips.size(); i++){
+            int b;
+            CanFrame frame;
+            if(_chips[i]->pendingTransmit(b, frame) &&
+               (winner < 0 || arbitrationKey(frame) < arbitrationKey(best))){
+                winner = (int)i;
+                buffer = b;
+                best = frame;
+            }
+        }
+        if(winner < 0){
+            if(until > _now) _now = until;
+            return false;
+        }
+        _chips[winner]->transmitting(buffer);
+        _busy = true;
+        _sender = winner;
+        _buffer = buffer;
+        _frame = best;
+        _start = _now;
+        _busyUntil = _now + canFrameBits(best) * _chips[winner]->bitTime();
+        _woken.assign(_chips.size(), false);
+        if(!_chips[winner]->loopback()){
+            for(size_t i = 0; i < _chips.size(); i++){
+                if((int)i != winner) _woken[i] = _chips[i]->busActivity();
+            }
+        }
+    }
+}
+
+/* End of the frame on the bus: acknowledgement, then delivery to every chip at the same bit rate */
+void CanBus::finish(void)
+{
+    Mcp2515 *sender = _chips[_sender];
+    bool acknowledged = false;
+
+    _busy = false;
+    _busyTime += _busyUntil - _start;
+    if(sender->loopback()){
+        acknowledged = true;
+    } else {
+        for(size_t i = 0; i < _chips.size(); i++){
+            if((int)i != _sender && _chips[i]->acknowledges() && _chips[i]->bitTime() == sender->bitTime()){
+                acknowledged = true;
+            }
+        }
+    }
+
+    if(!sender->transmitted(_buffer, acknowledged)) acknowledged = false;
+    else if(!acknowledged) _errors++;
+    if(acknowledged){
+        _frames++;
+        if(sender->loopback()){
+            sender->receive(_frame);
+        } else {
+            for(size_t i = 0; i < _chips.size(); i++){
+                if((int)i != _sender && !_woken[i] && !_chips[i]->loopback() && _chips[i]->bitTime() == sender->bitTime()){
+                    _chips[i]->receive(_frame);
+                }
+            }
+        }
+    }
+
+    if(_record){
+        CanBusRecord record = { _frame, _sender, _start, _busyUntil, acknowledged };
+        _log.push_back(record);
+    }
+}
@@ -0,0 +1,178 @@
+/*************************** mcp2515_model.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * CAN_BUS: Register-Level Model of the MCP2515 CAN Controller
+ *
+ * Purpose: Lets the SEEED_CAN library run on a workstation. Mcp2515 is the chip on the CAN-BUS
+ * Shield as the driver sees it through SPI: the register map, the SPI instruction set
+ * (RESET, READ, READ RX BUFFER, WRITE, LOAD TX BUFFER, RTS, READ STATUS, RX STATUS, BIT MODIFY),
+ * the three transmit and two receive buffers, the acceptance masks and filters with RXB0 to
+ * RXB1 rollover, the interrupt flags and the INT pin, the error counters and EFLG, and the
+ * operating modes. CanBus connects any number of them: it arbitrates between the pending
+ * transmit buffers by identifier (and TXP inside a chip), takes the exact time of every frame
+ * from the bit timing in CNF1-3 (stuff bits included), and delivers the frame to every chip
+ * that listens. A frame no other chip acknowledges is an error: TEC rises by 8 and the frame is
+ * sent again (not in one-shot mode) until the chip is error passive, where a lone node stays.
+ * Clearing TXREQ aborts a pending frame (ABTF); a frame already on the bus goes on to the end
+ * and the abort only keeps it from being sent again.
+ *
+ * Each chip counts its SPI transactions and bytes, per instruction, so the driver's SPI traffic
+ * can be measured (see emulator_main.cpp). Time is the simulated time of the host mbed shim
+ * (mbed.h), in nanoseconds.
+ *
+ * Simplifications: a mode change takes effect at once, a frame without an acknowledgement takes
+ * the time of a whole frame, a chip in loopback mode is given bus time like any other chip but
+ * its frames only go to itself, and there are no bit errors (so no bus off).
+ *
+ *****************************************************************************************/
+#ifndef _MCP2515_MODEL_H_
+#define _MCP2515_MODEL_H_
+
+#include <stdint.h>
+#include <vector>
+
+#define MCP2515_REGISTERS    128
+#define MCP2515_OSCILLATOR   16000000   // crystal of the CAN-BUS Shield (Hz)
+
+/* A frame on the bus */
+struct CanFrame {
+    uint32_t id;            // 11 or 29 bits
+    bool     extended;
+    bool     remote;
+    uint8_t  length;        // DLC as sent (0-15, at most 8 data bytes)
+    uint8_t  data[8];
+};
+
+/* Bits of 'frame' on the wire, start of frame to the end of the intermission, stuff bits included */
+int canFrameBits(const CanFrame &frame);
+
+class Mcp2515
+{
+public:
+    Mcp2515(uint32_t oscillator = MCP2515_OSCILLATOR);
+
+    /* SPI: chip select low, one byte each way per transfer, chip select high */
+    void select(void);
+    uint8_t transfer(uint8_t mosi);
+    void deselect(void);
+
+    /* INT pin, true while asserted (low) */
+    bool interrupt(void) const;
+
+    /* Register contents without going through SPI, for the tests */
+    uint8_t peek(uint8_t address) const;
+    void poke(uint8_t address, uint8_t value);
+
+    /* Operating mode, CANSTAT.OPMOD (0 normal, 1 sleep, 2 loopback, 3 listen-only, 4 config) */
+    int mode(void) const;
+
+    /* Bit time set by CNF1-3 (ns), and its sample point (tenths of a percent of the bit) */
+    uint64_t bitTime(void) const;
+    int samplePoint(void) const;
+
+    /* SPI traffic since the counters were cleared */
+    struct Traffic {
+        unsigned long transactions;             // chip select cycles
+        unsigned long bytes;                    // bytes clocked, instruction bytes included
+        unsigned long instructions[256];        // transactions per instruction byte
+    };
+    const Traffic &traffic(void) const { return _traffic; }
+    void clearTraffic(void);
+
+    /* Frames lost because the receive buffer was full, and writes the chip ignored */
+    unsigned long overflows(void) const { return _overflows; }
+    unsigned long ignoredWrites(void) const { return _ignoredWrites; }
+
+    // Bus side, used by CanBus
+    bool pendingTransmit(int &buffer, CanFrame &frame) const;
+    void transmitting(int buffer);
+    bool transmitted(int buffer, bool acknowledged);
+    bool acknowledges(void) const;
+    bool loopback(void) const;
+    bool busActivity(void);
+    void receive(const CanFrame &frame);
+
+private:
+    enum State { IDLE, ADDRESS, READ, WRITE, MASK, DATA, STATUS, DONE };
+
+    void reset(void);
+    uint8_t readRegister(uint8_t address) const;
+    void writeRegister(uint8_t address, uint8_t value, uint8_t mask);
+    void setMode(int mode);
+    void requestTransmit(int buffer);
+    void abortTransmit(int buffer);
+    void updateErrorFlags(void);
+    uint8_t readStatus(void) const;
+    uint8_t rxStatus(void) const;
+    bool accepts(int buffer, const CanFrame &frame, int &filterHit) const;
+    bool filterMatch(const CanFrame &frame, int filter, int mask) const;
+    void store(int buffer, const CanFrame &frame, int filterHit);
+    void overflow(int buffer);
+
+    uint32_t  _oscillator;
+    uint8_t   _reg[MCP2515_REGISTERS];
+    bool      _selected;
+    State     _state;
+    uint8_t   _instruction;
+    uint8_t   _address;
+    uint8_t   _mask;
+    uint8_t   _rxRead;                          // RXnIF to clear when the READ RX BUFFER ends
+    int       _filterHit[2];                    // RX STATUS filter code of each receive buffer
+    int       _onBus;                           // transmit buffer whose frame is on the bus, -1 if none
+    bool      _abortOnBus;                      // TXREQ cleared while on the bus: no retry
+    Traffic   _traffic;
+    unsigned long _overflows;
+    unsigned long _ignoredWrites;
+};
+
+/* One frame on the bus, as recorded by CanBus */
+struct CanBusRecord {
+    CanFrame frame;
+    int      sender;            // index of the chip in attach order
+    uint64_t start, end;        // ns
+    bool     acknowledged;
+};
+
+class CanBus
+{
+public:
+    CanBus() : _now(0), _busyUntil(0), _busy(false), _sender(0), _buffer(0), _start(0),
+               _frames(0), _errors(0), _busyTime(0), _record(false) {}
+
+    void attach(Mcp2515 &chip);
+
+    /*
+    * Runs the bus up to time 'until' (ns), but stops at the end of the first frame; returns true
+    * if it did, so the caller can look at the interrupt pins before going on.
+    */
+    bool step(uint64_t until);
+
+    uint64_t now(void) const { return _now; }
+    bool busy(void) const { return _busy; }
+
+    unsigned long frames(void) const { return _frames; }           // frames acknowledged
+    unsigned long errors(void) const { return _errors; }           // frames nobody acknowledged
+    uint64_t busyTime(void) const { return _busyTime; }            // ns the bus carried a frame
+
+    /* Keeps a record of every frame when 'on' */
+    void record(bool on) { _record = on; }
+    const std::vector<CanBusRecord> &log(void) const { return _log; }
+    void clearLog(void) { _log.clear(); }
+
+private:
+    void finish(void);
+
+    std::vector<Mcp2515 *> _chips;
+    std::vector<bool> _woken;              // chips woken by the frame on the bus
+    uint64_t _now, _busyUntil;
+    bool     _busy;
+    int      _sender, _buffer;
+    CanFrame _frame;
+    uint64_t _start;
+    unsigned long _frames, _errors;
+    uint64_t _busyTime;
+    bool     _record;
+    std::vector<CanBusRecord> _log;
+};
+
+#endif // _MCP2515_MODEL_H_
@@ -0,0 +1,273 @@
+/*************************** mppt_acquisition.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * MPPT Controller Library: Oversampled, Filtered ADC Acquisition
+ *
+ * Purpose: Reading each AnalogIn pin once per controller step lets a single noisy Hall sensor
+ * sample decide the direction of the next perturbation. MpptAcquisition samples all four channels
+ * several times per controller step (sample(), called from the sampling interrupt) and hands the
+ * controller the filtered values: it is a Sensor for MpptController (read()) and for
+ * MpptFixedController (read_u16()).
+ *
+ * The filter is a template parameter, one instance per channel. Every filter provides:
+ *
+ *      void reset(unsigned short counts)   start as if 'counts' had always been read
+ *      void add(unsigned short counts)     one new sample, called at the sampling rate
+ *      unsigned value(void) const          the filtered reading, in ADC counts with
+ *                                          ACQ_FRACTION_BITS fraction bits
+ *      static float latency(void)          group delay in samples: how far the filtered value
+ *                                          lags behind the input
+ *
+ * Filters:
+ *      BoxcarFilter<N>     - mean of the last N samples (running sum, O(1) per sample)
+ *      MedianFilter<N>     - median of the last N samples; ignores spikes (N odd, small)
+ *      IirFilter<K>        - first order low pass y += (x - y) / 2^K, no sample buffer
+ *      NoFilter            - the last sample, what the firmware did before
+ *
+ * The schedule, the third template parameter, decides the order of the conversions in sample().
+ * The controller multiplies each voltage by its current, so a voltage and current converted far
+ * apart see different parts of the converter's switching ripple. skew() is the time between the
+ * two readings of a pair, in conversions:
+ *
+ *      SequentialSchedule   - HALL_IN, HALL_OUT, V_OUT, V_IN, the order the firmware always read
+ *                             the pins in (input pair 3 conversions apart)
+ *      PairedSchedule       - V_IN, HALL_IN, HALL_OUT, V_OUT: each pair back to back (1 conversion)
+ *      InterpolatedSchedule - V_IN, HALL_IN, V_IN, V_OUT, HALL_OUT, V_OUT: the voltage on both sides
+ *                             of its current, averaged, is the voltage at the instant of the
+ *                             current (0 for a linear ripple, 6 conversions instead of 4)
+ *
+ * Boxcar and median keep the last N samples in a ring buffer (AdcRing). All arithmetic is integer
+ * and every call takes a fixed time (the median sorts a copy of N samples when it is read), so
+ * sample() can run in an interrupt. sample() and the controller step must not preempt each
+ * other; on the board both run from the same Ticker interrupt.
+ *
+ * This file has no mbed dependencies and compiles on any host with a C++ compiler.
+ *
+ *****************************************************************************************/
+#ifndef _MPPT_ACQUISITION_H_
+#define _MPPT_ACQUISITION_H_
+
+#include "mppt_config.h"
+
+#define ACQ_FRACTION_BITS    8                  // fraction bits of a filtered reading
+#define ACQ_ONE              (1u << ACQ_FRACTION_BITS)
+
+/*
+* The last N samples of one channel.
+*/
+template <unsigned N>
+class AdcRing
+{
+public:
+    void fill(unsigned short counts){
+        for(unsigned k = 0; k < N; k++) _samples[k] = counts;
+        _next = 0;
+    }
+
+    /* Stores 'counts' in place of the oldest sample and returns the oldest sample */
+    unsigned short push(unsigned short counts){
+        unsigned short oldest = _samples[_next];
+        _samples[_next] = counts;
+        if(++_next == N) _next = 0;
+        return oldest;
+    }
+
+    unsigned short operator[](unsigned k) const { return _samples[k]; }
+
+private:
+    unsigned short _samples[N];
+    unsigned       _next;
+};
+
+/* Mean of the last N samples */
+template <unsigned N>
+class BoxcarFilter
+{
+public:
+    BoxcarFilter() { reset(0); }
+
+    void reset(unsigned short counts){
+        _ring.fill(counts);
+        _sum = (unsigned long)counts * N;
+    }
+
+    void add(unsigned short counts){
+        _sum += counts;
+        _sum -= _ring.push(counts);
+    }
+
+    unsigned value(void) const { return (unsigned)(((_sum << ACQ_FRACTION_BITS) + N / 2) / N); }
+
+    static float latency(void) { return (N - 1) / 2.0f; }
+
+private:
+    AdcRing<N>    _ring;
+    unsigned long _sum;
+};
+
+/* Median of the last N samples; a spike in fewer than half of them does not move it */
+template <unsigned N>
+class MedianFilter
+{
+public:
+    MedianFilter() { reset(0); }
+
+    void reset(unsigned short counts) { _ring.fill(counts); }
+
+    void add(unsigned short counts) { _ring.push(counts); }
+
+    unsigned value(void) const {
+        unsigned short sorted[N];
+        for(unsigned k = 0; k < N; k++){        // insertion sort, N is small
+            unsigned short v = _ring[k];
+            unsigned j = k;
+            while(j > 0 && sorted[j - 1] > v){
+                sorted[j] = sorted[j - 1];
+                j--;
+            }
+            sorted[j] = v;
+        }
+        if(N & 1) return (unsigned)sorted[N / 2] << ACQ_FRACTION_BITS;
+        return ((unsigned)sorted[N / 2 - 1] + sorted[N / 2]) << (ACQ_FRACTION_BITS - 1);
+    }
+
+    static float latency(void) { return (N - 1) / 2.0f; }
+
+private:
+    AdcRing<N> _ring;
+};
+
+/* First order low pass, y += (x - y) / 2^K, kept with ACQ_FRACTION_BITS fraction bits */
+template <unsigned K>
+class IirFilter
+{
+public:
+    IirFilter() { reset(0); }
+
+    void reset(unsigned short counts) { _state = (long)counts << ACQ_FRACTION_BITS; }
+
+    void add(unsigned short counts){
+        long x = (long)counts << ACQ_FRACTION_BITS;
+        _state += (x - _state) / (1L << K);
+    }
+
+    unsigned value(void) const { return (unsigned)_state; }
+
+    /* the group delay of y += a (x - y) at low frequencies is (1 - a) / a samples */
+    static float latency(void) { return (float)((1L << K) - 1); }
+
+private:
+    long _state;
+};
+
+/* The last sample only */
+class NoFilter
+{
+public:
+    NoFilter() : _last(0) {}
+
+    void reset(unsigned short counts) { _last = counts; }
+    void add(unsigned short counts) { _last = counts; }
+    unsigned value(void) const { return (unsigned)_last << ACQ_FRACTION_BITS; }
+    static float latency(void) { return 0; }
+
+private:
+    unsigned short _last;
+};
+
+/* The four channels in channel order */
+struct SequentialSchedule {
+    template <class Source, class Filter>
+    static void sample(Source &source, Filter *filter){
+        for(int c = 0; c < MPPT_CHANNEL_COUNT; c++){
+            filter[c].add(source.read_u16((MpptChannel)c));
+        }
+    }
+
+    static int conversions(void) { return MPPT_CHANNEL_COUNT; }
+    static float skew(void) { return V_IN - HALL_IN; }
+};
+
+/* Each voltage directly followed by its current */
+struct PairedSchedule {
+    template <class Source, class Filter>
+    static void sample(Source &source, Filter *filter){
+        filter[V_IN].add(source.read_u16(V_IN));
+        filter[HALL_IN].add(source.read_u16(HALL_IN));
+        filter[HALL_OUT].add(source.read_u16(HALL_OUT));
+        filter[V_OUT].add(source.read_u16(V_OUT));
+    }
+
+    static int conversions(void) { return MPPT_CHANNEL_COUNT; }
+    static float skew(void) { return 1; }
+};
+
+/* Each current between two conversions of its voltage */
+struct InterpolatedSchedule {
+    template <class Source, class Filter>
+    static void sample(Source &source, Filter *filter){
+        unsigned before = source.read_u16(V_IN);
+        filter[HALL_IN].add(source.read_u16(HALL_IN));
+        filter[V_IN].add((unsigned short)((before + source.read_u16(V_IN) + 1) / 2));
+        before = source.read_u16(V_OUT);
+        filter[HALL_OUT].add(source.read_u16(HALL_OUT));
+        filter[V_OUT].add((unsigned short)((before + source.read_u16(V_OUT) + 1) / 2));
+    }
+
+    static int conversions(void) { return 6; }
+    static float skew(void) { return 0; }
+};
+
+/*
+* Samples the four channels of 'Source' (anything with read_u16(MpptChannel), e.g. the board's
+* AnalogIn pins or the plant simulator) through one 'Filter' per channel, in the order of 'Schedule'.
+*/
+template <class Source, class Filter, class Schedule = PairedSchedule>
+class MpptAcquisition
+{
+public:
+    MpptAcquisition(Source &source) : _source(source), _samples(0) {}
+
+    /* Starts every filter from one reading of each channel */
+    void reset(void){
+        for(int c = 0; c < MPPT_CHANNEL_COUNT; c++){
+            _filter[c].reset(_source.read_u16((MpptChannel)c));
+        }
+        _samples = 0;
+    }
+
+    /* Reads all four channels once; call this at the sampling rate */
+    void sample(void){
+        Schedule::sample(_source, _filter);
+        _samples++;
+    }
+
+    /* Sensor interface used by MpptController: the filtered reading (0.0 - 1.0) */
+    float read(MpptChannel channel) const {
+        return _filter[channel].value() * (1.0f / (float)(ADC_FULL_SCALE * ACQ_ONE));
+    }
+
+    /* Sensor interface used by MpptFixedController: the filtered reading in counts, rounded */
+    unsigned short read_u16(MpptChannel channel) const {
+        unsigned v = (_filter[channel].value() + ACQ_ONE / 2) >> ACQ_FRACTION_BITS;
+        return (unsigned short)(v > 65535 ? 65535 : v);
+    }
+
+    /* How far the filtered readings lag behind the pins, in samples */
+    static float latency(void) { return Filter::latency(); }
+
+    /* Time between the voltage and the current reading of a pair, in conversions */
+    static float skew(void) { return Schedule::skew(); }
+
+    /* AnalogIn conversions per sample() */
+    static int conversions(void) { return Schedule::conversions(); }
+
+    unsigned long samples(void) const { return _samples; }
+
+private:
+    Source        &_source;
+    Filter        _filter[MPPT_CHANNEL_COUNT];
+    unsigned long _samples;
+};
+
+#endif // _MPPT_ACQUISITION_H_
@@ -0,0 +1,444 @@
+/*************************** mppt_algorithms.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * MPPT Controller Library: Tracking Algorithms
+ *
+ * Purpose: The algorithms MpptController can run. The controller takes the algorithm as a
+ * template parameter (a policy), so choosing one is a compile-time decision and the call in the
+ * control interrupt is an ordinary inlined function call, not a virtual call.
+ *
+ * Every algorithm provides:
+ *
+ *      void reset(float voltage, float current)
+ *              restart from the given operating point
+ *      float update(float inVoltage, float inCurrent)
+ *              take this step's input readings and return the new reference voltage, the
+ *              input voltage the controller should steer the boost converter towards
+ *      float referenceVoltage(void) const
+ *              the reference voltage returned by the last update()
+ *
+ * Algorithms:
+ *      PerturbAndObserve       - the algorithm the car has always run (see main.cpp)
+ *      IncrementalConductance  - climbs towards dP/dV = 0 using dI/dV = -I/V
+ *      VariableStepPerturbAndObserve
+ *                              - P&O on the reference voltage with a step proportional to |dP/dV|
+ *                                and a limit-cycle detector that shrinks the step at the MPP
+ *      GlobalScan<Local>       - runs Local and periodically scans the whole voltage range for the
+ *                                global MPP under partial shading, then hands back to Local
+ *
+ *****************************************************************************************/
+#ifndef _MPPT_ALGORITHMS_H_
+#define _MPPT_ALGORITHMS_H_
+
+#include "mppt_config.h"
+
+#define INC_COND_STEP        0.5                // IncrementalConductance reference step (V)
+#define INC_COND_TOLERANCE   0.002              // |dI/dV + I/V| below this counts as "at the MPP" (A/V)
+#define MIN_INPUT_CURRENT    0.05               // input currents below this count as no current (A)
+
+#define PO_MIN_STEP          0.1                // VariableStepPerturbAndObserve smallest reference step (V)
+#define PO_MAX_STEP          2.0                // VariableStepPerturbAndObserve largest reference step (V)
+#define PO_STEP_GAIN         0.05               // reference step per W/V of |dP/dV| (V^2/W)
+#define PO_STEP_SHRINK       0.5                // step multiplier applied every time the limit cycle is seen
+#define PO_MIN_SHRINK        0.015625           // the step multiplier never goes below this (1/64)
+#define PO_STEP_GROW         1.25               // step multiplier per step of a run in one direction
+
+#define GLOBAL_SCAN_INTERVAL     1000           // controller steps between two global scans
+#define GLOBAL_SCAN_SPACING      2.0            // reference voltage between two scan points (V)
+#define GLOBAL_SCAN_MIN_VOLTAGE  25             // lowest voltage scanned (V); 80% duty at 120 V out is 24 V
+#define GLOBAL_SCAN_MAX_VOLTAGE  70             // highest voltage scanned (V), above the array's open circuit voltage
+#define GLOBAL_SCAN_MAX_CURRENT  4.0            // array short circuit current at 1000 W/m2 (A)
+#define GLOBAL_SCAN_MAX_LOSS     4.0            // energy one scan may lose, in control steps at the pre-scan power
+
+/**
+*                                   Perturb & Observe Algorithm
+*
+* The P&O algorithm perturbs the duty cycle which controls the power converter, in this way it
+* takes steps over the p-v characteristic to find the MPPT. In case the new output power is
+* larger than the previous output power, this point is set as the new operating point. In case it
+* is lower, the same power point is adjusted to a lower or higher working voltage, depending on
+* the previous step direction. (http://bit.ly/1L73nzE)
+*
+* The step size is the voltage change between the two readings.
+**/
+class PerturbAndObserve
+{
+public:
+    PerturbAndObserve() { reset(START_VOLTAGE, START_CURRENT); }
+
+    void reset(float voltage, float current){
+        originalVoltage = voltage;
+        originalCurrent = current;
+        originalPower = voltage * current;
+    }
+
+    float update(float inVoltage, float inCurrent){
+        float inPower = inVoltage * inCurrent; // Power = Voltage * Current
+        float deltaVoltage = inVoltage - originalVoltage; // also known as Perturbation
+        float deltaPower = inPower - originalPower;
+        float tmpInVoltage = inVoltage;
+
+        if(deltaPower == 0){
+            // continue code and skip everything else
+        } else if(deltaPower > 0){
+            if(deltaVoltage > 0){
+                tmpInVoltage += deltaVoltage; // decrease duty cycle
+            } else {
+                tmpInVoltage -= deltaVoltage; // decrease duty cycle
+            }
+        } else{ // deltaPower < 0
+            if(deltaVoltage > 0){
+                tmpInVoltage -= deltaVoltage; // increase duty cycle
+            } else {
+                tmpInVoltage += deltaVoltage; // increase duty cycle
+            }
+        }
+        originalVoltage = tmpInVoltage; // replace old voltage with current voltage
+        originalCurrent = inCurrent;
+        originalPower = inPower; // replace old power with current power
+        return tmpInVoltage;
+    }
+
+    float referenceVoltage(void) const { return originalVoltage; }
+
+private:
+    float originalVoltage;
+    float originalCurrent;
+    float originalPower;
+};
+
+/**
+*                                   Incremental Conductance Algorithm
+*
+* At the maximum power point dP/dV = 0. Since P = V * I, dP/dV = I + V * dI/dV, so the MPP is
+* where the incremental conductance dI/dV equals the negative of the instantaneous conductance
+* -I/V. Left of the MPP dI/dV > -I/V and the reference voltage is raised; right of the MPP
+* dI/dV < -I/V and it is lowered. Unlike P&O it can tell that it has reached the MPP and stop
+* stepping, and it does not mistake an irradiance change for the result of its own step.
+*
+* The step size is fixed; readings closer to the MPP than 'tolerance' leave the reference alone.
+* While no current flows the readings say nothing about dI/dV (the converter is not drawing from
+* the array at all), so the reference is walked down from open circuit until it does.
+**/
+class IncrementalConductance
+{
+public:
+    IncrementalConductance(float step = INC_COND_STEP, float tolerance = INC_COND_TOLERANCE) :
+        _step(step),
+        _tolerance(tolerance)
+    {
+        reset(START_VOLTAGE, START_CURRENT);
+    }
+
+    void reset(float voltage, float current){
+        _reference = voltage;
+        _lastVoltage = voltage;
+        _lastCurrent = current;
+    }
+
+    float update(float inVoltage, float inCurrent){
+        float deltaVoltage = inVoltage - _lastVoltage;
+        float deltaCurrent = inCurrent - _lastCurrent;
+
+        if(inCurrent < MIN_INPUT_CURRENT){
+            _reference -= _step;            // no current flows: the array is at open circuit, right of the MPP
+        } else if(deltaVoltage == 0){
+            if(deltaCurrent > 0){           // irradiance went up at the same voltage
+                _reference += _step;
+            } else if(deltaCurrent < 0){    // irradiance went down at the same voltage
+                _reference -= _step;
+            }
+        } else if(inVoltage > 0){
+            // dI/dV + I/V, scaled by dV * V to avoid the divisions; the sign of dV * V is the sign of dV
+            float error = (deltaCurrent * inVoltage + inCurrent * deltaVoltage);
+            float scale = deltaVoltage * inVoltage;
+            if(scale < 0){
+                error = -error;
+                scale = -scale;
+            }
+            if(error > _tolerance * scale){         // left of the MPP
+                _reference += _step;
+            } else if(error < -_tolerance * scale){ // right of the MPP
+                _reference -= _step;
+            }
+        }
+        _lastVoltage = inVoltage;
+        _lastCurrent = inCurrent;
+        return _reference;
+    }
+
+    float referenceVoltage(void) const { return _reference; }
+
+private:
+    float _step;
+    float _tolerance;
+    float _reference;
+    float _lastVoltage;
+    float _lastCurrent;
+};
+
+/**
+*                               Variable-Step Perturb & Observe Algorithm
+*
+* P&O on the reference voltage: every step moves the reference by 'step' in the current direction,
+* and the direction is reversed whenever the power went down. The step is proportional to the
+* slope of the p-v curve, |dP/dV|, bounded by 'minStep' and 'maxStep': far from the MPP the slope
+* is steep and the step is large, close to it the slope goes to zero and so does the step.
+*
+* Measured slopes are noisy, so the step alone never quite stops the dither at the MPP. The
+* direction of the last four steps is kept as a bit pattern; the classic three-point limit cycle
+* (up, up, down, down, ...) and the two-point cycle (up, down, ...) show up as a fixed set of
+* patterns, and every time one is seen the step is multiplied by PO_STEP_SHRINK.
+*
+* Four steps in the same direction mean the MPP moved, or that a rising irradiance is raising the
+* power whichever way the reference goes and is dragging the algorithm away from the MPP (the
+* classic P&O drift). Either way the shrink is undone and the step grows by PO_STEP_GROW on every
+* further step of the run, until the power change caused by the step outweighs the one caused by
+* the irradiance and P&O turns around.
+*
+* With minStep == maxStep this is ordinary fixed-step P&O.
+**/
+class VariableStepPerturbAndObserve
+{
+public:
+    VariableStepPerturbAndObserve(float minStep = PO_MIN_STEP, float maxStep = PO_MAX_STEP, float gain = PO_STEP_GAIN) :
+        _minStep(minStep),
+        _maxStep(maxStep),
+        _gain(gain)
+    {
+        reset(START_VOLTAGE, START_CURRENT);
+    }
+
+    void reset(float voltage, float current){
+        _reference = voltage;
+        _lastVoltage = voltage;
+        _lastPower = voltage * current;
+        _step = _minStep;
+        _shrink = 1;
+        _direction = 1;
+        _history = 0;
+        _recorded = 0;                      // the pattern means nothing until four steps are in it
+    }
+
+    float update(float inVoltage, float inCurrent){
+        float inPower = inVoltage * inCurrent;
+        float deltaPower = inPower - _lastPower;
+        float deltaVoltage = inVoltage - _lastVoltage;
+
+        if(inCurrent < MIN_INPUT_CURRENT){
+            _direction = -1;                // open circuit, right of the MPP: come down quickly
+            _step = _maxStep;
+        } else {
+            if(deltaPower < 0){
+                _direction = -_direction;   // the last step made things worse
+            }
+            _history = ((_history << 1) | (_direction > 0 ? 1 : 0)) & 0xF;
+            if(_recorded < 4){
+                _recorded++;
+            }
+            float runStep = 0;
+            if(_recorded == 4){
+                if(isLimitCycle(_history)){
+                    _shrink *= PO_STEP_SHRINK;
+                    if(_shrink < PO_MIN_SHRINK) _shrink = PO_MIN_SHRINK;
+                } else if(_history == 0x0 || _history == 0xF){
+                    _shrink = 1;
+                    runStep = _step * PO_STEP_GROW;
+                }
+            }
+
+            float slope = 0;
+            if(deltaVoltage != 0){
+                slope = deltaPower / deltaVoltage;
+                if(slope < 0) slope = -slope;
+            }
+            _step = _gain * slope * _shrink;
+            if(_step < runStep) _step = runStep;
+            if(_step < _minStep) _step = _minStep;
+            if(_step > _maxStep) _step = _maxStep;
+        }
+
+        _reference += _direction * _step;
+        _lastVoltage = inVoltage;
+        _lastPower = inPower;
+        return _reference;
+    }
+
+    float referenceVoltage(void) const { return _reference; }
+
+    /* The step taken by the last update() (V) */
+    float step(void) const { return _step; }
+
+private:
+    /* Direction patterns of the last four steps (oldest in bit 3, 1 = up) that only a limit cycle produces */
+    static bool isLimitCycle(unsigned history){
+        switch(history){
+            case 0x3: case 0x6: case 0xC: case 0x9:     // up, up, down, down
+            case 0x5: case 0xA:                         // up, down, up, down
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    float    _minStep;
+    float    _maxStep;
+    float    _gain;
+    float    _reference;
+    float    _lastVoltage;
+    float    _lastPower;
+    float    _step;
+    float    _shrink;
+    int      _direction;
+    unsigned _history;
+    int      _recorded;
+};
+
+/*
+* Settings for GlobalScan. 'interval' = 0 turns the scan off.
+*/
+struct GlobalScanConfig {
+    unsigned interval;          // controller steps between two scans
+    float    spacing;           // reference voltage between two scan points (V)
+    float    minVoltage;        // the scan range (V)
+    float    maxVoltage;
+    float    maxCurrent;        // largest current the array can deliver (A)
+    float    maxLoss;           // energy one scan may lose, in control steps at the pre-scan power
+
+    GlobalScanConfig() :
+        interval(GLOBAL_SCAN_INTERVAL),
+        spacing(GLOBAL_SCAN_SPACING),
+        minVoltage(GLOBAL_SCAN_MIN_VOLTAGE),
+        maxVoltage(GLOBAL_SCAN_MAX_VOLTAGE),
+        maxCurrent(GLOBAL_SCAN_MAX_CURRENT),
+        maxLoss(GLOBAL_SCAN_MAX_LOSS)
+    {}
+};
+
+/**
+*                                   Global Maximum Power Point Scan
+*
+* Partial shading (the car body, a neighbouring module) makes the bypass diodes conduct and puts
+* several peaks on the p-v curve. A hill-climbing algorithm locks onto whichever peak is nearest.
+* GlobalScan runs a local algorithm ('Local', e.g. VariableStepPerturbAndObserve) and every
+* 'interval' steps takes over for a short scan: it moves the reference voltage up the range one
+* 'spacing' at a time, measures the power at each point on the following step, and hands the best
+* point it saw back to the local algorithm (Local::reset()), which then tracks that peak.
+*
+* Three things keep the scan short:
+*      - the array can never deliver more than maxCurrent, so no voltage below P / maxCurrent can
+*        beat the power P measured before the scan; the scan starts above that voltage
+*      - the array current never rises with the voltage, so once maxVoltage times the current just
+*        measured is below the best power seen, nothing further up can beat it either
+*      - every scan point that delivers less than the pre-scan power adds the shortfall (as a
+*        fraction of that power) to a loss counter, and the scan stops as soon as the counter
+*        reaches maxLoss. It also stops when the array stops delivering current (open circuit).
+*
+* The scan moves the reference voltage rather than the duty cycle directly; the controller turns
+* the reference into a duty cycle as it does for every other algorithm.
+**/
+template <class Local = VariableStepPerturbAndObserve>
+class GlobalScan
+{
+public:
+    GlobalScan(const GlobalScanConfig &config = GlobalScanConfig(), const Local &local = Local()) :
+        _config(config),
+        _local(local),
+        _scans(0),
+        _bestVoltage(START_VOLTAGE),
+        _bestCurrent(START_CURRENT),
+        _bestPower(0),
+        _scanPower(0),
+        _lost(0)
+    {
+        reset(START_VOLTAGE, START_CURRENT);
+    }
+
+    void reset(float voltage, float current){
+        _local.reset(voltage, current);
+        _reference = voltage;
+        _countdown = _config.interval;
+        _scanning = false;
+    }
+
+    float update(float inVoltage, float inCurrent){
+        if(!_scanning){
+            if(_config.interval == 0 || --_countdown > 0){
+                _reference = _local.update(inVoltage, inCurrent);
+                return _reference;
+            }
+            startScan(inVoltage, inCurrent);
+            return _reference;
+        }
+
+        // this step's readings are the result of the scan point set on the last step
+        float inPower = inVoltage * inCurrent;
+        if(inPower > _bestPower){
+            _bestVoltage = inVoltage;
+            _bestCurrent = inCurrent;
+            _bestPower = inPower;
+        }
+        if(_scanPower > 0 && inPower < _scanPower){
+            _lost += (_scanPower - inPower) / _scanPower;
+        }
+
+        float next = _reference + _config.spacing;
+        if(inCurrent < MIN_INPUT_CURRENT || next > _config.maxVoltage || _lost >= _config.maxLoss ||
+           _config.maxVoltage * inCurrent <= _bestPower){
+            finishScan();
+        } else {
+            _reference = next;
+        }
+        return _reference;
+    }
+
+    float referenceVoltage(void) const { return _reference; }
+
+    /* True while a scan is running */
+    bool scanning(void) const { return _scanning; }
+
+    /* Number of scans started since construction */
+    unsigned long scans(void) const { return _scans; }
+
+    Local &local(void) { return _local; }
+
+private:
+    void startScan(float inVoltage, float inCurrent){
+        _bestVoltage = inVoltage;
+        _bestCurrent = inCurrent;
+        _bestPower = inVoltage * inCurrent;
+        _scanPower = _bestPower;
+        _lost = 0;
+
+        float start = _bestPower / _config.maxCurrent;   // nothing below this can beat the pre-scan power
+        if(start < _config.minVoltage) start = _config.minVoltage;
+        if(start > _config.maxVoltage){
+            finishScan();
+            return;
+        }
+        _reference = start;
+        _scanning = true;
+        _scans++;
+    }
+
+    void finishScan(void){
+        _local.reset(_bestVoltage, _bestCurrent);
+        _reference = _bestVoltage;
+        _countdown = _config.interval;
+        _scanning = false;
+    }
+
+    GlobalScanConfig _config;
+    Local            _local;
+    float            _reference;
+    unsigned         _countdown;
+    bool             _scanning;
+    unsigned long    _scans;
+    float            _bestVoltage;
+    float            _bestCurrent;
+    float            _bestPower;
+    float            _scanPower;
+    float            _lost;
+};
+
+#endif // _MPPT_ALGORITHMS_H_
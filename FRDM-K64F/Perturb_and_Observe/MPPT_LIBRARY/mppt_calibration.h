@@ -0,0 +1,172 @@
+/*************************** mppt_calibration.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * MPPT Controller Library: Runtime Sensor Calibration
+ *
+ * Purpose: The calibration constants in mppt_config.h are the values of one board. Every Hall
+ * sensor has its own zero-current output, and a zero that is off by 0.1 V reads as 0.57 A that
+ * is not there, which sends the tracker the wrong way at low light. This file lets each board
+ * carry its own calibration:
+ *
+ *      MpptCoefficients     - the calibration folded into value = reading * gain + offset per
+ *                             channel, computed once, so the controller step does no divisions
+ *      mpptAutoZero()       - measures the zero-current output of both Hall sensors while the
+ *                             converter is idle (switch off, the battery above the array's open
+ *                             circuit voltage, so no current flows)
+ *      MpptCalibrationStore - keeps an MpptCalibration in a small persistent store, with a magic
+ *                             number, a version and a CRC so a blank or corrupt store is never used
+ *
+ * The store works on anything with
+ *
+ *      bool read(void *data, unsigned size)
+ *      bool write(const void *data, unsigned size)
+ *
+ * (the last flash sector on the FRDM-K64F, a file on the host).
+ *
+ * This file has no mbed dependencies and compiles on any host with a C++ compiler.
+ *
+ *****************************************************************************************/
+#ifndef _MPPT_CALIBRATION_H_
+#define _MPPT_CALIBRATION_H_
+
+#include <stdint.h>
+#include <math.h>
+#include "mppt_config.h"
+
+#define AUTO_ZERO_SAMPLES        256        // readings of each Hall sensor per auto-zero
+#define AUTO_ZERO_TOLERANCE      0.25       // largest credible distance of a Hall zero from its nominal value (V)
+#define AUTO_ZERO_MAX_DEVIATION  0.02       // largest standard deviation of an idle Hall reading (V)
+
+#define CALIBRATION_MAGIC        0x4D505043 // "MPPC"
+#define CALIBRATION_VERSION      1          // bump when MpptCalibration changes
+
+/*
+* Precomputed coefficients of all four channels: value = AnalogIn::read() * gain + offset.
+* These are the formulas MpptController::step() used to evaluate every step:
+*
+*      current = (reading * ainMult - hallNoCurrent) / iDiv
+*      voltage =  reading * ainMult * vMult
+*/
+struct MpptCoefficients {
+    float gain[MPPT_CHANNEL_COUNT];
+    float offset[MPPT_CHANNEL_COUNT];
+
+    MpptCoefficients(const MpptCalibration &cal = MpptCalibration()){
+        gain[HALL_IN] = cal.ainMult / cal.iInDiv;
+        offset[HALL_IN] = -cal.hallInNoCurrent / cal.iInDiv;
+        gain[HALL_OUT] = cal.ainMult / cal.iOutDiv;
+        offset[HALL_OUT] = -cal.hallOutNoCurrent / cal.iOutDiv;
+        gain[V_OUT] = cal.ainMult * cal.vOutMult;
+        offset[V_OUT] = 0;
+        gain[V_IN] = cal.ainMult * cal.vInMult;
+        offset[V_IN] = 0;
+    }
+
+    float scale(MpptChannel channel, float reading) const { return reading * gain[channel] + offset[channel]; }
+};
+
+enum MpptAutoZeroStatus {
+    AUTO_ZERO_OK = 0,
+    AUTO_ZERO_OUT_OF_RANGE,     // a zero is more than AUTO_ZERO_TOLERANCE from its nominal value
+    AUTO_ZERO_UNSTABLE          // a reading moved too much: current is flowing or the sensor is noisy
+};
+
+inline const char *mpptAutoZeroStatusName(MpptAutoZeroStatus status)
+{
+    switch(status){
+        case AUTO_ZERO_OK:           return "ok";
+        case AUTO_ZERO_OUT_OF_RANGE: return "out of range";
+        default:                     return "unstable";
+    }
+}
+
+/*
+* Measures the zero-current output of both Hall sensors from 'samples' readings of each and
+* stores it in 'cal'. Call it with the converter idle. 'cal' is left unchanged unless both zeros
+* are within AUTO_ZERO_TOLERANCE of the nominal values in mppt_config.h and the readings are steady.
+* 'Sensor' is anything with read_u16(MpptChannel).
+*/
+template <class Sensor>
+MpptAutoZeroStatus mpptAutoZero(Sensor &sensor, MpptCalibration &cal, int samples = AUTO_ZERO_SAMPLES)
+{
+    static const MpptChannel channels[2] = { HALL_IN, HALL_OUT };
+    static const float nominal[2] = { HALL_IN_NO_CURRENT, HALL_OUT_NO_CURRENT };
+    float zero[2];
+
+    for(int k = 0; k < 2; k++){
+        uint32_t sum = 0;
+        uint64_t squares = 0;
+        for(int n = 0; n < samples; n++){
+            uint32_t counts = sensor.read_u16(channels[k]);
+            sum += counts;
+            squares += counts * counts;
+        }
+        double mean = (double)sum / samples;
+        double variance = (double)squares / samples - mean * mean;
+        double volts = cal.ainMult / ADC_FULL_SCALE;
+
+        zero[k] = (float)(mean * volts);
+        if(sqrt(variance > 0 ? variance : 0) * volts > AUTO_ZERO_MAX_DEVIATION){
+            return AUTO_ZERO_UNSTABLE;
+        }
+        if(fabs(zero[k] - nominal[k]) > AUTO_ZERO_TOLERANCE){
+            return AUTO_ZERO_OUT_OF_RANGE;
+        }
+    }
+    cal.hallInNoCurrent = zero[0];
+    cal.hallOutNoCurrent = zero[1];
+    return AUTO_ZERO_OK;
+}
+
+/* CRC-32 (IEEE 802.3, bitwise: the store is read once at boot) */
+inline uint32_t mpptCrc32(const void *data, unsigned size)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t crc = 0xFFFFFFFF;
+    while(size--){
+        crc ^= *p++;
+        for(int bit = 0; bit < 8; bit++){
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+/* What the store holds */
+struct MpptCalibrationRecord {
+    uint32_t        magic;
+    uint32_t        version;
+    MpptCalibration calibration;
+    uint32_t        crc;            // of everything above
+};
+
+template <class Storage>
+class MpptCalibrationStore
+{
+public:
+    MpptCalibrationStore(Storage &storage) : _storage(storage) {}
+
+    /* Loads the stored calibration into 'cal'. Returns false, leaving 'cal' alone, if there is none */
+    bool load(MpptCalibration &cal){
+        MpptCalibrationRecord record;
+        if(!_storage.read(&record, sizeof(record))) return false;
+        if(record.magic != CALIBRATION_MAGIC || record.version != CALIBRATION_VERSION) return false;
+        if(record.crc != mpptCrc32(&record, sizeof(record) - sizeof(record.crc))) return false;
+        cal = record.calibration;
+        return true;
+    }
+
+    bool save(const MpptCalibration &cal){
+        MpptCalibrationRecord record;
+        record.magic = CALIBRATION_MAGIC;
+        record.version = CALIBRATION_VERSION;
+        record.calibration = cal;
+        record.crc = mpptCrc32(&record, sizeof(record) - sizeof(record.crc));
+        return _storage.write(&record, sizeof(record));
+    }
+
+private:
+    Storage &_storage;
+};
+
+#endif // _MPPT_CALIBRATION_H_
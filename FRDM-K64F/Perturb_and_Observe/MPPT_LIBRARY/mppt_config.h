@@ -0,0 +1,70 @@
+/*************************** mppt_config.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * MPPT Controller Library: Board Constants and Sensor Calibration
+ *
+ * Purpose: Single home for the constants that used to be duplicated (with different values)
+ * between Perturb_and_Observe/main.cpp and test/test_main.cpp. Both the FRDM-K64F firmware
+ * and the host test programs include this file, so the calibration that ships on the board is
+ * the calibration that gets tested.
+ *
+ * This file has no mbed dependencies and compiles on any host with a C++ compiler.
+ *
+ *****************************************************************************************/
+#ifndef _MPPT_CONFIG_H_
+#define _MPPT_CONFIG_H_
+
+//Define Constants
+#define PWM_PERIOD_us        25                 // 40 kHz boost converter switching frequency
+#define V_IN_MULT            51                 // input voltage divider ratio
+#define V_OUT_MULT           50.97              // output voltage divider ratio
+#define I_IN_DIV             0.17625899280576   // input Hall sensor sensitivity (V/A)
+#define I_OUT_DIV            0.17785467128028   // output Hall sensor sensitivity (V/A)
+#define HALL_IN_NO_CURRENT   2.513              // input Hall sensor output at 0 A (V)
+#define HALL_OUT_NO_CURRENT  2.517              // output Hall sensor output at 0 A (V)
+#define AIN_MULT             3.3                // AnalogIn full scale (V)
+#define ADC_FULL_SCALE       65535.0            // AnalogIn::read() == read_u16() / 65535 (16 bit ADC)
+
+#define MAX_DUTY_CYCLE       0.80               // duty cycle must NOT go above 80%
+#define MIN_DUTY_CYCLE       0.00
+#define START_VOLTAGE        60                 // P&O starting reference voltage (V)
+#define START_CURRENT        1                  // P&O starting reference current (A)
+
+/*
+* The four analog channels read from the boost converter. The order matches the order in which
+* the original perturb_and_observe() read them.
+*/
+enum MpptChannel {
+    HALL_IN = 0,    // PTB3  - Hall Sensor In
+    HALL_OUT,       // PTB11 - Hall Sensor Out
+    V_OUT,          // PTB10 - Voltage Out
+    V_IN,           // PTB2  - Voltage In
+    MPPT_CHANNEL_COUNT
+};
+
+/*
+* Calibration constants used to turn AnalogIn readings (0.0 - 1.0) into volts and amps.
+* The default constructor loads the values defined above; the firmware replaces them with the
+* calibration stored on the board and the Hall zeros it measures at start-up (mppt_calibration.h).
+*/
+struct MpptCalibration {
+    float ainMult;
+    float vInMult;
+    float vOutMult;
+    float iInDiv;
+    float iOutDiv;
+    float hallInNoCurrent;
+    float hallOutNoCurrent;
+
+    MpptCalibration() :
+        ainMult(AIN_MULT),
+        vInMult(V_IN_MULT),
+        vOutMult(V_OUT_MULT),
+        iInDiv(I_IN_DIV),
+        iOutDiv(I_OUT_DIV),
+        hallInNoCurrent(HALL_IN_NO_CURRENT),
+        hallOutNoCurrent(HALL_OUT_NO_CURRENT)
+    {}
+};
+
+#endif // _MPPT_CONFIG_H_
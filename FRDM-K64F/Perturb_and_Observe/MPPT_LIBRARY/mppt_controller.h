@@ -0,0 +1,151 @@
+/*************************** mppt_controller.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * MPPT Controller Library: Hardware-Independent MPPT Controller
+ *
+ * Purpose: This is the controller step that used to live inside perturb_and_observe() in main.cpp,
+ * with the AnalogIn, PwmOut, RawSerial and SEEED_CAN globals replaced by three objects that
+ * are handed to the controller when it is constructed:
+ *
+ *      Sensor    - float read(MpptChannel channel)
+ *                  returns the AnalogIn reading (0.0 - 1.0) of the requested channel
+ *      Actuator  - void write(float dutyCycle)
+ *                  applies the new duty cycle (0.0 - MAX_DUTY_CYCLE) to the boost converter
+ *      Telemetry - void publish(const MpptReadings &readings)
+ *                  reports the readings of the step that just finished
+ *
+ * The three are template parameters rather than virtual interfaces so the calls inline away.
+ * On the FRDM-K64F they wrap the mbed objects (see main.cpp); on a Linux host they wrap a
+ * file, a simulator or nothing at all (see test/test_main.cpp), so the exact algorithm that
+ * ships on the board can be run and profiled on a workstation.
+ *
+ * The tracking algorithm is a fourth template parameter (see mppt_algorithms.h). It defaults to
+ * PerturbAndObserve.
+ *
+ *****************************************************************************************/
+#ifndef _MPPT_CONTROLLER_H_
+#define _MPPT_CONTROLLER_H_
+
+#include "mppt_config.h"
+#include "mppt_calibration.h"
+#include "mppt_algorithms.h"
+
+/*
+* Everything measured and computed during one controller step.
+*/
+struct MpptReadings {
+    float inVoltage;
+    float inCurrent;
+    float inPower;
+    float outVoltage;
+    float outCurrent;
+    float outPower;
+    float dutyCycle;
+    float efficiency;
+};
+
+template <class Sensor, class Actuator, class Telemetry, class Algorithm = PerturbAndObserve>
+class MpptController
+{
+public:
+    MpptController(Sensor &sensor, Actuator &actuator, Telemetry &telemetry,
+                   const MpptCalibration &calibration = MpptCalibration(),
+                   const Algorithm &algorithm = Algorithm()) :
+        _sensor(sensor),
+        _actuator(actuator),
+        _telemetry(telemetry),
+        _coefficients(calibration),
+        _algorithm(algorithm)
+    {
+        reset();
+    }
+
+    /* Replaces the calibration, e.g. with the one measured and stored by the board at start-up */
+    void setCalibration(const MpptCalibration &calibration){
+        _coefficients = MpptCoefficients(calibration);
+    }
+
+    /*
+    * Restarts the algorithm from the given operating point. The firmware starts from
+    * 60 V and 1 A; the test harness reads its starting point from inputs.txt.
+    */
+    void reset(float voltage = START_VOLTAGE, float current = START_CURRENT){
+        _algorithm.reset(voltage, current);
+        _readings = MpptReadings();
+    }
+
+    /*
+    * One complete controller step: read the four sensor channels, run the tracking algorithm,
+    * set the duty cycle and publish the readings.
+    */
+    void step(void){
+        /* Actual reading values (calibration precomputed in MpptCoefficients) */
+        float inCurrent = _coefficients.scale(HALL_IN, _sensor.read(HALL_IN));
+        float outCurrent = _coefficients.scale(HALL_OUT, _sensor.read(HALL_OUT));
+        float outVoltage = _coefficients.scale(V_OUT, _sensor.read(V_OUT));
+        float inVoltage = _coefficients.scale(V_IN, _sensor.read(V_IN));
+
+        update(inVoltage, inCurrent, outVoltage, outCurrent);
+    }
+
+    /*
+    * Runs the algorithm on readings that are already in volts and amps. step() calls this
+    * after scaling the AnalogIn readings; the test harness calls it directly.
+    */
+    void update(float inVoltage, float inCurrent, float outVoltage, float outCurrent){
+        float inPower = inVoltage * inCurrent; // Power = Voltage * Current
+        float outPower = outVoltage * outCurrent;
+
+        float referenceVoltage = _algorithm.update(inVoltage, inCurrent);
+
+        _readings.inVoltage = inVoltage;
+        _readings.inCurrent = inCurrent;
+        _readings.inPower = inPower;
+        _readings.outVoltage = outVoltage;
+        _readings.outCurrent = outCurrent;
+        _readings.outPower = outPower;
+        _readings.dutyCycle = dutyCycleFor(referenceVoltage, outVoltage);
+        _readings.efficiency = (outPower / inPower) * 100;
+
+        _actuator.write(_readings.dutyCycle);
+        _telemetry.publish(_readings);
+    }
+
+    /* Readings of the most recent step */
+    const MpptReadings &readings(void) const { return _readings; }
+
+    /* Input voltage the algorithm is currently steering towards */
+    float referenceVoltage(void) const { return _algorithm.referenceVoltage(); }
+
+    /* The tracking algorithm, for reading or changing its settings */
+    Algorithm &algorithm(void) { return _algorithm; }
+
+private:
+    /*
+    * A boost converter steps Vin up to Vout = Vin / (1 - D), so the duty cycle that holds the
+    * input at the reference voltage is D = (Vout - Vref) / Vout.
+    */
+    static float dutyCycleFor(float referenceVoltage, float outVoltage){
+        if(outVoltage <= 0){
+            return MIN_DUTY_CYCLE; // no output voltage reading, leave the switch off
+        }
+        float dutyCycle = (outVoltage - referenceVoltage) / (outVoltage);
+
+        // error handling: duty cycle must NOT go above 0.8, or 80%
+        if(dutyCycle >= MAX_DUTY_CYCLE){
+            dutyCycle = MAX_DUTY_CYCLE;
+        } else if(dutyCycle < MIN_DUTY_CYCLE){
+            dutyCycle = MIN_DUTY_CYCLE;
+        }
+        return dutyCycle;
+    }
+
+    Sensor          &_sensor;
+    Actuator        &_actuator;
+    Telemetry       &_telemetry;
+    MpptCoefficients _coefficients;
+    Algorithm       _algorithm;
+    MpptReadings    _readings;
+};
+
+#endif // _MPPT_CONTROLLER_H_
@@ -0,0 +1,326 @@
+/*************************** mppt_fixed.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * MPPT Controller Library: Fixed-Point (Q16) Controller
+ *
+ * Purpose: An integer version of MpptController's sensing-to-duty pipeline. MpptController does
+ * every step in float: AnalogIn scaling with AIN_MULT, the divisions by I_IN_DIV and I_OUT_DIV,
+ * the powers and the duty cycle division. MpptFixedController works directly in ADC counts:
+ *
+ *      - the calibration is folded into one affine coefficient pair per channel, computed once
+ *        when the controller is constructed, so a reading is one multiply and one add
+ *        (value = counts * gain + offset) and the calibration divisions disappear
+ *      - volts, amps and watts are Q16 (16 integer bits, 16 fraction bits), which holds the
+ *        input and output voltages with a resolution of 15 uV
+ *      - the one division left, by the output voltage in the duty cycle, is done with 32 bit
+ *        hardware divides (the Cortex-M4 has one; it has no 64 bit divide)
+ *
+ * The sensor must provide 'unsigned short read_u16(MpptChannel)' (AnalogIn::read_u16()), the
+ * actuator 'void write_q16(q16_t dutyCycle)' and the telemetry
+ * 'void publish(const MpptFixedReadings &)'. The readings are published in Q16, so the control
+ * step converts nothing to float; mpptFloatReadings() does that for printing and CAN wherever
+ * there is time for it (the main loop on the board). The tracking algorithm works in Q16 as well;
+ * FixedPerturbAndObserve is the shipping P&O, and FloatAlgorithm<> runs any of the float
+ * algorithms in mppt_algorithms.h (only the scaling, power and duty cycle are integer then).
+ * MpptFixedAlgorithm<A>::type picks the right one for an algorithm name.
+ *
+ * test/fixed_main.cpp checks the scaling against the float path for every ADC count of every
+ * channel and the duty cycle for a million reference/output voltage pairs, compares both
+ * controllers in closed loop and reports the time per step of both.
+ *
+ * This file has no mbed dependencies and compiles on any host with a C++ compiler.
+ *
+ *****************************************************************************************/
+#ifndef _MPPT_FIXED_H_
+#define _MPPT_FIXED_H_
+
+#include <stdint.h>
+#include "mppt_config.h"
+#include "mppt_algorithms.h"
+#include "mppt_controller.h"
+
+typedef int32_t q16_t;
+
+#define Q16_SHIFT            16
+#define Q16_ONE              ((q16_t)1 << Q16_SHIFT)
+
+#define MAX_DUTY_CYCLE_Q16   ((q16_t)(MAX_DUTY_CYCLE * Q16_ONE + 0.5))
+#define MIN_DUTY_CYCLE_Q16   ((q16_t)(MIN_DUTY_CYCLE * Q16_ONE + 0.5))
+
+static inline q16_t q16FromFloat(float value) { return (q16_t)(value * Q16_ONE + (value < 0 ? -0.5f : 0.5f)); }
+static inline float q16ToFloat(q16_t value) { return value * (1.0f / Q16_ONE); }
+
+/* a * b, both Q16, rounded; the 64 bit product is a single SMULL on the Cortex-M4 */
+static inline q16_t q16Multiply(q16_t a, q16_t b)
+{
+    return (q16_t)(((int64_t)a * b + (1 << (Q16_SHIFT - 1))) >> Q16_SHIFT);
+}
+
+#if defined(__CC_ARM)
+#define Q16_CLZ(x)           __clz(x)           // ARM compiler intrinsic, a single CLZ instruction
+#else
+#define Q16_CLZ(x)           __builtin_clz(x)
+#endif
+
+/*
+* num / den as Q16, rounded, for 0 <= num < den < 2^31. Long division in as many bits at a time as
+* fit in 32 bits: num < den, so num can be shifted left by the leading zeros of den. Q16 voltages
+* below 256 V have at least 8 leading zeros, so this is two 32 bit hardware divides.
+*/
+static inline q16_t q16Ratio(uint32_t num, uint32_t den)
+{
+    uint32_t quotient = 0;
+    int bits = Q16_SHIFT;
+    while (bits > 0) {
+        int shift = Q16_CLZ(den);
+        if (shift > bits) shift = bits;
+        num <<= shift;
+        quotient = (quotient << shift) | (num / den);
+        num %= den;
+        bits -= shift;
+    }
+    if (2 * num >= den) quotient++;
+    return (q16_t)quotient;
+}
+
+/*
+* Turns ADC counts into a Q16 value: value = (counts * gain + offset) >> 16, where gain and offset
+* are Q32. One 32x32 multiply, one 64 bit add and a shift per reading.
+*/
+struct MpptChannelCoefficients {
+    int32_t gain;
+    int64_t offset;
+
+    q16_t scale(unsigned short counts) const {
+        return (q16_t)(((int64_t)counts * gain + offset + (1 << (Q16_SHIFT - 1))) >> Q16_SHIFT);
+    }
+};
+
+/*
+* The coefficients of all four channels, precomputed from an MpptCalibration. These are the same
+* formulas as MpptCoefficients (mppt_calibration.h) with AnalogIn::read() = counts / 65535:
+*
+*      current = (counts / 65535 * ainMult - hallNoCurrent) / iDiv
+*      voltage =  counts / 65535 * ainMult * vMult
+**/
+struct MpptFixedCalibration {
+    MpptChannelCoefficients channel[MPPT_CHANNEL_COUNT];
+
+    MpptFixedCalibration(const MpptCalibration &cal = MpptCalibration()){
+        set(HALL_IN, cal.ainMult / (ADC_FULL_SCALE * cal.iInDiv), -cal.hallInNoCurrent / cal.iInDiv);
+        set(HALL_OUT, cal.ainMult / (ADC_FULL_SCALE * cal.iOutDiv), -cal.hallOutNoCurrent / cal.iOutDiv);
+        set(V_OUT, cal.ainMult * cal.vOutMult / ADC_FULL_SCALE, 0);
+        set(V_IN, cal.ainMult * cal.vInMult / ADC_FULL_SCALE, 0);
+    }
+
+private:
+    void set(MpptChannel c, double gain, double offset){
+        channel[c].gain = (int32_t)(gain * 4294967296.0 + 0.5);
+        channel[c].offset = (int64_t)(offset * 4294967296.0 + (offset < 0 ? -0.5 : 0.5));
+    }
+};
+
+/*
+* Everything measured and computed during one fixed-point controller step, in Q16.
+*/
+struct MpptFixedReadings {
+    q16_t inVoltage;
+    q16_t inCurrent;
+    q16_t inPower;
+    q16_t outVoltage;
+    q16_t outCurrent;
+    q16_t outPower;
+    q16_t dutyCycle;
+};
+
+/*
+* Fixed-point readings converted to float, for printing and CAN. The efficiency is 0 while no
+* power comes in.
+*/
+inline MpptReadings mpptFloatReadings(const MpptFixedReadings &f)
+{
+    MpptReadings r;
+    r.inVoltage = q16ToFloat(f.inVoltage);
+    r.inCurrent = q16ToFloat(f.inCurrent);
+    r.inPower = q16ToFloat(f.inPower);
+    r.outVoltage = q16ToFloat(f.outVoltage);
+    r.outCurrent = q16ToFloat(f.outCurrent);
+    r.outPower = q16ToFloat(f.outPower);
+    r.dutyCycle = q16ToFloat(f.dutyCycle);
+    r.efficiency = (f.inPower > 0) ? (r.outPower / r.inPower) * 100 : 0;
+    return r;
+}
+
+/* Float readings are already converted */
+inline const MpptReadings &mpptFloatReadings(const MpptReadings &r) { return r; }
+
+/**
+* The Perturb & Observe algorithm of mppt_algorithms.h, step for step, in Q16.
+**/
+class FixedPerturbAndObserve
+{
+public:
+    FixedPerturbAndObserve() { reset(q16FromFloat(START_VOLTAGE), q16FromFloat(START_CURRENT)); }
+
+    void reset(q16_t voltage, q16_t current){
+        originalVoltage = voltage;
+        originalPower = q16Multiply(voltage, current);
+    }
+
+    q16_t update(q16_t inVoltage, q16_t inCurrent){
+        q16_t inPower = q16Multiply(inVoltage, inCurrent);
+        q16_t deltaVoltage = inVoltage - originalVoltage;
+        q16_t deltaPower = inPower - originalPower;
+        q16_t tmpInVoltage = inVoltage;
+
+        if(deltaPower == 0){
+            // continue code and skip everything else
+        } else if(deltaPower > 0){
+            if(deltaVoltage > 0){
+                tmpInVoltage += deltaVoltage; // decrease duty cycle
+            } else {
+                tmpInVoltage -= deltaVoltage; // decrease duty cycle
+            }
+        } else{ // deltaPower < 0
+            if(deltaVoltage > 0){
+                tmpInVoltage -= deltaVoltage; // increase duty cycle
+            } else {
+                tmpInVoltage += deltaVoltage; // increase duty cycle
+            }
+        }
+        originalVoltage = tmpInVoltage;
+        originalPower = inPower;
+        return tmpInVoltage;
+    }
+
+    q16_t referenceVoltage(void) const { return originalVoltage; }
+
+private:
+    q16_t originalVoltage;
+    q16_t originalPower;
+};
+
+/*
+* Runs one of the float algorithms of mppt_algorithms.h inside MpptFixedController.
+*/
+template <class Algorithm>
+class FloatAlgorithm
+{
+public:
+    FloatAlgorithm(const Algorithm &algorithm = Algorithm()) : _algorithm(algorithm) {}
+
+    void reset(q16_t voltage, q16_t current){ _algorithm.reset(q16ToFloat(voltage), q16ToFloat(current)); }
+
+    q16_t update(q16_t inVoltage, q16_t inCurrent){
+        return q16FromFloat(_algorithm.update(q16ToFloat(inVoltage), q16ToFloat(inCurrent)));
+    }
+
+    q16_t referenceVoltage(void) const { return q16FromFloat(_algorithm.referenceVoltage()); }
+
+    Algorithm &algorithm(void) { return _algorithm; }
+
+private:
+    Algorithm _algorithm;
+};
+
+/* The fixed-point algorithm to use for a float algorithm: an integer version where there is one */
+template <class Algorithm> struct MpptFixedAlgorithm { typedef FloatAlgorithm<Algorithm> type; };
+template <> struct MpptFixedAlgorithm<PerturbAndObserve> { typedef FixedPerturbAndObserve type; };
+
+template <class Sensor, class Actuator, class Telemetry, class Algorithm = FixedPerturbAndObserve>
+class MpptFixedController
+{
+public:
+    MpptFixedController(Sensor &sensor, Actuator &actuator, Telemetry &telemetry,
+                        const MpptCalibration &calibration = MpptCalibration(),
+                        const Algorithm &algorithm = Algorithm()) :
+        _sensor(sensor),
+        _actuator(actuator),
+        _telemetry(telemetry),
+        _cal(calibration),
+        _algorithm(algorithm)
+    {
+        reset();
+    }
+
+    /* Replaces the calibration, e.g. with the one measured and stored by the board at start-up */
+    void setCalibration(const MpptCalibration &calibration){
+        _cal = MpptFixedCalibration(calibration);
+    }
+
+    void reset(float voltage = START_VOLTAGE, float current = START_CURRENT){
+        _algorithm.reset(q16FromFloat(voltage), q16FromFloat(current));
+        _readings = MpptFixedReadings();
+    }
+
+    /*
+    * One complete controller step: read the four sensor channels in the same order as
+    * MpptController::step(), run the tracking algorithm, set the duty cycle, publish the Q16 readings.
+    */
+    void step(void){
+        q16_t inCurrent = _cal.channel[HALL_IN].scale(_sensor.read_u16(HALL_IN));
+        q16_t outCurrent = _cal.channel[HALL_OUT].scale(_sensor.read_u16(HALL_OUT));
+        q16_t outVoltage = _cal.channel[V_OUT].scale(_sensor.read_u16(V_OUT));
+        q16_t inVoltage = _cal.channel[V_IN].scale(_sensor.read_u16(V_IN));
+
+        update(inVoltage, inCurrent, outVoltage, outCurrent);
+    }
+
+    /* Runs the algorithm on readings that are already Q16 volts and amps */
+    void update(q16_t inVoltage, q16_t inCurrent, q16_t outVoltage, q16_t outCurrent){
+        q16_t referenceVoltage = _algorithm.update(inVoltage, inCurrent);
+
+        _readings.inVoltage = inVoltage;
+        _readings.inCurrent = inCurrent;
+        _readings.inPower = q16Multiply(inVoltage, inCurrent);
+        _readings.outVoltage = outVoltage;
+        _readings.outCurrent = outCurrent;
+        _readings.outPower = q16Multiply(outVoltage, outCurrent);
+        _readings.dutyCycle = dutyCycleFor(referenceVoltage, outVoltage);
+
+        _actuator.write_q16(_readings.dutyCycle);
+        _telemetry.publish(_readings);
+    }
+
+    /* Readings of the most recent step, converted to float */
+    MpptReadings readings(void) const { return mpptFloatReadings(_readings); }
+
+    const MpptFixedReadings &fixedReadings(void) const { return _readings; }
+
+    float referenceVoltage(void) const { return q16ToFloat(_algorithm.referenceVoltage()); }
+
+    Algorithm &algorithm(void) { return _algorithm; }
+
+    /* D = (Vout - Vref) / Vout, clamped like MpptController::dutyCycleFor() */
+    static q16_t dutyCycleFor(q16_t referenceVoltage, q16_t outVoltage){
+        if(outVoltage <= 0){
+            return MIN_DUTY_CYCLE_Q16; // no output voltage reading, leave the switch off
+        }
+        if(referenceVoltage >= outVoltage){
+            return MIN_DUTY_CYCLE_Q16;
+        }
+        uint32_t difference = (uint32_t)outVoltage - (uint32_t)referenceVoltage;
+        if(difference >= (uint32_t)outVoltage){
+            return MAX_DUTY_CYCLE_Q16; // reference at or below 0 V
+        }
+        q16_t dutyCycle = q16Ratio(difference, outVoltage);
+
+        // error handling: duty cycle must NOT go above 0.8, or 80%
+        if(dutyCycle >= MAX_DUTY_CYCLE_Q16){
+            dutyCycle = MAX_DUTY_CYCLE_Q16;
+        } else if(dutyCycle < MIN_DUTY_CYCLE_Q16){
+            dutyCycle = MIN_DUTY_CYCLE_Q16;
+        }
+        return dutyCycle;
+    }
+
+private:
+    Sensor               &_sensor;
+    Actuator             &_actuator;
+    Telemetry            &_telemetry;
+    MpptFixedCalibration _cal;
+    Algorithm            _algorithm;
+    MpptFixedReadings    _readings;
+};
+
+#endif // _MPPT_FIXED_H_
@@ -0,0 +1,80 @@
+/*************************** mppt_snapshot.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * MPPT Controller Library: Latest Readings for Telemetry
+ *
+ * Purpose: A Telemetry for MpptController that only keeps the latest readings. The controller
+ * runs inside the Ticker interrupt, where anything slow (printf, CAN writes, wait()) does not
+ * belong. The interrupt publishes into an MpptSnapshot, which takes a short, fixed time, and the
+ * main loop samples the latest readings whenever it is ready to print and transmit them.
+ *
+ * There is no lock and interrupts are never disabled. publish() makes a sequence counter odd
+ * while it writes the readings and even again when it is done; sample() copies the readings and
+ * keeps the copy only if the counter was even and did not change while it copied, otherwise it
+ * copies again. The main loop can never preempt the interrupt, so publish() never waits.
+ *
+ * Only valid for one writer (the interrupt) and readers the writer can preempt, on a single core.
+ *
+ * MpptSnapshot holds the float MpptReadings of MpptController, MpptFixedSnapshot the Q16
+ * MpptFixedReadings of MpptFixedController, which the main loop converts with mpptFloatReadings().
+ * The readings are copied as 32 bit words; every field of both is 32 bits.
+ *
+ * This file has no mbed dependencies and compiles on any host with a C++ compiler.
+ *
+ *****************************************************************************************/
+#ifndef _MPPT_SNAPSHOT_H_
+#define _MPPT_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "mppt_controller.h"
+#include "mppt_fixed.h"
+
+template <class Readings>
+class MpptSnapshotOf
+{
+public:
+    MpptSnapshotOf() : _sequence(0) {}
+
+    /* Telemetry interface used by the controller; called from the control interrupt */
+    void publish(const Readings &r){
+        uint32_t words[WORDS];
+        memcpy(words, &r, sizeof(words));
+        _sequence++;                    // odd: the readings are being written
+        for(unsigned k = 0; k < WORDS; k++){
+            _words[k] = words[k];
+        }
+        _sequence++;                    // even: the readings are complete
+    }
+
+    /*
+    * Copies the latest readings into 'r'. Returns false if nothing has been published yet.
+    * 'steps', if given, receives the number of readings published so far.
+    */
+    bool sample(Readings &r, unsigned long *steps = 0) const {
+        uint32_t words[WORDS];
+        unsigned long before, after;
+        do {
+            before = _sequence;
+            for(unsigned k = 0; k < WORDS; k++){
+                words[k] = _words[k];
+            }
+            after = _sequence;
+        } while((before & 1) || before != after);
+        memcpy(&r, words, sizeof(words));
+
+        if(steps) *steps = before / 2;
+        return before != 0;
+    }
+
+private:
+    enum { WORDS = sizeof(Readings) / sizeof(uint32_t) };
+
+    volatile unsigned long _sequence;
+    volatile uint32_t      _words[WORDS];
+};
+
+typedef MpptSnapshotOf<MpptReadings> MpptSnapshot;
+typedef MpptSnapshotOf<MpptFixedReadings> MpptFixedSnapshot;
+
+#endif // _MPPT_SNAPSHOT_H_
@@ -17,6 +17,8 @@
  * Dependent Libraries:
  *          - mbed Library: https://developer.mbed.org/users/mbed_official/code/mbed/
  *          - SEEEED_CAN_LIBRARY: /mppt/FRDM-K64F/CAN_BUS/SEEED_CAN/SEEED_CAN_LIBRARY
+ *          - MPPT_LIBRARY: /mppt/FRDM-K64F/Perturb_and_Observe/MPPT_LIBRARY
+ *          - MPPT_CAN_CODEC: /mppt/FRDM-K64F/CAN_BUS/MPPT_CAN_CODEC
  *
  * FRDM-K64F Pinout: https://developer.mbed.org/media/uploads/sam_grove/xk64f_page2.jpg.pagespeed.ic.XmUo-mk4LT.webp
  *
@@ -35,11 +37,13 @@
  * 'Perturb & Observe Algorithm'. The binary of this file is located in the following directory
  * of the Github repository: '/mppt/FRDM-K64F/Perturb_and_Observe/Compiled Code'. Once the binary
  * of this program is loaded onto the board, the program will begin by initializing the
- * CAN_BUS Shield and runs the P&O algorithm in 2 second intervals.
+ * CAN_BUS Shield and runs the P&O algorithm about CONTROL_RATE_HZ times a second in a Ticker interrupt,
+* on readings filtered from OVERSAMPLING samples of each AnalogIn pin per step.
  * The FRDM-K64 microcontroller reads in 5 different values from the Boost Converter and calculates the
  * most optimal duty cycle. Then, the CAN_BUS Shield sends the following values to another
  * FRDM-K64F receiving CAN_BUS board: outVoltage, inCurrent, inVoltage, outCurrent, efficiency. All outputs
- * are printed using the RawSerial command. To view the contents being printed, Windows users can use
+ * are printed using the RawSerial command. Printing and CAN_BUS transmission happen in the main loop,
+ * which samples the latest readings of the controller, so they never hold up the control interrupt. To view the contents being printed, Windows users can use
  * the program 'PuTTy', and Mac users can use the built-in terminal function, 'screen.'
  *
  *****************************************************************************************************/
@@ -72,18 +76,68 @@
 #include "mbed.h"
 #include "seeed_can.h"
 #include "stdlib.h"
+#include "mppt_controller.h"
+#include "mppt_fixed.h"
+#include "mppt_snapshot.h"
+#include "mppt_acquisition.h"
+#include "mppt_calibration.h"
+#include "mppt_can_codec.h"
  
-//Define Constants
-#define PWM_PERIOD_us        25
-#define V_IN_MULT            51
-#define V_OUT_MULT           50.97
-#define I_IN_DIV             0.17625899280576
-#define I_OUT_DIV            0.17785467128028
-#define HALL_IN_NO_CURRENT   2.513
-#define HALL_OUT_NO_CURRENT  2.517
-#define AIN_MULT             3.3
-#define MESSAGE_LENGTH       8
-#define READING_COUNT        6
+//Define Constants (calibration constants are in MPPT_LIBRARY/mppt_config.h)
+
+// Tracking algorithm run by the controller (MPPT_LIBRARY/mppt_algorithms.h):
+// PerturbAndObserve, VariableStepPerturbAndObserve, IncrementalConductance or
+// GlobalScan<VariableStepPerturbAndObserve> (partial shading)
+#define MPPT_ALGORITHM       PerturbAndObserve
+
+// The control step runs in a Ticker interrupt CONTROL_RATE_HZ times a second (100 Hz - 10 kHz).
+// It runs the algorithm on the filtered AnalogIn readings and sets the PWM, and nothing else.
+#define CONTROL_RATE_HZ      1000
+#if CONTROL_RATE_HZ < 100 || CONTROL_RATE_HZ > 10000
+#error "CONTROL_RATE_HZ must be between 100 Hz and 10 kHz"
+#endif
+
+// The Ticker interrupt samples the four AnalogIn pins OVERSAMPLING times per control step and the
+// controller runs on the filtered readings. ACQ_FILTER is one of the filters in
+// MPPT_LIBRARY/mppt_acquisition.h: BoxcarFilter<N>, MedianFilter<N> (spiky sensors), IirFilter<K>
+// or NoFilter (one sample, no filtering). ACQ_SCHEDULE is the order of the conversions:
+// PairedSchedule converts each voltage right before its current, InterpolatedSchedule converts
+// it before and after (6 conversions), SequentialSchedule is the old channel order.
+//
+// The Hall sensors see the 40 kHz switching ripple. The sample period is a whole number of PWM
+// periods plus PWM_PERIOD_us / OVERSAMPLING, so the samples of one control step fall evenly across
+// the PWM period and their average is the average current, not the current at one point of the
+// ripple. OVERSAMPLING must divide PWM_PERIOD_us, and the control step runs every
+// SAMPLE_PERIOD_us * OVERSAMPLING us (STEP_RATE_HZ, close to CONTROL_RATE_HZ).
+#define OVERSAMPLING         5
+#define ACQ_FILTER           BoxcarFilter<OVERSAMPLING>
+#define ACQ_SCHEDULE         PairedSchedule
+#define SAMPLE_PERIOD_us     (PWM_PERIOD_us * (1000000 / CONTROL_RATE_HZ / OVERSAMPLING / PWM_PERIOD_us) + PWM_PERIOD_us / OVERSAMPLING)
+#define STEP_RATE_HZ         (1000000 / (SAMPLE_PERIOD_us * OVERSAMPLING))
+#if PWM_PERIOD_us % OVERSAMPLING != 0
+#error "OVERSAMPLING must divide PWM_PERIOD_us"
+#endif
+#if SAMPLE_PERIOD_us < 50
+#error "Samples closer than 50 us (four ADC conversions each): lower CONTROL_RATE_HZ or OVERSAMPLING"
+#endif
+
+// At start-up the calibration is loaded from the last flash sector (CALIBRATION_SECTOR; the
+// constants of MPPT_LIBRARY/mppt_config.h if it is blank) and the zero-current output of both
+// Hall sensors is measured with the converter idle. The sector is only rewritten when a zero moved
+// by more than CALIBRATION_SAVE_THRESHOLD volts, to spare the flash.
+#define CALIBRATION_SECTOR   0x000FF000         // last 4 KB sector of the 1 MB program flash
+#define CALIBRATION_SAVE_THRESHOLD 0.005
+#define AUTO_ZERO_SETTLE     0.1                // seconds the idle converter settles before the auto-zero
+
+// The main loop prints and transmits the latest readings, then waits this long (seconds)
+#define TELEMETRY_PERIOD     0.5
+
+// Uncomment to run the fixed-point (Q16) controller of MPPT_LIBRARY/mppt_fixed.h instead of the float one
+// #define MPPT_FIXED_POINT
+
+// Uncomment to print the cycle count of a float and of a fixed-point controller step at start-up
+// #define MPPT_CYCLE_COUNT
+#define CYCLE_COUNT_STEPS    1000
 
  // Create a PwmOut connected to the specific pin
  PwmOut mypwm(PTC3);
@@ -110,141 +164,283 @@
  // Attach a member function to be called by the Ticker, specifying time in seconds
  Ticker timer;
  
- // prints contents that are in the 8 character array
-void printData(char*); 
-
-// converts a char variable into an 8 character array
-void convertToCharArray(char*, float);
-
-// prints out all the character elements inside an 8 character array
+// prints out the status of the CAN Bus initialization
 void printStatus(int);
 
-// Global Variables and starting Voltage and Current values
+// Global Variables
 int heartbeat = 0;
 int start = 0;
-float pulseWidth;
-float dutyCycle;
-float originalVoltage = 60;
-float originalCurrent = 1;
-float originalPower = originalVoltage * originalCurrent;
 
 // Global Variables used for SEEED_CAN Transmitter
 // initialize CAN_BUS pin values with 500k baud rate
 SEEED_CAN can(SEEED_CAN_CS,SEEED_CAN_IRQ, SEEED_CAN_MOSI, SEEED_CAN_MISO, SEEED_CAN_CLK , 500000);
-int id = 7; // ID of the CAN_BUS Message TODO: determine which ID to send
-char can_data[MESSAGE_LENGTH] = {}; // data being transmitted over CAN_BUS
+char can_data[MPPT_CAN_LENGTH] = {}; // data being transmitted over CAN_BUS
+
+/*
+* Sensor used by the MPPT controller: the four AnalogIn pins of the boost converter.
+*/
+struct BoardSensor {
+    float read(MpptChannel channel){
+        switch(channel){
+            case HALL_IN:  return i_hall_in.read();
+            case HALL_OUT: return i_hall_out.read();
+            case V_OUT:    return v_out.read();
+            case V_IN:     return v_in.read();
+            default:       return 0;
+        }
+    }
 
-char *readingString[] = {
-    "OutVoltage", "InCurrent",
-    "InVoltage", "OutCurrent",
-    "Efficiency"
+    unsigned short read_u16(MpptChannel channel){
+        switch(channel){
+            case HALL_IN:  return i_hall_in.read_u16();
+            case HALL_OUT: return i_hall_out.read_u16();
+            case V_OUT:    return v_out.read_u16();
+            case V_IN:     return v_in.read_u16();
+            default:       return 0;
+        }
+    }
 };
-int readingNumber = 0; // counter for which data is being transmitted
 
- void perturb_and_observe(void){
-    
-    /* Actual reading values */
-    float inHallSensorRaw = i_hall_in.read() * AIN_MULT ;
-    float outHallSensorRaw = i_hall_out.read() * AIN_MULT;
-    float outCurrent = (outHallSensorRaw - HALL_OUT_NO_CURRENT)/ I_OUT_DIV;
-    float outVoltage = (v_out.read() * AIN_MULT) * V_OUT_MULT; // 120V
-    float inCurrent = (inHallSensorRaw - HALL_IN_NO_CURRENT)/ I_IN_DIV;
-    float inVoltage = (v_in.read() * AIN_MULT) * V_IN_MULT;
-    
-    /* Test reading values */
-    /*
-    float outCurrent = 0.8930;
-    float outVoltage = 119.281; // 120V
-    float inCurrent = 1.23243;
-    float inVoltage = 45.2132;
-    */
-
-    //pc.printf("outVoltage %.6f, inVoltage %.6f, inCurrent %.6f, outCurrent %.6f\r\n", outVoltage, inVoltage, inCurrent, outCurrent);
-
-    float inPower = inVoltage * inCurrent; // Power = Voltage * Current
-    float outPower = outPower = outVoltage * outCurrent;
-
-    pc.printf("Input Readings: \r\n");
-    pc.printf("Inputs: Voltage: %.6f, Current: %.6f, Power: %.6f \r\n", inVoltage, inCurrent, inPower);
-    pc.printf("Outputs: Voltage: %.2f, Current: %.2f, Power: %.2f\r\n", outVoltage, outCurrent, outPower);
-
-    float deltaVoltage = inVoltage - originalVoltage; // also known as Perturbation
-    float deltaPower = inPower - originalPower;
-    float tmpInVoltage = inVoltage;
-    //pc.printf("Delta Voltage is: %.6f, Delta Power is: %.6f \r\n", deltaVoltage, deltaPower);
-
-    if(deltaPower == 0){
-        // continue code and skip everything else
-    } else if(deltaPower > 0){
-        if(deltaVoltage > 0){
-            tmpInVoltage += deltaVoltage; // increase duty cycle
-        } else {
-            tmpInVoltage -= deltaVoltage; // decrease duty cycle
+/*
+* Actuator used by the MPPT controller: the PWM signal driving the boost converter.
+*/
+struct BoardPwm {
+    void write(float dutyCycle){
+        // set the duty cycle as a fraction of the period, keeping the period the same (it is set
+        // once in main()). write() scales it to the FTM's counts (1500 per 25 us period at 60 MHz);
+        // pulsewidth_us() would round it to whole microseconds, 25 levels of 4%.
+        mypwm.write(dutyCycle);
+    }
+
+    void write_q16(q16_t dutyCycle){
+        mypwm.write(q16ToFloat(dutyCycle));
+    }
+};
+
+/*
+* Persistent store for the calibration: the sector at CALIBRATION_SECTOR, erased and programmed
+* through the flash controller (FTFE). The sector is in the second program flash block, so the
+* code keeps running from the first block while the command executes. Nothing else may be linked
+* into that sector.
+*/
+struct FlashStorage {
+    bool read(void *data, unsigned size){
+        memcpy(data, (const void *)CALIBRATION_SECTOR, size); // flash is memory mapped
+        return true;
+    }
+
+    bool write(const void *data, unsigned size){
+        if(!command(0x09, CALIBRATION_SECTOR, 0)){ // Erase Flash Sector
+            return false;
         }
-    } else{ // deltaPower < 0
-        if(deltaVoltage > 0){
-            tmpInVoltage -= deltaVoltage; // decrease duty cycle
-        } else {
-            tmpInVoltage += deltaVoltage; // increase duty cycle
+        for(unsigned k = 0; k < size; k += 8){
+            uint8_t phrase[8];
+            memset(phrase, 0xFF, sizeof(phrase));
+            memcpy(phrase, (const uint8_t *)data + k, size - k < 8 ? size - k : 8);
+            if(!command(0x07, CALIBRATION_SECTOR + k, phrase)){ // Program Phrase (8 bytes)
+                return false;
+            }
         }
+        return memcmp((const void *)CALIBRATION_SECTOR, data, size) == 0;
     }
-    originalVoltage = tmpInVoltage; // replace old voltage with current voltage
-    originalCurrent = inCurrent;
-    originalPower = inPower; // replace old power with current power
 
-    //compute duty cyle and set pulsewidth
-    dutyCycle = (outVoltage - inVoltage) / (outVoltage);
+private:
+    /* Runs one flash command; returns false if the controller reports an error */
+    static bool command(uint8_t code, uint32_t address, const uint8_t *phrase){
+        while(!(FTFE->FSTAT & FTFE_FSTAT_CCIF_MASK)); // previous command done
+        FTFE->FSTAT = FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK | FTFE_FSTAT_RDCOLERR_MASK;
+        FTFE->FCCOB0 = code;
+        FTFE->FCCOB1 = (uint8_t)(address >> 16);
+        FTFE->FCCOB2 = (uint8_t)(address >> 8);
+        FTFE->FCCOB3 = (uint8_t)address;
+        if(phrase){ // each longword is loaded most significant byte first
+            FTFE->FCCOB4 = phrase[3]; FTFE->FCCOB5 = phrase[2]; FTFE->FCCOB6 = phrase[1]; FTFE->FCCOB7 = phrase[0];
+            FTFE->FCCOB8 = phrase[7]; FTFE->FCCOB9 = phrase[6]; FTFE->FCCOBA = phrase[5]; FTFE->FCCOBB = phrase[4];
+        }
+        __disable_irq();
+        FTFE->FSTAT = FTFE_FSTAT_CCIF_MASK; // launch
+        while(!(FTFE->FSTAT & FTFE_FSTAT_CCIF_MASK));
+        __enable_irq();
+        return !(FTFE->FSTAT & (FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK | FTFE_FSTAT_MGSTAT0_MASK));
+    }
+};
 
-    //pc.printf("Duty cycle to: %.2f\r\n", dutyCycle);
+/*
+* Prints the readings and transmits them via CAN_BUS, all five packed into one MPPT_CAN_ID frame
+* (CAN_BUS/MPPT_CAN_CODEC/mppt_can_codec.h). It runs in the main loop on readings sampled from
+* the controller, so printing never holds up the control interrupt.
+*/
+struct CanTelemetry {
+    void publish(const MpptReadings &r){
+        pc.printf("Input Readings: \r\n");
+        pc.printf("Inputs: Voltage: %.6f, Current: %.6f, Power: %.6f \r\n", r.inVoltage, r.inCurrent, r.inPower);
+        pc.printf("Outputs: Voltage: %.2f, Current: %.2f, Power: %.2f\r\n", r.outVoltage, r.outCurrent, r.outPower);
+
+        // read(): return the current output duty-cycle setting, measured as a percentage (float)
+        pc.printf("PWM: %f %%\r\n", mypwm.read() * 100);
+        pc.printf("Efficiency: %.2f %%\r\n", r.efficiency);
+        pc.printf("\r\n");
+
+        MpptCanReadings packed = { r.outVoltage, r.inCurrent, r.inVoltage, r.outCurrent, r.efficiency };
+        mpptCanEncode(packed, (unsigned char *)can_data);
+
+        pc.printf("CAN_BUS transmitting...\r\n");
+        if (can.write(SEEED_CANMessage(MPPT_CAN_ID, can_data, MPPT_CAN_LENGTH, CANData, CANStandard))) {
+            printData(can_data);
+            led1 = !led1; // heartbeat
+        }else{
+            // write() queues while the TX buffers are busy; 0 means the queue was full and the frame was dropped
+            pc.printf("CAN_BUS queue full, frame dropped (%lu dropped, high-water %d)\r\n", can.txDropped(), can.txHighWater());
+        }
+        pc.printf("\r\n\r\n");
+    }
 
-    // error handling: duty cycle must NOT go above 0.8, or 80%
-    if(dutyCycle >= 0.8){
-        dutyCycle = 0.80;
+    /* Prints the packed frame in hex */
+    void printData(const char *data){
+        for(int k = 0; k < MPPT_CAN_LENGTH; k++){
+            pc.printf("%02X ", (unsigned char)data[k]);
+        }
+        pc.printf("\r\n");
+    }
+};
+
+typedef MpptAcquisition<BoardSensor, ACQ_FILTER, ACQ_SCHEDULE> BoardAcquisition;
+
+BoardSensor sensor;
+BoardAcquisition acquisition(sensor); // filtered readings of the four pins, the controller's sensor
+BoardPwm pwm;
+CanTelemetry telemetry;
+#ifdef MPPT_FIXED_POINT
+typedef MpptFixedReadings ControlReadings; // Q16: the main loop converts them to float, not the control interrupt
+#else
+typedef MpptReadings ControlReadings;
+#endif
+MpptSnapshotOf<ControlReadings> snapshot; // latest readings, written by the control interrupt, sampled by the main loop
+#ifdef MPPT_FIXED_POINT
+MpptFixedController<BoardAcquisition, BoardPwm, MpptFixedSnapshot, MpptFixedAlgorithm<MPPT_ALGORITHM>::type> mppt(acquisition, pwm, snapshot);
+#else
+MpptController<BoardAcquisition, BoardPwm, MpptSnapshot, MPPT_ALGORITHM> mppt(acquisition, pwm, snapshot);
+#endif
+
+volatile uint32_t longestStep_us = 0; // longest control step so far, including the last ADC sample
+int sampleCount = 0; // samples taken since the last control step
+
+ void perturb_and_observe(void){
+    uint32_t start = us_ticker_read();
+    acquisition.sample(); // one conversion of each AnalogIn pin into the filters, in ACQ_SCHEDULE order
+    if(++sampleCount < OVERSAMPLING){
+        return;
+    }
+    sampleCount = 0;
+    mppt.step(); // run the MPPT algorithm on the filtered readings, set the duty cycle and store the readings
+    uint32_t elapsed = us_ticker_read() - start;
+    if(elapsed > longestStep_us){
+        longestStep_us = elapsed;
     }
+ }
 
-    pulseWidth = dutyCycle * PWM_PERIOD_us; // duty cycle = pulsewidth/period -> pulsewidth = duty cycle * period
+#ifdef MPPT_CYCLE_COUNT
+/*
+* Serves one set of AnalogIn readings over and over, so the cycle count below covers the
+* controller's arithmetic and not the ADC conversions.
+*/
+struct HeldSensor {
+    unsigned short counts[MPPT_CHANNEL_COUNT];
 
-    // set the PWM period, specified in micro-seconds (int), keeping the duty cycle the same
-    mypwm.period_us(PWM_PERIOD_us); 
-    // set the PWM pulsewidth, specified in milli-seconds (int), keeping the period the same
-    mypwm.pulsewidth_us(pulseWidth);
+    float read(MpptChannel channel){ return counts[channel] * (1.0f / (float)ADC_FULL_SCALE); }
+    unsigned short read_u16(MpptChannel channel){ return counts[channel]; }
+};
 
-    // read(): return the current output duty-cycle setting, measured as a percentage (float)
-    pc.printf("PWM: %f %%\r\n", mypwm.read() * 100);
+/* Keeps the duty cycle without touching the PWM */
+struct HeldPwm {
+    volatile float dutyCycle;
+    volatile q16_t dutyCycleQ16;
 
-    float efficiency = (outPower / inPower) * 100;
+    void write(float d){ dutyCycle = d; }
+    void write_q16(q16_t d){ dutyCycleQ16 = d; }
+};
 
-    pc.printf("Efficiency: %.2f %%\r\n", efficiency);
-    pc.printf("\r\n");
-    
-    // Put all the mpptReadings into an array so they can be transmitted via CAN_BUS
-    float mpptReadings[READING_COUNT] = {outVoltage, inCurrent, inVoltage, outCurrent, efficiency};
-    
-    pc.printf("CAN_BUS transmitting...\r\n");
-    for(readingNumber = 0; readingNumber < READING_COUNT - 1; readingNumber){
-        convertToCharArray(*&can_data, mpptReadings[readingNumber]); // convert float to an 8 char number
-         if (can.write(SEEED_CANMessage(id, can_data, MESSAGE_LENGTH, CANData, CANStandard))) { 
-            /*
-            * CAN-BUS TRANSMIT will send mppt values in this order: 
-            * "OutVoltage:", "InCurrent:", "InVoltage", "OutCurrent:, "Efficiency:"
-            */
-            pc.printf("%s: ", readingString[readingNumber]);
-            printData(*&can_data);
-            readingNumber++;
-            led1 = !led1; // heartbeat
-        }else{
-            int reset_status = can.mode(SEEED_CAN::Reset); // reset canbus if there is a problem, returns 1 if successful, 0 otherwise
+/*
+* Prints the average DWT cycle count of a float and of a fixed-point controller step, each
+* publishing into its snapshot as it does in the control interrupt.
+*/
+void printCycleCounts(void){
+    HeldSensor held;
+    HeldPwm heldPwm;
+    MpptSnapshot floatSnapshot;
+    MpptFixedSnapshot fixedSnapshot;
+    MpptController<HeldSensor, HeldPwm, MpptSnapshot, MPPT_ALGORITHM> floatMppt(held, heldPwm, floatSnapshot);
+    MpptFixedController<HeldSensor, HeldPwm, MpptFixedSnapshot, MpptFixedAlgorithm<MPPT_ALGORITHM>::type> fixedMppt(held, heldPwm, fixedSnapshot);
+    uint32_t floatCycles = 0, fixedCycles = 0;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // enable the DWT cycle counter
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    for(int n = 0; n < CYCLE_COUNT_STEPS; n++){
+        for(int c = 0; c < MPPT_CHANNEL_COUNT; c++){
+            held.counts[c] = sensor.read_u16((MpptChannel)c); // live readings, so the algorithm takes real branches
         }
-        wait(0.5);
-    } // end of for loop
-    pc.printf("\r\n\r\n");
- }
+        uint32_t start = DWT->CYCCNT;
+        floatMppt.step();
+        floatCycles += DWT->CYCCNT - start;
+        start = DWT->CYCCNT;
+        fixedMppt.step();
+        fixedCycles += DWT->CYCCNT - start;
+    }
+    pc.printf("Controller step: float %lu cycles, fixed point %lu cycles\r\n",
+              (unsigned long)(floatCycles / CYCLE_COUNT_STEPS), (unsigned long)(fixedCycles / CYCLE_COUNT_STEPS));
+}
+#endif
+
+/*
+* Times the conversions of one sample and prints the sampling plan, including the time between
+* the voltage and the current of a pair (the V/I skew) with ACQ_SCHEDULE.
+*/
+void printAcquisition(void){
+    uint32_t start = us_ticker_read();
+    for(int n = 0; n < 100; n++){
+        acquisition.sample();
+    }
+    float conversion_us = (us_ticker_read() - start) / (100.0f * acquisition.conversions());
+    pc.printf("ADC: %d samples per control step every %d us, %.1f us per conversion\r\n",
+              OVERSAMPLING, SAMPLE_PERIOD_us, conversion_us);
+    pc.printf("ADC: V/I skew %.1f us, filter latency %.1f samples\r\n",
+              acquisition.skew() * conversion_us, acquisition.latency());
+}
+
+/*
+* Loads the stored calibration, auto-zeroes the Hall sensors with the converter idle, stores the
+* result if a zero moved, and hands the calibration to the controller.
+*/
+void calibrate(void){
+    FlashStorage flash;
+    MpptCalibrationStore<FlashStorage> store(flash);
+    MpptCalibration calibration; // the constants of mppt_config.h
+    bool stored = store.load(calibration);
+    MpptCalibration measured = calibration;
+
+    mypwm.pulsewidth_us(0); // switch off: the array sits at open circuit, below the battery, and no current flows
+    wait(AUTO_ZERO_SETTLE);
+    MpptAutoZeroStatus status = mpptAutoZero(sensor, measured);
+    if(status == AUTO_ZERO_OK){
+        bool moved = fabs(measured.hallInNoCurrent - calibration.hallInNoCurrent) > CALIBRATION_SAVE_THRESHOLD
+                  || fabs(measured.hallOutNoCurrent - calibration.hallOutNoCurrent) > CALIBRATION_SAVE_THRESHOLD;
+        if(!stored || moved){
+            pc.printf("Calibration: %s\r\n", store.save(measured) ? "saved to flash" : "flash write failed");
+        }
+        calibration = measured;
+    }
+    mppt.setCalibration(calibration);
+    pc.printf("Calibration: %s, auto-zero %s, Hall zeros in %.4f V, out %.4f V\r\n",
+              stored ? "loaded from flash" : "defaults", mpptAutoZeroStatusName(status),
+              calibration.hallInNoCurrent, calibration.hallOutNoCurrent);
+}
 
 /* This function gets called when 'SW3' of the onboard FRDM-K64F is pressed. */
  // void interruptHandler(){
  //    start ^= 1; // flip between 0 or 1
  //    if(start == 1){
- //        timer.attach(&perturb_and_observe, 2); // interrupt every n seconds
+ //        timer.attach_us(&perturb_and_observe, SAMPLE_PERIOD_us);
  //    } else{
  //        timer.detach();
  //    }
@@ -253,20 +449,35 @@ int readingNumber = 0; // counter for which data is being transmitted
 int main(void){  
     // \r is an escape character for the terminal emulator
     pc.printf("Program starting...\r\n");
-    int can_open_status = can.open(500000, SEEED_CAN::Normal); // initialize CAN-BUS Shield
+    int can_open_status = can.open(mcpBitTiming<500000>(), SEEED_CAN::Normal); // initialize CAN-BUS Shield
     printStatus(can_open_status); // prints status of initialization
-    timer.attach(&perturb_and_observe,2); // run the P&O algorithm every 2 seconds
+#ifdef MPPT_CYCLE_COUNT
+    printCycleCounts();
+#endif
+    // set the PWM period, specified in micro-seconds (int); the controller only changes the pulsewidth
+    mypwm.period_us(PWM_PERIOD_us);
+    calibrate(); // stored calibration and Hall sensor auto-zero, before the controller starts
+    printAcquisition();
+    acquisition.reset(); // start the filters from one reading of each pin
+    timer.attach_us(&perturb_and_observe, SAMPLE_PERIOD_us); // sample every SAMPLE_PERIOD_us and run the MPPT controller STEP_RATE_HZ times a second
     // perturb and observe algorithm will begin when SW3 is pressed. If pressed again, it will stop.
     // sw3.rise(&interruptHandler);
     
-    // heartbeat to make sure the program is running
+    // print and transmit the latest readings, with a heartbeat to make sure the program is running
     while(1){
+        ControlReadings latest;
+        unsigned long steps;
+        if(snapshot.sample(latest, &steps)){
+            pc.printf("Control loop: %lu steps at %d Hz, longest step %lu us\r\n",
+                      steps, STEP_RATE_HZ, (unsigned long)longestStep_us);
+            telemetry.publish(mpptFloatReadings(latest));
+        }
         if(heartbeat == 0){
             led1 = !led1;
         } else{
             led2 = !led2;
         }
-        wait(3); // flash heartbeat every n seconds
+        wait(TELEMETRY_PERIOD);
     }
 }
 
@@ -278,45 +489,3 @@ void printStatus(int status){
         pc.printf("CAN BUS Shield initialization failed...\r\n");    
     }
 }
-
-/*
-* This function converts float numbers to a char array. Limit of 7 characters.
-*
-* Inputs: char* ptr - points to the beginning of buffer[8], the char array where
-*                     we will place the result
-*         float val - the value we want converted to a char array
-*
-* Output: 3 whole number values, dot, 3 decimal points
-*
-* Expected Result: 23.2345 ---->  [0, 2, 3, ., 2, 3, 4]
-* Expected Result: 120.1234 ----> [1, 2, 0, ., 1, 2, 3]
-*/
-void convertToCharArray(char* ptr, float val){
-    memset(ptr, 0, MESSAGE_LENGTH); // empty array  
-    ptr = ptr + 7; // point the pointer to the end of the array
-    int expandedVal = val * 10000; // 23.2345 -> 232345, 120.123 -> 120123
-    int counter = 0;
-    int digit; 
-    while (expandedVal > 0) {
-        digit = expandedVal % 10;
-        *ptr = digit + '0'; // convert to a char
-        counter++; ptr--;
-        if(counter == 4){
-            *ptr = '.';
-            ptr--;
-        }
-        expandedVal /= 10;
-    }
-}
-
-/*
-* This function prints out all the character elements inside an 8 character array
-*/
-void printData(char* ptr){
-    int counter = 0;
-    while(counter < MESSAGE_LENGTH){
-        pc.printf("%c", *ptr++);
-        counter++;
-    }
-    pc.printf("\r\n");
-}
\ No newline at end of file
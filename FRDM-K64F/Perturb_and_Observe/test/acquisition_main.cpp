@@ -0,0 +1,322 @@
+/*************************** acquisition_main.cpp ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * Perturb and Observe Algorithm: Filtered ADC Acquisition Test
+ *
+ * Purpose: Tests MpptAcquisition (../MPPT_LIBRARY/mppt_acquisition.h) and its filters.
+ *
+ *      1. Latency: a ramp goes through every filter; once the filter has settled, the distance
+ *         between the input and the filtered value must be the filter's latency() (within half a
+ *         sample).
+ *      2. Noise: the plant is held still and its input voltage pin is read many times, directly
+ *         and through every filter, under each noise model. Every filter must lower the standard
+ *         deviation of the reading, and the median must keep the spikes out.
+ *      3. Closed loop: the controller tracks the generated scenarios (mppt_scenarios.h) on the
+ *         raw pins and on the filtered readings, with ACQ_OVERSAMPLING samples per control period,
+ *         under each noise model.
+ *      4. Time alignment: with the converter's 40 kHz switching ripple on the input pins, the
+ *         plant is held at a fixed duty cycle and the controller's inPower (the product of the
+ *         filtered V_IN and HALL_IN readings) is compared with the power the array actually
+ *         delivered over the same control step, for every conversion schedule, with the samples
+ *         locked to the PWM (200 us, 8 PWM periods) and spread evenly over it (205 us, the firmware's
+ *         default), over a range of duty cycles and PWM phases. The spread schedules must have a
+ *         smaller error than the sequential, locked sampling the firmware used to do.
+ *
+ * Instructions: To compile code:
+ *                  $g++ -std=c++11 -O2 -I../MPPT_LIBRARY -o runAcq acquisition_main.cpp pv_plant.cpp mppt_scenarios.cpp
+ *               To run code: $./runAcq [scenarios] [seconds per scenario]
+ *               The exit code is 0 when every check passes.
+ *
+ *****************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "mppt_acquisition.h"
+#include "mppt_sim.h"
+#include "mppt_scenarios.h"
+
+#define ACQ_OVERSAMPLING    16          // samples per control period in the closed-loop runs
+#define RAMP_SLOPE          8           // counts per sample in the latency check
+#define RAMP_SAMPLES        400
+#define NOISE_READINGS      20000       // readings per filter in the noise check
+#define NOISE_MODEL_COUNT   3
+#define CONVERSION_TIME     5e-6        // assumed time of one AnalogIn conversion (s)
+#define ALIGN_SAMPLES       5           // samples per control step in the time alignment check (divides PWM_PERIOD_us)
+#define ALIGN_STEPS         40          // control steps measured per duty cycle and PWM phase
+#define ALIGN_PHASES        10          // PWM phases the sampling starts at
+#define ALIGN_PLANT_STEP    1e-6        // plant integration step in the time alignment check (s)
+#define ALIGN_IRRADIANCE    600         // W/m2; at full sun the HALL_IN ripple peaks clip at the top of the ADC range
+
+typedef BoxcarFilter<ACQ_OVERSAMPLING> Boxcar;
+typedef MedianFilter<ACQ_OVERSAMPLING - 1> Median;
+typedef IirFilter<3> Iir;
+
+/* The noise models every check runs under */
+static PvSensorNoise noiseModel(int n, const char **name)
+{
+    switch (n) {
+        case 0:  *name = "gaussian 5 mV";            return PvSensorNoise(0.005);
+        case 1:  *name = "gaussian 20 mV";           return PvSensorNoise(0.02);
+        default: *name = "5 mV + 2% spikes 300 mV";  return PvSensorNoise(0.005, 0.02, 0.3);
+    }
+}
+
+/* Returns the same, settable count on every channel */
+struct RampSource {
+    unsigned short counts;
+
+    unsigned short read_u16(MpptChannel) { return counts; }
+};
+
+/*
+* 1. Latency of one filter, measured on a ramp.
+*/
+template <class Filter>
+static bool checkLatency(const char *name)
+{
+    RampSource ramp = { 1000 };
+    MpptAcquisition<RampSource, Filter> acquisition(ramp);
+
+    acquisition.reset();
+    for (int n = 0; n < RAMP_SAMPLES; n++) {
+        ramp.counts += RAMP_SLOPE;
+        acquisition.sample();
+    }
+    double filtered = acquisition.read(V_IN) * ADC_FULL_SCALE;
+    double lag = (ramp.counts - filtered) / RAMP_SLOPE;
+    bool pass = fabs(lag - acquisition.latency()) <= 0.5
+                && abs((int)acquisition.read_u16(V_IN) - (int)floor(filtered + 0.5)) <= 1;
+
+    printf("%-12s %10.1f %10.2f %8s\n", name, acquisition.latency(), lag, pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+struct NoiseStats {
+    double deviation;       // standard deviation of the reading (V at the array)
+    double largest;         // largest distance from the noise free reading (V at the array)
+};
+
+/* Input voltage at the array for a reading of the V_IN pin */
+static double arrayVoltage(double fraction)
+{
+    return fraction * AIN_MULT * V_IN_MULT;
+}
+
+/*
+* 2. The V_IN reading of a plant that stands still, directly (NoFilter samples once per reading)
+* or through 'Filter' with ACQ_OVERSAMPLING samples per reading.
+*/
+template <class Filter>
+static NoiseStats measureNoise(const PvSensorNoise &noise, int oversampling)
+{
+    PvProfile profile;
+    PvPlant plant;
+    MpptAcquisition<PvPlant, Filter> acquisition(plant);
+    NoiseStats stats = { 0, 0 };
+    double sum = 0, squares = 0;
+
+    profile.add(0, PvConditions(1000, 25));
+    profile.add(1, PvConditions(1000, 25));
+    plant.reset(profile);
+    double exact = arrayVoltage(plant.read(V_IN));
+
+    plant.setSensorNoise(noise, 7);
+    acquisition.reset();
+    for (int n = 0; n < NOISE_READINGS; n++) {
+        for (int k = 0; k < oversampling; k++) acquisition.sample();
+        double v = arrayVoltage(acquisition.read(V_IN));
+        sum += v;
+        squares += v * v;
+        if (fabs(v - exact) > stats.largest) stats.largest = fabs(v - exact);
+    }
+    double mean = sum / NOISE_READINGS;
+    stats.deviation = sqrt(squares / NOISE_READINGS - mean * mean);
+    return stats;
+}
+
+static bool checkNoise(void)
+{
+    bool pass = true;
+    printf("2. Noise, V_IN reading of a still plant (V at the array), %d readings, %d samples each\n",
+           NOISE_READINGS, ACQ_OVERSAMPLING);
+    printf("%-26s %15s %15s %15s %15s\n", "Noise model", "raw", "boxcar", "median", "IIR");
+    for (int m = 0; m < NOISE_MODEL_COUNT; m++) {
+        const char *name;
+        PvSensorNoise noise = noiseModel(m, &name);
+        NoiseStats raw = measureNoise<NoFilter>(noise, 1);
+        NoiseStats boxcar = measureNoise<Boxcar>(noise, ACQ_OVERSAMPLING);
+        NoiseStats median = measureNoise<Median>(noise, ACQ_OVERSAMPLING);
+        NoiseStats iir = measureNoise<Iir>(noise, ACQ_OVERSAMPLING);
+
+        printf("%-26s %6.3f/%-8.3f %6.3f/%-8.3f %6.3f/%-8.3f %6.3f/%-8.3f\n", name, raw.deviation, raw.largest,
+               boxcar.deviation, boxcar.largest, median.deviation, median.largest, iir.deviation, iir.largest);
+        pass = pass && boxcar.deviation < raw.deviation && median.deviation < raw.deviation
+               && iir.deviation < raw.deviation;
+        if (noise.spikeProbability > 0) pass = pass && median.largest < boxcar.largest;
+    }
+    printf("(standard deviation/largest error)\n");
+    printf("%s\n\n", pass ? "PASS: every filter lowers the noise, the median keeps the spikes out"
+                          : "FAIL: a filter does not lower the noise");
+    return pass;
+}
+
+/*
+* 3. Mean tracking efficiency of 'Algorithm' over the scenarios, on the filtered readings
+* (oversampling > 1) or on the pins (oversampling == 1, NoFilter).
+*/
+template <class Filter, class Algorithm>
+static double meanTracking(const std::vector<MpptScenario> &scenarios, const PvSensorNoise &noise, int oversampling)
+{
+    double tracking = 0;
+    for (size_t i = 0; i < scenarios.size(); i++) {
+        typedef MpptAcquisition<PvPlant, Filter> Acquisition;
+        PvPlant plant;
+        Acquisition acquisition(plant);
+        NullTelemetry telemetry;
+        MpptController<Acquisition, PvPlant, NullTelemetry, Algorithm> mppt(acquisition, plant, telemetry);
+        MpptSimConfig config;
+
+        config.oversampling = oversampling;
+        plant.setSensorNoise(noise, scenarios[i].seed);
+        tracking += runClosedLoop(plant, mppt, acquisition, scenarios[i].profile, config).trackingEfficiency;
+    }
+    return tracking / scenarios.size();
+}
+
+template <class Algorithm>
+static void compareClosedLoop(const char *algorithm, const std::vector<MpptScenario> &scenarios)
+{
+    for (int m = 0; m < NOISE_MODEL_COUNT; m++) {
+        const char *name;
+        PvSensorNoise noise = noiseModel(m, &name);
+        printf("%-20s %-26s %9.2f%% %9.2f%% %9.2f%% %9.2f%%\n", algorithm, name,
+               100 * meanTracking<NoFilter, Algorithm>(scenarios, noise, 1),
+               100 * meanTracking<Boxcar, Algorithm>(scenarios, noise, ACQ_OVERSAMPLING),
+               100 * meanTracking<Median, Algorithm>(scenarios, noise, ACQ_OVERSAMPLING),
+               100 * meanTracking<Iir, Algorithm>(scenarios, noise, ACQ_OVERSAMPLING));
+    }
+}
+
+/* Keeps whatever the controller writes away from the plant, so the duty cycle stays put */
+struct HeldPwm {
+    void write(float) {}
+};
+
+struct AlignmentError {
+    double mean;            // mean |inPower error| / delivered power
+    double largest;
+};
+
+/*
+* 4. inPower error of 'Schedule' with one sample every 'samplePeriod' seconds and ALIGN_SAMPLES
+* samples (a boxcar) per control step.
+*/
+template <class Schedule>
+static AlignmentError measureAlignment(double samplePeriod)
+{
+    typedef MpptAcquisition<PvPlant, BoxcarFilter<ALIGN_SAMPLES>, Schedule> Acquisition;
+    static const double duties[] = { 0.62, 0.66, 0.70, 0.74 };
+    AlignmentError error = { 0, 0 };
+    int measured = 0;
+
+    for (size_t d = 0; d < sizeof(duties) / sizeof(duties[0]); d++) {
+        for (int phase = 0; phase < ALIGN_PHASES; phase++) {
+            PvProfile profile;
+            PvPlant plant;
+            Acquisition acquisition(plant);
+            HeldPwm pwm;
+            NullTelemetry telemetry;
+            MpptController<Acquisition, HeldPwm, NullTelemetry> mppt(acquisition, pwm, telemetry);
+
+            profile.add(0, PvConditions(ALIGN_IRRADIANCE, 25));
+            profile.add(1, PvConditions(ALIGN_IRRADIANCE, 25));
+            plant.reset(profile);
+            plant.setSwitchingRipple(true);
+            plant.setConversionTime(CONVERSION_TIME);
+            plant.write(duties[d]);
+            plant.run(0.05 + phase * PWM_PERIOD_us * 1e-6 / ALIGN_PHASES, ALIGN_PLANT_STEP); // settle, then shift the phase
+            acquisition.reset();
+
+            for (int step = 0; step < ALIGN_STEPS; step++) {
+                double t = plant.time();
+                double captured = plant.energyCaptured();
+                for (int k = 0; k < ALIGN_SAMPLES; k++) {
+                    plant.run(samplePeriod, ALIGN_PLANT_STEP);
+                    acquisition.sample();
+                }
+                mppt.step();
+                double delivered = (plant.energyCaptured() - captured) / (plant.time() - t);
+                double e = fabs(mppt.readings().inPower - delivered) / delivered;
+                error.mean += e;
+                if (e > error.largest) error.largest = e;
+                measured++;
+            }
+        }
+    }
+    error.mean /= measured;
+    return error;
+}
+
+template <class Schedule>
+static AlignmentError printAlignment(const char *name, double samplePeriod)
+{
+    AlignmentError e = measureAlignment<Schedule>(samplePeriod);
+    printf("%-14s %10.0f %10d %10.1f %11.2f%% %11.2f%%\n", name, samplePeriod * 1e6, Schedule::conversions(),
+           Schedule::skew() * CONVERSION_TIME * 1e6, 100 * e.mean, 100 * e.largest);
+    return e;
+}
+
+static bool checkAlignment(void)
+{
+    double locked = 8 * PWM_PERIOD_us * 1e-6;                       // the PWM phase of every sample is the same
+    double spread = locked + PWM_PERIOD_us * 1e-6 / ALIGN_SAMPLES;  // the samples walk evenly across the PWM period
+
+    printf("4. Time alignment, inPower against the delivered power, 40 kHz ripple, %.0f us per conversion\n",
+           CONVERSION_TIME * 1e6);
+    printf("%-14s %10s %10s %10s %12s %12s\n", "Schedule", "Period(us)", "Convs", "Skew(us)", "Mean error", "Largest");
+    AlignmentError before = printAlignment<SequentialSchedule>("sequential", locked);
+    printAlignment<PairedSchedule>("paired", locked);
+    printAlignment<InterpolatedSchedule>("interpolated", locked);
+    printAlignment<SequentialSchedule>("sequential", spread);
+    AlignmentError paired = printAlignment<PairedSchedule>("paired", spread);
+    AlignmentError interpolated = printAlignment<InterpolatedSchedule>("interpolated", spread);
+
+    bool pass = interpolated.mean < before.mean && paired.mean < before.mean;
+    printf("%s\n\n", pass ? "PASS: time-aligned samples spread over the PWM period lower the power error"
+                          : "FAIL: time alignment does not lower the power error");
+    return pass;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned count = argc > 1 ? atoi(argv[1]) : 20;
+    double duration = argc > 2 ? atof(argv[2]) : 3.0;
+    MpptSimConfig config;
+    double samplePeriod = config.controlPeriod / ACQ_OVERSAMPLING;
+    bool pass = true;
+
+    printf("1. Latency on a %d count/sample ramp (samples)\n", RAMP_SLOPE);
+    printf("%-12s %10s %10s\n", "Filter", "latency()", "measured");
+    pass = checkLatency<NoFilter>("none") && pass;
+    pass = checkLatency<Boxcar>("boxcar 16") && pass;
+    pass = checkLatency<Median>("median 15") && pass;
+    pass = checkLatency<Iir>("IIR 1/8") && pass;
+    printf("At %.0f samples/s: boxcar %.1f ms, median %.1f ms, IIR %.1f ms\n\n", 1 / samplePeriod,
+           1e3 * Boxcar::latency() * samplePeriod, 1e3 * Median::latency() * samplePeriod,
+           1e3 * Iir::latency() * samplePeriod);
+
+    pass = checkNoise() && pass;
+
+    std::vector<MpptScenario> scenarios = makeScenarioSet(count, 464, duration);
+    printf("3. Closed loop, %u scenarios x %.1f s at %.0f Hz, %d samples per step, mean tracking efficiency\n",
+           count, duration, 1 / config.controlPeriod, ACQ_OVERSAMPLING);
+    printf("%-20s %-26s %10s %10s %10s %10s\n", "Algorithm", "Noise model", "raw", "boxcar", "median", "IIR");
+    compareClosedLoop<PerturbAndObserve>("P&O", scenarios);
+    compareClosedLoop<VariableStepPerturbAndObserve>("Variable-step P&O", scenarios);
+    compareClosedLoop<IncrementalConductance>("IncCond", scenarios);
+    printf("\n");
+
+    pass = checkAlignment() && pass;
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+/*************************** batch_main.cpp ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * Perturb and Observe Algorithm: Multi-Core Scenario Sweep
+ *
+ * Purpose: Runs the closed-loop simulation (mppt_sim.h) over a large generated scenario set
+ * (mppt_scenarios.h) on every core of the host and prints one summary table per tracking
+ * algorithm, followed by a head-to-head comparison of every algorithm against the first one
+ * (P&O) on the same scenarios. Every run gets its own PvPlant and its own MpptController, so no
+ * state is shared between runs and the result does not depend on the number of threads.
+ *
+ * Instructions: To compile code:
+ *                  $g++ -std=c++11 -O2 -pthread -I../MPPT_LIBRARY -o runBatch batch_main.cpp pv_plant.cpp mppt_scenarios.cpp
+ *               To run code: $./runBatch [scenarios] [threads] [seconds per scenario] [seed]
+ *                  (threads = 0 uses every core)
+ *               To print every scenario's result: $./runBatch csv [scenarios] [threads] [seconds] [seed]
+ *
+ *****************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "mppt_sim.h"
+#include "mppt_scenarios.h"
+#include "work_pool.h"
+
+/*
+* Per-category totals for the summary table.
+*/
+struct CategorySummary {
+    int    count;
+    int    reached;             // scenarios that settled at the MPP
+    double tracking;            // sum of tracking efficiencies
+    double worstTracking;
+    double timeToMpp;           // sum over the scenarios that settled
+    double oscillation;         // sum of peak-to-peak voltages
+    double rippleLoss;
+
+    CategorySummary() : count(0), reached(0), tracking(0), worstTracking(1), timeToMpp(0), oscillation(0), rippleLoss(0) {}
+
+    void add(const MpptSimResult &r){
+        count++;
+        tracking += r.trackingEfficiency;
+        if (r.trackingEfficiency < worstTracking) worstTracking = r.trackingEfficiency;
+        if (r.timeToMpp >= 0) {
+            reached++;
+            timeToMpp += r.timeToMpp;
+        }
+        oscillation += r.oscillationVoltage;
+        rippleLoss += r.rippleLoss;
+    }
+
+    void print(const char *name) const {
+        if (count == 0) return;
+        printf("%-10s %6d %9.2f%% %9.2f%% %8.1f%% %12.3f %9.3f %9.2f%%\n", name, count,
+               100 * tracking / count, 100 * worstTracking, 100.0 * reached / count,
+               reached ? timeToMpp / reached : -1, oscillation / count, 100 * rippleLoss / count);
+    }
+};
+
+/* Runs one scenario with a fresh plant and a fresh controller running 'Algorithm' */
+template <class Algorithm>
+MpptSimResult runScenario(const MpptScenario &scenario, const MpptSimConfig &config)
+{
+    PvPlant plant;
+    NullTelemetry telemetry;
+    SimController<Algorithm> mppt(plant, plant, telemetry);
+
+    plant.setSensorNoise(scenario.sensorNoise, scenario.seed);
+    return runClosedLoop(plant, mppt, scenario.profile, config);
+}
+
+/*
+* The algorithms being compared. The first one is the baseline the others are measured against.
+*/
+struct AlgorithmEntry {
+    const char *name;
+    MpptSimResult (*run)(const MpptScenario &, const MpptSimConfig &);
+};
+
+static const AlgorithmEntry ALGORITHMS[] = {
+    { "P&O",     &runScenario<PerturbAndObserve> },
+    { "FixedP&O", &runScenario<FixedStepPerturbAndObserve> },
+    { "VarP&O",  &runScenario<VariableStepPerturbAndObserve> },
+    { "IncCond", &runScenario<IncrementalConductance> },
+    { "Scan+VarP&O", &runScenario<SimGlobalScan> },
+};
+
+#define ALGORITHM_COUNT (sizeof(ALGORITHMS) / sizeof(ALGORITHMS[0]))
+
+int main(int argc, char **argv)
+{
+    bool csv = (argc > 1 && strcmp(argv[1], "csv") == 0);
+    int arg = csv ? 2 : 1;
+    unsigned count = argc > arg ? atoi(argv[arg]) : 500;
+    unsigned threads = argc > arg + 1 ? atoi(argv[arg + 1]) : 0;
+    double duration = argc > arg + 2 ? atof(argv[arg + 2]) : 3.0;
+    unsigned seed = argc > arg + 3 ? atoi(argv[arg + 3]) : 464;
+
+    MpptSimConfig config;
+    config.steadyStateWindow = 0.5;
+    std::vector<MpptScenario> scenarios = makeScenarioSet(count, seed, duration);
+    size_t runs = ALGORITHM_COUNT * scenarios.size();
+    std::vector<MpptSimResult> results(runs);      // results[a * scenarios + i]
+    WorkStealingPool pool(threads);
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    pool.run(runs, [&](size_t n) {
+        results[n] = ALGORITHMS[n / scenarios.size()].run(scenarios[n % scenarios.size()], config);
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    if (csv) {
+        printf("algorithm,index,category,name,tracking,time_to_mpp,vpp,ripple_loss\n");
+        for (size_t n = 0; n < runs; n++) {
+            size_t i = n % scenarios.size();
+            printf("%s,%u,%s,%s,%.5f,%.3f,%.4f,%.5f\n", ALGORITHMS[n / scenarios.size()].name, (unsigned)i,
+                   scenarioCategoryName(scenarios[i].category), scenarios[i].name.c_str(), results[n].trackingEfficiency,
+                   results[n].timeToMpp, results[n].oscillationVoltage, results[n].rippleLoss);
+        }
+        return 0;
+    }
+
+    printf("Scenarios: %u x %.1f s, seed %u, control period %.1f ms\n", count, duration, seed, config.controlPeriod * 1e3);
+    printf("Threads: %u, steals: %lu, wall time: %.2f s (%.1f runs/s, %.0fx real time)\n",
+           pool.threads(), pool.steals(), seconds, runs / seconds, runs * duration / seconds);
+
+    for (size_t a = 0; a < ALGORITHM_COUNT; a++) {
+        const MpptSimResult *r = &results[a * scenarios.size()];
+        CategorySummary categories[SCENARIO_CATEGORY_COUNT];
+        CategorySummary total;
+        for (size_t i = 0; i < scenarios.size(); i++) {
+            categories[scenarios[i].category].add(r[i]);
+            total.add(r[i]);
+        }
+
+        printf("\n%s\n", ALGORITHMS[a].name);
+        printf("%-10s %6s %10s %10s %9s %12s %9s %10s\n", "Category", "Runs", "Tracking", "Worst", "Settled",
+               "TimeToMPP(s)", "Vpp(V)", "Ripple");
+        for (int c = 0; c < SCENARIO_CATEGORY_COUNT; c++) {
+            categories[c].print(scenarioCategoryName((MpptScenarioCategory)c));
+        }
+        total.print("All");
+    }
+
+    /* Head to head: the same scenario, the same noise, only the algorithm differs */
+    for (size_t a = 1; a < ALGORITHM_COUNT; a++) {
+        const MpptSimResult *base = &results[0];
+        const MpptSimResult *r = &results[a * scenarios.size()];
+        int wins = 0, losses = 0;
+        double gained = 0, captured = 0;
+        for (size_t i = 0; i < scenarios.size(); i++) {
+            double d = r[i].trackingEfficiency - base[i].trackingEfficiency;
+            if (d > 1e-4) wins++;
+            else if (d < -1e-4) losses++;
+            gained += r[i].energyCaptured - base[i].energyCaptured;
+            captured += base[i].energyCaptured;
+        }
+        printf("\n%s vs %s: better on %d, worse on %d, tied on %d of %u scenarios; energy captured %+.1f J (%+.1f%%)\n",
+               ALGORITHMS[a].name, ALGORITHMS[0].name, wins, losses, (int)scenarios.size() - wins - losses,
+               (unsigned)scenarios.size(), gained, captured > 0 ? 100 * gained / captured : 0);
+    }
+    return 0;
+}
@@ -0,0 +1,265 @@
+/*************************** calibration_main.cpp ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * Perturb and Observe Algorithm: Runtime Calibration Test
+ *
+ * Purpose: Tests the calibration subsystem of ../MPPT_LIBRARY/mppt_calibration.h.
+ *
+ *      1. Store: a calibration saved to the store (a file, see file_storage.h) loads back bit for
+ *         bit; a missing, truncated, corrupt or older-version store is refused.
+ *      2. Coefficients: every ADC count of every channel through the precomputed coefficients,
+ *         against the formulas the controller used to evaluate every step, both against double.
+ *      3. Auto-zero: boards whose Hall sensors have their own zero-current output are auto-zeroed
+ *         on the idle plant; the measured zeros must be within 1 mV. A zero too far from its
+ *         nominal value, a noisy sensor and current flowing during the auto-zero are refused.
+ *      4. Closed loop: the same boards track the generated scenarios (mppt_scenarios.h) with the
+ *         nominal constants of mppt_config.h and with the auto-zeroed calibration.
+ *
+ * Instructions: To compile code:
+ *                  $g++ -std=c++11 -O2 -I../MPPT_LIBRARY -o runCal calibration_main.cpp pv_plant.cpp mppt_scenarios.cpp
+ *               To run code: $./runCal [scenarios] [seconds per scenario]
+ *               The exit code is 0 when every check passes.
+ *
+ *****************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "mppt_calibration.h"
+#include "mppt_sim.h"
+#include "mppt_scenarios.h"
+#include "file_storage.h"
+
+#define STORE_FILE          "calibration_test.bin"
+#define BOARD_COUNT         200         // boards in the auto-zero check
+#define BOARD_ZERO_SPREAD   0.2         // Hall zeros are nominal +- this much (V)
+#define BOARD_NOISE         0.005       // AnalogIn pin noise during the auto-zero (V)
+#define ZERO_ERROR_LIMIT    0.001       // largest auto-zero error (V)
+
+/* Uniform random number in [lo, hi) (xorshift32), so the boards are the same on every run */
+static double randomBetween(unsigned &state, double lo, double hi)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return lo + (hi - lo) * (state / 4294967296.0);
+}
+
+static bool sameCalibration(const MpptCalibration &a, const MpptCalibration &b)
+{
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+/*
+* 1. Round trip and refusals of the store.
+*/
+static bool checkStore(void)
+{
+    FileStorage file(STORE_FILE);
+    MpptCalibrationStore<FileStorage> store(file);
+    MpptCalibration saved, loaded;
+    MpptCalibrationRecord record;
+    bool pass = true;
+
+    remove(STORE_FILE);
+    bool missing = !store.load(loaded) && sameCalibration(loaded, MpptCalibration());
+
+    saved.hallInNoCurrent = 2.5311f;
+    saved.hallOutNoCurrent = 2.4987f;
+    saved.iInDiv = 0.1802f;
+    bool roundTrip = store.save(saved) && store.load(loaded) && sameCalibration(saved, loaded);
+
+    file.read(&record, sizeof(record));
+    ((unsigned char *)&record.calibration)[5] ^= 0x10;
+    file.write(&record, sizeof(record));
+    loaded = MpptCalibration();
+    bool corrupt = !store.load(loaded) && sameCalibration(loaded, MpptCalibration());
+
+    record.calibration = saved;
+    record.version = CALIBRATION_VERSION + 1;
+    record.crc = mpptCrc32(&record, sizeof(record) - sizeof(record.crc));
+    file.write(&record, sizeof(record));
+    bool version = !store.load(loaded);
+
+    file.write(&record, sizeof(record) / 2);
+    bool truncated = !store.load(loaded);
+    remove(STORE_FILE);
+
+    pass = missing && roundTrip && corrupt && version && truncated;
+    printf("1. Store (%u byte record in %s)\n", (unsigned)sizeof(MpptCalibrationRecord), STORE_FILE);
+    printf("missing: %s, round trip: %s, corrupt: %s, other version: %s, truncated: %s\n",
+           missing ? "refused" : "LOADED", roundTrip ? "identical" : "DIFFERENT", corrupt ? "refused" : "LOADED",
+           version ? "refused" : "LOADED", truncated ? "refused" : "LOADED");
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/*
+* 2. Largest error of the precomputed coefficients and of the old per-step formulas.
+*/
+static bool checkCoefficients(void)
+{
+    static const char *names[MPPT_CHANNEL_COUNT] = { "HALL_IN (A)", "HALL_OUT (A)", "V_OUT (V)", "V_IN (V)" };
+    MpptCalibration cal;
+    MpptCoefficients coefficients(cal);
+    bool pass = true;
+
+    printf("2. Coefficients, every ADC count, largest error against double\n");
+    printf("%-14s %14s %14s\n", "Channel", "per step", "precomputed");
+    for (int c = 0; c < MPPT_CHANNEL_COUNT; c++) {
+        double oldError = 0, newError = 0;
+        for (unsigned counts = 0; counts <= 65535; counts++) {
+            float reading = counts * (1.0f / (float)ADC_FULL_SCALE);
+            double r = counts / ADC_FULL_SCALE, exact = 0;
+            float old = 0;
+            switch (c) {
+                case HALL_IN:
+                    exact = (r * cal.ainMult - cal.hallInNoCurrent) / cal.iInDiv;
+                    old = (reading * cal.ainMult - cal.hallInNoCurrent) / cal.iInDiv;
+                    break;
+                case HALL_OUT:
+                    exact = (r * cal.ainMult - cal.hallOutNoCurrent) / cal.iOutDiv;
+                    old = (reading * cal.ainMult - cal.hallOutNoCurrent) / cal.iOutDiv;
+                    break;
+                case V_OUT:
+                    exact = r * cal.ainMult * cal.vOutMult;
+                    old = (reading * cal.ainMult) * cal.vOutMult;
+                    break;
+                default:
+                    exact = r * cal.ainMult * cal.vInMult;
+                    old = (reading * cal.ainMult) * cal.vInMult;
+                    break;
+            }
+            double e = fabs(coefficients.scale((MpptChannel)c, reading) - exact);
+            if (e > newError) newError = e;
+            if (fabs(old - exact) > oldError) oldError = fabs(old - exact);
+        }
+        printf("%-14s %14.2e %14.2e\n", names[c], oldError, newError);
+        pass = pass && newError < 1e-4;
+    }
+    printf("%s\n\n", pass ? "PASS: precomputed coefficients within 0.1 mA / 0.1 mV"
+                          : "FAIL: precomputed coefficients off");
+    return pass;
+}
+
+/* The true calibration of board 'n': its own Hall sensor zeros */
+static MpptCalibration boardCalibration(unsigned n, double spread)
+{
+    unsigned state = 0x9E3779B9u ^ (n * 2654435761u);
+    MpptCalibration cal;
+    for (int k = 0; k < 4; k++) randomBetween(state, 0, 1);
+    cal.hallInNoCurrent += randomBetween(state, -spread, spread);
+    cal.hallOutNoCurrent += randomBetween(state, -spread, spread);
+    return cal;
+}
+
+/* Auto-zeroes the idle plant made of 'board' into 'measured' */
+static MpptAutoZeroStatus autoZero(const MpptCalibration &board, MpptCalibration &measured, double noise,
+                                   const BoostParams &boost = BoostParams())
+{
+    PvProfile profile;
+    PvPlant plant(PvArrayParams(), boost, board);
+    profile.add(0, PvConditions(1000, 25));
+    profile.add(1, PvConditions(1000, 25));
+    plant.reset(profile);
+    plant.run(0.01, 5e-6);                  // the converter idles for 10 ms
+    plant.setSensorNoise(noise, 11);
+    return mpptAutoZero(plant, measured);
+}
+
+/*
+* 3. Auto-zero of BOARD_COUNT boards, and the cases it must refuse.
+*/
+static bool checkAutoZero(void)
+{
+    double largest = 0;
+    int failed = 0;
+
+    for (unsigned n = 0; n < BOARD_COUNT; n++) {
+        MpptCalibration board = boardCalibration(n, BOARD_ZERO_SPREAD), measured;
+        if (autoZero(board, measured, BOARD_NOISE) != AUTO_ZERO_OK) {
+            failed++;
+            continue;
+        }
+        double e = fmax(fabs(measured.hallInNoCurrent - board.hallInNoCurrent),
+                        fabs(measured.hallOutNoCurrent - board.hallOutNoCurrent));
+        if (e > largest) largest = e;
+    }
+
+    MpptCalibration far = MpptCalibration(), measured;
+    far.hallInNoCurrent += 2 * AUTO_ZERO_TOLERANCE;
+    MpptAutoZeroStatus outOfRange = autoZero(far, measured, BOARD_NOISE);
+    MpptAutoZeroStatus noisy = autoZero(MpptCalibration(), measured, 0.05);
+    BoostParams lowBattery;
+    lowBattery.batteryVoltage = 40;         // below the array's open circuit voltage: current flows at idle
+    MpptAutoZeroStatus flowing = autoZero(MpptCalibration(), measured, BOARD_NOISE, lowBattery);
+    bool unchanged = sameCalibration(measured, MpptCalibration());
+
+    bool pass = failed == 0 && largest <= ZERO_ERROR_LIMIT && outOfRange == AUTO_ZERO_OUT_OF_RANGE
+                && noisy == AUTO_ZERO_UNSTABLE && flowing != AUTO_ZERO_OK && unchanged;
+    printf("3. Auto-zero, %d boards with Hall zeros within +-%.0f mV, %.0f mV noise, %d readings per sensor\n",
+           BOARD_COUNT, BOARD_ZERO_SPREAD * 1e3, BOARD_NOISE * 1e3, AUTO_ZERO_SAMPLES);
+    printf("refused: %d, largest error: %.3f mV\n", failed, largest * 1e3);
+    printf("zero %.0f mV off: %s, 50 mV noise: %s, current flowing: %s, calibration %s\n",
+           2 * AUTO_ZERO_TOLERANCE * 1e3, mpptAutoZeroStatusName(outOfRange), mpptAutoZeroStatusName(noisy),
+           mpptAutoZeroStatusName(flowing), unchanged ? "unchanged" : "CHANGED");
+    printf("%s\n\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+/*
+* 4. Mean tracking efficiency of 'Algorithm' on boards whose Hall zeros are 'offset' volts above
+* (odd scenarios: below) the nominal values, with and without auto-zero.
+*/
+template <class Algorithm>
+static void compareCalibration(const char *name, const std::vector<MpptScenario> &scenarios, double offset)
+{
+    double nominal = 0, calibrated = 0;
+    for (size_t i = 0; i < scenarios.size(); i++) {
+        MpptCalibration board;
+        double sign = (i & 1) ? -1 : 1;
+        board.hallInNoCurrent += sign * offset;
+        board.hallOutNoCurrent += sign * offset;
+
+        for (int zeroed = 0; zeroed < 2; zeroed++) {
+            PvPlant plant(PvArrayParams(), BoostParams(), board);
+            NullTelemetry telemetry;
+            MpptController<PvPlant, PvPlant, NullTelemetry, Algorithm> mppt(plant, plant, telemetry);
+
+            plant.reset(scenarios[i].profile);
+            if (zeroed) {
+                MpptCalibration cal;
+                mpptAutoZero(plant, cal);
+                mppt.setCalibration(cal);
+            }
+            plant.setSensorNoise(scenarios[i].sensorNoise, scenarios[i].seed);
+            double tracking = runClosedLoop(plant, mppt, scenarios[i].profile).trackingEfficiency;
+            (zeroed ? calibrated : nominal) += tracking;
+        }
+    }
+    printf("%-20s %8.0f mV %11.2f%% %11.2f%%\n", name, offset * 1e3,
+           100 * nominal / scenarios.size(), 100 * calibrated / scenarios.size());
+}
+
+int main(int argc, char **argv)
+{
+    unsigned count = argc > 1 ? atoi(argv[1]) : 20;
+    double duration = argc > 2 ? atof(argv[2]) : 3.0;
+    static const double offsets[] = { 0.0, 0.05, 0.1, 0.2 };
+
+    bool pass = checkStore();
+    pass = checkCoefficients() && pass;
+    pass = checkAutoZero() && pass;
+
+    std::vector<MpptScenario> scenarios = makeScenarioSet(count, 464, duration);
+    printf("4. Closed loop, %u scenarios x %.1f s, Hall zeros off by +-offset, mean tracking efficiency\n",
+           count, duration);
+    printf("%-20s %11s %12s %12s\n", "Algorithm", "Offset", "nominal", "auto-zero");
+    for (size_t k = 0; k < sizeof(offsets) / sizeof(offsets[0]); k++) {
+        compareCalibration<VariableStepPerturbAndObserve>("Variable-step P&O", scenarios, offsets[k]);
+        compareCalibration<IncrementalConductance>("IncCond", scenarios, offsets[k]);
+    }
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+/*************************** file_storage.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * Perturb and Observe Algorithm: Persistent Store Emulated as a File
+ *
+ * Purpose: The host version of the board's calibration flash sector, for MpptCalibrationStore
+ * (../MPPT_LIBRARY/mppt_calibration.h). read() fails if the file is missing or too short;
+ * write() replaces the whole file, as erasing and programming the sector does on the board.
+ *
+ *****************************************************************************************/
+#ifndef _FILE_STORAGE_H_
+#define _FILE_STORAGE_H_
+
+#include <stdio.h>
+#include <string>
+
+class FileStorage
+{
+public:
+    FileStorage(const std::string &path) : _path(path) {}
+
+    bool read(void *data, unsigned size){
+        FILE *f = fopen(_path.c_str(), "rb");
+        if (!f) return false;
+        bool ok = fread(data, 1, size, f) == size;
+        fclose(f);
+        return ok;
+    }
+
+    bool write(const void *data, unsigned size){
+        FILE *f = fopen(_path.c_str(), "wb");
+        if (!f) return false;
+        bool ok = fwrite(data, 1, size, f) == size;
+        return fclose(f) == 0 && ok;
+    }
+
+    const std::string &path(void) const { return _path; }
+
+private:
+    std::string _path;
+};
+
+#endif // _FILE_STORAGE_H_
@@ -0,0 +1,334 @@
+/*************************** fixed_main.cpp ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * Perturb and Observe Algorithm: Fixed-Point Controller Test
+ *
+ * Purpose: Compares MpptFixedController (../MPPT_LIBRARY/mppt_fixed.h) with the float
+ * MpptController it can replace.
+ *
+ *      1. Scaling: every ADC count (0 - 65535) of every channel goes through both controllers and
+ *         is compared with the exact result computed in double. The fixed-point path must stay
+ *         within 1 Q16 LSB (15 uV / 15 uA) of it.
+ *      2. Duty cycle: a million random reference/output voltage pairs go through both
+ *         controllers; the PWM compare value of the fixed-point path must never be more than one
+ *         count away from the exact one.
+ *      3. Closed loop: both controllers track the generated scenarios (mppt_scenarios.h), each on
+ *         its own plant. The tracking algorithms branch on the sign of small power differences,
+ *         so the two runs are not identical step for step; the tracking efficiencies are compared.
+ *      4. Time: time per controller step of both controllers over ADC counts recorded in the
+ *         closed-loop runs, publishing nowhere and publishing into the snapshot the firmware's
+ *         control interrupt writes (MpptSnapshot, MpptFixedSnapshot: Q16, no float conversion).
+ *         On x86 hosts this is the time stamp counter, elsewhere nanoseconds. The host has a fast
+ *         FPU, so these numbers say little about the FRDM-K64F; build the firmware with
+ *         MPPT_CYCLE_COUNT defined to get the DWT cycle counts of both controllers on the board.
+ *
+ * Instructions: To compile code:
+ *                  $g++ -std=c++11 -O2 -I../MPPT_LIBRARY -o runFixed fixed_main.cpp pv_plant.cpp mppt_scenarios.cpp
+ *               To run code: $./runFixed [scenarios] [seconds per scenario]
+ *               The exit code is 0 when every check passes.
+ *
+ *****************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "mppt_fixed.h"
+#include "mppt_snapshot.h"
+#include "mppt_sim.h"
+#include "mppt_scenarios.h"
+
+#define PWM_COUNTS      1500        // FTM counts per 25 us PWM period at the K64F's 60 MHz bus clock
+#define TIMED_STEPS     4000000     // controller steps timed per controller
+
+static inline unsigned long long cycleCounter(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/* Returns the same ADC counts on every channel; read() is AnalogIn::read() */
+struct ConstantSensor {
+    unsigned short counts;
+
+    unsigned short read_u16(MpptChannel) { return counts; }
+    float read(MpptChannel) { return counts * (1.0f / (float)ADC_FULL_SCALE); }
+};
+
+/* Replays recorded ADC counts in the order the controllers read them */
+struct ReplaySensor {
+    const unsigned short *next;
+
+    unsigned short read_u16(MpptChannel) { return *next++; }
+    float read(MpptChannel) { return *next++ * (1.0f / (float)ADC_FULL_SCALE); }
+};
+
+/* Reads the plant and records every count read */
+struct RecordingSensor {
+    PvPlant *plant;
+    std::vector<unsigned short> *counts;
+
+    float read(MpptChannel channel) {
+        unsigned short c = plant->read_u16(channel);
+        counts->push_back(c);
+        return c * (1.0f / (float)ADC_FULL_SCALE);
+    }
+};
+
+/* Keeps the last duty cycle written */
+struct CapturePwm {
+    float dutyCycle;
+    q16_t dutyCycleQ16;
+
+    void write(float d) { dutyCycle = d; }
+    void write_q16(q16_t d) { dutyCycleQ16 = d; }
+};
+
+/* Forces the compiler to produce every duty cycle while the controllers are timed */
+struct SinkPwm {
+    volatile float dutyCycle;
+    volatile q16_t dutyCycleQ16;
+
+    void write(float d) { dutyCycle = d; }
+    void write_q16(q16_t d) { dutyCycleQ16 = d; }
+};
+
+/* xorshift32 */
+static unsigned nextRandom(unsigned *seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+/* PWM compare value the duty cycle turns into, as PwmOut::write() truncates it */
+static int pwmCounts(double dutyCycle) { return (int)floor(dutyCycle * PWM_COUNTS); }
+
+/*
+* 1. Every count of every channel: largest error of both paths against the exact value, in Q16 LSB.
+*/
+static bool checkScaling(void)
+{
+    ConstantSensor sensor;
+    CapturePwm pwm;
+    NullTelemetry telemetry;
+    MpptCalibration cal;
+    MpptController<ConstantSensor, CapturePwm, NullTelemetry> floatMppt(sensor, pwm, telemetry);
+    MpptFixedController<ConstantSensor, CapturePwm, NullTelemetry> fixedMppt(sensor, pwm, telemetry);
+    const char *names[] = { "InCurrent", "OutCurrent", "OutVoltage", "InVoltage" };
+    double floatError[4] = {0}, fixedError[4] = {0};
+
+    for (unsigned c = 0; c <= 65535; c++) {
+        sensor.counts = (unsigned short)c;
+        floatMppt.step();
+        fixedMppt.step();
+
+        double pin = c / ADC_FULL_SCALE * cal.ainMult;
+        double exact[4] = {
+            (pin - cal.hallInNoCurrent) / cal.iInDiv,
+            (pin - cal.hallOutNoCurrent) / cal.iOutDiv,
+            pin * cal.vOutMult,
+            pin * cal.vInMult
+        };
+        const MpptReadings &f = floatMppt.readings();
+        const MpptFixedReadings &q = fixedMppt.fixedReadings();
+        double floatValue[4] = { f.inCurrent, f.outCurrent, f.outVoltage, f.inVoltage };
+        double fixedValue[4] = { (double)q.inCurrent, (double)q.outCurrent, (double)q.outVoltage, (double)q.inVoltage };
+
+        for (int k = 0; k < 4; k++) {
+            double e = fabs(floatValue[k] - exact[k]) * Q16_ONE;
+            if (e > floatError[k]) floatError[k] = e;
+            e = fabs(fixedValue[k] - exact[k] * Q16_ONE);
+            if (e > fixedError[k]) fixedError[k] = e;
+        }
+    }
+
+    bool pass = true;
+    printf("1. Scaling, all 65536 counts per channel, largest error against double (Q16 LSB)\n");
+    printf("%-12s %10s %10s\n", "Channel", "float", "fixed");
+    for (int k = 0; k < 4; k++) {
+        printf("%-12s %10.3f %10.3f\n", names[k], floatError[k], fixedError[k]);
+        if (fixedError[k] > 1.0) pass = false;
+    }
+    printf("%s\n\n", pass ? "PASS: fixed point within 1 LSB" : "FAIL: fixed point more than 1 LSB off");
+    return pass;
+}
+
+/* An algorithm that holds whatever reference voltage it is given, to test the duty cycle alone */
+struct HeldReference {
+    float reference;
+
+    void reset(float, float) {}
+    float update(float, float) { return reference; }
+    float referenceVoltage(void) const { return reference; }
+};
+
+struct HeldReferenceQ16 {
+    q16_t reference;
+
+    void reset(q16_t, q16_t) {}
+    q16_t update(q16_t, q16_t) { return reference; }
+    q16_t referenceVoltage(void) const { return reference; }
+};
+
+/*
+* 2. Duty cycle for random reference and output voltages. Q16 values up to 256 V have 24
+* significant bits, so both controllers see exactly the same voltages.
+*/
+static bool checkDutyCycle(long pairs)
+{
+    ConstantSensor sensor;
+    CapturePwm pwm;
+    NullTelemetry telemetry;
+    MpptController<ConstantSensor, CapturePwm, NullTelemetry, HeldReference> floatMppt(sensor, pwm, telemetry);
+    MpptFixedController<ConstantSensor, CapturePwm, NullTelemetry, HeldReferenceQ16> fixedMppt(sensor, pwm, telemetry);
+    unsigned seed = 464;
+    long floatDiffers = 0, fixedDiffers = 0;
+    int floatLargest = 0, fixedLargest = 0;
+    double fixedError = 0;
+
+    for (long n = 0; n < pairs; n++) {
+        q16_t outVoltage = (q16_t)(nextRandom(&seed) % (200 * Q16_ONE)) + Q16_ONE;
+        q16_t reference = (q16_t)(nextRandom(&seed) % (unsigned)(outVoltage + 10 * Q16_ONE)) - 5 * Q16_ONE;
+        floatMppt.algorithm().reference = q16ToFloat(reference);
+        fixedMppt.algorithm().reference = reference;
+        floatMppt.update(60, 1, q16ToFloat(outVoltage), 1);
+        fixedMppt.update(60 * Q16_ONE, Q16_ONE, outVoltage, Q16_ONE);
+
+        double exact = (double)(outVoltage - reference) / outVoltage;
+        if (exact >= MAX_DUTY_CYCLE) exact = MAX_DUTY_CYCLE;
+        if (exact < MIN_DUTY_CYCLE) exact = MIN_DUTY_CYCLE;
+        double fixed = pwm.dutyCycleQ16 / (double)Q16_ONE;
+        if (fabs(fixed - exact) > fixedError) fixedError = fabs(fixed - exact);
+
+        int d = abs(pwmCounts(pwm.dutyCycle) - pwmCounts(exact));
+        if (d) floatDiffers++;
+        if (d > floatLargest) floatLargest = d;
+        d = abs(pwmCounts(fixed) - pwmCounts(exact));
+        if (d) fixedDiffers++;
+        if (d > fixedLargest) fixedLargest = d;
+    }
+
+    bool pass = fixedLargest <= 1;
+    printf("2. Duty cycle, %ld random reference/output voltage pairs, PWM compare value (%d per period) against double\n",
+           pairs, PWM_COUNTS);
+    printf("float: %ld differ (largest %d count), fixed: %ld differ (largest %d count), largest fixed duty error %.2e\n",
+           floatDiffers, floatLargest, fixedDiffers, fixedLargest, fixedError);
+    printf("%s\n\n", pass ? "PASS: fixed point never more than 1 count off" : "FAIL: fixed point more than 1 count off");
+    return pass;
+}
+
+/* Closed-loop tracking of both controllers, each on its own plant, over the same scenarios */
+template <class Algorithm>
+static void compareClosedLoop(const char *name, const std::vector<MpptScenario> &scenarios)
+{
+    double floatTracking = 0, fixedTracking = 0, largest = 0;
+    for (size_t i = 0; i < scenarios.size(); i++) {
+        PvPlant floatPlant, fixedPlant;
+        NullTelemetry telemetry;
+        MpptController<PvPlant, PvPlant, NullTelemetry, Algorithm> floatMppt(floatPlant, floatPlant, telemetry);
+        MpptFixedController<PvPlant, PvPlant, NullTelemetry, typename MpptFixedAlgorithm<Algorithm>::type>
+            fixedMppt(fixedPlant, fixedPlant, telemetry);
+
+        floatPlant.setSensorNoise(scenarios[i].sensorNoise, scenarios[i].seed);
+        fixedPlant.setSensorNoise(scenarios[i].sensorNoise, scenarios[i].seed);
+        double f = runClosedLoop(floatPlant, floatMppt, scenarios[i].profile).trackingEfficiency;
+        double q = runClosedLoop(fixedPlant, fixedMppt, scenarios[i].profile).trackingEfficiency;
+        floatTracking += f;
+        fixedTracking += q;
+        if (fabs(f - q) > largest) largest = fabs(f - q);
+    }
+    printf("%-20s %9.3f%% %9.3f%% %15.3f%%\n", name, 100 * floatTracking / scenarios.size(),
+           100 * fixedTracking / scenarios.size(), 100 * largest);
+}
+
+/* Runs 'scenario' closed loop with the float controller and records every count it reads */
+template <class Algorithm>
+static void record(const MpptScenario &scenario, std::vector<unsigned short> &counts)
+{
+    PvPlant plant;
+    RecordingSensor sensor = { &plant, &counts };
+    NullTelemetry telemetry;
+    MpptController<RecordingSensor, PvPlant, NullTelemetry, Algorithm> mppt(sensor, plant, telemetry);
+
+    plant.setSensorNoise(scenario.sensorNoise, scenario.seed);
+    runClosedLoop(plant, mppt, scenario.profile);
+}
+
+/*
+* 4. Time per step of a controller over the recorded counts, repeated until TIMED_STEPS steps.
+*/
+template <class Controller>
+static double timeSteps(Controller &mppt, ReplaySensor &sensor, const std::vector<unsigned short> &counts)
+{
+    size_t perPass = counts.size() / MPPT_CHANNEL_COUNT;
+    long steps = 0;
+    unsigned long long begin = cycleCounter();
+    while (steps < TIMED_STEPS) {
+        sensor.next = &counts[0];
+        for (size_t n = 0; n < perPass; n++) mppt.step();
+        steps += perPass;
+    }
+    return (double)(cycleCounter() - begin) / steps;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned count = argc > 1 ? atoi(argv[1]) : 20;
+    double duration = argc > 2 ? atof(argv[2]) : 3.0;
+    bool pass = checkScaling();
+    pass = checkDutyCycle(1000000) && pass;
+
+    std::vector<MpptScenario> scenarios = makeScenarioSet(count, 464, duration);
+    printf("3. Closed loop, %u scenarios x %.1f s, mean tracking efficiency\n", count, duration);
+    printf("%-20s %10s %10s %16s\n", "Algorithm", "float", "fixed", "largest diff");
+    compareClosedLoop<PerturbAndObserve>("P&O", scenarios);
+    compareClosedLoop<VariableStepPerturbAndObserve>("Variable-step P&O", scenarios);
+    compareClosedLoop<IncrementalConductance>("IncCond", scenarios);
+    printf("\n");
+
+    /* the counts the float controller read during the closed-loop runs */
+    std::vector<unsigned short> counts;
+    for (size_t i = 0; i < scenarios.size(); i++) {
+        record<VariableStepPerturbAndObserve>(scenarios[i], counts);
+    }
+    ReplaySensor sensor;
+    SinkPwm pwm;
+    NullTelemetry telemetry;
+    MpptController<ReplaySensor, SinkPwm, NullTelemetry> floatMppt(sensor, pwm, telemetry);
+    MpptFixedController<ReplaySensor, SinkPwm, NullTelemetry> fixedMppt(sensor, pwm, telemetry);
+    double floatCycles = timeSteps(floatMppt, sensor, counts);
+    double fixedCycles = timeSteps(fixedMppt, sensor, counts);
+    MpptSnapshot floatSnapshot;
+    MpptFixedSnapshot fixedSnapshot;
+    MpptController<ReplaySensor, SinkPwm, MpptSnapshot> floatSnapshotMppt(sensor, pwm, floatSnapshot);
+    MpptFixedController<ReplaySensor, SinkPwm, MpptFixedSnapshot> fixedSnapshotMppt(sensor, pwm, fixedSnapshot);
+    double floatSnapshotCycles = timeSteps(floatSnapshotMppt, sensor, counts);
+    double fixedSnapshotCycles = timeSteps(fixedSnapshotMppt, sensor, counts);
+#if defined(__x86_64__) || defined(__i386__)
+    const char *unit = "TSC ticks";
+#else
+    const char *unit = "ns";
+#endif
+    printf("4. Time per controller step (P&O on recorded counts, %d steps each)\n", TIMED_STEPS);
+    printf("no telemetry: float: %.1f %s, fixed: %.1f %s\n", floatCycles, unit, fixedCycles, unit);
+    printf("snapshot:     float: %.1f %s, fixed: %.1f %s\n", floatSnapshotCycles, unit, fixedSnapshotCycles, unit);
+
+    // the snapshot hands back the Q16 readings of the last step unchanged
+    MpptFixedReadings latest;
+    const MpptFixedReadings &last = fixedSnapshotMppt.fixedReadings();
+    bool sampled = fixedSnapshot.sample(latest) && memcmp(&latest, &last, sizeof(latest)) == 0;
+    printf("%s\n", sampled ? "PASS: snapshot holds the last fixed-point readings"
+                           : "FAIL: snapshot does not hold the last fixed-point readings");
+    pass = sampled && pass;
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+/*************************** mppt_scenarios.cpp ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * Perturb and Observe Algorithm: Scenario Generator
+ *
+ * See mppt_scenarios.h for the scenario categories.
+ *
+ *****************************************************************************************/
+#include <stdio.h>
+#include "mppt_scenarios.h"
+
+/*
+* Small deterministic generator (xorshift32) so a scenario only depends on its index and seed.
+*/
+class ScenarioRandom
+{
+public:
+    ScenarioRandom(unsigned index, unsigned seed) : _state(seed * 2654435761u ^ (index + 1) * 40503u) {
+        if (_state == 0) _state = 1;
+        for (int i = 0; i < 4; i++) next();
+    }
+    unsigned next(void) {
+        _state ^= _state << 13;
+        _state ^= _state >> 17;
+        _state ^= _state << 5;
+        return _state;
+    }
+    /* uniform in [lo, hi) */
+    double uniform(double lo, double hi) { return lo + (hi - lo) * (next() / 4294967296.0); }
+
+private:
+    unsigned _state;
+};
+
+const char *scenarioCategoryName(MpptScenarioCategory category)
+{
+    switch (category) {
+        case SCENARIO_STEADY:  return "Steady";
+        case SCENARIO_CLOUD:   return "Cloud";
+        case SCENARIO_RAMP:    return "Ramp";
+        case SCENARIO_SHADING: return "Shading";
+        case SCENARIO_NOISE:   return "Noise";
+        default:               return "?";
+    }
+}
+
+/* Adds a cloud edge to 'profile': the irradiance falls to 'depth' of 'g' and comes back */
+static void addCloud(PvProfile &profile, ScenarioRandom &rnd, double g, double t, double duration)
+{
+    double start = rnd.uniform(0.2, 0.5) * duration;
+    double edge = rnd.uniform(0.02, 0.3);                // how quickly the cloud edge passes
+    if (edge > 0.05 * duration) edge = 0.05 * duration;
+    double length = rnd.uniform(0.15, 0.35) * duration;
+    double depth = rnd.uniform(0.2, 0.7);
+
+    profile.add(0, PvConditions(g, t));
+    profile.add(start, PvConditions(g, t));
+    profile.add(start + edge, PvConditions(g * depth, t));
+    profile.add(start + length, PvConditions(g * depth, t));
+    profile.add(start + length + edge, PvConditions(g, t));
+    profile.add(duration, PvConditions(g, t));
+}
+
+MpptScenario makeScenario(unsigned index, unsigned seed, double duration)
+{
+    ScenarioRandom rnd(index, seed);
+    MpptScenario s;
+    char name[64];
+    double g = rnd.uniform(200, 1000);
+    double t = rnd.uniform(5, 60);
+
+    s.category = (MpptScenarioCategory)(index % SCENARIO_CATEGORY_COUNT);
+    s.sensorNoise = 0;
+    s.seed = rnd.next();
+
+    switch (s.category) {
+        case SCENARIO_STEADY:
+            s.profile.add(0, PvConditions(g, t));
+            s.profile.add(duration, PvConditions(g, t));
+            snprintf(name, sizeof(name), "steady %.0fW %.0fC", g, t);
+            break;
+
+        case SCENARIO_CLOUD:
+            addCloud(s.profile, rnd, g, t, duration);
+            snprintf(name, sizeof(name), "cloud %.0fW %.0fC", g, t);
+            break;
+
+        case SCENARIO_RAMP: {
+            double g2 = rnd.uniform(200, 1000);
+            double t2 = t + rnd.uniform(-10, 10);
+            s.profile.add(0, PvConditions(g, t));
+            s.profile.add(duration, PvConditions(g2, t2));
+            snprintf(name, sizeof(name), "ramp %.0f-%.0fW", g, g2);
+            break;
+        }
+
+        case SCENARIO_SHADING: {
+            PvConditions shaded(g, t);
+            int first = rnd.next() % PV_SUBSTRINGS;
+            shaded.shade[first] = rnd.uniform(0.2, 0.7);
+            if (rnd.next() & 1) {
+                shaded.shade[(first + 1) % PV_SUBSTRINGS] = rnd.uniform(0.2, 0.7);
+            }
+            double when = rnd.uniform(0.2, 0.5) * duration;
+            s.profile.add(0, PvConditions(g, t));
+            s.profile.add(when, PvConditions(g, t));
+            s.profile.add(when + 0.05, shaded);
+            s.profile.add(duration, shaded);
+            snprintf(name, sizeof(name), "shading %.0fW %.2f/%.2f/%.2f", g, shaded.shade[0], shaded.shade[1], shaded.shade[2]);
+            break;
+        }
+
+        default:    // SCENARIO_NOISE
+            s.sensorNoise = rnd.uniform(0.002, 0.02);
+            if (rnd.next() & 1) {
+                addCloud(s.profile, rnd, g, t, duration);
+            } else {
+                s.profile.add(0, PvConditions(g, t));
+                s.profile.add(duration, PvConditions(g, t));
+            }
+            snprintf(name, sizeof(name), "noise %.0fmV %.0fW", s.sensorNoise * 1e3, g);
+            break;
+    }
+    s.name = name;
+    return s;
+}
+
+std::vector<MpptScenario> makeScenarioSet(unsigned count, unsigned seed, double duration)
+{
+    std::vector<MpptScenario> set;
+    set.reserve(count);
+    for (unsigned i = 0; i < count; i++) {
+        set.push_back(makeScenario(i, seed, duration));
+    }
+    return set;
+}
@@ -0,0 +1,51 @@
+/*************************** mppt_scenarios.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * Perturb and Observe Algorithm: Scenario Generator
+ *
+ * Purpose: Generates large, reproducible sets of irradiance/temperature profiles for the
+ * closed-loop simulator. Every scenario is derived from its index and a base seed, so a sweep
+ * can be re-run (or a single failing scenario re-created) without storing the profiles.
+ *
+ * Categories:
+ *      Steady   - constant irradiance and temperature
+ *      Cloud    - a cloud edge drops the irradiance for a while and it recovers
+ *      Ramp     - irradiance and temperature move linearly from one value to another
+ *      Shading  - one or two substrings are shaded part way through (multi-peak P-V curve)
+ *      Noise    - a Steady or Cloud profile with gaussian noise on the AnalogIn pins
+ *
+ *****************************************************************************************/
+#ifndef _MPPT_SCENARIOS_H_
+#define _MPPT_SCENARIOS_H_
+
+#include <string>
+#include <vector>
+#include "pv_plant.h"
+
+enum MpptScenarioCategory {
+    SCENARIO_STEADY = 0,
+    SCENARIO_CLOUD,
+    SCENARIO_RAMP,
+    SCENARIO_SHADING,
+    SCENARIO_NOISE,
+    SCENARIO_CATEGORY_COUNT
+};
+
+struct MpptScenario {
+    std::string          name;
+    MpptScenarioCategory category;
+    PvProfile            profile;
+    double               sensorNoise;   // standard deviation of the AnalogIn pin noise (V)
+    unsigned             seed;          // seed for the sensor noise
+};
+
+/* Name of a scenario category, for tables */
+const char *scenarioCategoryName(MpptScenarioCategory category);
+
+/* Builds scenario number 'index' of the set generated from 'seed' */
+MpptScenario makeScenario(unsigned index, unsigned seed, double duration);
+
+/* Builds scenarios 0 .. count-1, cycling through the categories */
+std::vector<MpptScenario> makeScenarioSet(unsigned count, unsigned seed, double duration);
+
+#endif // _MPPT_SCENARIOS_H_
@@ -0,0 +1,168 @@
+/*************************** mppt_sim.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * Perturb and Observe Algorithm: Closed-Loop Simulation
+ *
+ * Purpose: Closes the loop between an MpptController and a PvPlant. Every control period the
+ * controller reads the plant's AnalogIn channels and writes a duty cycle; the plant then runs
+ * with that duty cycle until the next control step. With a sampler (e.g. an MpptAcquisition on
+ * the plant) the plant stops 'oversampling' times per control period for the sampler to read
+ * its pins, the way the sampling interrupt does on the board. The result reports:
+ *
+ *      trackingEfficiency - energy taken from the array / energy available at the MPP
+ *      timeToMpp          - time until the array power first settles within mppBand of the MPP
+ *                           (-1 if it never does)
+ *      oscillationVoltage - peak-to-peak array voltage over the steady-state window
+ *      rippleLoss         - fraction of the MPP power lost over the steady-state window
+ *
+ *****************************************************************************************/
+#ifndef _MPPT_SIM_H_
+#define _MPPT_SIM_H_
+
+#include "pv_plant.h"
+#include "mppt_controller.h"
+
+/* Telemetry that throws the readings away */
+struct NullTelemetry {
+    template <class Readings>
+    void publish(const Readings &) {}   // MpptReadings, or MpptFixedReadings from MpptFixedController
+};
+
+/*
+* Fixed-step P&O on the reference voltage: the baseline VariableStepPerturbAndObserve is measured
+* against (the shipping PerturbAndObserve steps by the measured voltage change instead).
+*/
+#define FIXED_PO_STEP 0.5
+
+struct FixedStepPerturbAndObserve : public VariableStepPerturbAndObserve {
+    FixedStepPerturbAndObserve() : VariableStepPerturbAndObserve(FIXED_PO_STEP, FIXED_PO_STEP) {}
+};
+
+/*
+* The global scan as the simulator runs it: the simulated runs last a few seconds, so the scan
+* comes every SIM_SCAN_INTERVAL steps instead of every GLOBAL_SCAN_INTERVAL.
+*/
+#define SIM_SCAN_INTERVAL 100
+
+struct SimGlobalScan : public GlobalScan<VariableStepPerturbAndObserve> {
+    SimGlobalScan() : GlobalScan<VariableStepPerturbAndObserve>(config()) {}
+
+    static GlobalScanConfig config(void){
+        GlobalScanConfig c;
+        c.interval = SIM_SCAN_INTERVAL;
+        return c;
+    }
+};
+
+/* Sampler that reads nothing: the controller reads the plant directly */
+struct NullSampler {
+    void reset(void) {}
+    void sample(void) {}
+};
+
+/* The controller as the simulator runs it: the plant is both the sensor and the actuator */
+template <class Algorithm = PerturbAndObserve>
+using SimController = MpptController<PvPlant, PvPlant, NullTelemetry, Algorithm>;
+
+struct MpptSimConfig {
+    double controlPeriod;       // time between controller steps (s)
+    double plantStep;           // integration step of the plant model (s)
+    double mppBand;             // fraction of the MPP power that counts as "at the MPP"
+    int    settleSteps;         // control steps the power must stay in the band
+    double steadyStateWindow;   // length of the window at the end of the run (s)
+    int    oversampling;        // sampler readings per control period
+
+    MpptSimConfig() :
+        controlPeriod(0.01),
+        plantStep(5e-6),
+        mppBand(0.99),
+        settleSteps(5),
+        steadyStateWindow(0.5),
+        oversampling(1)
+    {}
+};
+
+struct MpptSimResult {
+    double energyCaptured;
+    double energyAvailable;
+    double trackingEfficiency;
+    double timeToMpp;
+    double oscillationVoltage;
+    double rippleLoss;
+    long   steps;
+};
+
+/*
+* Runs 'controller' against 'plant' for the duration of 'profile'. Any object with the
+* MpptController step() interface can be used, so the same loop benchmarks every algorithm.
+* 'sampler' (reset() and sample()) is reset with the plant and sampled config.oversampling times
+* per control period.
+*/
+template <class Controller, class Sampler>
+MpptSimResult runClosedLoop(PvPlant &plant, Controller &controller, Sampler &sampler, const PvProfile &profile,
+                            const MpptSimConfig &config = MpptSimConfig())
+{
+    MpptSimResult result;
+    double duration = profile.duration();
+    double steadyStart = duration - config.steadyStateWindow;
+    double vMin = 1e9, vMax = -1e9;
+    double steadyCaptured = 0, steadyAvailable = 0;
+    int inBand = 0;
+
+    plant.reset(profile);
+    sampler.reset();
+    result.timeToMpp = -1;
+    result.steps = 0;
+
+    while (plant.time() < duration) {
+        double t = plant.time();
+        double captured = plant.energyCaptured();
+        double available = plant.energyAvailable();
+
+        controller.step();
+        for (int k = 0; k < config.oversampling; k++) {
+            plant.run(config.controlPeriod / config.oversampling, config.plantStep);
+            sampler.sample();
+        }
+        result.steps++;
+
+        double elapsed = plant.time() - t;
+        double power = (plant.energyCaptured() - captured) / elapsed;
+        double mppPower = (plant.energyAvailable() - available) / elapsed;
+
+        if (power >= config.mppBand * mppPower) {
+            if (++inBand == config.settleSteps && result.timeToMpp < 0) {
+                result.timeToMpp = t - (config.settleSteps - 1) * config.controlPeriod;
+            }
+        } else {
+            inBand = 0;
+        }
+
+        if (t >= steadyStart) {
+            double v = plant.panelVoltage();
+            if (v < vMin) vMin = v;
+            if (v > vMax) vMax = v;
+            steadyCaptured += plant.energyCaptured() - captured;
+            steadyAvailable += plant.energyAvailable() - available;
+        }
+    }
+
+    result.energyCaptured = plant.energyCaptured();
+    result.energyAvailable = plant.energyAvailable();
+    result.trackingEfficiency = result.energyAvailable > 0 ? result.energyCaptured / result.energyAvailable : 0;
+    result.oscillationVoltage = vMax >= vMin ? vMax - vMin : 0;
+    result.rippleLoss = steadyAvailable > 0 ? 1 - steadyCaptured / steadyAvailable : 0;
+    return result;
+}
+
+template <class Controller>
+MpptSimResult runClosedLoop(PvPlant &plant, Controller &controller, const PvProfile &profile,
+                            const MpptSimConfig &config = MpptSimConfig())
+{
+    NullSampler none;
+    MpptSimConfig direct = config;
+    direct.oversampling = 1;
+    return runClosedLoop(plant, controller, none, profile, direct);
+}
+
+#endif // _MPPT_SIM_H_
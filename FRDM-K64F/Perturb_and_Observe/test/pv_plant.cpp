@@ -0,0 +1,361 @@
+/*************************** pv_plant.cpp ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * Perturb and Observe Algorithm: PV Array and Boost Converter Simulator
+ *
+ * See pv_plant.h for a description of the models.
+ *
+ *****************************************************************************************/
+#include <math.h>
+#include "pv_plant.h"
+
+#define BOLTZMANN            1.380649e-23
+#define ELECTRON_CHARGE      1.602176634e-19
+#define KELVIN               273.15
+#define BYPASS_RESISTANCE    0.01       // on resistance of a conducting bypass diode (ohm)
+#define MPP_SCAN_POINTS      600        // resolution of the global MPP search
+#define CONDITIONS_PERIOD    0.01       // the profile is sampled every 10 ms of simulated time
+
+/*********************************** PvArray ***********************************/
+
+PvArray::PvArray(const PvArrayParams &params) :
+    _p(params),
+    _lastCurrent(0)
+{
+    setConditions(PvConditions());
+}
+
+void PvArray::setConditions(const PvConditions &c)
+{
+    double dT = c.temperature - PV_STC_TEMPERATURE;
+    double vt = BOLTZMANN * (c.temperature + KELVIN) / ELECTRON_CHARGE;
+    double isc = _p.iscRef * (1 + _p.iscTempCoeff * dT);
+    double voc = _p.cellsPerSubstring * _p.vocCellRef * (1 + _p.vocTempCoeff * dT);
+
+    _a = _p.idealityFactor * _p.cellsPerSubstring * vt;
+    _i0 = isc / (exp(voc / _a) - 1);
+    for (int k = 0; k < PV_SUBSTRINGS; k++) {
+        double g = c.irradiance * c.shade[k];
+        _iph[k] = isc * (g > 0 ? g : 0) / PV_STC_IRRADIANCE;
+    }
+}
+
+/*
+* Voltage of substring k carrying 'current'. Once the substring cannot supply the current its
+* bypass diode conducts and clamps it at -bypassDrop. 'slope' returns dV/dI.
+*/
+double PvArray::substringVoltage(int k, double current, double *slope) const
+{
+    double bypass = -_p.bypassDrop - BYPASS_RESISTANCE * (current > 0 ? current : 0);
+    double headroom = _iph[k] - current + _i0;
+
+    if (headroom > 0) {
+        double v = _a * log(headroom / _i0) - current * _p.seriesResistance;
+        if (v > bypass) {
+            if (slope) *slope = -_a / headroom - _p.seriesResistance;
+            return v;
+        }
+    }
+    if (slope) *slope = -BYPASS_RESISTANCE;
+    return bypass;
+}
+
+double PvArray::voltageAt(double current) const
+{
+    double v = 0;
+    for (int k = 0; k < PV_SUBSTRINGS; k++) {
+        v += substringVoltage(k, current, NULL);
+    }
+    return v;
+}
+
+double PvArray::maxPhotoCurrent(void) const
+{
+    double iph = 0;
+    for (int k = 0; k < PV_SUBSTRINGS; k++) {
+        if (_iph[k] > iph) iph = _iph[k];
+    }
+    return iph;
+}
+
+/*
+* The array voltage falls monotonically with current, so the current at a given voltage is the
+* root of voltageAt(I) - V. Newton's method from the previous answer usually converges in two
+* or three iterations; bisection keeps it safe across the bypass diode kinks.
+*/
+double PvArray::currentAt(double voltage)
+{
+    double lo = -1.0;
+    double hi = maxPhotoCurrent() + 1.0;
+
+    for (int i = 0; i < 40 && voltageAt(lo) < voltage; i++) {
+        lo *= 2;                                            // above Voc: current flows into the array
+    }
+    double current = (_lastCurrent > lo && _lastCurrent < hi) ? _lastCurrent : 0.5 * (lo + hi);
+
+    for (int i = 0; i < 60; i++) {
+        double slope = 0;
+        double f = -voltage;
+        for (int k = 0; k < PV_SUBSTRINGS; k++) {
+            double s;
+            f += substringVoltage(k, current, &s);
+            slope += s;
+        }
+        if (f > 0) lo = current; else hi = current;
+        double next = current - f / slope;
+        if (!(next > lo && next < hi)) next = 0.5 * (lo + hi);
+        if (fabs(next - current) < 1e-9) {
+            current = next;
+            break;
+        }
+        current = next;
+    }
+    _lastCurrent = current;
+    return current;
+}
+
+/*
+* Scans the whole I-V curve for the highest power and refines the best point with a golden
+* section search. Partial shading creates one local maximum per distinct substring irradiance;
+* the scan makes sure the global one is found.
+*/
+PvOperatingPoint PvArray::maximumPowerPoint(void) const
+{
+    double iMax = maxPhotoCurrent();
+    double step = iMax / MPP_SCAN_POINTS;
+    double bestCurrent = 0;
+    double bestPower = 0;
+
+    for (int i = 1; i < MPP_SCAN_POINTS; i++) {
+        double current = i * step;
+        double power = current * voltageAt(current);
+        if (power > bestPower) {
+            bestPower = power;
+            bestCurrent = current;
+        }
+    }
+
+    const double ratio = 0.6180339887498949;
+    double a = bestCurrent - step;
+    double b = bestCurrent + step;
+    for (int i = 0; i < 40; i++) {
+        double c = b - ratio * (b - a);
+        double d = a + ratio * (b - a);
+        if (c * voltageAt(c) > d * voltageAt(d)) b = d; else a = c;
+    }
+
+    PvOperatingPoint mpp;
+    mpp.current = 0.5 * (a + b);
+    mpp.voltage = voltageAt(mpp.current);
+    mpp.power = mpp.current * mpp.voltage;
+    if (mpp.power < bestPower) {
+        mpp.current = bestCurrent;
+        mpp.voltage = voltageAt(bestCurrent);
+        mpp.power = bestPower;
+    }
+    return mpp;
+}
+
+/*********************************** BoostConverter ***********************************/
+
+BoostConverter::BoostConverter(const BoostParams &params) :
+    _p(params)
+{
+    reset(0);
+}
+
+void BoostConverter::reset(double inputVoltage)
+{
+    _vin = inputVoltage;
+    _il = 0;
+    _iout = 0;
+}
+
+/*
+* Averaged boost converter: over one switching period the inductor sees Vin for D of the time
+* and Vin - Vout for the rest, so L dIL/dt = Vin - IL*RL - (1 - D)(Vout + Vd). The diode stops
+* the inductor current from reversing (discontinuous conduction clamps it at zero).
+*/
+void BoostConverter::step(double panelCurrent, double dutyCycle, double dt)
+{
+    double offTime = 1 - dutyCycle;
+
+    _vin += dt * (panelCurrent - _il) / _p.inputCapacitance;
+    if (_vin < 0) _vin = 0;
+
+    double vout = _p.batteryVoltage + offTime * _il * _p.batteryResistance;
+    double vl = _vin - _il * _p.inductorResistance - offTime * (vout + _p.diodeDrop);
+    _il += dt * vl / _p.inductance;
+    if (_il < 0) _il = 0;
+
+    _iout = offTime * _il;
+}
+
+/*********************************** PvProfile ***********************************/
+
+void PvProfile::add(double time, const PvConditions &conditions)
+{
+    _times.push_back(time);
+    _points.push_back(conditions);
+}
+
+PvConditions PvProfile::at(double time) const
+{
+    if (_points.empty()) return PvConditions();
+    if (time <= _times.front()) return _points.front();
+    if (time >= _times.back()) return _points.back();
+
+    size_t i = 1;
+    while (_times[i] < time) i++;
+    double f = (time - _times[i - 1]) / (_times[i] - _times[i - 1]);
+    const PvConditions &a = _points[i - 1];
+    const PvConditions &b = _points[i];
+
+    PvConditions c(a.irradiance + f * (b.irradiance - a.irradiance),
+                   a.temperature + f * (b.temperature - a.temperature));
+    for (int k = 0; k < PV_SUBSTRINGS; k++) {
+        c.shade[k] = a.shade[k] + f * (b.shade[k] - a.shade[k]);
+    }
+    return c;
+}
+
+/*********************************** PvPlant ***********************************/
+
+PvPlant::PvPlant(const PvArrayParams &array, const BoostParams &boost, const MpptCalibration &calibration) :
+    _array(array),
+    _boost(boost),
+    _cal(calibration),
+    _ripple(false),
+    _conversionTime(0),
+    _seed(1)
+{
+    reset(PvProfile());
+}
+
+void PvPlant::reset(const PvProfile &profile)
+{
+    _profile = profile;
+    _time = 0;
+    _dutyCycle = 0;
+    _energyCaptured = 0;
+    _energyAvailable = 0;
+    updateConditions();
+    _boost.reset(_array.openCircuitVoltage());
+    _panelCurrent = _array.currentAt(_boost.inputVoltage());
+    _adcTime = _time;
+}
+
+void PvPlant::updateConditions(void)
+{
+    _conditions = _profile.at(_time);
+    _array.setConditions(_conditions);
+    _mpp = _array.maximumPowerPoint();
+}
+
+void PvPlant::run(double duration, double dt)
+{
+    long steps = (long)(duration / dt + 0.5);
+    double nextConditions = _time;
+
+    for (long i = 0; i < steps; i++) {
+        if (_time >= nextConditions) {
+            updateConditions();
+            nextConditions = _time + CONDITIONS_PERIOD;
+        }
+        _panelCurrent = _array.currentAt(_boost.inputVoltage());
+        _energyCaptured += _boost.inputVoltage() * _panelCurrent * dt;
+        _energyAvailable += _mpp.power * dt;
+        _boost.step(_panelCurrent, _dutyCycle, dt);
+        _time += dt;
+    }
+    _panelCurrent = _array.currentAt(_boost.inputVoltage());
+    _adcTime = _time;
+}
+
+/*
+* Inductor current and input capacitor voltage at 'time' within the PWM period, around their
+* averages. The switch turns on at the start of every period: the inductor current rises by
+* dI = Vin D T / L while it is on and falls back while it is off (a triangle), and the input
+* capacitor absorbs the difference between the steady panel current and the inductor current.
+*/
+void PvPlant::rippleAt(double time, double *voltage, double *current) const
+{
+    double period = PWM_PERIOD_us * 1e-6;
+    double d = _dutyCycle;
+    if (d <= 0 || d >= 1) return;
+
+    const BoostParams &p = _boost.params();
+    double phase = fmod(time, period) / period;
+    double ripple = *voltage * d * period / p.inductance;
+    double triangle, integral;     // triangle in -1/2 .. 1/2, and its integral over the period so far
+    if (phase < d) {
+        triangle = phase / d - 0.5;
+        integral = phase * phase / (2 * d) - phase / 2;
+    } else {
+        double off = phase - d;
+        triangle = 0.5 - off / (1 - d);
+        integral = off / 2 - off * off / (2 * (1 - d));
+    }
+    double meanIntegral = (1 - 2 * d) / 12;
+
+    *current = _boost.inductorCurrent() + ripple * triangle;
+    *voltage -= ripple * period / p.inputCapacitance * (integral - meanIntegral);
+}
+
+void PvPlant::setSensorNoise(const PvSensorNoise &noise, unsigned seed)
+{
+    _noise = noise;
+    _seed = seed ? seed : 1;
+}
+
+/*
+* Uniform random number in (0, 1) (xorshift32).
+*/
+double PvPlant::uniform(void)
+{
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return (_seed + 1.0) / 4294967297.0;
+}
+
+/*
+* Standard normal random number (Box-Muller).
+*/
+double PvPlant::gaussian(void)
+{
+    double u = uniform();
+    return sqrt(-2 * log(u)) * cos(6.283185307179586 * uniform());
+}
+
+/*
+* Inverts the scaling in MpptController::step() to produce the voltage at each AnalogIn pin,
+* adds the sensor noise, then quantises it to the ADC's resolution.
+*/
+unsigned short PvPlant::read_u16(MpptChannel channel)
+{
+    double inVoltage = _boost.inputVoltage(), inCurrent = _panelCurrent;
+    if (_ripple) {
+        rippleAt(_adcTime, &inVoltage, &inCurrent);
+    }
+    _adcTime += _conversionTime;
+
+    double pin = 0;
+    switch (channel) {
+        case HALL_IN:  pin = inCurrent * _cal.iInDiv + _cal.hallInNoCurrent; break;
+        case HALL_OUT: pin = _boost.outputCurrent() * _cal.iOutDiv + _cal.hallOutNoCurrent; break;
+        case V_OUT:    pin = _boost.outputVoltage() / _cal.vOutMult; break;
+        case V_IN:     pin = inVoltage / _cal.vInMult; break;
+        default:       break;
+    }
+    if (_noise.gaussian > 0) {
+        pin += _noise.gaussian * gaussian();
+    }
+    if (_noise.spikeProbability > 0 && uniform() < _noise.spikeProbability) {
+        pin += _noise.spikeAmplitude * (2 * uniform() - 1);
+    }
+    double fraction = pin / _cal.ainMult;
+    if (fraction < 0) fraction = 0;
+    if (fraction > 1) fraction = 1;
+    return (unsigned short)floor(fraction * ADC_FULL_SCALE + 0.5);
+}
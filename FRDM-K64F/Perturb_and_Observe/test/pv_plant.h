@@ -0,0 +1,273 @@
+/*************************** pv_plant.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * Perturb and Observe Algorithm: PV Array and Boost Converter Simulator
+ *
+ * Purpose: A host-side model of the hardware the MPPT controller drives, so the controller's
+ * duty cycle feeds back into its next reading the same way it does on the car:
+ *
+ *      PvArray         - single-diode model of the solar array (series resistance, shunt
+ *                        resistance neglected). The array is made of PV_SUBSTRINGS substrings,
+ *                        each with its own bypass diode, so a shaded substring produces the
+ *                        multi-peak P-V curves seen on the car.
+ *      BoostConverter  - averaged (state-space) model of the boost converter: input capacitor,
+ *                        inductor with winding resistance, diode drop, and a battery on the
+ *                        output that holds the output voltage.
+ *      PvPlant         - the two connected together and driven by an irradiance/temperature
+ *                        profile. PvPlant::read() returns what the FRDM-K64F's AnalogIn pins
+ *                        would see, using the calibration from mppt_config.h, optionally with
+ *                        sensor noise (PvSensorNoise: gaussian noise and switching spikes) and
+ *                        the converter's switching ripple at the instant of each conversion.
+ *
+ * Units are SI throughout (V, A, W, s, degrees C, W/m^2).
+ *
+ *****************************************************************************************/
+#ifndef _PV_PLANT_H_
+#define _PV_PLANT_H_
+
+#include <stdint.h>
+#include <vector>
+#include "mppt_config.h"
+
+#define PV_SUBSTRINGS        3          // bypass diodes in the array
+#define PV_STC_IRRADIANCE    1000.0     // standard test conditions (W/m^2)
+#define PV_STC_TEMPERATURE   25.0       // standard test conditions (C)
+
+/*
+* Electrical parameters of the array at standard test conditions.
+*/
+struct PvArrayParams {
+    int    cellsPerSubstring;
+    double iscRef;              // short circuit current (A)
+    double vocCellRef;          // open circuit voltage per cell (V)
+    double idealityFactor;
+    double seriesResistance;    // per substring (ohm)
+    double bypassDrop;          // forward voltage of a bypass diode (V)
+    double iscTempCoeff;        // relative change of Isc per C
+    double vocTempCoeff;        // relative change of Voc per C
+
+    PvArrayParams() :
+        cellsPerSubstring(36),
+        iscRef(4.0),
+        vocCellRef(0.62),
+        idealityFactor(1.3),
+        seriesResistance(0.15),
+        bypassDrop(0.5),
+        iscTempCoeff(0.0005),
+        vocTempCoeff(-0.0033)
+    {}
+};
+
+/*
+* Operating conditions of the array. Each substring sees irradiance * shade[k].
+*/
+struct PvConditions {
+    double irradiance;
+    double temperature;
+    double shade[PV_SUBSTRINGS];
+
+    PvConditions(double g = PV_STC_IRRADIANCE, double t = PV_STC_TEMPERATURE) :
+        irradiance(g),
+        temperature(t)
+    {
+        for (int k = 0; k < PV_SUBSTRINGS; k++) shade[k] = 1.0;
+    }
+};
+
+/*
+* The maximum power point of the array under some set of conditions.
+*/
+struct PvOperatingPoint {
+    double voltage;
+    double current;
+    double power;
+};
+
+class PvArray
+{
+public:
+    PvArray(const PvArrayParams &params = PvArrayParams());
+
+    /* Recomputes the diode parameters for new conditions */
+    void setConditions(const PvConditions &conditions);
+
+    /* Array voltage when it delivers 'current' (the closed-form direction of the model) */
+    double voltageAt(double current) const;
+
+    /* Array current at terminal voltage 'voltage' (solved numerically, warm-started) */
+    double currentAt(double voltage);
+
+    /* Global maximum power point under the current conditions (searches every peak) */
+    PvOperatingPoint maximumPowerPoint(void) const;
+
+    /* Open circuit voltage under the current conditions */
+    double openCircuitVoltage(void) const { return voltageAt(0); }
+
+    /* Largest photo current of any substring, the upper end of the array's I-V curve */
+    double maxPhotoCurrent(void) const;
+
+private:
+    double substringVoltage(int k, double current, double *slope) const;
+
+    PvArrayParams _p;
+    double _iph[PV_SUBSTRINGS];     // photo current per substring
+    double _i0;                     // diode saturation current
+    double _a;                      // n * Ns * Vt, the diode's thermal voltage for one substring
+    double _lastCurrent;            // warm start for currentAt()
+};
+
+/*
+* Averaged model parameters of the boost converter.
+*/
+struct BoostParams {
+    double inputCapacitance;    // F
+    double inductance;          // H
+    double inductorResistance;  // ohm
+    double diodeDrop;           // V
+    double batteryVoltage;      // V
+    double batteryResistance;   // ohm
+
+    BoostParams() :
+        inputCapacitance(100e-6),
+        inductance(220e-6),
+        inductorResistance(0.05),
+        diodeDrop(0.7),
+        batteryVoltage(120.0),
+        batteryResistance(0.1)
+    {}
+};
+
+class BoostConverter
+{
+public:
+    BoostConverter(const BoostParams &params = BoostParams());
+
+    /* Starts the converter idle with the input capacitor charged to 'inputVoltage' */
+    void reset(double inputVoltage);
+
+    /* Advances the converter by dt seconds with the given panel current and duty cycle */
+    void step(double panelCurrent, double dutyCycle, double dt);
+
+    double inputVoltage(void) const { return _vin; }
+    double inductorCurrent(void) const { return _il; }
+    double outputCurrent(void) const { return _iout; }
+    double outputVoltage(void) const { return _p.batteryVoltage + _iout * _p.batteryResistance; }
+    const BoostParams &params(void) const { return _p; }
+
+private:
+    BoostParams _p;
+    double _vin;
+    double _il;
+    double _iout;
+};
+
+/*
+* A piecewise-linear profile of operating conditions over time.
+*/
+class PvProfile
+{
+public:
+    void add(double time, const PvConditions &conditions);
+    PvConditions at(double time) const;
+    double duration(void) const { return _times.empty() ? 0 : _times.back(); }
+
+private:
+    std::vector<double>       _times;
+    std::vector<PvConditions> _points;
+};
+
+/*
+* Noise added to every AnalogIn pin voltage by PvPlant::read_u16(), independently for every reading.
+*/
+struct PvSensorNoise {
+    double gaussian;            // standard deviation of white gaussian noise (V)
+    double spikeProbability;    // chance that a reading is hit by a switching spike
+    double spikeAmplitude;      // spikes are uniformly distributed in +-spikeAmplitude (V)
+
+    explicit PvSensorNoise(double volts = 0, double probability = 0, double amplitude = 0) :
+        gaussian(volts),
+        spikeProbability(probability),
+        spikeAmplitude(amplitude)
+    {}
+};
+
+class PvPlant
+{
+public:
+    PvPlant(const PvArrayParams &array = PvArrayParams(),
+            const BoostParams &boost = BoostParams(),
+            const MpptCalibration &calibration = MpptCalibration());
+
+    /* Starts the plant at time 0 with the converter idle and the array at open circuit */
+    void reset(const PvProfile &profile);
+
+    /* Advances the plant by 'duration' seconds in steps of 'dt' seconds */
+    void run(double duration, double dt);
+
+    /* Sensor interface used by MpptController: the AnalogIn reading (0.0 - 1.0) of a channel */
+    float read(MpptChannel channel) { return read_u16(channel) * (1.0f / (float)ADC_FULL_SCALE); }
+
+    /* Sensor interface used by MpptFixedController: the raw 16 bit ADC reading of a channel */
+    unsigned short read_u16(MpptChannel channel);
+
+    /* Adds gaussian noise with a standard deviation of 'volts' to every AnalogIn pin voltage */
+    void setSensorNoise(double volts, unsigned seed = 1) { setSensorNoise(PvSensorNoise(volts), seed); }
+
+    /* Adds 'noise' to every AnalogIn pin voltage */
+    void setSensorNoise(const PvSensorNoise &noise, unsigned seed = 1);
+
+    /*
+    * Adds the switching ripple of the converter (PWM_PERIOD_us) to the input pins: HALL_IN then
+    * reads the inductor current (the Hall sensor sits between the input capacitor and the
+    * inductor) and V_IN the input capacitor voltage, as they are at the instant of the conversion.
+    */
+    void setSwitchingRipple(bool on) { _ripple = on; }
+
+    /* Time one AnalogIn conversion takes: each read_u16() samples the plant this much after the last */
+    void setConversionTime(double seconds) { _conversionTime = seconds; }
+
+    /* Actuator interface used by MpptController */
+    void write(float dutyCycle) { _dutyCycle = dutyCycle; }
+
+    /* Actuator interface used by MpptFixedController: the duty cycle in Q16 */
+    void write_q16(int32_t dutyCycle) { _dutyCycle = dutyCycle / 65536.0; }
+
+    double time(void) const { return _time; }
+    double panelVoltage(void) const { return _boost.inputVoltage(); }
+    double panelCurrent(void) const { return _panelCurrent; }
+    double panelPower(void) const { return _boost.inputVoltage() * _panelCurrent; }
+    double dutyCycle(void) const { return _dutyCycle; }
+    const BoostConverter &converter(void) const { return _boost; }
+
+    /* Maximum power point of the conditions at the current time */
+    const PvOperatingPoint &maximumPowerPoint(void) const { return _mpp; }
+
+    /* Energy the array delivered and the energy that was available at the MPP (J) */
+    double energyCaptured(void) const { return _energyCaptured; }
+    double energyAvailable(void) const { return _energyAvailable; }
+
+private:
+    void updateConditions(void);
+    void rippleAt(double time, double *voltage, double *current) const;
+    double uniform(void);
+    double gaussian(void);
+
+    PvArray         _array;
+    BoostConverter  _boost;
+    MpptCalibration _cal;
+    PvProfile       _profile;
+    PvConditions    _conditions;
+    PvOperatingPoint _mpp;
+    double          _time;
+    double          _dutyCycle;
+    double          _panelCurrent;
+    double          _energyCaptured;
+    double          _energyAvailable;
+    PvSensorNoise   _noise;
+    bool            _ripple;
+    double          _conversionTime;
+    double          _adcTime;           // instant of the next conversion
+    unsigned        _seed;              // each plant has its own generator so plants can run in parallel
+};
+
+#endif // _PV_PLANT_H_
@@ -0,0 +1,126 @@
+/*************************** sim_main.cpp ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * Perturb and Observe Algorithm: Closed-Loop Tracking Benchmark
+ *
+ * Purpose: Runs the shared MpptController against the PV array and boost converter models in
+ * pv_plant.h and reports how well it tracks the maximum power point. Unlike test_main.cpp the
+ * duty cycle chosen by the controller feeds back into the next reading.
+ *
+ * Instructions: To compile code: $g++ -std=c++11 -O2 -I../MPPT_LIBRARY -o runSim sim_main.cpp pv_plant.cpp
+ *               To run code: $./runSim
+ *               To run the controller at another rate (default 100 Hz): $./runSim rate [Hz]
+ *               To print a trace of one scenario: $./runSim trace [scenario number] [po|fixed|var|ic|scan] > trace.csv
+ *
+ *****************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mppt_sim.h"
+
+#define SCENARIO_COUNT 5
+
+/* Builds scenario 'n' into 'profile' and returns its name */
+const char *buildScenario(int n, PvProfile &profile)
+{
+    switch (n) {
+        case 0:     // full sun, nothing changes
+            profile.add(0, PvConditions(1000, 25));
+            profile.add(5, PvConditions(1000, 25));
+            return "Steady 1000 W/m2";
+        case 1:     // a cloud edge: the irradiance drops to 40% in 50 ms and comes back
+            profile.add(0, PvConditions(1000, 25));
+            profile.add(2, PvConditions(1000, 25));
+            profile.add(2.05, PvConditions(400, 25));
+            profile.add(4, PvConditions(400, 25));
+            profile.add(4.05, PvConditions(1000, 25));
+            profile.add(6, PvConditions(1000, 25));
+            return "Cloud transient";
+        case 2:     // slow ramp as the sun comes out, with the panel warming up
+            profile.add(0, PvConditions(200, 15));
+            profile.add(6, PvConditions(1000, 45));
+            return "Irradiance ramp";
+        case 3: {   // the car body shades one substring: a 70 W peak near 60 V, the 136 W peak at 36 V
+            PvConditions shaded(1000, 25);
+            shaded.shade[2] = 0.3;
+            profile.add(0, PvConditions(1000, 25));
+            profile.add(1, PvConditions(1000, 25));
+            profile.add(1.05, shaded);
+            profile.add(6, shaded);
+            return "Partial shading";
+        }
+        default:    // hot panel at low light
+            profile.add(0, PvConditions(300, 60));
+            profile.add(5, PvConditions(300, 60));
+            return "Hot, low light";
+    }
+}
+
+/* Prints time, array voltage, current, power, MPP power and duty cycle at every control step */
+template <class Algorithm>
+int runTrace(int scenario, const MpptSimConfig &config)
+{
+    PvProfile profile;
+    PvPlant plant;
+    NullTelemetry telemetry;
+    SimController<Algorithm> mppt(plant, plant, telemetry);
+
+    buildScenario(scenario, profile);
+    plant.reset(profile);
+    printf("time,voltage,current,power,mpp_power,duty_cycle\n");
+    while (plant.time() < profile.duration()) {
+        mppt.step();
+        plant.run(config.controlPeriod, config.plantStep);
+        printf("%.4f,%.3f,%.4f,%.3f,%.3f,%.4f\n", plant.time(), plant.panelVoltage(), plant.panelCurrent(),
+               plant.panelPower(), plant.maximumPowerPoint().power, plant.dutyCycle());
+    }
+    return 0;
+}
+
+/* Runs every scenario with one algorithm and prints a row per scenario */
+template <class Algorithm>
+void runTable(const char *algorithm, const MpptSimConfig &config)
+{
+    printf("%s\n", algorithm);
+    printf("%-20s %12s %12s %10s %12s %10s %10s\n", "Scenario", "Captured(J)", "Available(J)",
+           "Tracking", "TimeToMPP(s)", "Vpp(V)", "Ripple");
+    for (int n = 0; n < SCENARIO_COUNT; n++) {
+        PvProfile profile;
+        PvPlant plant;
+        NullTelemetry telemetry;
+        SimController<Algorithm> mppt(plant, plant, telemetry);
+
+        const char *name = buildScenario(n, profile);
+        MpptSimResult r = runClosedLoop(plant, mppt, profile, config);
+        printf("%-20s %12.1f %12.1f %9.2f%% %12.3f %10.3f %9.2f%%\n", name, r.energyCaptured, r.energyAvailable,
+               100 * r.trackingEfficiency, r.timeToMpp, r.oscillationVoltage, 100 * r.rippleLoss);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    MpptSimConfig config;
+
+    if (argc > 1 && strcmp(argv[1], "trace") == 0) {
+        int scenario = argc > 2 ? atoi(argv[2]) : 0;
+        const char *algorithm = argc > 3 ? argv[3] : "po";
+        if (strcmp(algorithm, "fixed") == 0) return runTrace<FixedStepPerturbAndObserve>(scenario, config);
+        if (strcmp(algorithm, "var") == 0) return runTrace<VariableStepPerturbAndObserve>(scenario, config);
+        if (strcmp(algorithm, "scan") == 0) return runTrace<SimGlobalScan>(scenario, config);
+        if (strcmp(algorithm, "ic") == 0) return runTrace<IncrementalConductance>(scenario, config);
+        return runTrace<PerturbAndObserve>(scenario, config);
+    }
+
+    if (argc > 2 && strcmp(argv[1], "rate") == 0) {
+        config.controlPeriod = 1.0 / atof(argv[2]);
+    }
+
+    printf("Control period: %.1f ms, plant step: %.1f us\n\n", config.controlPeriod * 1e3, config.plantStep * 1e6);
+    runTable<PerturbAndObserve>("Perturb and Observe", config);
+    runTable<FixedStepPerturbAndObserve>("Fixed-step P&O", config);
+    runTable<VariableStepPerturbAndObserve>("Variable-step P&O", config);
+    runTable<IncrementalConductance>("Incremental Conductance", config);
+    runTable<SimGlobalScan>("Global scan + variable-step P&O", config);
+    return 0;
+}
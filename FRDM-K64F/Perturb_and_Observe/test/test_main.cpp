@@ -17,8 +17,9 @@
  *			     Installing compiler for Linux and Mac:
  *					- For Mac, installing XCode command line tools (https://developer.apple.com/xcode/)
  *					- For Linux, run $sudo apt-get install g++
- *				 To compile code: $g++ -o runTest test_main.cpp
+ *				 To compile code: $g++ -O2 -I../MPPT_LIBRARY -o runTest test_main.cpp
  * 				 To run code: $./runTest
+ * 				 To benchmark the controller: $./runTest bench [number of steps]
  *
  * 				 These instructions are written for Windows users.
  * 				 Install an IDE (preferable Eclipse)
@@ -67,27 +68,53 @@
 #include <stdbool.h>
 #include <string.h>
 #include <time.h>
+#include "mppt_controller.h"
 
 /*
 * Debugging P&O Algorithm
 *
 * Inputs: input voltage and input current
 * Output: PWM
+*
+* The algorithm itself is the shared MpptController in MPPT_LIBRARY, the same code that runs on
+* the FRDM-K64F. This file only supplies host versions of the sensor, PWM and telemetry.
 */
 
-//Define Constants
-#define PWM_PERIOD_us        25
-#define V_IN_MULT            50.989761
-#define V_OUT_MULT           51.011235
-#define I_IN_DIV             0.09776
-#define I_OUT_DIV            0.09605
-#define HALL_IN_NO_CURRENT   2.524
-#define HALL_OUT_NO_CURRENT  2.514
+/* Replays readings from inputs.txt; only used by the benchmark, the file test calls update() */
+struct HostSensor {
+	float value[MPPT_CHANNEL_COUNT];
+	float read(MpptChannel channel){ return value[channel]; }
+};
+
+/* Remembers the last duty cycle instead of driving a MOSFET */
+struct HostPwm {
+	float dutyCycle;
+	HostPwm() : dutyCycle(0) {}
+	void write(float duty){ dutyCycle = duty; }
+};
+
+/* Prints the readings of each step to the terminal (or nowhere, for the benchmark) */
+struct HostTelemetry {
+	bool verbose;
+	HostTelemetry(bool v) : verbose(v) {}
+	void publish(const MpptReadings &r){
+		if(verbose){
+			printf("Input voltage is: %.6f, Input current is: %.6f, Input power is: %.6f \n", r.inVoltage, r.inCurrent, r.inPower);
+		}
+	}
+};
+
+typedef MpptController<HostSensor, HostPwm, HostTelemetry> HostController;
 
+int runBenchmark(long steps);
 
 //TODO: Read input values from a text file with random values to disable manual entry
 int main ( int argc, char **argv){
 
+	if(argc > 1 && strcmp(argv[1], "bench") == 0){
+		return runBenchmark(argc > 2 ? atol(argv[2]) : 10000000L);
+	}
+
 	FILE *ptr_file; // pointer to the input file
 	FILE *output_ptr_file; // pointer to the output file
 	char inputFileName[11] = "inputs.txt"; // name of input file (with null termination)
@@ -121,60 +148,40 @@ int main ( int argc, char **argv){
 	char buf[100]; // can read 100 characters per line
 	printf("\n\t\t\t----------Program starting----------\n\n");
 
+	HostSensor sensor;
+	HostPwm pwm;
+	HostTelemetry telemetry(true);
+	HostController mppt(sensor, pwm, telemetry);
+
 	// TODO: Angus spoke about a scale factor to multiple the readings by. Need to implement this.
 	// read inputVoltage and inputCurrent from textfile
-	double inVoltage, inCurrent, inPower;
-	double outVoltage = 120;
+	float inVoltage, inCurrent;
+	float outVoltage = 120;
 	fgets(buf, 100, ptr_file);
 	inVoltage = atof(strtok(buf, " -\n"));
 	inCurrent = atof(strtok(NULL, " -\n"));
-	inPower = inVoltage * inCurrent; // Power = Voltage * Current
 
 	// read starting dutyCycle, originalVoltage, and originalCurrent from textfile
-	double dutyCycle, originalVoltage, originalCurrent, originalPower, pulseWidth;
+	float dutyCycle, originalVoltage, originalCurrent;
 	fgets(buf, 100, ptr_file);
 	dutyCycle = atof(strtok(buf, " -\n"));
 	originalVoltage = atof(strtok(NULL, " -\n"));
 	originalCurrent = atof(strtok(NULL, " -\n"));
-	originalPower = originalCurrent * originalVoltage;
+	mppt.reset(originalVoltage, originalCurrent);
 
-	printf("Previous voltage is: %.6f, Previous current is: %.6f, Previous power is: %.6f \n\n", originalVoltage, originalCurrent, originalPower);
+	printf("Previous voltage is: %.6f, Previous current is: %.6f, Previous power is: %.6f \n\n", originalVoltage, originalCurrent, originalVoltage * originalCurrent);
 
-	while (fgets(buf,1000, ptr_file) != NULL){
+	while (fgets(buf, 100, ptr_file) != NULL){
 		printf("\t\t\t----------Start of reading #%d----------\n\n", reading); // make space in terminal
 		if(strlen(buf) != 1){
 			inVoltage = atof(strtok(buf, " -\n"));
 			inCurrent = atof(strtok(NULL, " -\n"));
-			inPower = inVoltage * inCurrent;
 		}
-		printf("Input voltage is: %.6f, Input current is: %.6f, Input power is: %.6f \n", inVoltage, inCurrent, inPower);
-		double deltaVoltage = inVoltage - originalVoltage; // also known as Perturbation
-		double deltaPower = inPower - originalPower;
-		printf("Delta Voltage is: %.2f, Delta Power is: %.2f \n", deltaVoltage, deltaPower);
-
-		if(deltaPower == 0){
-			// continue code and skip everything else
-		} else if(deltaPower > 0){
-			if(deltaVoltage > 0){
-				inVoltage += deltaVoltage; // increase PWM
-			} else {
-				inVoltage -= deltaVoltage; // decrease PWM
-			}
-		} else{ // deltaPower < 0
-			if(deltaVoltage > 0){
-				inVoltage -= deltaVoltage; // decrease PWM
-			} else {
-				inVoltage += deltaVoltage; // increase PWM
-			}
-		}
-		originalVoltage = inVoltage; // replace old voltage with current voltage
-		originalCurrent = inCurrent;
-		originalPower = inPower; // replace old power with current power
-		printf("Original voltage: %lf, Original current: %lf, Original Power: %lf\n", originalVoltage, originalCurrent, originalPower);
-		dutyCycle = (outVoltage - inVoltage) / (outVoltage);
-        pulseWidth = dutyCycle * PWM_PERIOD_us; // duty cycle = pulsewidth/period -> pulsewidth = duty cycle * period
-		// TODO: Power Mosfet with new dutyCycle
-		printf("Duty Cycle set to: %lf Pulse Width set to: %lf\n\n", dutyCycle, pulseWidth);
+		mppt.update(inVoltage, inCurrent, outVoltage, 0);
+		dutyCycle = pwm.dutyCycle;
+		printf("Reference voltage: %f\n", mppt.referenceVoltage());
+        float pulseWidth = dutyCycle * PWM_PERIOD_us; // duty cycle = pulsewidth/period -> pulsewidth = duty cycle * period
+		printf("Duty Cycle set to: %f Pulse Width set to: %f\n\n", dutyCycle, pulseWidth);
 
 		fprintf(output_ptr_file, "Reading #%d \t %lf \n", reading, dutyCycle);
 
@@ -187,3 +194,31 @@ int main ( int argc, char **argv){
 
 }
 
+/*
+* Runs the complete controller step (AnalogIn scaling, P&O, duty cycle) 'steps' times on a
+* synthetic sensor and reports how many steps per second the host can execute.
+*/
+int runBenchmark(long steps){
+	HostSensor sensor;
+	HostPwm pwm;
+	HostTelemetry telemetry(false);
+	HostController mppt(sensor, pwm, telemetry);
+	float checksum = 0;
+
+	sensor.value[HALL_OUT] = 0.80;
+	sensor.value[V_OUT] = 0.71;
+	clock_t begin = clock();
+	for(long i = 0; i < steps; i++){
+		sensor.value[HALL_IN] = 0.85 + 0.01 * (i & 7);  // wiggle the operating point so every
+		sensor.value[V_IN] = 0.35 + 0.002 * (i & 15);   // branch of the algorithm is exercised
+		mppt.step();
+		checksum += pwm.dutyCycle;
+	}
+	double seconds = (double)(clock() - begin) / CLOCKS_PER_SEC;
+
+	printf("Controller steps: %ld\n", steps);
+	printf("Elapsed time: %.3f s\n", seconds);
+	printf("Steps per second: %.0f\n", seconds > 0 ? steps / seconds : 0);
+	printf("Checksum: %f\n", checksum); // keeps the compiler from optimising the loop away
+	return 0;
+}
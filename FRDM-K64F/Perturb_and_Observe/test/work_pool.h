@@ -0,0 +1,111 @@
+/*************************** work_pool.h ***************************************************
+ * Maximum Power Point Tracker Project for EE 464R
+ *
+ * Perturb and Observe Algorithm: Work-Stealing Thread Pool
+ *
+ * Purpose: Spreads a batch of independent tasks (numbered 0 .. count-1) across every core of
+ * the host. Each worker starts with its own contiguous share of the task numbers and works
+ * through it from the back; a worker that runs out steals from the front of another worker's
+ * queue. Scenarios take very different amounts of time (a noisy cloud transient is much more
+ * work than a steady profile), so stealing keeps every core busy until the batch is done.
+ *
+ * Tasks must not share mutable state; each one writes only its own result slot.
+ *
+ * Requires C++11 (std::thread): $g++ -std=c++11 -pthread ...
+ *
+ *****************************************************************************************/
+#ifndef _WORK_POOL_H_
+#define _WORK_POOL_H_
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool
+{
+public:
+    /* 'threads' = 0 uses one worker per hardware thread */
+    explicit WorkStealingPool(unsigned threads = 0) :
+        _threads(threads ? threads : std::thread::hardware_concurrency()),
+        _steals(0)
+    {
+        if (_threads == 0) _threads = 1;
+    }
+
+    unsigned threads(void) const { return _threads; }
+
+    /* Number of tasks that were taken from another worker's queue during the last run() */
+    unsigned long steals(void) const { return _steals; }
+
+    /* Calls task(i) once for every i in 0 .. count-1 and returns when all calls have finished */
+    template <class Task>
+    void run(size_t count, Task task)
+    {
+        std::vector<Queue> queues(_threads);
+        for (unsigned w = 0; w < _threads; w++) {
+            size_t first = count * w / _threads;
+            size_t last = count * (w + 1) / _threads;
+            for (size_t i = first; i < last; i++) queues[w].tasks.push_back(i);
+        }
+
+        std::vector<unsigned long> stolen(_threads, 0);
+        std::vector<std::thread> workers;
+        for (unsigned w = 1; w < _threads; w++) {
+            workers.push_back(std::thread(&WorkStealingPool::work<Task>, this, w, std::ref(queues), std::ref(task), &stolen[w]));
+        }
+        work<Task>(0, queues, task, &stolen[0]);   // the calling thread is worker 0
+        for (size_t w = 0; w < workers.size(); w++) workers[w].join();
+
+        _steals = 0;
+        for (unsigned w = 0; w < _threads; w++) _steals += stolen[w];
+    }
+
+private:
+    struct Queue {
+        std::mutex         lock;
+        std::deque<size_t> tasks;
+    };
+
+    template <class Task>
+    void work(unsigned self, std::vector<Queue> &queues, Task &task, unsigned long *stolen)
+    {
+        size_t i;
+        for (;;) {
+            if (pop(queues[self], &i)) {
+                task(i);
+                continue;
+            }
+            bool found = false;
+            for (unsigned n = 1; n < _threads && !found; n++) {
+                found = steal(queues[(self + n) % _threads], &i);
+            }
+            if (!found) return;     // nothing is ever added to the queues, so empty means done
+            (*stolen)++;
+            task(i);
+        }
+    }
+
+    static bool pop(Queue &q, size_t *i)
+    {
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.tasks.empty()) return false;
+        *i = q.tasks.back();
+        q.tasks.pop_back();
+        return true;
+    }
+
+    static bool steal(Queue &q, size_t *i)
+    {
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.tasks.empty()) return false;
+        *i = q.tasks.front();
+        q.tasks.pop_front();
+        return true;
+    }
+
+    unsigned      _threads;
+    unsigned long _steals;
+};
+
+#endif // _WORK_POOL_H_